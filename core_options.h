@@ -61,6 +61,7 @@ namespace DBP_Option
 		savestate,
 		#endif
 		strict_mode,
+		savechunks,
 		conf,
 		menu_time,
 		menu_transparency,
@@ -110,6 +111,10 @@ namespace DBP_Option
 		bootos_ramdisk,
 		bootos_dfreespace,
 		bootos_forcenormal,
+		diskcache,
+		iotiming,
+		idedma,
+		contentsnapshot,
 		// Audio
 		#ifndef DBP_STANDALONE
 		audiorate,
@@ -129,6 +134,10 @@ namespace DBP_Option
 		sblaster_adlib_emu,
 		gus,
 		tandysound,
+		#ifndef DBP_STANDALONE
+		audiolatency,
+		#endif
+		mt32renderahead,
 		swapstereo,
 		_OPTIONS_NULL_TERMINATOR, _OPTIONS_TOTAL,
 	};
@@ -293,6 +302,18 @@ static retro_core_option_v2_definition option_defs[DBP_Option::_OPTIONS_TOTAL] =
 		},
 		"false"
 	},
+	{
+		"dosbox_pure_savechunks",
+		"Advanced > Chunked Save Files", NULL,
+		"Store large files in the save file as chunks so only changed parts get written again when saving." "\n"
+		"Save files written with this enabled cannot be read correctly by older versions of the core. Turning it off stores all files as a whole again on the next save.", NULL,
+		DBP_OptionCat::General,
+		{
+			{ "false", "Off" },
+			{ "true", "On" },
+		},
+		"false"
+	},
 	{
 		"dosbox_pure_conf",
 		"Advanced > Loading of dosbox.conf", NULL,
@@ -965,7 +986,46 @@ static retro_core_option_v2_definition option_defs[DBP_Option::_OPTIONS_TOTAL] =
 		"dosbox_pure_bootos_forcenormal",
 		"Advanced > Force Normal Core in OS", NULL,
 		"The normal core can be more stable when running an installed operating system." "\n"
-		"This can be toggled on and off to navigate around crashes." "\n\n", NULL, //end of System > Advanced section
+		"This can be toggled on and off to navigate around crashes.", NULL,
+		DBP_OptionCat::System,
+		{ { "false", "Off (default)" }, { "true", "On" } },
+		"false"
+	},
+	{
+		"dosbox_pure_diskcache",
+		"Advanced > Disk Image Cache", NULL,
+		"Amount of memory used to cache data read from each mounted floppy or hard disk image, with data read ahead when accessed sequentially." "\n"
+		"Also sets the sector cache of hard disks that get built from the files of a drive when booting an operating system." "\n"
+		"Takes effect when a disk image gets mounted.", NULL,
+		DBP_OptionCat::System,
+		{ { "0", "Off" }, { "4", "4 MB" }, { "16", "16 MB (default)" }, { "32", "32 MB" }, { "64", "64 MB" } },
+		"16"
+	},
+	{
+		"dosbox_pure_iotiming",
+		"Advanced > Disk Timing", NULL,
+		"How long emulated floppy, hard disk and CD-ROM transfers take." "\n"
+		"Turbo completes file, BIOS disk and IDE transfers instantly. Accurate waits for the seek and transfer time of a floppy drive, an IDE hard disk or a 2x CD-ROM drive which some games and installers expect." "\n"
+		"The detailed performance statistics list the operations and bytes transferred per drive.", NULL,
+		DBP_OptionCat::System,
+		{ { "default", "Default" }, { "turbo", "Turbo" }, { "accurate", "Accurate" } },
+		"default"
+	},
+	{
+		"dosbox_pure_idedma",
+		"Advanced > IDE Bus Master DMA", NULL,
+		"Add a PCI bus master IDE controller on machines with a PCI bus so CD-ROM drivers can transfer data with DMA instead of PIO." "\n"
+		"DMA is only available for the IDE CD-ROM drive. Takes effect when the IDE controller gets set up (restart required).", NULL,
+		DBP_OptionCat::System,
+		{ { "false", "Off (default)" }, { "true", "On" } },
+		"false"
+	},
+	{
+		"dosbox_pure_contentsnapshot",
+		"Advanced > Content Snapshot", NULL,
+		"When starting content from a ZIP file, its files get extracted once into a snapshot file in the system directory." "\n"
+		"Later starts map the snapshot into memory instead of reading the files from the ZIP file." "\n"
+		"Creating the snapshot needs enough memory to hold all files of the content. Takes effect when content gets started." "\n\n", NULL, //end of System > Advanced section
 		DBP_OptionCat::System,
 		{ { "false", "Off (default)" }, { "true", "On" } },
 		"false"
@@ -1164,6 +1224,26 @@ static retro_core_option_v2_definition option_defs[DBP_Option::_OPTIONS_TOTAL] =
 		{ { "auto", "Off (default)" }, { "on", "On" } },
 		"auto"
 	},
+	#ifndef DBP_STANDALONE
+	{
+		"dosbox_pure_audiolatency",
+		"Advanced > Audio Buffering", NULL,
+		"Adaptive buffering watches for audio dropouts and overflows and lowers the internal audio buffer to the smallest size that still plays back without dropouts." "\n"
+		"The current latency is shown in the detailed performance statistics.", NULL,
+		DBP_OptionCat::Audio,
+		{ { "fixed", "Fixed (default)" }, { "adaptive", "Adaptive" } },
+		"fixed"
+	},
+	#endif
+	{
+		"dosbox_pure_mt32renderahead",
+		"Advanced > MT-32 Render Ahead", NULL,
+		"Render the MT-32 emulation on a background thread ahead of time by the set amount." "\n"
+		"This takes load off the emulation thread but delays MT-32 music by the same amount. Takes effect when the MT-32 gets loaded.", NULL,
+		DBP_OptionCat::Audio,
+		{ { "0", "Off (default)" }, { "10", "10 ms" }, { "20", "20 ms" }, { "40", "40 ms" }, { "60", "60 ms" }, { "100", "100 ms" } },
+		"0"
+	},
 	{
 		"dosbox_pure_swapstereo",
 		"Advanced > Swap Stereo Channels", NULL,
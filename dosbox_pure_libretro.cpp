@@ -60,7 +60,7 @@ static retro_system_av_info av_info;
 static enum DBP_State : Bit8u { DBPSTATE_BOOT, DBPSTATE_EXITED, DBPSTATE_SHUTDOWN, DBPSTATE_REBOOT, DBPSTATE_FIRST_FRAME, DBPSTATE_RUNNING } dbp_state;
 static enum DBP_SerializeMode : Bit8u { DBPSERIALIZE_STATES, DBPSERIALIZE_REWIND, DBPSERIALIZE_DISABLED } dbp_serializemode;
 static bool dbp_game_running, dbp_pause_events, dbp_paused_midframe, dbp_frame_pending, dbp_biosreboot, dbp_biospoweroff, dbp_system_cached, dbp_system_scannable, dbp_refresh_memmaps;
-static bool dbp_optionsupdatecallback, dbp_reboot_set64mem, dbp_use_network, dbp_had_game_running, dbp_strict_mode, dbp_legacy_save, dbp_wasloaded, dbp_skip_c_mount;
+static bool dbp_optionsupdatecallback, dbp_reboot_set64mem, dbp_use_network, dbp_had_game_running, dbp_strict_mode, dbp_legacy_save, dbp_wasloaded, dbp_skip_c_mount, dbp_content_snapshot, dbp_save_chunks;
 static signed char dbp_menu_time, dbp_conf_loading, dbp_reboot_machine;
 static Bit8u dbp_alphablend_base;
 static float dbp_auto_target, dbp_last_fastforward;
@@ -83,6 +83,9 @@ static struct DBP_Audio { int16_t* audio; Bit32u length; } dbp_audio[2];
 static Bit8u dbp_audio_active;
 #endif
 static double dbp_audio_remain;
+#ifndef DBP_STANDALONE
+static struct DBP_AudioBuffering { bool adaptive; Bit8u stable_secs, stable_needed; Bit32u frames, buffered, underruns, frontend_underruns, prebuffer, blocksize; float latency_ms; } dbp_audiobuf;
+#endif
 static struct retro_hw_render_callback dbp_hw_render;
 static void (*dbp_opengl_draw)(const DBP_Buffer& buf);
 
@@ -314,6 +317,10 @@ void DBP_SetMountSwappingRequested();
 Bit32u DBP_MIXER_GetFrequency();
 Bit32u DBP_MIXER_DoneSamplesCount();
 void DBP_MIXER_ScrapAudio();
+void DBP_MIXER_SetBuffering(Bit32u prebuffer_samples, Bit32u blocksize);
+void DBP_MIXER_GetBufferStats(Bit32u& underruns, Bit32u& overruns, bool reset);
+void DBP_MIXER_GetPerfStats(char* buf, size_t bufsize);
+void DBP_LocalFile_GetPerfStats(char* buf, size_t bufsize);
 void MIXER_CallBack(void *userdata, uint8_t *stream, int len);
 bool MSCDEX_HasDrive(char driveLetter);
 int MSCDEX_AddDrive(char driveLetter, const char* physicalPath, Bit8u& subUnit);
@@ -942,6 +949,86 @@ static bool DBP_IsDiskCDISO(imageDisk* id)
 	return false;
 }
 
+// Snapshots of ZIP content are shared by all content in the system directory, the file name is made from the path of the ZIP file
+// and the path, size and modification time of it and all files it depends on (parent ZIP files) as reported by MountWithDependencies
+static std::string DBP_GetContentSnapshotPath(const std::vector<std::string>& dependencies)
+{
+	std::string res;
+	const char *system_dir = NULL;
+	if (dependencies.empty() || !environ_cb(RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY, &system_dir) || !system_dir || !*system_dir) return res;
+	Bit32u key_crc = DriveCalculateCRC32((const Bit8u*)&dbp_legacy_save, 1);
+	for (const std::string& dep : dependencies)
+	{
+		FILE* f = fopen_wrap(dep.c_str(), "rb");
+		if (!f) return res;
+		struct stat dep_stat;
+		const bool have_stat = !fstat(fileno(f), &dep_stat);
+		fclose(f);
+		if (!have_stat) return res;
+		const Bit64u size = (Bit64u)dep_stat.st_size, mtime = (Bit64u)dep_stat.st_mtime;
+		Bit8u arr[] = { (Bit8u)(size>>56), (Bit8u)(size>>48), (Bit8u)(size>>40), (Bit8u)(size>>32), (Bit8u)(size>>24), (Bit8u)(size>>16), (Bit8u)(size>>8), (Bit8u)(size),
+			(Bit8u)(mtime>>56), (Bit8u)(mtime>>48), (Bit8u)(mtime>>40), (Bit8u)(mtime>>32), (Bit8u)(mtime>>24), (Bit8u)(mtime>>16), (Bit8u)(mtime>>8), (Bit8u)(mtime) };
+		key_crc = DriveCalculateCRC32((const Bit8u*)dep.c_str(), dep.length() + 1, key_crc);
+		key_crc = DriveCalculateCRC32(arr, sizeof(arr), key_crc);
+	}
+	char name[32];
+	sprintf(name, "%08X-%08X.snap", DriveCalculateCRC32((const Bit8u*)dependencies[0].c_str(), dependencies[0].length()), key_crc);
+	((res = DBP_GetSaveFile(SFT_SYSTEMDIR)).append("DOSBoxPure-Snapshots") += CROSS_FILESPLIT).append(name);
+	return res;
+}
+
+static memoryDrive* DBP_MountContentSnapshot(const std::string& snapshot_path, DOS_Drive* create_from = NULL)
+{
+	if (create_from)
+	{
+		// Memory drives have no long file names, content that uses them keeps being mounted from the ZIP file
+		struct Local { DOS_Drive* drv; bool has_lfn; static void CheckLFN(const char* path, bool, Bit32u, Bit16u, Bit16u, Bit8u, Bitu data)
+		{
+			Local& l = *(Local*)data;
+			char longname[256];
+			if (!l.has_lfn && l.drv->GetLongFileName(path, longname)) l.has_lfn = true;
+		}} l = { create_from, false };
+		DriveFileIterator(create_from, Local::CheckLFN, (Bitu)&l);
+		if (l.has_lfn) return NULL;
+
+		// Extract all files into memory once and write them out, written to a temporary file first so an incomplete snapshot never gets used
+		std::string tmp_path(snapshot_path);
+		tmp_path.append(".tmp");
+		#ifdef WIN32
+		mkdir(tmp_path.substr(0, tmp_path.rfind(CROSS_FILESPLIT)).c_str());
+		#else
+		mkdir(tmp_path.substr(0, tmp_path.rfind(CROSS_FILESPLIT)).c_str(), 0700);
+		#endif
+		memoryDrive* clone = new memoryDrive();
+		bool written = (clone->CloneDrive(create_from) && clone->WriteSnapshot(tmp_path.c_str()));
+		delete clone;
+		if (!written) return NULL;
+		#ifdef WIN32
+		remove(snapshot_path.c_str()); // rename doesn't replace on Windows
+		#endif
+		if (rename(tmp_path.c_str(), snapshot_path.c_str())) { remove(tmp_path.c_str()); return NULL; }
+
+		// Remove outdated snapshots of the same content (same path but different files)
+		const size_t name_ofs = snapshot_path.rfind(CROSS_FILESPLIT) + 1;
+		std::string dir(snapshot_path, 0, name_ofs), old_path;
+		char entry_name[CROSS_LEN]; bool is_directory;
+		if (dir_information* dirp = open_directory(dir.c_str()))
+		{
+			for (bool more = read_directory_first(dirp, entry_name, is_directory); more; more = read_directory_next(dirp, entry_name, is_directory))
+			{
+				size_t entry_len = strlen(entry_name);
+				if (is_directory || entry_len < 5 || strncmp(entry_name, snapshot_path.c_str() + name_ofs, 9) || strcmp(entry_name + entry_len - 5, ".snap") || !strcmp(entry_name, snapshot_path.c_str() + name_ofs)) continue;
+				remove((old_path = dir).append(entry_name).c_str());
+			}
+			close_directory(dirp);
+		}
+	}
+	memoryDrive* mem = new memoryDrive();
+	if (mem->ReadSnapshot(snapshot_path.c_str())) return mem;
+	delete mem;
+	return NULL;
+}
+
 static DOS_Drive* DBP_Mount(unsigned image_index = 0, bool unmount_existing = true, char remount_letter = 0, const char* boot = NULL, bool no_register_just_get_drive = false)
 {
 	DBP_Image* dbpimage = (!boot ? &dbp_images[image_index] : NULL);
@@ -976,8 +1063,23 @@ static DOS_Drive* DBP_Mount(unsigned image_index = 0, bool unmount_existing = tr
 		if (!letter) letter = (boot ? 'C' : 'D');
 		if (!unmount_existing && Drives[letter-'A']) return NULL;
 		std::string* ziperr = NULL;
+		std::string snapshot_path;
 		if ((ext[3]|0x20) != 'c')
-			drive = zipDrive::MountWithDependencies(path, ziperr, dbp_strict_mode, dbp_legacy_save);
+		{
+			// A ZIP file started as content can be mounted from its snapshot instead (identified by the files it was mounted from)
+			std::vector<std::string> dependencies;
+			const bool use_snapshot = (dbp_content_snapshot && boot && letter == 'C' && !strcasecmp(ext, "ZIP") && path[0] != '$');
+			drive = zipDrive::MountWithDependencies(path, ziperr, dbp_strict_mode, dbp_legacy_save, NULL, (use_snapshot ? &dependencies : NULL));
+			if (drive && use_snapshot && !(snapshot_path = DBP_GetContentSnapshotPath(dependencies)).empty())
+			{
+				if (memoryDrive* mem = DBP_MountContentSnapshot(snapshot_path))
+				{
+					delete drive;
+					drive = mem;
+					snapshot_path.clear(); // no need to create it
+				}
+			}
+		}
 		else
 		{
 			// When loading a DOSC file, load the corresponding DOSZ file, but strip out a [VARIANT] specifier at the end.
@@ -997,6 +1099,11 @@ static DOS_Drive* DBP_Mount(unsigned image_index = 0, bool unmount_existing = tr
 			error_type = "ZIP";
 			goto TRY_DIRECTORY;
 		}
+		if (!snapshot_path.empty())
+		{
+			// The snapshot doesn't exist yet, create it from the ZIP file and use it right away
+			if (memoryDrive* mem = DBP_MountContentSnapshot(snapshot_path, drive)) { delete drive; drive = mem; }
+		}
 		DBP_SetDriveLabelFromContentPath(drive, path, letter, path_file, ext);
 		if ((boot && letter == 'C') || no_register_just_get_drive) return drive;
 	}
@@ -1328,6 +1435,11 @@ Bit32u DBP_GetTicks()
 	return (Bit32u)((time_cb() - dbp_boot_time) / 1000);
 }
 
+Bit64u DBP_GetTicksUs()
+{
+	return (Bit64u)(time_cb() - dbp_boot_time);
+}
+
 void DBP_MidiDelay(Bit32u ms)
 {
 	if (dbp_throttle.mode == RETRO_THROTTLE_FAST_FORWARD) return;
@@ -2315,6 +2427,7 @@ static bool check_variables()
 	dbp_strict_mode = (DBP_Option::Get(DBP_Option::strict_mode)[0] == 't');
 	if (old_strict_mode != dbp_strict_mode && dbp_state != DBPSTATE_BOOT && !dbp_game_running)
 		dbp_state = DBPSTATE_REBOOT;
+	dbp_save_chunks = (DBP_Option::Get(DBP_Option::savechunks)[0] == 't');
 
 	Section &sec_dosbox   = *control->GetSection("dosbox"),   &sec_dos = *control->GetSection("dos"), &sec_mixer    = *control->GetSection("mixer"), &sec_midi = *control->GetSection("midi"), 
 	        &sec_speaker  = *control->GetSection("speaker"),  &sec_cpu = *control->GetSection("cpu"), &sec_render   = *control->GetSection("render"),
@@ -2346,6 +2459,14 @@ static bool check_variables()
 	DBP_Option::Apply(sec_dos, "xms", (mem_use_extended ? "true" : "false"), true);
 	DBP_Option::Apply(sec_dos, "ems", (mem_use_extended ? "true" : "false"), true);
 	DBP_Option::Apply(sec_dosbox, "memsize", (mem_use_extended ? mem : "16"), false, true, mem_changed);
+	extern Bit32u dbp_diskcache_mb;
+	dbp_diskcache_mb = (Bit32u)atoi(DBP_Option::Get(DBP_Option::diskcache));
+
+	const char* iotiming = DBP_Option::Get(DBP_Option::iotiming);
+	dbp_iotiming = (iotiming[0] == 't' ? DBP_IOTIMING_TURBO : iotiming[0] == 'a' ? DBP_IOTIMING_ACCURATE : DBP_IOTIMING_DEFAULT);
+	extern bool dbp_ide_busmaster;
+	dbp_ide_busmaster = (DBP_Option::Get(DBP_Option::idedma)[0] == 't');
+	dbp_content_snapshot = (DBP_Option::Get(DBP_Option::contentsnapshot)[0] == 't');
 
 	bool audiorate_changed = false;
 	#ifndef DBP_STANDALONE
@@ -2357,6 +2478,8 @@ static bool check_variables()
 	DBP_Option::GetAndApply(sec_mixer, "swapstereo", DBP_Option::swapstereo);
 	extern bool dbp_swapstereo;
 	dbp_swapstereo = (bool)control->GetProp("mixer", "swapstereo")->GetValue(); // to also get dosbox.conf override
+	extern Bit32u dbp_mt32_renderahead;
+	dbp_mt32_renderahead = (Bit32u)atoi(DBP_Option::Get(DBP_Option::mt32renderahead));
 
 	extern float dbp_volume_sb, dbp_volume_midi, dbp_volume_adlib, dbp_volume_speaker, dbp_volume_cdrom, dbp_volume_other;
 	bool volumes_changed = false;
@@ -2379,6 +2502,25 @@ static bool check_variables()
 		DBP_Option::Apply(sec_mixer, "blocksize", "2048");
 	}
 
+	#ifndef DBP_STANDALONE
+	const bool adaptive_audio = (DBP_Option::Get(DBP_Option::audiolatency)[0] == 'a');
+	if (adaptive_audio != dbp_audiobuf.adaptive)
+	{
+		struct CallBacks
+		{
+			static void RETRO_CALLCONV audio_buffer_status(bool active, unsigned occupancy, bool underrun_likely)
+			{
+				if (active && underrun_likely) dbp_audiobuf.frontend_underruns++;
+			}
+		};
+		static const retro_audio_buffer_status_callback abscb = { CallBacks::audio_buffer_status };
+		environ_cb(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, (adaptive_audio ? (void*)&abscb : NULL));
+		if (!adaptive_audio) DBP_MIXER_SetBuffering(0, 0); // restore configured values
+		memset(&dbp_audiobuf, 0, sizeof(dbp_audiobuf));
+		dbp_audiobuf.adaptive = adaptive_audio;
+	}
+	#endif
+
 	// Emulation options
 	const char* forcefps = DBP_Option::Get(DBP_Option::forcefps);
 	dbp_forcefps = (Bit16s)(forcefps[0] == 'f' ? 0 : forcefps[0] == 't' ? 60 : atoi(forcefps));
@@ -2390,6 +2532,8 @@ static bool check_variables()
 		case 'd': dbp_perf = DBP_PERF_DETAILED; break;
 		default:  dbp_perf = DBP_PERF_NONE; break;
 	}
+	extern bool dbp_mixer_perf;
+	dbp_mixer_perf = (dbp_perf == DBP_PERF_DETAILED);
 	#ifndef DBP_STANDALONE
 	switch (DBP_Option::Get(DBP_Option::savestate)[0])
 	{
@@ -2745,7 +2889,7 @@ static void init_dosbox(bool forcemenu = false, bool reinit = false, const std::
 				std::string save_name_redirect = DBP_GetSaveFile(SFT_SAVENAMEREDIRECT);
 				if (!save_name_redirect.empty()) save_file.swap(save_name_redirect);
 			}
-			unionDrive* uni = new unionDrive(*union_underlay, (save_file.empty() ? NULL : &save_file[0]), true, dbp_strict_mode);
+			unionDrive* uni = new unionDrive(*union_underlay, (save_file.empty() ? NULL : &save_file[0]), true, dbp_strict_mode, (dbp_save_chunks && !dbp_legacy_save));
 			Drives['C'-'A'] = uni;
 			mem_writeb(Real2Phys(dos.tables.mediaid) + ('C'-'A') * 9, uni->GetMediaByte());
 		}
@@ -3323,6 +3467,13 @@ bool retro_load_game(const struct retro_game_info *info) //#4
 	//bool use_audio_callback = environ_cb(RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, (void*)&rac);
 
 	if (info && info->path && *info->path) dbp_content_path = info->path;
+
+	// Persistent seek indexes of mounted ZIP archives are shared by all content in the system directory
+	const char *system_dir = NULL;
+	extern std::string dbp_seekindex_dir;
+	if (environ_cb(RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY, &system_dir) && system_dir && *system_dir)
+		(dbp_seekindex_dir = DBP_GetSaveFile(SFT_SYSTEMDIR)).append("DOSBoxPure-SeekIndex");
+
 	init_dosbox();
 
 	return true;
@@ -3417,6 +3568,58 @@ void retro_run_touchpad(bool has_press, Bit16s absx, Bit16s absy)
 		{ DBP_QueueEvent(DBPET_MOUSEUP, DBP_NO_PORT, down_btn); down_tick = 0; }
 }
 
+#ifndef DBP_STANDALONE
+static void DBP_AudioBufferingUpdate(Bit32u haveSamples, double numSamples, bool count_underrun)
+{
+	// Called once per frame after mixing to measure the buffered audio and (in adaptive mode) tune the mixer buffering once per second
+	DBP_AudioBuffering& ab = dbp_audiobuf;
+	if (count_underrun && numSamples >= haveSamples + 1.0) ab.underruns++;
+	ab.buffered += haveSamples;
+	if (++ab.frames < (Bit32u)av_info.timing.fps) return;
+
+	const Bit32u freq = (Bit32u)av_info.timing.sample_rate, frame_samples = (Bit32u)(av_info.timing.sample_rate / av_info.timing.fps) + 1;
+	ab.latency_ms = (float)ab.buffered * 1000.0f / (float)ab.frames / (float)freq;
+	ab.buffered = ab.frames = 0;
+
+	Bit32u mixer_underruns, mixer_overruns;
+	DBP_MIXER_GetBufferStats(mixer_underruns, mixer_overruns, true);
+	const bool starved = (ab.underruns || ab.frontend_underruns || mixer_underruns);
+	ab.underruns = ab.frontend_underruns = 0;
+	if (!ab.adaptive) return;
+
+	const Bit32u old_prebuffer = ab.prebuffer, old_blocksize = ab.blocksize, max_prebuffer = freq / 10, max_blocksize = 2048;
+	if (!ab.blocksize)
+	{
+		// Start with one frame of prebuffered audio (the configured mixer prebuffer is 0) and lower it from there while there are no underruns
+		ab.prebuffer = frame_samples;
+		ab.blocksize = max_blocksize;
+		ab.stable_needed = 4;
+	}
+	if (starved)
+	{
+		// Grow quickly and wait longer before trying to lower again to avoid oscillating around the limit
+		ab.prebuffer += frame_samples / 4;
+		if (ab.prebuffer > max_prebuffer) ab.prebuffer = max_prebuffer;
+		if (ab.stable_needed < 64) ab.stable_needed *= 2;
+		ab.stable_secs = 0;
+	}
+	else if (++ab.stable_secs >= ab.stable_needed)
+	{
+		ab.prebuffer -= (ab.prebuffer > freq / 1000 ? freq / 1000 : ab.prebuffer);
+		ab.stable_secs = 0;
+	}
+	if (mixer_overruns)
+		ab.blocksize = (ab.blocksize * 2 > max_blocksize ? max_blocksize : ab.blocksize * 2);
+	else if (!starved && ab.blocksize > frame_samples)
+		ab.blocksize = (ab.blocksize - ab.blocksize / 8 < frame_samples ? frame_samples : ab.blocksize - ab.blocksize / 8);
+
+	if (ab.prebuffer == old_prebuffer && ab.blocksize == old_blocksize) return;
+	DBP_MIXER_SetBuffering(ab.prebuffer, ab.blocksize);
+	if (dbp_perf == DBP_PERF_DETAILED)
+		log_cb(RETRO_LOG_INFO, "[DOSBOX] Adaptive audio buffering %s: prebuffer %u samples, blocksize %u samples, latency %.1f ms\n", (starved ? "increased" : "decreased"), ab.prebuffer, ab.blocksize, ab.latency_ms);
+}
+#endif
+
 void retro_run(void)
 {
 	#ifdef DBP_ENABLE_FPS_COUNTERS
@@ -3614,6 +3817,7 @@ void retro_run(void)
 	DBP_ThreadControl(skip_emulate ? TCM_PAUSE_FRAME : TCM_FINISH_FRAME);
 
 	Bit32u tpfActual = 0, tpfTarget = 0, tpfDraws = 0;
+	static char perfAudio[256], perfDisk[256], perfFiles[256];
 	#ifdef DBP_ENABLE_WAITSTATS
 	Bit32u waitPause = 0, waitFinish = 0, waitPaused = 0, waitContinue = 0;
 	#endif
@@ -3627,6 +3831,9 @@ void retro_run(void)
 		dbp_wait_pause = dbp_wait_finish = dbp_wait_paused = dbp_wait_continue = 0;
 		#endif
 		dbp_perf_uniquedraw = dbp_perf_count = dbp_perf_totaltime = 0;
+		if (dbp_perf == DBP_PERF_DETAILED) DBP_MIXER_GetPerfStats(perfAudio, sizeof(perfAudio)); // emulation thread is paused
+		if (dbp_perf == DBP_PERF_DETAILED) DBP_IOTiming_GetPerfStats(perfDisk, sizeof(perfDisk));
+		if (dbp_perf == DBP_PERF_DETAILED) DBP_LocalFile_GetPerfStats(perfFiles, sizeof(perfFiles));
 	}
 
 	#ifndef DBP_STANDALONE
@@ -3647,6 +3854,7 @@ void retro_run(void)
 		if (mixSamples > aud.length) { aud.audio = (int16_t*)realloc(aud.audio, mixSamples * 4); aud.length = mixSamples; }
 		MIXER_CallBack(0, (Bit8u*)aud.audio, mixSamples * 4);
 	}
+	DBP_AudioBufferingUpdate(haveSamples, numSamples, (dbp_throttle.mode != RETRO_THROTTLE_FAST_FORWARD && fpsboost <= 1 && dbp_audio_remain != -1));
 	#endif
 
 	// Read buffer_active before waking up emulation thread
@@ -3668,21 +3876,36 @@ void retro_run(void)
 	{
 		extern const char* DBP_CPU_GetDecoderName();
 		if (dbp_perf == DBP_PERF_DETAILED)
+		{
 			retro_notify(-1500, RETRO_LOG_INFO, "Speed: %4.1f%%, DOS: %dx%d@%4.2fhz, Actual: %4.2ffps, Drawn: %dfps, Cycles: %u (%s)"
+				#ifndef DBP_STANDALONE
+				", Audio: %.1fms"
+				#endif
 				#ifdef DBP_ENABLE_WAITSTATS
 				", Waits: p%u|f%u|z%u|c%u"
 				#endif
 				#ifdef DBP_ENABLE_FPS_COUNTERS
 				"\nRetro: %u, GfxStart: %u, GfxEnd: %u, Event: %u, SkipRun: %u, SkipRender: %u"
 				#endif
+				"%s%s%s%s%s%s"
 				, ((float)tpfTarget / (float)tpfActual * 100), (int)render.src.width, (int)render.src.height, render.src.fps, (1000000.f / tpfActual), tpfDraws, CPU_CycleMax, DBP_CPU_GetDecoderName()
+				#ifndef DBP_STANDALONE
+				, dbp_audiobuf.latency_ms
+				#endif
 				#ifdef DBP_ENABLE_WAITSTATS
 				, waitPause, waitFinish, waitPaused, waitContinue
 				#endif
 				#ifdef DBP_ENABLE_FPS_COUNTERS
 				, dbp_fpscount_retro, dbp_fpscount_gfxstart, dbp_fpscount_gfxend, dbp_fpscount_event, dbp_fpscount_skip_run, dbp_fpscount_skip_render
 				#endif
+				, (perfAudio[0] ? "\nAudio Devices: " : ""), perfAudio
+				, (perfDisk[0] ? "\nDisk Transfers: " : ""), perfDisk
+				, (perfFiles[0] ? "\nHost File Latency (<1|<4|<16|<64|64+ ms): " : ""), perfFiles
 				);
+			if (perfAudio[0]) log_cb(RETRO_LOG_INFO, "[DOSBOX] Audio device time per second of audio: %s\n", perfAudio);
+			if (perfDisk[0]) log_cb(RETRO_LOG_INFO, "[DOSBOX] Disk transfers per drive: %s\n", perfDisk);
+			if (perfFiles[0]) log_cb(RETRO_LOG_INFO, "[DOSBOX] Host file access latency histogram per drive: %s\n", perfFiles);
+		}
 		else
 			retro_notify(-1500, RETRO_LOG_INFO, "Emulation Speed: %4.1f%%",
 				((float)tpfTarget / (float)tpfActual * 100));
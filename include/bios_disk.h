@@ -64,8 +64,10 @@ public:
 	imageDisk(class DOS_File *imgFile, const char *imgName, Bit32u imgSizeK, bool isHardDisk);
 	~imageDisk();
 	Bit32u Read_Raw(Bit8u *buffer, Bit32u seek, Bit32u len);
+	Bit8u Read_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data);
 	void SetDifferencingDisk(const char* savePath);
 	bool ExportToFile(const char* path, bool vhd_format);
+	bool CompactVHD(Bit64u* freed_bytes = NULL);
 	#else
 	imageDisk(FILE *imgFile, const char *imgName, Bit32u imgSizeK, bool isHardDisk);
 	~imageDisk() { if(diskimg != NULL) { fclose(diskimg); }	};
@@ -96,6 +98,8 @@ private:
 	struct discardDisk* discard = NULL;
 	struct differencingDisk* differencing = NULL;
 	struct sparseVhd* vhd = NULL;
+	struct diskBlockCache* cache = NULL;
+	Bit8u Read_Uncached(Bit32u sectnum, Bit32u count, void * data);
 	#else
 	Bit32u current_fpos;
 	#endif
@@ -125,4 +129,15 @@ void swapInNextDisk(void);
 #endif
 bool getSwapRequest(void);
 
+//DBP: Disk access timing (INT 13h, INT 21h file transfers and IDE/ATAPI) and per drive transfer counters
+enum DBP_IOTimingMode : Bit8u { DBP_IOTIMING_DEFAULT, DBP_IOTIMING_TURBO, DBP_IOTIMING_ACCURATE };
+enum DBP_IODevice : Bit8u { DBP_IODEV_FLOPPY, DBP_IODEV_HARDDISK, DBP_IODEV_CDROM };
+enum { DBP_IOSTATS_DOS = 0, DBP_IOSTATS_BIOS = DOS_DRIVES, DBP_IOSTATS_COUNT = DOS_DRIVES + MAX_DISK_IMAGES };
+struct DBP_IOStats { Bit64u read_bytes, write_bytes, next_pos; Bit32u read_ops, write_ops; };
+extern Bit8u dbp_iotiming;
+extern DBP_IOStats dbp_iostats[DBP_IOSTATS_COUNT];
+double DBP_IOTiming_Access(Bitu slot, DBP_IODevice device, Bit64u pos, Bitu bytes, bool write);
+void DBP_IOTiming_Wait(double ms);
+void DBP_IOTiming_GetPerfStats(char* buf, size_t bufsize);
+
 #endif
@@ -250,6 +250,7 @@ static INLINE Bit16u DOS_PackDate(Bit16u year,Bit16u mon,Bit16u day) {
 #define DOSERR_FILE_ALREADY_EXISTS 80
 //DBP: Added for invalidFileHandle
 #define DOSERR_DRIVE_NOT_READY 21
+#define DOSERR_WRITE_FAULT 29
 
 /* Remains some classes used to access certain things */
 #define sOffset(s,m) ((char*)&(((s*)NULL)->m)-(char*)NULL)
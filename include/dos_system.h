@@ -125,6 +125,7 @@ private:
 class localFile : public DOS_File {
 public:
 	localFile(const char* name, FILE * handle);
+	~localFile();
 	bool Read(Bit8u * data,Bit16u * size);
 	bool Write(Bit8u * data,Bit16u * size);
 	bool Seek(Bit32u * pos,Bit32u type);
@@ -132,11 +133,13 @@ public:
 	Bit16u GetInformation(void);
 	bool UpdateDateTimeFromHost(void);   
 	void FlagReadOnlyMedium(void);
-	void Flush(void);
+	bool Flush(void);
 	FILE * fhandle; //todo handle this properly
 private:
 	bool read_only_medium;
-	enum { NONE,READ,WRITE } last_action;
+	//DBP: Read-ahead and write-behind on a host I/O thread, replaces last_action
+	struct localFileAsync* async;
+	friend struct localFileAsync;
 };
 
 //DBP: Moved label out of DOS_Drive_Cache into its own class
@@ -190,42 +193,18 @@ public:
 
 	void		EmptyCache			(DOS_Label& label);
 
-	class CFileInfo {
-	public:
-		CFileInfo(void) {
-			orgname[0] = shortname[0] = 0;
-			isDir = false;
-#ifdef C_DBP_NATIVE_OVERLAY
-			isOverlayDir = false;
-#endif
-			id = MAX_OPENDIRS;
-			nextEntry = shortNr = 0;
-		}
-		~CFileInfo(void) {
-			for (Bit32u i=0; i<fileList.size(); i++) delete fileList[i];
-			fileList.clear();
-			longNameList.clear();
-		};
-		char		orgname		[CROSS_LEN];
-		char		shortname	[DOS_NAMELENGTH_ASCII];
-#ifdef C_DBP_NATIVE_OVERLAY
-		bool		isOverlayDir;
-#endif
-		bool		isDir;
-		Bit16u		id;
-		Bitu		nextEntry;
-		Bitu		shortNr;
-		// contents
-		std::vector<CFileInfo*>	fileList;
-		std::vector<CFileInfo*>	longNameList;
-	};
+	//DBP: Moved definition of CFileInfo into drive_cache.cpp
+	class CFileInfo;
+
+	bool		IsWatchingChanges	(void) { return watchFd >= 0; }
 
 private:
 	void ClearFileInfo(CFileInfo *dir);
 	void DeleteFileInfo(CFileInfo *dir);
 
 	bool		RemoveTrailingDot	(char* shortname);
-	Bits		GetLongName		(CFileInfo* info, char* shortname);
+	CFileInfo*	GetLongName		(CFileInfo* info, char* shortname);
+	CFileInfo*	FindOrgName		(CFileInfo* dir, const char* name);
 	void		CreateShortName		(CFileInfo* dir, CFileInfo* info);
 	Bitu		CreateShortNameID	(CFileInfo* dir, const char* name);
 	int		CompareShortname	(const char* compareName, const char* shortName);
@@ -234,7 +213,11 @@ private:
 	CFileInfo*	FindDirInfo		(const char* path, char* expandedPath);
 	bool		RemoveSpaces		(char* str);
 	bool		OpenDir			(CFileInfo* dir, const char* path, Bit16u& id);
-	void		CreateEntry		(CFileInfo* dir, const char* name, bool is_directory);
+	CFileInfo*	CreateEntry		(CFileInfo* dir, const char* name, bool is_directory, bool keepSorted = true);
+	void		InsertEntry		(CFileInfo* dir, CFileInfo* info, bool keepSorted);
+	void		ClearDir		(CFileInfo* dir);
+	void		WatchDir		(CFileInfo* dir, const char* path);
+	void		PollChanges		(void);
 	void		CopyEntry		(CFileInfo* dir, CFileInfo* from);
 	Bit16u		GetFreeID		(CFileInfo* dir);
 	void		Clear			(void);
@@ -256,6 +239,9 @@ private:
 	//char		dirSearchName		[MAX_OPENDIRS];
 	CFileInfo*	dirFindFirst		[MAX_OPENDIRS];
 	Bit16u		nextFreeFindFirst;
+	//DBP: Added host directory change notification (only on Linux, -1 if not in use)
+	int		watchFd;
+	std::vector<CFileInfo*>	watchDirs;
 };
 
 class DOS_Drive {
@@ -174,6 +174,7 @@ static INLINE Bit32u phys_readd(PhysPt addr){
 void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size);
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size);
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size);
+HostPt MEM_GetBlockHostPt(PhysPt pt,Bitu size,bool write); //DBP: Direct host pointer for a range of plain RAM, NULL if any page of it goes through a handler
 void MEM_StrCopy(PhysPt pt,char * data,Bitu size);
 
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size);
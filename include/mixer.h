@@ -98,6 +98,8 @@ public:
 	bool interpolate;
 	bool enabled;
 	bool ever_enabled; //DBP: added for serialization
+	Bit32u perf_time; //DBP: added for performance statistics (microseconds spent generating samples)
+	bool perf_external; //DBP: handler adds its own time to perf_time instead of the time spent in Mix
 	bool last_samples_were_stereo;
 	bool last_samples_were_silence;
 	MixerChannel * next;
@@ -30,7 +30,7 @@
 
 #ifdef C_DBP_LIBRETRO
 // Reduced to be just as much as needed
-#define PCI_MAX_PCIDEVICES		2
+#define PCI_MAX_PCIDEVICES		3
 #define PCI_MAX_PCIFUNCTIONS	2
 #else
 #define PCI_MAX_PCIDEVICES		10
@@ -89,6 +89,7 @@ public:
 };
 
 bool PCI_IsInitialized();
+bool PCI_IsPresent();
 
 RealPt PCI_GetPModeInterface(void);
 
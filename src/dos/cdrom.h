@@ -165,11 +165,14 @@ private:
 	protected:
 		class DOS_File* dos_file;
 		Bit32u dos_ofs, dos_end;
+	public:
 	#else
 		virtual bool read(Bit8u *buffer, int seek, int count) = 0;
 		virtual int getLength() = 0;
 		virtual ~TrackFile() { };
 	#endif
+		//DBP: Read count bytes of num consecutive sectors packed into buffer, the default reads them one by one
+		virtual bool readSectors(Bit8u *buffer, int seek, int sectorSize, int count, int num);
 	};
 	
 	class BinaryFile : public TrackFile {
@@ -179,11 +182,13 @@ private:
 		#else
 		BinaryFile(const char *filename, bool &error);
 		#endif
+		bool readSectors(Bit8u *buffer, int seek, int sectorSize, int count, int num);
 	private:
 		#ifndef C_DBP_SUPPORT_CDROM_MOUNT_DOSFILE
 		BinaryFile();
 		std::ifstream *file;
 		#endif
+		std::vector<Bit8u> spanBuffer;
 	};
 	
 	class AudioFile : public TrackFile {
@@ -202,6 +207,7 @@ private:
 		Bit32u wave_start, audio_length, last_seek;
 		double audio_factor;
 		struct stb_vorbis *vorb;
+		struct CDFlacStream *flac;
 		std::vector<Bit8u> buffer_temp;
 		#elif defined(C_SDL_SOUND)
 		Sound_Sample *sample;
@@ -253,6 +259,7 @@ private:
 	// player
 static	void	CDAudioCallBack(Bitu len);
 	int	GetTrack(int sector);
+	int	GetSectorOffset(const Track &track, bool raw);
 
 static  struct imagePlayer {
 		CDROM_Interface_Image *cd;
@@ -289,6 +296,7 @@ static	int	refCount;
 typedef	std::vector<Track>::iterator	track_it;
 	std::string	mcn;
 	Bit8u	subUnit;
+	std::vector<Bit8u>	readBuffer;
 
 	friend void DBPSerialize_CDPlayer(struct DBPArchive& ar);
 };
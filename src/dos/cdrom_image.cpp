@@ -31,6 +31,7 @@
 #include "drives.h"
 #include "support.h"
 #include "setup.h"
+#include "dbp_threads.h"
 
 #if !defined(WIN32)
 #include <libgen.h>
@@ -115,11 +116,531 @@ int CDROM_Interface_Image::BinaryFile::getLength()
 }
 #endif /* C_DBP_SUPPORT_CDROM_MOUNT_DOSFILE */
 
+bool CDROM_Interface_Image::TrackFile::readSectors(Bit8u *buffer, int seek, int sectorSize, int count, int num)
+{
+	for (int i = 0; i != num; i++, buffer += count, seek += sectorSize)
+		if (!read(buffer, seek, count)) return false;
+	return true;
+}
+
+bool CDROM_Interface_Image::BinaryFile::readSectors(Bit8u *buffer, int seek, int sectorSize, int count, int num)
+{
+	// Sectors are stored back to back so a run can be read at once, when only a part of each sector is wanted it gets packed afterwards
+	if (count == sectorSize) return BinaryFile::read(buffer, seek, count * num);
+	if (spanBuffer.size() < (size_t)(sectorSize * num)) spanBuffer.resize(sectorSize * num);
+	if (!BinaryFile::read(&spanBuffer[0], seek, sectorSize * (num - 1) + count)) return false;
+	for (int i = 0; i != num; i++) memcpy(buffer + i * count, &spanBuffer[i * sectorSize], count);
+	return true;
+}
+
+#if defined(C_DBP_SUPPORT_CDROM_MOUNT_DOSFILE) || defined(C_DBP_SUPPORT_CDROM_CHD_IMAGE)
+// Bit reader for FLAC frames and the CHD hunk map
+struct CDBitReader
+{
+	const Bit8u *data;
+	Bit32u len, bitpos;
+
+	CDBitReader(const Bit8u* _data, Bit32u _len) : data(_data), len(_len), bitpos(0) { }
+	INLINE bool Overflow() const { return (bitpos > len * 8); }
+	INLINE void Align() { bitpos = ((bitpos + 7) & ~7u); }
+
+	// Returns the next 64 bits with at least 57 of them valid, zero padded past the end of the data
+	INLINE Bit64u Peek() const
+	{
+		Bit64u v = 0;
+		for (Bit32u i = (bitpos >> 3), iEnd = i + 8; i != iEnd; i++) v = (v << 8) | (i < len ? data[i] : 0);
+		return (v << (bitpos & 7));
+	}
+
+	INLINE Bit32u Read(Bit32u bits) { if (!bits) return 0; Bit32u res = (Bit32u)(Peek() >> (64 - bits)); bitpos += bits; return res; }
+	INLINE Bit32s ReadSigned(Bit32u bits) { if (!bits) return 0; Bit32s res = (Bit32s)((Bit64s)Peek() >> (64 - bits)); bitpos += bits; return res; }
+
+	Bit32u ReadUnary()
+	{
+		for (Bit32u zeros = 0;;)
+		{
+			Bit64u v = Peek();
+			if (!(v >> 7)) { zeros += 57; bitpos += 57; if (Overflow()) return zeros; continue; }
+			for (; !(v & 0x8000000000000000ULL); v <<= 1) { zeros++; bitpos++; }
+			bitpos++;
+			return zeros;
+		}
+	}
+};
+
+// Frame decoder for mono or stereo FLAC, used for FLAC audio track files and the cdfl codec of CHD images (which stores stereo frames without stream header)
+struct CDFlacDecoder
+{
+	std::vector<Bit32s> samples[2];
+	Bit32u stream_bps, bps, channels;
+
+	CDFlacDecoder() : stream_bps(16), bps(0), channels(0) { }
+
+	static bool DecodeResidual(CDBitReader& br, Bit32s* s, Bit32u n, Bit32u order)
+	{
+		Bit32u method = br.Read(2);
+		if (method > 1) return false;
+		const Bit32u param_bits = (method ? 5 : 4), escape = (method ? 31 : 15), partition_order = br.Read(4), partition_len = (n >> partition_order);
+		if (partition_len < order || (partition_len << partition_order) != n) return false;
+		Bit32s* p = s + order;
+		for (Bit32u part = 0; part != (1u << partition_order); part++)
+		{
+			Bit32s* pEnd = s + (part + 1) * partition_len;
+			Bit32u k = br.Read(param_bits);
+			if (k == escape) for (Bit32u bits = br.Read(5); p != pEnd; p++) *p = br.ReadSigned(bits);
+			else for (; p != pEnd; p++) { Bit32u v = ((br.ReadUnary() << k) | br.Read(k)); *p = (Bit32s)(v >> 1) ^ -(Bit32s)(v & 1); }
+			if (br.Overflow()) return false;
+		}
+		return true;
+	}
+
+	static bool DecodeSubframe(CDBitReader& br, Bit32s* s, Bit32u n, Bit32u bps)
+	{
+		if (br.Read(1)) return false;
+		Bit32u type = br.Read(6), wasted = 0;
+		if (br.Read(1)) { wasted = br.ReadUnary() + 1; if (wasted >= bps) return false; bps -= wasted; }
+		if (type == 0) // constant
+		{
+			Bit32s v = br.ReadSigned(bps);
+			for (Bit32u i = 0; i != n; i++) s[i] = v;
+		}
+		else if (type == 1) // verbatim
+		{
+			for (Bit32u i = 0; i != n; i++) s[i] = br.ReadSigned(bps);
+		}
+		else if (type >= 8 && type <= 12) // fixed predictor
+		{
+			Bit32u order = type - 8;
+			if (order > n) return false;
+			for (Bit32u i = 0; i != order; i++) s[i] = br.ReadSigned(bps);
+			if (!DecodeResidual(br, s, n, order)) return false;
+			for (Bit32u i = order; i != n; i++)
+			{
+				switch (order)
+				{
+					case 1: s[i] += s[i-1]; break;
+					case 2: s[i] += 2 * s[i-1] - s[i-2]; break;
+					case 3: s[i] += 3 * (s[i-1] - s[i-2]) + s[i-3]; break;
+					case 4: s[i] += 4 * (s[i-1] + s[i-3]) - 6 * s[i-2] - s[i-4]; break;
+				}
+			}
+		}
+		else if (type >= 32) // linear predictor
+		{
+			Bit32u order = type - 31, precision;
+			if (order > n) return false;
+			for (Bit32u i = 0; i != order; i++) s[i] = br.ReadSigned(bps);
+			if ((precision = br.Read(4) + 1) == 16) return false;
+			Bit32s shift = br.ReadSigned(5), coefs[32];
+			if (shift < 0) return false;
+			for (Bit32u i = 0; i != order; i++) coefs[i] = br.ReadSigned(precision);
+			if (!DecodeResidual(br, s, n, order)) return false;
+			for (Bit32u i = order; i != n; i++)
+			{
+				Bit64s sum = 0;
+				for (Bit32u j = 0; j != order; j++) sum += (Bit64s)coefs[j] * s[i - 1 - j];
+				s[i] += (Bit32s)(sum >> shift);
+			}
+		}
+		else return false;
+		if (wasted) for (Bit32u i = 0; i != n; i++) s[i] = (Bit32s)((Bit32u)s[i] << wasted);
+		return !br.Overflow();
+	}
+
+	struct Header { Bit64u number; Bit32u blocksize, ch_code, bps_code; bool variable; };
+
+	// Parses a frame header at the (byte aligned) position of the bit reader and verifies its CRC-8
+	static bool ReadHeader(CDBitReader& br, Header& h)
+	{
+		const Bit32u start = (br.bitpos >> 3);
+		if (br.Read(15) != 0x7FFC) return false; // frame sync code and reserved bit
+		h.variable = (br.Read(1) != 0); // blocking strategy
+		const Bit32u bs_code = br.Read(4), sr_code = br.Read(4);
+		h.ch_code = br.Read(4);
+		h.bps_code = br.Read(3);
+		br.Read(1);
+		if (!bs_code || sr_code == 15 || h.ch_code > 10 || h.bps_code == 3 || h.bps_code == 7) return false;
+
+		Bit32u utf8 = br.Read(8), extra = 0; // coded frame number (fixed blocking) or sample number (variable blocking)
+		for (Bit32u m = 0x40; (utf8 & 0x80) && (utf8 & m); m >>= 1) extra++;
+		if ((utf8 & 0x80) && (extra < 1 || extra > 6)) return false;
+		h.number = (utf8 & (extra ? (0x3F >> extra) : 0x7F));
+		for (; extra; extra--)
+		{
+			Bit32u b = br.Read(8);
+			if ((b & 0xC0) != 0x80) return false;
+			h.number = ((h.number << 6) | (b & 0x3F));
+		}
+
+		h.blocksize = (bs_code == 1 ? 192 : bs_code <= 5 ? (576 << (bs_code - 2)) : bs_code == 6 ? br.Read(8) + 1 : bs_code == 7 ? br.Read(16) + 1 : (256 << (bs_code - 8)));
+		if (sr_code == 12) br.Read(8); else if (sr_code == 13 || sr_code == 14) br.Read(16);
+		const Bit32u end = (br.bitpos >> 3);
+		if (br.Overflow()) return false;
+		Bit32u crc = 0;
+		for (const Bit8u *p = br.data + start, *pEnd = br.data + end; p != pEnd; p++)
+		{
+			crc ^= *p;
+			for (Bit32u i = 0; i != 8; i++) crc = (((crc << 1) ^ ((crc & 0x80) ? 0x07 : 0)) & 0xFF);
+		}
+		return (br.Read(8) == crc);
+	}
+
+	bool DecodeFrame(CDBitReader& br, Header& h)
+	{
+		if (!ReadHeader(br, h)) return false;
+		static const Bit8u bps_table[8] = { 0, 8, 12, 0, 16, 20, 24, 0 }; // code 0 refers to the stream header
+		const Bit32u blocksize = h.blocksize;
+		bps = (h.bps_code ? bps_table[h.bps_code] : stream_bps);
+		if (h.ch_code > 1 && h.ch_code < 8) return false; // only mono or stereo is supported
+		channels = (h.ch_code ? 2 : 1);
+		for (Bit32u ch = 0; ch != channels; ch++)
+		{
+			if (samples[ch].size() < blocksize) samples[ch].resize(blocksize);
+			const bool side = ((h.ch_code == 8 || h.ch_code == 10) ? ch == 1 : (h.ch_code == 9 && ch == 0));
+			if (!DecodeSubframe(br, &samples[ch][0], blocksize, bps + (side ? 1 : 0))) return false;
+		}
+		br.Align();
+		br.Read(16); // CRC-16
+		if (br.Overflow()) return false;
+
+		Bit32s *l = &samples[0][0], *r = (channels == 2 ? &samples[1][0] : NULL);
+		switch (h.ch_code)
+		{
+			case 8: for (Bit32u i = 0; i != blocksize; i++) r[i] = l[i] - r[i]; break; // left/side
+			case 9: for (Bit32u i = 0; i != blocksize; i++) l[i] += r[i]; break; // side/right
+			case 10: for (Bit32u i = 0; i != blocksize; i++) { Bit32s mid = (Bit32s)(((Bit32u)l[i] << 1) | (r[i] & 1)), side = r[i]; l[i] = (mid + side) >> 1; r[i] = (mid - side) >> 1; } break; // mid/side
+		}
+		return true;
+	}
+
+	// Writes num_samples big endian stereo sample pairs to out and returns the number of bytes used from src in out_consumed
+	bool Decode(const Bit8u* src, Bit32u srclen, Bit8u* out, Bit32u num_samples, Bit32u& out_consumed)
+	{
+		CDBitReader br(src, srclen);
+		Header h;
+		for (Bit32u done = 0, n; done != num_samples; done += n)
+		{
+			if (!DecodeFrame(br, h) || channels != 2) return false;
+			if ((n = h.blocksize) > num_samples - done) n = num_samples - done;
+			for (Bit32s *l = &samples[0][0], *r = &samples[1][0], *lEnd = l + n; l != lEnd; l++, r++, out += 4)
+				{ out[0] = (Bit8u)(*l >> 8); out[1] = (Bit8u)*l; out[2] = (Bit8u)(*r >> 8); out[3] = (Bit8u)*r; }
+		}
+		out_consumed = (br.bitpos >> 3);
+		return true;
+	}
+};
+
+#endif
+
 #ifdef C_DBP_SUPPORT_CDROM_MOUNT_DOSFILE
 
 #include "stb_vorbis.inl"
 
-CDROM_Interface_Image::AudioFile::AudioFile(const char *filename, bool &error, const char *relative_to) : TrackFile(filename, error, relative_to), last_seek(0), vorb(NULL)
+// FLAC audio track file which gets decoded ahead of the playback position on a worker thread
+// File data is always read on the emulation thread into an input window (file access can go through DOS drives), the worker thread only decodes frames from it into a ring of stereo samples
+// Positions of decoded frames are remembered in a seek index so jumps in playback can restart decoding close to the target
+struct CDFlacStream
+{
+	enum { IN_SIZE = 1024*1024, IN_CHUNK = 64*1024, IN_AHEAD = 256*1024, PCM_SIZE = 128*1024, INDEX_STEP = 44100/2, SKIP_AHEAD = 44100 };
+	enum { THREAD_NONE, THREAD_RUNNING, THREAD_UNAVAILABLE };
+	typedef bool (*ReadFunc)(void* trk, Bit8u *buffer, int seek, int count);
+	struct IndexEntry { Bit64u sample; Bit32u offset; };
+
+	void* trk;
+	ReadFunc trkread;
+	CDFlacDecoder decoder;
+	Bit32u sample_rate, channels, max_block, file_end, in_need;
+	Bit64u total_samples;
+	std::vector<IndexEntry> index;
+	std::vector<Bit8u> in, chunk;
+	std::vector<Bit16s> pcm;
+	Bit32u in_base, in_pos, in_end, pcm_count;
+	Bit64u pcm_start;
+	bool in_eof, dec_end;
+	Mutex mutex;
+	Semaphore wake, finished, exited;
+	bool idle, busy, quit, waiting;
+	Bit8u thread_state;
+
+	CDFlacStream(void* _trk, ReadFunc _trkread, Bit32u _file_end) : trk(_trk), trkread(_trkread), file_end(_file_end), idle(false), busy(false), quit(false), waiting(false), thread_state(THREAD_NONE) { }
+	~CDFlacStream()
+	{
+		if (thread_state != THREAD_RUNNING) return;
+		mutex.Lock();
+		quit = true;
+		if (idle) { idle = false; wake.Post(); }
+		mutex.Unlock();
+		exited.Wait();
+	}
+
+	Bit32u ReadFile(Bit8u* buffer, Bit32u seek, Bit32u count)
+	{
+		if (seek >= file_end) return 0;
+		if (count > file_end - seek) count = file_end - seek;
+		return (trkread(trk, buffer, (int)seek, (int)count) ? count : 0);
+	}
+
+	static Bit64u get_bigendian_uint64(const Bit8u *base) { return ((Bit64u)base[0] << 56) | ((Bit64u)base[1] << 48) | ((Bit64u)base[2] << 40) | ((Bit64u)base[3] << 32) | ((Bit64u)base[4] << 24) | ((Bit64u)base[5] << 16) | ((Bit64u)base[6] << 8) | (Bit64u)base[7]; }
+
+	bool Open()
+	{
+		Bit8u hdr[34];
+		if (ReadFile(hdr, 0, 4) != 4 || memcmp(hdr, "fLaC", 4)) return false;
+		Bit32u ofs = 4;
+		sample_rate = 0;
+		for (bool last = false; !last; ofs += 4 + ((hdr[1] << 16) | (hdr[2] << 8) | hdr[3]))
+		{
+			if (ReadFile(hdr, ofs, 4) != 4) return false;
+			const Bit32u type = (hdr[0] & 0x7F), len = ((hdr[1] << 16) | (hdr[2] << 8) | hdr[3]);
+			last = ((hdr[0] & 0x80) != 0);
+			if (type == 0 && len >= 34) // STREAMINFO
+			{
+				Bit8u info[34];
+				if (ReadFile(info, ofs + 4, 34) != 34) return false;
+				CDBitReader br(info, 34);
+				br.Read(16); // minimum block size
+				max_block = br.Read(16);
+				br.Read(24); // minimum frame size
+				in_need = br.Read(24); // maximum frame size
+				sample_rate = br.Read(20);
+				channels = br.Read(3) + 1;
+				decoder.stream_bps = br.Read(5) + 1;
+				total_samples = ((Bit64u)br.Read(4) << 32) | br.Read(32);
+			}
+			else if (type == 3) // SEEKTABLE, offsets are relative to the first frame and get added to the index below
+			{
+				chunk.resize(len);
+				if (len && ReadFile(&chunk[0], ofs + 4, len) != len) return false;
+			}
+		}
+		if (!sample_rate || channels > 2 || decoder.stream_bps < 8 || decoder.stream_bps > 24 || !total_samples || max_block < 16) return false;
+
+		// Make sure a complete frame is in the input window before it gets decoded (unless the end of the file is reached)
+		const Bit32u frame_limit = max_block * channels * (decoder.stream_bps + 1) / 8 + 32;
+		if (!in_need || in_need > frame_limit) in_need = frame_limit;
+
+		IndexEntry first = { 0, ofs };
+		index.assign(1, first);
+		for (Bit32u i = 0; i + 18 <= (Bit32u)chunk.size(); i += 18)
+		{
+			const Bit64u sample = get_bigendian_uint64(&chunk[i]), offset = get_bigendian_uint64(&chunk[i + 8]);
+			if (sample < total_samples && offset < file_end - ofs) AddIndex(sample, ofs + (Bit32u)offset); // also skips placeholder points
+		}
+		chunk.clear();
+		in.resize(IN_SIZE);
+		pcm.resize(PCM_SIZE * 2);
+		in_base = ofs;
+		in_pos = in_end = pcm_count = 0;
+		pcm_start = 0;
+		in_eof = dec_end = false;
+		return true;
+	}
+
+	// Returns the index entry with the highest sample number not after the given sample
+	size_t FindIndex(Bit64u sample) const
+	{
+		size_t lo = 0, hi = index.size();
+		while (hi - lo > 1) { size_t mid = (lo + hi) / 2; if (index[mid].sample <= sample) lo = mid; else hi = mid; }
+		return lo;
+	}
+
+	void AddIndex(Bit64u sample, Bit32u offset)
+	{
+		const size_t i = FindIndex(sample);
+		if (sample - index[i].sample < INDEX_STEP || (i + 1 != index.size() && index[i + 1].sample - sample < INDEX_STEP)) return;
+		IndexEntry e = { sample, offset };
+		index.insert(index.begin() + i + 1, e);
+	}
+
+	Bit64u FrameSample(const CDFlacDecoder::Header& h) const { return (h.variable ? h.number : h.number * max_block); }
+
+	// Finds the first valid frame header in the file at or after offset from
+	bool FindFrame(Bit32u from, Bit32u len, IndexEntry& e)
+	{
+		chunk.resize(len);
+		const Bit32u n = ReadFile(&chunk[0], from, len);
+		for (Bit32u i = 0; i + 1 < n; i++)
+		{
+			if (chunk[i] != 0xFF || (chunk[i + 1] & 0xFE) != 0xF8) continue;
+			CDBitReader br(&chunk[i], n - i);
+			CDFlacDecoder::Header h;
+			if (!CDFlacDecoder::ReadHeader(br, h) || h.blocksize > max_block || FrameSample(h) >= total_samples) continue;
+			e.sample = FrameSample(h);
+			e.offset = from + i;
+			return true;
+		}
+		return false;
+	}
+
+	// Restart decoding at the closest known frame before the target, narrowing down far away targets by probing frame headers in the file (called on the emulation thread with the mutex locked)
+	void Seek(Bit64u target)
+	{
+		while (busy) { waiting = true; mutex.Unlock(); finished.Wait(); mutex.Lock(); }
+		const size_t i = FindIndex(target);
+		IndexEntry lo = index[i], hi = { total_samples, file_end }, e;
+		if (i + 1 != index.size()) hi = index[i + 1];
+		const Bit32u probe = (in_need * 2 < IN_CHUNK ? in_need * 2 : IN_CHUNK); // enough to contain at least one frame header
+		for (int probes = 0; probes != 16 && target - lo.sample > INDEX_STEP && hi.sample > lo.sample && hi.offset - lo.offset > probe; probes++)
+		{
+			Bit32u guess = lo.offset + (Bit32u)((hi.offset - lo.offset) * ((double)(target - lo.sample) / (double)(hi.sample - lo.sample)));
+			if (guess > hi.offset - probe) guess = hi.offset - probe;
+			if (guess <= lo.offset) guess = lo.offset + 1;
+			if (!FindFrame(guess, probe, e) || e.offset >= hi.offset) break;
+			AddIndex(e.sample, e.offset);
+			if (e.sample <= target) lo = e; else hi = e;
+		}
+		in_base = lo.offset;
+		in_pos = in_end = pcm_count = 0;
+		pcm_start = lo.sample;
+		in_eof = dec_end = false;
+	}
+
+	// Read more of the file into the input window, either enough for the next frame or one more chunk ahead for the worker thread
+	// Called on the emulation thread with the mutex locked, the worker thread never accesses data past in_end
+	void FillInput(bool ahead)
+	{
+		while (!in_eof && in_end - in_pos < in_need + (ahead ? IN_AHEAD : 0) && in_end + IN_CHUNK <= IN_SIZE)
+		{
+			const Bit32u n = ReadFile(&in[in_end], in_base + in_end, IN_CHUNK);
+			if (n != IN_CHUNK) in_eof = true;
+			in_end += n;
+			if (ahead) break;
+		}
+	}
+
+	// Decode the next frame from the input window into the sample ring, called with the mutex locked and returns false if nothing could be done
+	bool DecodeStep()
+	{
+		if (dec_end || PCM_SIZE - pcm_count < max_block) return false;
+		const Bit32u avail = in_end - in_pos, pos = in_pos;
+		if (avail < in_need && !in_eof) return false;
+		if (!avail) { dec_end = true; return true; }
+
+		busy = true;
+		mutex.Unlock();
+		CDBitReader br(&in[pos], avail);
+		CDFlacDecoder::Header h;
+		const bool ok = decoder.DecodeFrame(br, h);
+		mutex.Lock();
+		busy = false;
+
+		if (!ok || h.blocksize > PCM_SIZE - pcm_count)
+		{
+			// Skip to the next possible frame sync code
+			Bit32u skip = 1;
+			while (skip != avail && (in[pos + skip] != 0xFF || (skip + 1 != avail && (in[pos + skip + 1] & 0xFE) != 0xF8))) skip++;
+			in_pos += skip;
+			return true;
+		}
+
+		const Bit64u sample = FrameSample(h), expect = pcm_start + pcm_count;
+		if (sample >= expect || !pcm_count) // otherwise drop a repeated frame found after damaged data
+		{
+			// Frames lost to damaged data become silence, or restart the ring if the gap is too large
+			if (!pcm_count || sample - expect > PCM_SIZE - pcm_count - h.blocksize) { pcm_start = sample; pcm_count = 0; }
+			for (; pcm_start + pcm_count != sample; pcm_count++) memset(&pcm[(Bit32u)((pcm_start + pcm_count) & (PCM_SIZE - 1)) * 2], 0, sizeof(Bit16s) * 2);
+
+			const Bit32s *l = &decoder.samples[0][0], *r = &decoder.samples[decoder.channels - 1][0];
+			const Bit32u shift = (decoder.bps > 16 ? decoder.bps - 16 : 0), mult = (decoder.bps < 16 ? 1 << (16 - decoder.bps) : 1);
+			for (Bit32u i = 0, n = h.blocksize; i != n; i++)
+			{
+				Bit16s* out = &pcm[(Bit32u)((sample + i) & (PCM_SIZE - 1)) * 2];
+				out[0] = (Bit16s)((l[i] >> shift) * (Bit32s)mult);
+				out[1] = (Bit16s)((r[i] >> shift) * (Bit32s)mult);
+			}
+			pcm_count += h.blocksize;
+			AddIndex(sample, in_base + pos);
+		}
+
+		in_pos += (br.bitpos >> 3);
+		if (in_pos >= IN_SIZE / 2)
+		{
+			// Move remaining data to the front, the emulation thread only appends data while holding the mutex
+			memmove(&in[0], &in[in_pos], in_end - in_pos);
+			in_base += in_pos;
+			in_end -= in_pos;
+			in_pos = 0;
+		}
+		return true;
+	}
+
+	// Copy num stereo samples starting at sample pos into out, returns how many samples were available
+	Bit32u Read(Bit64u pos, Bit32u num, Bit16s* out)
+	{
+		if (pos >= total_samples) return 0;
+		if (thread_state == THREAD_NONE)
+		{
+			extern unsigned dbp_cpu_features_get_core_amount(void);
+			if (dbp_cpu_features_get_core_amount() <= 1) thread_state = THREAD_UNAVAILABLE;
+			else
+			{
+				thread_state = THREAD_RUNNING;
+				Thread::StartDetached(DecodeThread, this);
+			}
+		}
+
+		mutex.Lock();
+		if (pos < pcm_start || pos > pcm_start + pcm_count + SKIP_AHEAD) Seek(pos);
+		for (;;)
+		{
+			if (pos > pcm_start) { Bit32u drop = (pos - pcm_start < pcm_count ? (Bit32u)(pos - pcm_start) : pcm_count); pcm_start += drop; pcm_count -= drop; }
+			if ((pos == pcm_start && pcm_count >= num) || dec_end) break;
+			const Bit32u prev_end = in_end;
+			FillInput(false);
+			if (thread_state == THREAD_RUNNING && !idle)
+			{
+				// Wait for the worker thread to finish decoding its current frame
+				waiting = true;
+				mutex.Unlock();
+				finished.Wait();
+				mutex.Lock();
+			}
+			else if (!DecodeStep() && in_end == prev_end) break; // decode directly while the worker thread is sleeping (it only gets woken up below)
+		}
+
+		Bit32u n = 0;
+		if (pos == pcm_start)
+		{
+			n = (num < pcm_count ? num : pcm_count);
+			for (Bit32u i = 0; i != n; i++)
+			{
+				const Bit16s* in_sample = &pcm[(Bit32u)((pcm_start + i) & (PCM_SIZE - 1)) * 2];
+				out[i * 2] = in_sample[0];
+				out[i * 2 + 1] = in_sample[1];
+			}
+			pcm_start += n;
+			pcm_count -= n;
+		}
+		if (thread_state == THREAD_RUNNING)
+		{
+			FillInput(true);
+			if (idle) { idle = false; wake.Post(); }
+		}
+		mutex.Unlock();
+		return n;
+	}
+
+	static Thread::RET_t THREAD_CC DecodeThread(void* p)
+	{
+		CDFlacStream& f = *(CDFlacStream*)p;
+		f.mutex.Lock();
+		while (!f.quit)
+		{
+			const bool progress = f.DecodeStep();
+			if (f.waiting) { f.waiting = false; f.finished.Post(); }
+			if (progress) continue;
+			f.idle = true;
+			f.mutex.Unlock();
+			f.wake.Wait();
+			f.mutex.Lock();
+		}
+		f.mutex.Unlock();
+		f.exited.Post();
+		return 0;
+	}
+};
+
+CDROM_Interface_Image::AudioFile::AudioFile(const char *filename, bool &error, const char *relative_to) : TrackFile(filename, error, relative_to), last_seek(0), vorb(NULL), flac(NULL)
 {
 	if (error) return;
 
@@ -176,6 +697,22 @@ CDROM_Interface_Image::AudioFile::AudioFile(const char *filename, bool &error, c
 		audio_factor = p.sample_rate / 44100.0f;
 		audio_length = stb_vorbis_stream_length_in_samples(vorb) * 4;
 	}
+	else if (sz >= 4 && !memcmp(header, "fLaC", 4))
+	{
+		dos_file->Seek(&(dos_ofs = 0), DOS_SEEK_SET);
+		struct FlacFuncs
+		{
+			static bool trkread(CDROM_Interface_Image::AudioFile* trk, Bit8u *buffer, int seek, int count)
+			{
+				return trk->TrackFile::read(buffer, seek, count);
+			}
+		};
+		flac = new CDFlacStream(this, (CDFlacStream::ReadFunc)&FlacFuncs::trkread, dos_end);
+		if (!flac->Open()) { LOG_MSG("ERROR: CD audio FLAC file '%s' is invalid or not a mono or stereo file", filename); error = true; return; }
+		if (flac->sample_rate != 44100) { LOG_MSG("WARNING: CD audio FLAC file '%s' has a rate of %d hz (playback quality might suffer if it's not a rate of 44100 hz)", filename, (int)flac->sample_rate); }
+		audio_factor = flac->sample_rate / 44100.0f;
+		audio_length = (Bit32u)(flac->total_samples * 4);
+	}
 	else { LOG_MSG("ERROR: CD audio file '%s' uses unsupported audio compression", filename); error = true; return; }
 
 	if (audio_factor != 1.0) buffer_temp.resize((size_t)(16 + RAW_SECTOR_SIZE * audio_factor)); // alloc temp buffer for resampling
@@ -187,6 +724,7 @@ CDROM_Interface_Image::AudioFile::~AudioFile()
 {
 	if (vorb)
 		stb_vorbis_close(vorb);
+	delete flac;
 }
 
 bool CDROM_Interface_Image::AudioFile::read(Bit8u *buffer, int seek, int count)
@@ -209,6 +747,10 @@ bool CDROM_Interface_Image::AudioFile::read(Bit8u *buffer, int seek, int count)
 		if (seek_jump && !stb_vorbis_seek(vorb, seek / 4)) got = 0;
 		else got = stb_vorbis_get_samples_short_interleaved(vorb, 2, (short*)buffer, count / 2) * 4;
 	}
+	else if (flac)
+	{
+		got = flac->Read((Bit32u)seek / 4, (Bit32u)count / 4, (Bit16s*)buffer) * 4;
+	}
 	else
 	{
 		got = dos_end - (wave_start + seek);
@@ -457,25 +999,34 @@ void CDROM_Interface_Image::ChannelControl(TCtrl ctrl)
 
 bool CDROM_Interface_Image::ReadSectors(PhysPt buffer, bool raw, unsigned long sector, unsigned long num)
 {
-	int sectorSize = raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
-	//DBP: Removed memory allocation
-	//Bitu buflen = num * sectorSize;
-	//Bit8u* buf = new Bit8u[buflen];
-	
-	bool success = true; //Gobliiins reads 0 sectors
-	for(unsigned long i = 0; i < num; i++) {
-		//success = ReadSector(&buf[i * sectorSize], raw, sector + i);
-		Bit8u buf[RAW_SECTOR_SIZE];
-		success = ReadSector(buf, raw, sector + i);
-		MEM_BlockWrite(buffer, buf, sectorSize);
-		buffer += sectorSize;
-		if (!success) break;
-	}
+	//DBP: Read runs of sectors inside the same track with a single file read and guest memory copy
+	enum { MAX_SPAN = 64 };
+	const int sectorSize = raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
+	while (num) //Gobliiins reads 0 sectors
+	{
+		int track = GetTrack((int)sector) - 1, off;
+		if (track < 0 || (off = GetSectorOffset(tracks[track], raw)) < 0) return false;
 
-	//MEM_BlockWrite(buffer, buf, buflen);
-	//delete[] buf;
+		Track &t = tracks[track];
+		unsigned long span = (unsigned long)(tracks[track + 1].start - (int)sector);
+		if (span > num) span = num;
+		if (span > MAX_SPAN) span = MAX_SPAN;
+		if (readBuffer.size() < span * sectorSize) readBuffer.resize(span * sectorSize);
 
-	return success;
+		int seek = t.skip + ((int)sector - t.start) * t.sectorSize + off;
+		if (!t.file->readSectors(&readBuffer[0], seek, t.sectorSize, sectorSize, (int)span))
+		{
+			// Fall back to single sector reads which handle pre-gap areas beyond the end of the file
+			for (unsigned long i = 0; i != span; i++)
+				if (!ReadSector(&readBuffer[i * sectorSize], raw, sector + i))
+					{ MEM_BlockWrite(buffer, &readBuffer[0], (i + 1) * sectorSize); return false; }
+		}
+		MEM_BlockWrite(buffer, &readBuffer[0], span * sectorSize);
+		buffer += span * sectorSize;
+		sector += span;
+		num -= span;
+	}
+	return true;
 }
 
 #ifdef C_DBP_ENABLE_IDE
@@ -487,7 +1038,9 @@ CDROM_Interface::atapi_res CDROM_Interface_Image::ReadSectorsAtapi(void* buffer,
 	if (track_num <= 0) return CDROM_Interface::ATAPI_ILLEGAL_MODE; // illegal request - illegal mode for this track
 	Track *t = &tracks[track_num - 1], *lastt = &tracks.back();
 
-	for (Bitu i = 0; i != num; i++, sector++, buf += readLength)
+	//DBP: Runs of sectors inside the same track are read at once (shared with ReadSectors)
+	enum { MAX_SPAN = 64 };
+	for (Bitu i = 0, span; i != num; i += span, sector += span, buf += span * readLength)
 	{
 		for (; sector >= t->start + t->length; t++)
 			if (t == lastt || (t + 1)->attr != t->attr)
@@ -524,49 +1077,62 @@ CDROM_Interface::atapi_res CDROM_Interface_Image::ReadSectorsAtapi(void* buffer,
 		if (!can_read || raw_off < 0 || readLength + off > t->sectorSize || buf + RAW_SECTOR_SIZE > bufEnd)
 			return CDROM_Interface::ATAPI_ILLEGAL_MODE; // illegal request - illegal mode for this track
 
+		span = (Bitu)(t->start + t->length) - sector;
+		if (span > num - i) span = num - i;
+		if (span > (Bitu)(bufEnd - buf - RAW_SECTOR_SIZE) / readLength + 1) span = (Bitu)(bufEnd - buf - RAW_SECTOR_SIZE) / readLength + 1;
+		if (span > MAX_SPAN) span = MAX_SPAN;
+
 		if (t_is_raw && !t->mode2)
 		{
-			if (!t->file->read(buf, seek, RAW_SECTOR_SIZE - off)) { DBP_ASSERT(false); return CDROM_Interface::ATAPI_ILLEGAL_MODE; } // illegal request - illegal mode for this track
+			const int len = RAW_SECTOR_SIZE - off;
+			if (readBuffer.size() < span * len) readBuffer.resize(span * len);
+			if (!t->file->readSectors(&readBuffer[0], seek, t->sectorSize, len, (int)span)) { DBP_ASSERT(false); return CDROM_Interface::ATAPI_ILLEGAL_MODE; } // illegal request - illegal mode for this track
 
-			#ifdef CDROM_VALIDATE_SECTOR_CRC // (slow + unoptimized) validation of CRC
-			if (!off)
+			for (Bitu j = 0; j != span; j++)
 			{
-				// validate crc
-				Bit32u invacc = 0, top = 0;
-				for (Bit32u i = 0; i < 2064 * 8 + 32; i++) {
-					top = invacc & 0x80000000;
-					invacc = (invacc << 1);
-					if (i < 2064 * 8)
-						invacc |= ((buf[i / 8] >> (i % 8)) & 1);
-					if (top)
-						invacc ^= 0x8001801b;
-				}
+				Bit8u *sec = &readBuffer[j * len];
+				memcpy(buf + j * readLength, sec, len);
 
-				Bit32u acc = 0;
-				for (Bit32u i = 0; i < 32; i++)
-					if (invacc & (1 << i))
-						acc |= 1 << (31 - i);
+				#ifdef CDROM_VALIDATE_SECTOR_CRC // (slow + unoptimized) validation of CRC
+				if (!off)
+				{
+					// validate crc
+					Bit32u invacc = 0, top = 0;
+					for (Bit32u i = 0; i < 2064 * 8 + 32; i++) {
+						top = invacc & 0x80000000;
+						invacc = (invacc << 1);
+						if (i < 2064 * 8)
+							invacc |= ((sec[i / 8] >> (i % 8)) & 1);
+						if (top)
+							invacc ^= 0x8001801b;
+					}
 
-				Bit8u chksum[] = { (Bit8u)((acc) & 0xFF), (Bit8u)((acc >> 8) & 0xFF), (Bit8u)((acc >> 16) & 0xFF), (Bit8u)((acc >> 24) & 0xFF) };
-				if (buf[2064] != chksum[0] || buf[2065] != chksum[1] || buf[2066] != chksum[2] || buf[2067] != chksum[3])
+					Bit32u acc = 0;
+					for (Bit32u i = 0; i < 32; i++)
+						if (invacc & (1 << i))
+							acc |= 1 << (31 - i);
+
+					Bit8u chksum[] = { (Bit8u)((acc) & 0xFF), (Bit8u)((acc >> 8) & 0xFF), (Bit8u)((acc >> 16) & 0xFF), (Bit8u)((acc >> 24) & 0xFF) };
+					if (sec[2064] != chksum[0] || sec[2065] != chksum[1] || sec[2066] != chksum[2] || sec[2067] != chksum[3])
+					{
+						DBP_ASSERT(sec[2068 - off]); // on failed checksum, this normally zero byte should also have some garbage in it
+						return CDROM_Interface::ATAPI_READ_ERROR; // medium error - unrecoverable read error
+					}
+				}
+				#endif
+
+				if (sec[2068 - off])
 				{
-					DBP_ASSERT(buf[2068 - off]); // on failed checksum, this normally zero byte should also have some garbage in it
+					// ECMA-130: The Intermediate field shall consist of 8 (00)-bytes recorded in positions 2068 to 2075
+					// We report a non-zero value as a sector read error. This is to satisfy copy protection checks which expect certain sectors to be bad.
+					// Some raw CD image formats represent bad sectors on the original media by filling up the entire sector beyond the header with a dummy byte like 0x55.
 					return CDROM_Interface::ATAPI_READ_ERROR; // medium error - unrecoverable read error
 				}
 			}
-			#endif
-
-			if (buf[2068 - off])
-			{
-				// ECMA-130: The Intermediate field shall consist of 8 (00)-bytes recorded in positions 2068 to 2075
-				// We report a non-zero value as a sector read error. This is to satisfy copy protection checks which expect certain sectors to be bad.
-				// Some raw CD image formats represent bad sectors on the original media by filling up the entire sector beyond the header with a dummy byte like 0x55.
-				return CDROM_Interface::ATAPI_READ_ERROR; // medium error - unrecoverable read error
-			}
 		}
 		else
 		{
-			if (!t->file->read(buf, seek, readLength)) { DBP_ASSERT(false); return CDROM_Interface::ATAPI_ILLEGAL_MODE; } // illegal request - illegal mode for this track
+			if (!t->file->readSectors(buf, seek, t->sectorSize, (int)readLength, (int)span)) { DBP_ASSERT(false); return CDROM_Interface::ATAPI_ILLEGAL_MODE; } // illegal request - illegal mode for this track
 		}
 	}
 	return CDROM_Interface::ATAPI_OK;
@@ -624,28 +1190,37 @@ bool CDROM_Interface_Image::ReadSector(Bit8u *buffer, bool raw, unsigned long se
 		attr: 0x40 - datasize:   2352 (RAW_SECTOR_SIZE)    - mode2: true  - cooked seek: 24  (!strcmp(Type, "MODE2_RAW")) (total seek: 24)
 	*/
 
-	int track = GetTrack(sector) - 1;
-	if (track < 0) return false;
+	int track = GetTrack(sector) - 1, off;
+	if (track < 0 || (off = GetSectorOffset(tracks[track], raw)) < 0) return false;
 	
-	int seek = tracks[track].skip + (sector - tracks[track].start) * tracks[track].sectorSize;
+	int seek = tracks[track].skip + (sector - tracks[track].start) * tracks[track].sectorSize + off;
 	int length = (raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE);
 #ifdef C_DBP_SUPPORT_CDROM_CHD_IMAGE
-	if (tracks[track].sectorSize < RAW_SECTOR_SIZE) { if (raw) return false; }
-	else { if (!tracks[track].mode2 && !raw) seek += 16; }
-	if (tracks[track].mode2 && !raw) seek += (tracks[track].sectorSize >= RAW_SECTOR_SIZE ? 24 : 8);
 	if (tracks[track].file->read(buffer, seek, length)) return true;
 	// Pre-gap areas between tracks stored in separate files can be beyond the file size, succeed and return a zeroed buffer instead of failing the read
 	memset(buffer, 0, length);
 	return true;
 #else
-	if (tracks[track].sectorSize != RAW_SECTOR_SIZE && raw) return false;
-	if (tracks[track].sectorSize == RAW_SECTOR_SIZE && !tracks[track].mode2 && !raw) seek += 16;
-	if (tracks[track].mode2 && !raw) seek += 24;
-
 	return tracks[track].file->read(buffer, seek, length);
 #endif
 }
 
+// Returns the offset of the requested data inside a stored sector of the track or -1 if it can't be read
+int CDROM_Interface_Image::GetSectorOffset(const Track &track, bool raw)
+{
+	int off = 0;
+#ifdef C_DBP_SUPPORT_CDROM_CHD_IMAGE
+	if (track.sectorSize < RAW_SECTOR_SIZE) { if (raw) return -1; }
+	else { if (!track.mode2 && !raw) off += 16; }
+	if (track.mode2 && !raw) off += (track.sectorSize >= RAW_SECTOR_SIZE ? 24 : 8);
+#else
+	if (track.sectorSize != RAW_SECTOR_SIZE && raw) return -1;
+	if (track.sectorSize == RAW_SECTOR_SIZE && !track.mode2 && !raw) off += 16;
+	if (track.mode2 && !raw) off += 24;
+#endif
+	return off;
+}
+
 //DBP: for restart
 void CDROM_Interface_Image::ShutDown()
 {
@@ -1141,6 +1716,235 @@ void CDROM_Interface_Image::ClearTracks()
 	tracks.clear();
 }
 
+#ifdef C_DBP_SUPPORT_CDROM_CHD_IMAGE
+// Decoders for the codecs used by compressed CHD CD images (cdzl and cdlz, cdfl uses CDFlacDecoder), deflate itself is handled by DriveInflate
+
+// Canonical huffman tree with 16 codes of up to 8 bits used to compress the hunk map
+struct ChdMapHuffman
+{
+	enum { NUM_CODES = 16, MAX_BITS = 8 };
+	Bit8u lookup_code[1 << MAX_BITS], lookup_len[1 << MAX_BITS];
+
+	bool Import(CDBitReader& br)
+	{
+		Bit8u lens[NUM_CODES];
+		for (Bit32u code = 0; code < NUM_CODES;)
+		{
+			Bit32u nodebits = br.Read(4);
+			if (nodebits != 1) { lens[code++] = (Bit8u)nodebits; continue; }
+			if ((nodebits = br.Read(4)) == 1) { lens[code++] = 1; continue; }
+			Bit32u repcount = br.Read(4) + 3;
+			if (code + repcount > NUM_CODES) return false;
+			for (; repcount; repcount--) lens[code++] = (Bit8u)nodebits;
+		}
+
+		// Assign canonical codes starting from the longest length
+		Bit32u starts[MAX_BITS + 1] = { 0 }, curstart = 0;
+		for (Bit32u code = 0; code != NUM_CODES; code++) { if (lens[code] > MAX_BITS) return false; starts[lens[code]]++; }
+		for (Bit32u codelen = MAX_BITS; codelen; codelen--)
+		{
+			Bit32u nextstart = ((curstart + starts[codelen]) >> 1);
+			if (codelen != 1 && nextstart * 2 != (curstart + starts[codelen])) return false;
+			starts[codelen] = curstart;
+			curstart = nextstart;
+		}
+
+		memset(lookup_len, 0, sizeof(lookup_len));
+		memset(lookup_code, 0, sizeof(lookup_code));
+		for (Bit32u code = 0; code != NUM_CODES; code++)
+		{
+			if (!lens[code]) continue;
+			Bit32u shift = MAX_BITS - lens[code], bits = starts[lens[code]]++;
+			memset(lookup_code + (bits << shift), (int)code, (size_t)1 << shift);
+			memset(lookup_len + (bits << shift), lens[code], (size_t)1 << shift);
+		}
+		return !br.Overflow();
+	}
+
+	INLINE Bit32u Decode(CDBitReader& br) { Bit32u i = (Bit32u)(br.Peek() >> (64 - MAX_BITS)); br.bitpos += lookup_len[i]; return lookup_code[i]; }
+};
+
+// Raw LZMA stream with fixed lc=3 lp=0 pb=2 properties and a known output size without end marker
+struct ChdLzmaDecoder
+{
+	enum { LC = 3, LP = 0, PB = 2, NUM_STATES = 12, POS_BITS_MAX = 4, LEN_TO_POS_STATES = 4, ALIGN_BITS = 4, END_POS_MODEL_INDEX = 14, FULL_DISTANCES = 1 << 7, MATCH_MIN_LEN = 2 };
+	typedef Bit16u Prob;
+	struct LenProbs { Prob choice, choice2, low[1 << POS_BITS_MAX][1 << 3], mid[1 << POS_BITS_MAX][1 << 3], high[1 << 8]; };
+	struct Probs
+	{
+		Prob lit[0x300 << (LC + LP)], pos_slot[LEN_TO_POS_STATES][1 << 6], pos[1 + FULL_DISTANCES - END_POS_MODEL_INDEX], align[1 << ALIGN_BITS];
+		Prob is_match[NUM_STATES << POS_BITS_MAX], is_rep[NUM_STATES], is_rep_g0[NUM_STATES], is_rep_g1[NUM_STATES], is_rep_g2[NUM_STATES], is_rep0_long[NUM_STATES << POS_BITS_MAX];
+		LenProbs len, rep_len;
+	} p;
+	const Bit8u *in, *in_end;
+	Bit32u range, code;
+
+	INLINE Bit32u DecodeBit(Prob* prob)
+	{
+		Bit32u v = *prob, bound = (range >> 11) * v, bit;
+		if (code < bound) { v += ((1 << 11) - v) >> 5; range = bound; bit = 0; }
+		else { v -= v >> 5; code -= bound; range -= bound; bit = 1; }
+		*prob = (Prob)v;
+		if (range < (1 << 24)) { range <<= 8; code = (code << 8) | (in != in_end ? *(in++) : 0); }
+		return bit;
+	}
+
+	Bit32u DecodeDirectBits(Bit32u bits)
+	{
+		Bit32u res = 0;
+		do
+		{
+			range >>= 1;
+			code -= range;
+			Bit32u t = 0 - (code >> 31);
+			code += range & t;
+			if (range < (1 << 24)) { range <<= 8; code = (code << 8) | (in != in_end ? *(in++) : 0); }
+			res = (res << 1) + (t + 1);
+		} while (--bits);
+		return res;
+	}
+
+	Bit32u BitTree(Prob* probs, Bit32u bits) { Bit32u m = 1; for (Bit32u i = 0; i != bits; i++) m = (m << 1) + DecodeBit(&probs[m]); return m - (1 << bits); }
+	Bit32u BitTreeReverse(Prob* probs, Bit32u bits) { Bit32u m = 1, res = 0; for (Bit32u i = 0; i != bits; i++) { Bit32u bit = DecodeBit(&probs[m]); m = (m << 1) + bit; res |= (bit << i); } return res; }
+
+	Bit32u DecodeLen(LenProbs& lp, Bit32u pos_state)
+	{
+		if (!DecodeBit(&lp.choice)) return BitTree(lp.low[pos_state], 3);
+		if (!DecodeBit(&lp.choice2)) return 8 + BitTree(lp.mid[pos_state], 3);
+		return 16 + BitTree(lp.high, 8);
+	}
+
+	bool Decode(const Bit8u* src, Bit32u srclen, Bit8u* dst, Bit32u dstlen)
+	{
+		if (srclen < 5 || src[0]) return false;
+		for (Prob *i = (Prob*)&p, *iEnd = (Prob*)(&p + 1); i != iEnd; i++) *i = (1 << 10);
+		in = src + 5;
+		in_end = src + srclen;
+		range = 0xFFFFFFFF;
+		code = ((Bit32u)src[1] << 24) | (src[2] << 16) | (src[3] << 8) | src[4];
+
+		Bit32u state = 0, rep0 = 0, rep1 = 0, rep2 = 0, rep3 = 0, pos = 0;
+		while (pos != dstlen)
+		{
+			const Bit32u pos_state = (pos & ((1 << PB) - 1));
+			if (!DecodeBit(&p.is_match[(state << POS_BITS_MAX) + pos_state]))
+			{
+				Prob* probs = &p.lit[0x300 * (((pos & ((1 << LP) - 1)) << LC) + ((pos ? dst[pos - 1] : 0) >> (8 - LC)))];
+				Bit32u symbol = 1;
+				if (state >= 7)
+				{
+					for (Bit32u match_byte = dst[pos - rep0 - 1]; symbol < 0x100; match_byte <<= 1)
+					{
+						Bit32u match_bit = ((match_byte >> 7) & 1), bit = DecodeBit(&probs[((1 + match_bit) << 8) + symbol]);
+						symbol = (symbol << 1) | bit;
+						if (match_bit != bit) break;
+					}
+				}
+				while (symbol < 0x100) symbol = (symbol << 1) | DecodeBit(&probs[symbol]);
+				dst[pos++] = (Bit8u)symbol;
+				state = (state < 4 ? 0 : (state < 10 ? state - 3 : state - 6));
+				continue;
+			}
+
+			Bit32u len;
+			if (DecodeBit(&p.is_rep[state]))
+			{
+				if (!pos) return false;
+				if (!DecodeBit(&p.is_rep_g0[state]))
+				{
+					if (!DecodeBit(&p.is_rep0_long[(state << POS_BITS_MAX) + pos_state]))
+					{
+						state = (state < 7 ? 9 : 11);
+						dst[pos] = dst[pos - rep0 - 1];
+						pos++;
+						continue;
+					}
+				}
+				else
+				{
+					Bit32u dist;
+					if (!DecodeBit(&p.is_rep_g1[state])) dist = rep1;
+					else
+					{
+						if (!DecodeBit(&p.is_rep_g2[state])) dist = rep2;
+						else { dist = rep3; rep3 = rep2; }
+						rep2 = rep1;
+					}
+					rep1 = rep0;
+					rep0 = dist;
+				}
+				len = DecodeLen(p.rep_len, pos_state);
+				state = (state < 7 ? 8 : 11);
+			}
+			else
+			{
+				rep3 = rep2; rep2 = rep1; rep1 = rep0;
+				len = DecodeLen(p.len, pos_state);
+				state = (state < 7 ? 7 : 10);
+				Bit32u pos_slot = BitTree(p.pos_slot[len < LEN_TO_POS_STATES - 1 ? len : LEN_TO_POS_STATES - 1], 6);
+				if (pos_slot < 4) rep0 = pos_slot;
+				else
+				{
+					Bit32u direct_bits = (pos_slot >> 1) - 1;
+					rep0 = ((2 | (pos_slot & 1)) << direct_bits);
+					if (pos_slot < END_POS_MODEL_INDEX) rep0 += BitTreeReverse(p.pos + rep0 - pos_slot, direct_bits);
+					else rep0 += (DecodeDirectBits(direct_bits - ALIGN_BITS) << ALIGN_BITS) + BitTreeReverse(p.align, ALIGN_BITS);
+				}
+				if (rep0 >= pos) return false; // also catches the end marker
+			}
+			len += MATCH_MIN_LEN;
+			if (len > dstlen - pos) return false;
+			for (Bit8u *d = dst + pos, *dEnd = d + len; d != dEnd; d++) *d = d[-(Bit32s)rep0 - 1];
+			pos += len;
+		}
+		return true;
+	}
+};
+
+// Regenerate sync header and P/Q error correction codes of a mode 1 or mode 2 form 1 sector which the CD codecs can strip
+static struct ChdEccTables
+{
+	Bit8u f[256], b[256];
+	ChdEccTables() { for (Bit32u i = 0; i != 256; i++) { Bit32u j = ((i << 1) ^ (i & 0x80 ? 0x11D : 0)); f[i] = (Bit8u)j; b[i ^ j] = (Bit8u)i; } }
+
+	void ComputeBlock(const Bit8u* src, Bit32u major_count, Bit32u minor_count, Bit32u major_mult, Bit32u minor_inc, Bit8u* dest) const
+	{
+		for (Bit32u major = 0, size = major_count * minor_count; major != major_count; major++)
+		{
+			Bit8u ecc_a = 0, ecc_b = 0;
+			for (Bit32u minor = 0, index = (major >> 1) * major_mult + (major & 1); minor != minor_count; minor++)
+			{
+				ecc_a = f[ecc_a ^ src[index]];
+				ecc_b ^= src[index];
+				if ((index += minor_inc) >= size) index -= size;
+			}
+			ecc_a = b[f[ecc_a] ^ ecc_b];
+			dest[major] = ecc_a;
+			dest[major + major_count] = (ecc_a ^ ecc_b);
+		}
+	}
+
+	void Generate(Bit8u* sector) const
+	{
+		static const Bit8u sync[12] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+		memcpy(sector, sync, 12);
+		Bit8u header[4];
+		const bool mode2 = (sector[15] == 2); // address header is not included in mode 2 ECC
+		if (mode2) { memcpy(header, sector + 12, 4); memset(sector + 12, 0, 4); }
+		ComputeBlock(sector + 0xC, 86, 24, 2, 86, sector + 0x81C);
+		ComputeBlock(sector + 0xC, 52, 43, 86, 88, sector + 0x8C8);
+		if (mode2) memcpy(sector + 12, header, 4);
+	}
+} chd_ecc;
+
+struct ChdDecoder
+{
+	ChdLzmaDecoder lzma;
+	CDFlacDecoder flac;
+	std::vector<Bit8u> buffer, comp;
+};
+#endif
+
 #ifdef C_DBP_SUPPORT_CDROM_CHD_IMAGE
 bool CDROM_Interface_Image::LoadChdFile(char* filename)
 {
@@ -1149,28 +1953,302 @@ bool CDROM_Interface_Image::LoadChdFile(char* filename)
 
 	enum { CHD_V5_HEADER_SIZE = 124, CHD_V5_UNCOMPMAPENTRYBYTES = 4, CD_MAX_SECTOR_DATA = 2352, CD_MAX_SUBCODE_DATA = 96, CD_FRAME_SIZE = CD_MAX_SECTOR_DATA + CD_MAX_SUBCODE_DATA };
 	enum { METADATA_HEADER_SIZE = 16, CDROM_TRACK_METADATA_TAG = 1128813650, CDROM_TRACK_METADATA2_TAG = 1128813618, CD_TRACK_PADDING = 4 };
+	enum { CHD_CODEC_ZLIB = 0x7a6c6962, CHD_CODEC_LZMA = 0x6c7a6d61, CHD_CODEC_CD_ZLIB = 0x63647a6c, CHD_CODEC_CD_LZMA = 0x63646c7a, CHD_CODEC_CD_FLAC = 0x6364666c };
 
 	struct ChdFile : public BinaryFile
 	{
-		ChdFile(const char *filename, bool &error) : BinaryFile(filename, error), hunkmap(NULL), cooked_sector_shift(0) { }
-		virtual ~ChdFile() { free(hunkmap); }
+		ChdFile(const char *filename, bool &error) : BinaryFile(filename, error), hunkmap(NULL), cooked_sector_shift(0), use_counter(0), last_hunk(NO_SLOT), used_slots(0), thread_state(THREAD_NONE) { }
+		virtual ~ChdFile()
+		{
+			free(hunkmap);
+			if (thread_state == THREAD_RUNNING)
+			{
+				mutex.Lock();
+				quit = true;
+				if (idle) { idle = false; wake.Post(); }
+				mutex.Unlock();
+				exited.Wait();
+			}
+			for (Slot& s : slots) free(s.data);
+		}
 		Bit32u *hunkmap;
 		int hunkbytes, cooked_sector_shift, audio_start;
 
+		// Compressed CHD files keep decompressed hunks in a LRU cache and decode the hunks following a sequential read on a worker thread
+		// Compressed data is always read on the emulation thread (file access can go through DOS drives), the worker thread only decodes
+		enum { HUNK_STORED = 4, CACHE_BYTES = 4*1024*1024, DECODE_AHEAD = 8, NO_SLOT = 0xFFFFFFFF };
+		enum { SLOT_FREE, SLOT_PENDING, SLOT_READY, SLOT_FAILED };
+		enum { THREAD_NONE, THREAD_RUNNING, THREAD_UNAVAILABLE };
+		struct Hunk { Bit32u offset, length; Bit8u codec; };
+		struct Slot { Bit32u hunk, last_use; Bit8u state; Bit8u *data; };
+		Bit32u codecs[4];
+		std::vector<Hunk> hunks;
+		std::vector<Slot> slots;
+		std::vector<Bit32u> hunk_slots;
+		Bit32u use_counter, last_hunk, used_slots;
+		ChdDecoder decoder, thread_decoder;
+		std::vector<Bit8u> jobs[DECODE_AHEAD];
+		Bit32u job_slots[DECODE_AHEAD];
+		std::vector<Bit32u> queue;
+		Mutex mutex;
+		Semaphore wake, finished, exited;
+		bool idle, quit, waiting;
+		Bit8u thread_state;
+
 		static Bit32u get_bigendian_uint32(const Bit8u *base) { return (base[0] << 24) | (base[1] << 16) | (base[2] << 8) | base[3]; }
 		static Bit64u get_bigendian_uint64(const Bit8u *base) { return ((Bit64u)base[0] << 56) | ((Bit64u)base[1] << 48) | ((Bit64u)base[2] << 40) | ((Bit64u)base[3] << 32) | ((Bit64u)base[4] << 24) | ((Bit64u)base[5] << 16) | ((Bit64u)base[6] << 8) | (Bit64u)base[7]; }
 
 		virtual bool read(Bit8u *buffer, int seek, int count)
 		{
 			DBP_ASSERT((seek / CD_FRAME_SIZE) == ((seek + count) / CD_FRAME_SIZE)); // read only inside one sector
-			const int hunk = (seek / hunkbytes), hunk_ofs = (seek % hunkbytes), hunk_pos = (int)hunkmap[hunk];
-			if (!hunk_pos) { memset(buffer, 0, count); return true; }
-			if (!BinaryFile::read(buffer, hunk_pos + hunk_ofs + (count == COOKED_SECTOR_SIZE ? cooked_sector_shift : 0), count)) return false;
+			const int hunk = (seek / hunkbytes), hunk_ofs = (seek % hunkbytes) + (count == COOKED_SECTOR_SIZE ? cooked_sector_shift : 0);
+			if (hunks.empty())
+			{
+				const int hunk_pos = (int)hunkmap[hunk];
+				if (!hunk_pos) { memset(buffer, 0, count); return true; }
+				if (!BinaryFile::read(buffer, hunk_pos + hunk_ofs, count)) return false;
+			}
+			else
+			{
+				const Bit8u* data = ((Bit32u)hunk < (Bit32u)hunks.size() ? GetHunk((Bit32u)hunk) : NULL);
+				if (!data) return false;
+				memcpy(buffer, data + hunk_ofs, count);
+				if ((Bit32u)hunk != last_hunk)
+				{
+					if ((Bit32u)hunk == last_hunk + 1) DecodeAhead((Bit32u)hunk);
+					last_hunk = (Bit32u)hunk;
+				}
+			}
 			if (seek >= audio_start) // CHD audio endian swap
 				for (Bit8u *p = buffer + (seek & 1), *pEnd = buffer + count, tmp; p < pEnd; p += 2)
 					{ tmp = p[0]; p[0] = p[1]; p[1] = tmp; }
 			return true;
 		}
+
+		virtual bool readSectors(Bit8u *buffer, int seek, int sectorSize, int count, int num)
+		{
+			return TrackFile::readSectors(buffer, seek, sectorSize, count, num); // sectors are interleaved with subcode data and each read handles the cooked data shift
+		}
+
+		bool ReadCompressedMap(int mapoffset, Bit32u hunkcount)
+		{
+			enum { TYPE_SELF = 5, TYPE_PARENT, TYPE_RLE_SMALL, TYPE_RLE_LARGE, TYPE_SELF_0, TYPE_SELF_1 };
+			Bit8u maphdr[16];
+			if (!BinaryFile::read(maphdr, mapoffset, sizeof(maphdr))) return false;
+			const Bit32u mapbytes = get_bigendian_uint32(&maphdr[0]), lengthbits = maphdr[12], selfbits = maphdr[13];
+			Bit64u curoffset = ((Bit64u)get_bigendian_uint32(&maphdr[4]) << 16) | (maphdr[8] << 8) | maphdr[9];
+			if (!mapbytes || mapbytes > 0x1000000 || lengthbits > 32 || selfbits > 32) return false;
+			std::vector<Bit8u> mapdata(mapbytes);
+			if (!BinaryFile::read(&mapdata[0], mapoffset + sizeof(maphdr), (int)mapbytes)) return false;
+
+			CDBitReader br(&mapdata[0], mapbytes);
+			ChdMapHuffman huffman;
+			if (!huffman.Import(br)) return false;
+			hunks.resize(hunkcount);
+			for (Bit32u i = 0, repcount = 0, lastcomp = 0; i != hunkcount; i++)
+			{
+				if (repcount) { repcount--; hunks[i].codec = (Bit8u)lastcomp; continue; }
+				Bit32u val = huffman.Decode(br);
+				if (val == TYPE_RLE_SMALL) repcount = 2 + huffman.Decode(br);
+				else if (val == TYPE_RLE_LARGE) { repcount = 2 + 16 + (huffman.Decode(br) << 4); repcount += huffman.Decode(br); }
+				else lastcomp = val;
+				hunks[i].codec = (Bit8u)lastcomp;
+			}
+
+			for (Bit32u i = 0, last_self = 0; i != hunkcount; i++)
+			{
+				Hunk& h = hunks[i];
+				switch (h.codec)
+				{
+					case 0: case 1: case 2: case 3: case HUNK_STORED:
+						if (h.codec != HUNK_STORED && !codecs[h.codec]) return false;
+						h.offset = (Bit32u)curoffset;
+						h.length = (h.codec == HUNK_STORED ? (Bit32u)hunkbytes : br.Read(lengthbits));
+						curoffset += h.length;
+						br.Read(16); // CRC-16 of the decompressed hunk
+						break;
+					case TYPE_SELF: case TYPE_SELF_0: case TYPE_SELF_1:
+						if (h.codec == TYPE_SELF) last_self = br.Read(selfbits);
+						else if (h.codec == TYPE_SELF_1) last_self++;
+						if (last_self >= i) return false;
+						h = hunks[last_self]; // already resolved
+						break;
+					default: return false; // parent references are not supported
+				}
+				if (curoffset > 0x7FFFFFFF) return false;
+			}
+			if (br.Overflow()) return false;
+
+			slots.resize(CACHE_BYTES / hunkbytes > DECODE_AHEAD * 2 + 2 ? CACHE_BYTES / hunkbytes : DECODE_AHEAD * 2 + 2);
+			for (Slot& s : slots) { s.hunk = NO_SLOT; s.state = SLOT_FREE; s.data = NULL; }
+			hunk_slots.resize(hunkcount, NO_SLOT);
+			for (Bit32u& js : job_slots) js = NO_SLOT;
+			return true;
+		}
+
+		bool DecodeHunk(ChdDecoder& dec, Bit8u codec, const Bit8u* src, Bit32u complen, Bit8u* dest) const
+		{
+			const Bit32u destlen = (Bit32u)hunkbytes;
+			switch (codecs[codec])
+			{
+				case CHD_CODEC_ZLIB: return DriveInflate(src, complen, dest, destlen);
+				case CHD_CODEC_LZMA: return dec.lzma.Decode(src, complen, dest, destlen);
+				case CHD_CODEC_CD_ZLIB: case CHD_CODEC_CD_LZMA: case CHD_CODEC_CD_FLAC: break;
+				default: return false;
+			}
+
+			// CD codecs store sector data and subcode data separately, sectors with the ECC bit set need to have their sync header and ECC restored
+			const Bit32u frames = destlen / CD_FRAME_SIZE, sector_bytes = frames * CD_MAX_SECTOR_DATA;
+			Bit32u subcode_ofs, ecc_bytes = 0;
+			dec.buffer.resize(destlen);
+			if (codecs[codec] == CHD_CODEC_CD_FLAC)
+			{
+				if (!dec.flac.Decode(src, complen, &dec.buffer[0], sector_bytes / 4, subcode_ofs)) return false;
+			}
+			else
+			{
+				const Bit32u complen_bytes = (destlen < 65536 ? 2 : 3), header_bytes = (ecc_bytes = (frames + 7) / 8) + complen_bytes;
+				if (complen < header_bytes) return false;
+				Bit32u complen_base = ((src[ecc_bytes] << 8) | src[ecc_bytes + 1]);
+				if (complen_bytes > 2) complen_base = ((complen_base << 8) | src[ecc_bytes + 2]);
+				if (header_bytes + complen_base > complen) return false;
+				if (!(codecs[codec] == CHD_CODEC_CD_ZLIB ? DriveInflate(src + header_bytes, complen_base, &dec.buffer[0], sector_bytes) : dec.lzma.Decode(src + header_bytes, complen_base, &dec.buffer[0], sector_bytes))) return false;
+				subcode_ofs = header_bytes + complen_base;
+			}
+			if (subcode_ofs > complen || !DriveInflate(src + subcode_ofs, complen - subcode_ofs, &dec.buffer[sector_bytes], destlen - sector_bytes)) return false;
+
+			for (Bit32u f = 0; f != frames; f++)
+			{
+				Bit8u* sector = dest + f * CD_FRAME_SIZE;
+				memcpy(sector, &dec.buffer[f * CD_MAX_SECTOR_DATA], CD_MAX_SECTOR_DATA);
+				memcpy(sector + CD_MAX_SECTOR_DATA, &dec.buffer[sector_bytes + f * CD_MAX_SUBCODE_DATA], CD_MAX_SUBCODE_DATA);
+				if (ecc_bytes && (src[f / 8] & (1 << (f % 8)))) chd_ecc.Generate(sector);
+			}
+			return true;
+		}
+
+		Bit32u AllocSlot(Bit32u hunk)
+		{
+			Bit32u s = NO_SLOT;
+			if (used_slots != (Bit32u)slots.size()) s = used_slots++;
+			else
+			{
+				if (thread_state == THREAD_RUNNING) mutex.Lock();
+				for (Bit32u i = 0, oldest = 0; i != used_slots; i++)
+				{
+					if (slots[i].state == SLOT_PENDING) continue;
+					Bit32u age = (slots[i].state == SLOT_FREE ? 0xFFFFFFFF : use_counter - slots[i].last_use);
+					if (s == NO_SLOT || age > oldest) { s = i; oldest = age; }
+				}
+				if (thread_state == THREAD_RUNNING) mutex.Unlock();
+				if (slots[s].hunk != NO_SLOT) hunk_slots[slots[s].hunk] = NO_SLOT;
+			}
+			Slot& slot = slots[s];
+			if (!slot.data) slot.data = (Bit8u*)malloc(hunkbytes);
+			slot.hunk = hunk;
+			slot.last_use = use_counter;
+			slot.state = SLOT_FREE;
+			hunk_slots[hunk] = s;
+			return s;
+		}
+
+		const Bit8u* GetHunk(Bit32u hunk)
+		{
+			Bit32u s = hunk_slots[hunk];
+			if (s != NO_SLOT && thread_state == THREAD_RUNNING)
+			{
+				mutex.Lock();
+				while (slots[s].state == SLOT_PENDING) { waiting = true; mutex.Unlock(); finished.Wait(); mutex.Lock(); }
+				mutex.Unlock();
+			}
+			if (s != NO_SLOT && slots[s].state != SLOT_READY) goto failed;
+			if (s == NO_SLOT)
+			{
+				s = AllocSlot(hunk);
+				const Hunk& h = hunks[hunk];
+				if (h.codec == HUNK_STORED)
+				{
+					if (!BinaryFile::read(slots[s].data, (int)h.offset, hunkbytes)) goto failed;
+				}
+				else
+				{
+					decoder.comp.resize(h.length + 1);
+					if (!BinaryFile::read(&decoder.comp[0], (int)h.offset, (int)h.length) || !DecodeHunk(decoder, h.codec, &decoder.comp[0], h.length, slots[s].data)) goto failed;
+				}
+				slots[s].state = SLOT_READY;
+			}
+			slots[s].last_use = ++use_counter;
+			return slots[s].data;
+
+			failed:
+			hunk_slots[hunk] = NO_SLOT;
+			slots[s].hunk = NO_SLOT;
+			slots[s].state = SLOT_FREE;
+			return NULL;
+		}
+
+		void DecodeAhead(Bit32u hunk)
+		{
+			if (thread_state == THREAD_NONE)
+			{
+				extern unsigned dbp_cpu_features_get_core_amount(void);
+				if (dbp_cpu_features_get_core_amount() <= 1) { thread_state = THREAD_UNAVAILABLE; return; }
+				idle = quit = waiting = false;
+				thread_state = THREAD_RUNNING;
+				Thread::StartDetached(DecodeThread, this);
+			}
+			if (thread_state != THREAD_RUNNING) return;
+			for (Bit32u h = hunk + 1, hEnd = (Bit32u)hunks.size(); h != hEnd && h <= hunk + DECODE_AHEAD; h++)
+			{
+				if (hunk_slots[h] != NO_SLOT || hunks[h].codec == HUNK_STORED) continue;
+				Bit32u j = 0;
+				mutex.Lock();
+				while (j != DECODE_AHEAD && job_slots[j] != NO_SLOT) j++;
+				mutex.Unlock();
+				if (j == DECODE_AHEAD) break; // all jobs in use
+
+				const Hunk& hk = hunks[h];
+				jobs[j].resize(hk.length + 1);
+				if (!BinaryFile::read(&jobs[j][0], (int)hk.offset, (int)hk.length)) break;
+				Bit32u s = AllocSlot(h);
+				mutex.Lock();
+				slots[s].state = SLOT_PENDING;
+				job_slots[j] = s;
+				queue.push_back(j);
+				if (idle) { idle = false; wake.Post(); }
+				mutex.Unlock();
+			}
+		}
+
+		static Thread::RET_t THREAD_CC DecodeThread(void* p)
+		{
+			ChdFile& f = *(ChdFile*)p;
+			f.mutex.Lock();
+			while (!f.quit)
+			{
+				if (f.queue.empty())
+				{
+					f.idle = true;
+					f.mutex.Unlock();
+					f.wake.Wait();
+					f.mutex.Lock();
+					continue;
+				}
+				Bit32u j = f.queue.front();
+				f.queue.erase(f.queue.begin());
+				Slot& s = f.slots[f.job_slots[j]];
+				const Hunk& h = f.hunks[s.hunk];
+				f.mutex.Unlock();
+				bool ok = f.DecodeHunk(f.thread_decoder, h.codec, &f.jobs[j][0], h.length, s.data);
+				f.mutex.Lock();
+				s.state = (ok ? SLOT_READY : SLOT_FAILED);
+				f.job_slots[j] = NO_SLOT;
+				if (f.waiting) { f.waiting = false; f.finished.Post(); }
+			}
+			f.mutex.Unlock();
+			f.exited.Post();
+			return 0;
+		}
 	};
 
 	bool not_chd;
@@ -1180,7 +2258,7 @@ bool CDROM_Interface_Image::LoadChdFile(char* filename)
 		err:
 		tracks.clear();
 		delete chd;
-		if (!not_chd) GFX_ShowMsg("Invalid or unsupported CHD file, must be an uncompressed version 5 CD image");
+		if (!not_chd) GFX_ShowMsg("Invalid or unsupported CHD file, must be a version 5 CD image without parent, either uncompressed or compressed with cdlz, cdzl or cdfl");
 		return false;
 	}
 
@@ -1192,7 +2270,14 @@ bool CDROM_Interface_Image::LoadChdFile(char* filename)
 	Bit32u hdr_length = ChdFile::get_bigendian_uint32(&rawheader[8]);
 	Bit32u hdr_version = ChdFile::get_bigendian_uint32(&rawheader[12]);
 	if (hdr_version != 5 || hdr_length != CHD_V5_HEADER_SIZE) goto err; // only ver 5 is supported
-	if (ChdFile::get_bigendian_uint32(&rawheader[16])) goto err; // compression is not supported
+	for (Bit32u i = 0; i != 4; i++)
+	{
+		switch ((chd->codecs[i] = ChdFile::get_bigendian_uint32(&rawheader[16 + i * 4])))
+		{
+			case 0: case CHD_CODEC_ZLIB: case CHD_CODEC_LZMA: case CHD_CODEC_CD_ZLIB: case CHD_CODEC_CD_LZMA: case CHD_CODEC_CD_FLAC: break;
+			default: goto err; // unsupported compression codec
+		}
+	}
 
 	// Make sure it's a CD image
 	DBP_STATIC_ASSERT(CD_MAX_SECTOR_DATA == RAW_SECTOR_SIZE);
@@ -1252,11 +2337,18 @@ bool CDROM_Interface_Image::LoadChdFile(char* filename)
 
 	DBP_STATIC_ASSERT(CHD_V5_UNCOMPMAPENTRYBYTES == sizeof(Bit32u));
 	Bit32u hunkcount = ((logicalbytes + chd->hunkbytes - 1) / chd->hunkbytes), sectorcount = (logicalbytes / CD_FRAME_SIZE);
-	chd->hunkmap = (Bit32u*)malloc(hunkcount * CHD_V5_UNCOMPMAPENTRYBYTES);
-
-	// Read hunk mapping and convert to file offsets
-	if (!chd->BinaryFile::read((Bit8u*)chd->hunkmap, (int)mapoffset, hunkcount * CHD_V5_UNCOMPMAPENTRYBYTES)) goto err;
-	for (Bit32u i = 0; i != hunkcount; i++) chd->hunkmap[i] = ChdFile::get_bigendian_uint32((Bit8u*)&chd->hunkmap[i]) * chd->hunkbytes;
+	if (chd->codecs[0])
+	{
+		// Read compressed hunk map with compression type, file offset and length of each hunk
+		if (!chd->ReadCompressedMap((int)mapoffset, hunkcount)) goto err;
+	}
+	else
+	{
+		// Read hunk mapping and convert to file offsets
+		chd->hunkmap = (Bit32u*)malloc(hunkcount * CHD_V5_UNCOMPMAPENTRYBYTES);
+		if (!chd->BinaryFile::read((Bit8u*)chd->hunkmap, (int)mapoffset, hunkcount * CHD_V5_UNCOMPMAPENTRYBYTES)) goto err;
+		for (Bit32u i = 0; i != hunkcount; i++) chd->hunkmap[i] = ChdFile::get_bigendian_uint32((Bit8u*)&chd->hunkmap[i]) * chd->hunkbytes;
+	}
 
 	// Now set physical start offsets for tracks and calculate CHD paddings. In CHD files tracks are padded to a to a 4-sector boundary.
 	// Thus we need to give ChdFile::read a means to figure out the padding that applies to the physical sector number it is reading.
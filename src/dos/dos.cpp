@@ -30,6 +30,7 @@
 #include "setup.h"
 #include "support.h"
 #include "serialport.h"
+#include "bios_disk.h"
 
 // DBP: Added exit check to support shutdown/restart
 extern bool DBP_IsShuttingDown();
@@ -104,6 +105,22 @@ static inline void modify_cycles(Bits /* value */) {
 	return;
 }
 #endif
+
+//DBP: Count file transfers per drive and wait for the modelled transfer time in accurate disk timing mode
+static void DOS_IOTiming(Bit16u entry, Bit16u amount, bool write) {
+	Bit8u handle = RealHandle(entry);
+	DOS_File* file = (handle < DOS_FILES ? Files[handle] : NULL);
+	Bit8u drive = (file ? file->GetDrive() : 0xff);
+	if (drive >= DOS_DRIVES) return; // device or invalid handle
+	extern bool MSCDEX_HasDrive(char driveLetter);
+	DBP_IODevice device = (MSCDEX_HasDrive((char)('A' + drive)) ? DBP_IODEV_CDROM : drive < 2 ? DBP_IODEV_FLOPPY : DBP_IODEV_HARDDISK);
+	Bit32u pos = 0;
+	if (dbp_iotiming == DBP_IOTIMING_ACCURATE) file->Seek(&pos, DOS_SEEK_CUR);
+	// The handle number separates the files on a drive so only continuing a read or write in the same file counts as sequential
+	double ms = DBP_IOTiming_Access(DBP_IOSTATS_DOS + drive, device, ((Bit64u)(handle + 1) << 32) + pos - amount, amount, write);
+	if (dbp_iotiming == DBP_IOTIMING_ACCURATE) DBP_IOTiming_Wait(ms);
+}
+
 #define DOS_OVERHEAD 1
 #ifdef DOS_OVERHEAD
 #ifndef DOSBOX_CPU_H
@@ -672,30 +689,36 @@ static Bitu DOS_21Handler(void) {
 		{ 
 			Bit16u toread=DOS_GetAmount();
 			dos.echo=true;
-			if (DOS_ReadFile(reg_bx,dos_copybuf,&toread)) {
-				MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
+			//DBP: Read directly into guest memory if it is plain RAM
+			HostPt direct=MEM_GetBlockHostPt(SegPhys(ds)+reg_dx,toread,true);
+			if (DOS_ReadFile(reg_bx,(direct ? direct : dos_copybuf),&toread)) {
+				if (!direct) MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
 				reg_ax=toread;
 				CALLBACK_SCF(false);
+				DOS_IOTiming(reg_bx,toread,false);
 			} else {
 				reg_ax=dos.errorcode;
 				CALLBACK_SCF(true);
 			}
-			modify_cycles(reg_ax);
+			if (dbp_iotiming == DBP_IOTIMING_DEFAULT) modify_cycles(reg_ax);
 			dos.echo=false;
 			break;
 		}
 	case 0x40:					/* WRITE Write to file or device */
 		{
 			Bit16u towrite=DOS_GetAmount();
-			MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
-			if (DOS_WriteFile(reg_bx,dos_copybuf,&towrite)) {
+			//DBP: Write directly from guest memory if it is plain RAM
+			HostPt direct=MEM_GetBlockHostPt(SegPhys(ds)+reg_dx,towrite,false);
+			if (!direct) MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
+			if (DOS_WriteFile(reg_bx,(direct ? direct : dos_copybuf),&towrite)) {
 				reg_ax=towrite;
 	   			CALLBACK_SCF(false);
+				DOS_IOTiming(reg_bx,towrite,true);
 			} else {
 				reg_ax=dos.errorcode;
 				CALLBACK_SCF(true);
 			}
-			modify_cycles(reg_ax);
+			if (dbp_iotiming == DBP_IOTIMING_DEFAULT) modify_cycles(reg_ax);
 			break;
 		};
 	case 0x41:					/* UNLINK Delete file */
@@ -477,6 +477,12 @@ bool DOS_FlushFile(Bit16u entry) {
 		return false;
 	};
 	LOG(LOG_DOSMISC,LOG_NORMAL)("FFlush used.");
+	//DBP: Commit data that is still being written out in the background
+	localFile* lf = dynamic_cast<localFile*>(Files[handle]);
+	if (lf && !lf->Flush()) {
+		DOS_SetError(DOSERR_WRITE_FAULT);
+		return false;
+	}
 	return true;
 }
 
@@ -1417,6 +1423,12 @@ void DBPSerialize_Files(DBPArchive& ar)
 			seekPos = 0;
 			if (drive >= DOS_DRIVES) devnum = (Bit8u)dynamic_cast<DOS_Device*>(Files[i])->GetDeviceNumber();
 			else if (refCtr) Files[i]->Seek(&seekPos, DOS_SEEK_CUR);
+			if (ar.mode == DBPArchive::MODE_SAVE && refCtr && drive < DOS_DRIVES)
+			{
+				// make sure data written in the background has reached the host file when saving
+				localFile* lf = dynamic_cast<localFile*>(Files[i]);
+				if (lf) lf->Flush();
+			}
 		}
 
 		ar << i << drive << name_len << flags << attr << refCtr << seekPos;
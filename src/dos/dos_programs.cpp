@@ -1382,6 +1382,38 @@ static void RESCAN_ProgramStart(Program * * make) {
 	*make=new RESCAN;
 }
 
+#ifdef C_DBP_SUPPORT_DISK_MOUNT_DOSFILE
+// VHDCOMP
+// Drops all blocks of a mounted writable sparse VHD image that contain only zeros and shrinks the file
+
+class VHDCOMP : public Program {
+public:
+	void Run(void);
+};
+
+void VHDCOMP::Run(void)
+{
+	if (!cmd->FindCommand(1,temp_line) || temp_line.size() != 2 || temp_line[1] != ':') {
+		WriteOut(MSG_Get("PROGRAM_VHDCOMP_SHOWHELP"));
+		return;
+	}
+	Bit8u drive = (Bit8u)(toupper(temp_line[0]) - 'A');
+	imageDisk* disk = NULL;
+	if (drive < MAX_DISK_IMAGES && imageDiskList[drive]) disk = imageDiskList[drive];
+	else if (drive < DOS_DRIVES && Drives[drive] && dynamic_cast<fatDrive*>(Drives[drive])) disk = ((fatDrive*)Drives[drive])->loadedDisk;
+	Bit64u freed;
+	if (!disk || !disk->CompactVHD(&freed)) {
+		WriteOut(MSG_Get("PROGRAM_VHDCOMP_NOT_VHD"), temp_line[0]);
+		return;
+	}
+	WriteOut(MSG_Get("PROGRAM_VHDCOMP_SUCCESS"), (Bit32u)(freed / 1024));
+}
+
+static void VHDCOMP_ProgramStart(Program * * make) {
+	*make=new VHDCOMP;
+}
+#endif
+
 #ifdef C_DBP_ENABLE_INTROPROGRAM
 class INTRO : public Program {
 public:
@@ -1971,6 +2003,11 @@ void DOS_SetupPrograms(void) {
 	MSG_Add("MSCDEX_UNKNOWN_ERROR","MSCDEX: Failure: Unknown error.\n");
 
 	MSG_Add("PROGRAM_RESCAN_SUCCESS","Drive cache cleared.\n");
+#ifdef C_DBP_SUPPORT_DISK_MOUNT_DOSFILE
+	MSG_Add("PROGRAM_VHDCOMP_SHOWHELP","Drops blocks that contain only zeros from a mounted sparse VHD disk image and shrinks the file.\n\n\033[32;1mVHDCOMP\033[0m drive:\n");
+	MSG_Add("PROGRAM_VHDCOMP_NOT_VHD","Drive %c: is not a mounted writable sparse VHD disk image.\n");
+	MSG_Add("PROGRAM_VHDCOMP_SUCCESS","Compacted disk image, freed %u KB.\n");
+#endif
 
 #ifdef C_DBP_ENABLE_INTROPROGRAM
 	MSG_Add("PROGRAM_INTRO",
@@ -2141,6 +2178,9 @@ void DOS_SetupPrograms(void) {
 	PROGRAMS_MakeFile("MEM.COM",MEM_ProgramStart);
 	PROGRAMS_MakeFile("LOADFIX.COM",LOADFIX_ProgramStart);
 	PROGRAMS_MakeFile("RESCAN.COM",RESCAN_ProgramStart);
+#ifdef C_DBP_SUPPORT_DISK_MOUNT_DOSFILE
+	PROGRAMS_MakeFile("VHDCOMP.COM",VHDCOMP_ProgramStart);
+#endif
 #ifdef C_DBP_ENABLE_INTROPROGRAM
 	PROGRAMS_MakeFile("INTRO.COM",INTRO_ProgramStart);
 #endif
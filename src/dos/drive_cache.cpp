@@ -38,7 +38,73 @@
 #include <os2.h>
 #endif
 
-int fileInfoCounter = 0;
+#if defined (__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#if defined (WIN32) || defined (OS2)
+static const bool cacheFoldCase = true;
+#else
+static const bool cacheFoldCase = false;
+#endif
+
+//DBP: Added hash maps by name to the directory contents, lookups used to do binary or linear searches and filling a
+//     directory inserted each entry into a sorted vector which made caching in a large directory very slow
+typedef ValueEqualHashMap<DOS_Drive_Cache::CFileInfo*> CacheNameMap;
+
+class DOS_Drive_Cache::CFileInfo {
+public:
+	CFileInfo(void) {
+		orgname[0] = shortname[0] = 0;
+		isDir = false;
+#ifdef C_DBP_NATIVE_OVERLAY
+		isOverlayDir = false;
+#endif
+		wineHashed = false;
+		id = MAX_OPENDIRS;
+		watchID = -1;
+		nextEntry = shortNr = 0;
+	}
+	~CFileInfo(void) {
+		for (Bit32u i=0; i<fileList.size(); i++) delete fileList[i];
+		for (Bit32u i=0; i<keptList.size(); i++) delete keptList[i];
+	};
+	char		orgname		[CROSS_LEN];
+	char		shortname	[DOS_NAMELENGTH_ASCII];
+#ifdef C_DBP_NATIVE_OVERLAY
+	bool		isOverlayDir;
+#endif
+	bool		isDir;
+	bool		wineHashed;
+	Bit16u		id;
+	int		watchID;
+	Bitu		nextEntry;
+	Bitu		shortNr;
+	// contents
+	std::vector<CFileInfo*>	fileList;
+	std::vector<CFileInfo*>	longNameList;
+	CacheNameMap	shortNames; // all of fileList
+	CacheNameMap	longNames;  // entries in longNameList by orgname
+	CacheNameMap	wineNames;  // built on first use of a Wine style short name
+	// entries with generated short names from before the directory got cached out, they get the same short name again
+	std::vector<CFileInfo*>	keptList;
+	CacheNameMap	keptNames;
+};
+
+static Bit32u CacheNameHash(const char* name, bool foldCase = false) {
+	Bit32u hash = (Bit32u)0x811c9dc5;
+	for (; *name; name++) hash = ((hash * (Bit32u)0x01000193) ^ (Bit32u)(Bit8u)(foldCase ? tolower(*name) : *name));
+	return hash;
+}
+
+static bool CacheShortNameEq(const bool&, DOS_Drive_Cache::CFileInfo* const& info, const char* const& name) {
+	return !strcmp(info->shortname, name);
+}
+
+static bool CacheOrgNameEq(const bool& foldCase, DOS_Drive_Cache::CFileInfo* const& info, const char* const& name) {
+	return !(foldCase ? strcasecmp(info->orgname, name) : strcmp(info->orgname, name));
+}
 
 bool SortByName(DOS_Drive_Cache::CFileInfo* const &a, DOS_Drive_Cache::CFileInfo* const &b) {
 	return strcmp(a->shortname,b->shortname)<0;
@@ -62,6 +128,7 @@ bool SortByDirNameRev(DOS_Drive_Cache::CFileInfo* const &a, DOS_Drive_Cache::CFi
 
 DOS_Drive_Cache::DOS_Drive_Cache(void) {
 	dirBase			= new CFileInfo;
+	watchFd			= -1;
 	save_dir		= 0;
 	srchNr			= 0;
 	basePath[0]		= 0;
@@ -72,6 +139,7 @@ DOS_Drive_Cache::DOS_Drive_Cache(void) {
 
 DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Label& label) {
 	dirBase			= new CFileInfo;
+	watchFd			= -1;
 	save_dir		= 0;
 	srchNr			= 0;
 	basePath[0]		= 0;
@@ -84,6 +152,9 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Label& label) {
 DOS_Drive_Cache::~DOS_Drive_Cache(void) {
 	Clear();
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { DeleteFileInfo(dirFindFirst[i]); dirFindFirst[i]=0; };
+#if defined (__linux__)
+	if (watchFd >= 0) close(watchFd);
+#endif
 }
 
 void DOS_Drive_Cache::Clear(void) {
@@ -211,19 +282,16 @@ void DOS_Drive_Cache::AddEntry(const char* path, bool checkExists) {
 		strcpy(file,pos+1);	
 		// Check if file already exists, then don't add new entry...
 		if (checkExists) {
-			if (GetLongName(dir,file)>=0) return;
+			if (GetLongName(dir,file)) return;
 		}
 
-		CreateEntry(dir,file,false);
+		CFileInfo* info = CreateEntry(dir,file,false);
 
-		Bits index = GetLongName(dir,file);
-		if (index>=0) {
-			Bit32u i;
-			// Check if there are any open search dir that are affected by this...
-			if (dir) for (i=0; i<MAX_OPENDIRS; i++) {
-				if ((dirSearch[i]==dir) && ((Bit32u)index<=dirSearch[i]->nextEntry)) 
-					dirSearch[i]->nextEntry++;
-			}
+		Bit32u i, index = (Bit32u)(std::lower_bound(dir->fileList.begin(), dir->fileList.end(), info, SortByName) - dir->fileList.begin());
+		// Check if there are any open search dir that are affected by this...
+		for (i=0; i<MAX_OPENDIRS; i++) {
+			if ((dirSearch[i]==dir) && (index<=dirSearch[i]->nextEntry)) 
+				dirSearch[i]->nextEntry++;
 		}
 		//		LOG_DEBUG("DIR: Added Entry %s",path);
 	} else {
@@ -261,10 +329,9 @@ void DOS_Drive_Cache::AddEntryDirOverlay(const char* path, bool checkExists) {
 		strcpy(file,pos + 1);	
 		// Check if directory already exists, then don't add new entry...
 		if (checkExists) {
-			Bits index = GetLongName(dir,file);
-			if (index >= 0) {
+			if (CFileInfo* existing = GetLongName(dir,file)) {
 				//directory already exists, but most likely empty. 
-				dir = dir->fileList[index];
+				dir = existing;
 				if (dir->isOverlayDir && dir->fileList.empty()) {
 					//maybe care about searches ? but this function should only run on cache inits/refreshes.
 					//add dot entries
@@ -275,19 +342,18 @@ void DOS_Drive_Cache::AddEntryDirOverlay(const char* path, bool checkExists) {
 			}
 		}
 
-		CreateEntry(dir,file,true);
+		CFileInfo* info = CreateEntry(dir,file,true);
 		
 
-		Bits index = GetLongName(dir,file);
-		if (index>=0) {
-			Bit32u i;
+		{
+			Bit32u i, index = (Bit32u)(std::lower_bound(dir->fileList.begin(), dir->fileList.end(), info, SortByName) - dir->fileList.begin());
 			// Check if there are any open search dir that are affected by this...
-			if (dir) for (i=0; i<MAX_OPENDIRS; i++) {
-				if ((dirSearch[i]==dir) && ((Bit32u)index<=dirSearch[i]->nextEntry)) 
+			for (i=0; i<MAX_OPENDIRS; i++) {
+				if ((dirSearch[i]==dir) && (index<=dirSearch[i]->nextEntry)) 
 					dirSearch[i]->nextEntry++;
 			}
 
-			dir = dir->fileList[index];
+			dir = info;
 			dir->isOverlayDir = true;
 			CreateEntry(dir,".",true);
 			CreateEntry(dir,"..",true);
@@ -335,15 +401,37 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 	}
 
 //	LOG_DEBUG("DIR: Caching out %s : dir %s",expand,dir->orgname);
+	ClearDir(dir);
+}
+
+void DOS_Drive_Cache::ClearDir(CFileInfo* dir) {
+	// forget names kept from the previous time this directory got cached out
+	for(Bit32u i=0; i<dir->keptList.size(); i++) delete dir->keptList[i];
+	dir->keptList.clear();
+	dir->keptNames.Clear();
 	// delete file objects...
 	//Maybe check if it is a file and then only delete the file and possibly the long name. instead of all objects in the dir.
 	for(Bit32u i=0; i<dir->fileList.size(); i++) {
-		if (dirSearch[srchNr]==dir->fileList[i]) dirSearch[srchNr] = 0;
-		DeleteFileInfo(dir->fileList[i]); dir->fileList[i] = 0;
+		CFileInfo* info = dir->fileList[i];
+		if (dirSearch[srchNr]==info) dirSearch[srchNr] = 0;
+		if (info->shortNr) {
+			// keep generated short names so they don't change when the directory gets cached in again
+			CFileInfo* kept = new CFileInfo;
+			strcpy(kept->orgname, info->orgname);
+			strcpy(kept->shortname, info->shortname);
+			kept->shortNr = info->shortNr;
+			dir->keptList.push_back(kept);
+			dir->keptNames.Put(CacheNameHash(kept->orgname, cacheFoldCase), CacheOrgNameEq, cacheFoldCase, kept->orgname, kept);
+		}
+		DeleteFileInfo(info); dir->fileList[i] = 0;
 	}
 	// clear lists
 	dir->fileList.clear();
 	dir->longNameList.clear();
+	dir->shortNames.Clear();
+	dir->longNames.Clear();
+	dir->wineNames.Clear();
+	dir->wineHashed = false;
 	save_dir = 0;
 }
 
@@ -364,21 +452,11 @@ bool DOS_Drive_Cache::GetShortName(const char* fullname, char* shortname) {
 	const char* pos = strrchr(fullname,CROSS_FILESPLIT);
 	if (pos) pos++; else return false;
 
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-	if (GCC_UNLIKELY(filelist_size<=0)) return false;
-
-	// The orgname part of the list is not sorted (shortname is)! So we can only walk through it.
-	for(Bitu i = 0; i < filelist_size; i++) {
-#if defined (WIN32) || defined (OS2)                        /* Win 32 & OS/2*/
-		if (strcasecmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#else
-		if (strcmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#endif
-			strcpy(shortname,curDir->longNameList[i]->shortname);
-			return true;
-		}
-	}
-	return false;
+	// Only entries in longNameList are in this map, others have no separate short name
+	CFileInfo** found = curDir->longNames.Get(CacheNameHash(pos, cacheFoldCase), CacheOrgNameEq, cacheFoldCase, pos);
+	if (!found) return false;
+	strcpy(shortname,(*found)->shortname);
+	return true;
 }
 
 int DOS_Drive_Cache::CompareShortname(const char* compareName, const char* shortName) {
@@ -419,23 +497,16 @@ Bitu DOS_Drive_Cache::CreateShortNameID(CFileInfo* curDir, const char* name) {
 	Bitu foundNr	= 0;	
 	Bits low		= 0;
 	Bits high		= (Bits)(filelist_size-1);
-	Bits mid, res;
+	Bits mid;
 
+	//DBP: Search for the last entry with the same x chars directly instead of walking through all of them
 	while (low<=high) {
 		mid = (low+high)/2;
-		res = CompareShortname(name,curDir->longNameList[mid]->shortname);
-		
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; 
-		else {
-			// any more same x chars in next entries ?	
-			do {
-				foundNr = curDir->longNameList[mid]->shortNr;
-				mid++;
-			} while((Bitu)mid<curDir->longNameList.size() && (CompareShortname(name,curDir->longNameList[mid]->shortname)==0));
-			break;
-		};
+		if (CompareShortname(name,curDir->longNameList[mid]->shortname)<0) high = mid-1;
+		else low = mid+1;
 	}
+	if (high>=0 && CompareShortname(name,curDir->longNameList[high]->shortname)==0)
+		foundNr = curDir->longNameList[high]->shortNr;
 	return foundNr+1;
 }
 
@@ -505,43 +576,58 @@ static Bits wine_hash_short_file_name( char* name, char* buffer )
 }
 #endif
 
-Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->fileList.size();
-	if (GCC_UNLIKELY(filelist_size<=0)) return -1;
+#if WINE_DRIVE_SUPPORT
+static bool CacheWineNameEq(const bool&, DOS_Drive_Cache::CFileInfo* const& info, const char* const& name) {
+	char buff[CROSS_LEN];
+	buff[wine_hash_short_file_name(info->orgname,buff)] = 0;
+	return !strcmp(buff, name);
+}
+
+static void CacheWineNamePut(CacheNameMap& wineNames, DOS_Drive_Cache::CFileInfo* info) {
+	char buff[CROSS_LEN];
+	buff[wine_hash_short_file_name(info->orgname,buff)] = 0;
+	const char* name = buff;
+	Bit32u hash = CacheNameHash(buff);
+	if (!wineNames.Get(hash, CacheWineNameEq, cacheFoldCase, name)) wineNames.Put(hash, CacheWineNameEq, cacheFoldCase, name, info);
+}
+#endif
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
+	if (GCC_UNLIKELY(curDir->fileList.empty())) return NULL;
 
 	// Remove dot, if no extension...
 	RemoveTrailingDot(shortName);
-	// Search long name and return array number of element
-	Bits low	= 0;
-	Bits high	= (Bits)(filelist_size-1);
-	Bits mid,res;
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = strcmp(shortName,curDir->fileList[mid]->shortname);
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; else
-		{	// Found
-			strcpy(shortName,curDir->fileList[mid]->orgname);
-			return mid;
-		};
-	}
-#ifdef WINE_DRIVE_SUPPORT
-	if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return -1; // not available
-	// else it's most likely a Wine style short name ABCD~###, # = not dot  (length at least 8) 
-	// The above test is rather strict as the following loop can be really slow if filelist_size is large.
-	char buff[CROSS_LEN];
-	for (Bitu i = 0; i < filelist_size; i++) {
-		res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
-		buff[res] = 0;
-		if (!strcmp(shortName,buff)) {	
-			// Found
-			strcpy(shortName,curDir->fileList[i]->orgname);
-			return (Bits)i;
+	// Search long name and return its entry
+	const char* name = shortName;
+	CFileInfo** found = curDir->shortNames.Get(CacheNameHash(name), CacheShortNameEq, cacheFoldCase, name);
+#if WINE_DRIVE_SUPPORT
+	if (!found) {
+		if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return NULL; // not available
+		// else it's most likely a Wine style short name ABCD~###, # = not dot  (length at least 8) 
+		// The hashes of all entries are generated once on first use and then kept up to date while the directory stays cached in
+		if (!curDir->wineHashed) {
+			for (Bitu i = 0; i < curDir->fileList.size(); i++) CacheWineNamePut(curDir->wineNames, curDir->fileList[i]);
+			curDir->wineHashed = true;
 		}
+		found = curDir->wineNames.Get(CacheNameHash(name), CacheWineNameEq, cacheFoldCase, name);
 	}
 #endif
-	// not available
-	return -1;
+	if (!found) return NULL; // not available
+	strcpy(shortName,(*found)->orgname);
+	return *found;
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindOrgName(CFileInfo* curDir, const char* name) {
+	// Entries with a generated short name are in longNames, others are found by their upper case short name
+	CFileInfo** found = curDir->longNames.Get(CacheNameHash(name, cacheFoldCase), CacheOrgNameEq, cacheFoldCase, name);
+	if (found) return *found;
+	char shortName[CROSS_LEN];
+	safe_strncpy(shortName, name, CROSS_LEN);
+	upcase(shortName);
+	RemoveTrailingDot(shortName);
+	const char* sname = shortName;
+	found = curDir->shortNames.Get(CacheNameHash(sname), CacheShortNameEq, cacheFoldCase, sname);
+	return ((found && CacheOrgNameEq(cacheFoldCase, *found, name)) ? *found : NULL);
 }
 
 bool DOS_Drive_Cache::RemoveSpaces(char* str) {
@@ -588,10 +674,18 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 	if (!createShort) {
 		char buffer[CROSS_LEN];
 		strcpy(buffer,tmpName);
-		createShort = (GetLongName(curDir,buffer)>=0);
+		createShort = (GetLongName(curDir,buffer)!=NULL);
 	}
 
-	if (createShort) {
+	CFileInfo** kept;
+	if (createShort && (kept = curDir->keptNames.Get(CacheNameHash(info->orgname, cacheFoldCase), CacheOrgNameEq, cacheFoldCase, info->orgname)) != NULL
+		&& !curDir->shortNames.Get(CacheNameHash((*kept)->shortname), CacheShortNameEq, cacheFoldCase, (*kept)->shortname)) {
+		// Use the same short name as before the directory got cached out
+		strcpy(info->shortname,(*kept)->shortname);
+		info->shortNr = (*kept)->shortNr;
+		curDir->longNameList.insert(std::upper_bound(curDir->longNameList.begin(), curDir->longNameList.end(), info, SortByName), info);
+		curDir->longNames.Put(CacheNameHash(info->orgname, cacheFoldCase), CacheOrgNameEq, cacheFoldCase, info->orgname, info);
+	} else if (createShort) {
 		// Create number
 		char buffer[8];
 		info->shortNr = CreateShortNameID(curDir,tmpName);
@@ -616,28 +710,8 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 		}
 
 		// keep list sorted for CreateShortNameID to work correctly
-		if (curDir->longNameList.size()>0) {
-			if (!(strcmp(info->shortname,curDir->longNameList.back()->shortname)<0)) {
-				// append at end of list
-				curDir->longNameList.push_back(info);
-			} else {
-				// look for position where to insert this element
-				bool found=false;
-				std::vector<CFileInfo*>::iterator it;
-				for (it=curDir->longNameList.begin(); it!=curDir->longNameList.end(); ++it) {
-					if (strcmp(info->shortname,(*it)->shortname)<0) {
-						found = true;
-						break;
-					}
-				}
-				// Put it in longname list...
-				if (found) curDir->longNameList.insert(it,info);
-				else curDir->longNameList.push_back(info);
-			}
-		} else {
-			// empty file list, append
-			curDir->longNameList.push_back(info);
-		}
+		curDir->longNameList.insert(std::upper_bound(curDir->longNameList.begin(), curDir->longNameList.end(), info, SortByName), info);
+		curDir->longNames.Put(CacheNameHash(info->orgname, cacheFoldCase), CacheOrgNameEq, cacheFoldCase, info->orgname, info);
 	} else {
 		strcpy(info->shortname,tmpName);
 	}
@@ -655,6 +729,8 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 	CFileInfo*	curDir = dirBase;
 	Bit16u		id;
 
+	PollChanges();
+
 	if (save_dir && (strcmp(path,save_path)==0)) {
 		strcpy(expandedPath,save_expanded);
 		return save_dir;
@@ -689,7 +765,7 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 		else	 { strcpy(dir,start); };
  
 		// Path found
-		Bits nextDir = GetLongName(curDir,dir);
+		CFileInfo* nextDir = GetLongName(curDir,dir);
 		strcat(expandedPath,dir);
 
 		// Error check
@@ -698,8 +774,8 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 		};
 */
 		// Follow Directory
-		if ((nextDir>=0) && curDir->fileList[nextDir]->isDir) {
-			curDir = curDir->fileList[nextDir];
+		if (nextDir && nextDir->isDir) {
+			curDir = nextDir;
 			strcpy (curDir->orgname,dir);
 			if (!IsCachedIn(curDir)) {
 				if (OpenDir(curDir,expandedPath,id)) {
@@ -770,39 +846,28 @@ bool DOS_Drive_Cache::OpenDir(CFileInfo* dir, const char* expand, Bit16u& id) {
 	return false;
 }
 
-void DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_directory) {
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_directory, bool keepSorted) {
 	CFileInfo* info = new CFileInfo;
 	strcpy(info->orgname, name);				
 	info->shortNr = 0;
 	info->isDir = is_directory;
+	InsertEntry(dir, info, keepSorted);
+	return info;
+}
 
+void DOS_Drive_Cache::InsertEntry(CFileInfo* dir, CFileInfo* info, bool keepSorted) {
 	// Check for long filenames...
 	CreateShortName(dir, info);		
 
-	bool found = false;
-
-	// keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
-	if (dir->fileList.size()>0) {
-		if (!(strcmp(info->shortname,dir->fileList.back()->shortname)<0)) {
-			// append at end of list
-			dir->fileList.push_back(info);
-		} else {
-			// look for position where to insert this element
-			std::vector<CFileInfo*>::iterator it;
-			for (it=dir->fileList.begin(); it!=dir->fileList.end(); ++it) {
-				if (strcmp(info->shortname,(*it)->shortname)<0) {
-					found = true;
-					break;
-				}
-			}
-			// Put file in lists
-			if (found) dir->fileList.insert(it,info);
-			else dir->fileList.push_back(info);
-		}
-	} else {
-		// empty file list, append
-		dir->fileList.push_back(info);
-	}
+	const char* name = info->shortname;
+	dir->shortNames.Put(CacheNameHash(name), CacheShortNameEq, cacheFoldCase, name, info);
+#if WINE_DRIVE_SUPPORT
+	if (dir->wineHashed) CacheWineNamePut(dir->wineNames, info);
+#endif
+
+	// keep list sorted (for SetResult), when filling a whole directory the list gets sorted once at the end instead
+	if (keepSorted) dir->fileList.insert(std::upper_bound(dir->fileList.begin(), dir->fileList.end(), info, SortByName), info);
+	else dir->fileList.push_back(info);
 }
 
 void DOS_Drive_Cache::CopyEntry(CFileInfo* dir, CFileInfo* from) {
@@ -830,19 +895,40 @@ bool DOS_Drive_Cache::ReadDir(Bit16u id, char* &result) {
 			}
 			return false;
 		}
+		//DBP: Make sure "." and ".." exist in directories (some Linux filesystems don't report them)
+		//DBP: Make sure "." and ".." doesn't exist in the drive root
+		CFileInfo* dir = dirSearch[id];
+		const bool isroot = (strlen(dirPath) == strlen(basePath));
+		bool founddot = false, founddotdot = false;
+
 		// Read complete directory
 		char dir_name[CROSS_LEN];
 		bool is_directory;
-		if (read_directory_first(dirp, dir_name, is_directory)) {
-			CreateEntry(dirSearch[id], dir_name, is_directory);
-			while (read_directory_next(dirp, dir_name, is_directory)) {
-				CreateEntry(dirSearch[id], dir_name, is_directory);
+		std::vector<CFileInfo*> later;
+		for (bool more = read_directory_first(dirp, dir_name, is_directory); more; more = read_directory_next(dirp, dir_name, is_directory)) {
+			if (dir_name[0] == '.' && (dir_name[1] == '\0' || (dir_name[1] == '.' && dir_name[2] == '\0'))) {
+				if (dir_name[1] == '\0') founddot = true; else founddotdot = true;
+				if (isroot) continue; // skip superfluous entry
 			}
+			CFileInfo* info = new CFileInfo;
+			strcpy(info->orgname, dir_name);
+			info->isDir = is_directory;
+			// entries that had a generated short name before get it back before new entries can take it
+			if (dir->keptList.size() && !dir->keptNames.Get(CacheNameHash(info->orgname, cacheFoldCase), CacheOrgNameEq, cacheFoldCase, info->orgname))
+				later.push_back(info);
+			else
+				InsertEntry(dir, info, false);
 		}
+		for (Bitu i = 0; i < later.size(); i++) InsertEntry(dir, later[i], false);
+		if (!isroot && !founddot) CreateEntry(dir, ".", true, false); // add missing entry
+		if (!isroot && !founddotdot) CreateEntry(dir, "..", true, false); // add missing entry
+		std::sort(dir->fileList.begin(), dir->fileList.end(), SortByName);
 
 		// close dir
 		close_directory(dirp);
 
+		WatchDir(dir, dirPath);
+
 		// Info
 /*		if (!dirp) {
 			LOG_DEBUG("DIR: Error Caching in %s",dirPath);			
@@ -853,20 +939,6 @@ bool DOS_Drive_Cache::ReadDir(Bit16u id, char* &result) {
 			LOG_DEBUG(buffer);
 		};*/
 
-		//DBP: Make sure "." and ".." exist in directories (some Linux filesystems don't report them)
-		//DBP: Make sure "." and ".." doesn't exist in the drive root
-		const bool isroot = (strlen(dirPath) == strlen(basePath));
-		std::vector<CFileInfo*>& filelist = dirSearch[id]->fileList;
-		for (std::vector<CFileInfo*>::iterator it = filelist.begin(), itend = filelist.end(); it != itend; ++it)
-			if ((*it)->shortname[0] == '.' && (*it)->shortname[1] == '\0')
-				{ if (isroot) filelist.erase(it); goto founddot; } // remove superfluous entry
-		if (!isroot) CreateEntry(dirSearch[id], ".",  true); // add missing entry
-		founddot:
-		for (std::vector<CFileInfo*>::iterator it = filelist.begin(), itend = filelist.end(); it != itend; ++it)
-			if ((*it)->shortname[0] == '.' && (*it)->shortname[1] == '.' && (*it)->shortname[2] == '\0')
-				{ if (isroot) filelist.erase(it); goto founddotdot; } // remove superfluous entry
-		if (!isroot) CreateEntry(dirSearch[id], "..",  true); // add missing entry
-		founddotdot:;
 	};
 	if (SetResult(dirSearch[id], result, dirSearch[id]->nextEntry)) return true;
 	if (dirSearch[id]) {
@@ -966,6 +1038,11 @@ void DOS_Drive_Cache::ClearFileInfo(CFileInfo *dir) {
 		dirSearch[dir->id] = 0;
 		dir->id = MAX_OPENDIRS;
 	}
+	if (dir->watchID >= 0) {
+		// the watch stays registered, it will be used again when the same directory gets cached in
+		if (watchDirs[dir->watchID] == dir) watchDirs[dir->watchID] = NULL;
+		dir->watchID = -1;
+	}
 }
 
 void DOS_Drive_Cache::DeleteFileInfo(CFileInfo *dir) {
@@ -973,3 +1050,53 @@ void DOS_Drive_Cache::DeleteFileInfo(CFileInfo *dir) {
 		ClearFileInfo(dir);
 	delete dir;
 }
+
+void DOS_Drive_Cache::WatchDir(CFileInfo* dir, const char* path) {
+#if defined (__linux__)
+	//DBP: Instead of requiring a rescan, directories with changes on the host get cached out and read again on next access
+	if (watchFd == -1) watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watchFd < 0) return;
+	int wd = inotify_add_watch(watchFd, path, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+	if (wd < 0) {
+		// Out of watches, fall back to not noticing host changes at all (and rescanning floppies)
+		LOG(LOG_FILES,LOG_NORMAL)("DIRCACHE: Unable to watch %s for changes", path);
+		close(watchFd);
+		watchFd = -2;
+		for (Bitu i = 0; i < watchDirs.size(); i++) if (watchDirs[i]) watchDirs[i]->watchID = -1;
+		watchDirs.clear();
+		return;
+	}
+	if ((size_t)wd >= watchDirs.size()) watchDirs.resize(wd + 1);
+	watchDirs[wd] = dir;
+	dir->watchID = wd;
+#endif
+}
+
+void DOS_Drive_Cache::PollChanges(void) {
+#if defined (__linux__)
+	if (watchFd < 0) return;
+	union { struct inotify_event ev; char buf[4096]; } events;
+	for (ssize_t len; (len = read(watchFd, events.buf, sizeof(events.buf))) > 0;) {
+		for (const char *p = events.buf, *pEnd = p + len; p < pEnd; p += sizeof(struct inotify_event) + ((const struct inotify_event*)p)->len) {
+			const struct inotify_event* ev = (const struct inotify_event*)p;
+			CFileInfo* dir = ((ev->mask & IN_Q_OVERFLOW) ? dirBase : ((size_t)ev->wd < watchDirs.size() ? watchDirs[ev->wd] : NULL));
+			if (!dir || !IsCachedIn(dir)) continue;
+			if ((ev->mask & IN_Q_OVERFLOW) || !ev->len) { ClearDir(dir); continue; }
+			// Changes made by the guest itself are already reflected in the cache and get ignored
+			CFileInfo* entry = FindOrgName(dir, ev->name);
+			if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+				if (entry) continue;
+				CFileInfo* info = CreateEntry(dir, ev->name, (ev->mask & IN_ISDIR) != 0);
+				Bit32u index = (Bit32u)(std::lower_bound(dir->fileList.begin(), dir->fileList.end(), info, SortByName) - dir->fileList.begin());
+				for (Bit32u i = 0; i < MAX_OPENDIRS; i++) {
+					if ((dirSearch[i]==dir) && (index<=dirSearch[i]->nextEntry))
+						dirSearch[i]->nextEntry++;
+				}
+			} else if (entry) {
+				// Removed on the host, read the directory again to keep short names and open searches consistent
+				ClearDir(dir);
+			}
+		}
+	}
+#endif
+}
@@ -59,6 +59,9 @@ public:
 
 	bool loadedSector;
 	fatDrive *myDrive;
+	fatChainCache chainCache;
+
+	inline Bit32u getSector(Bit32u bytePos, Bit32u* contiguousSectors = NULL) { return myDrive->getAbsoluteSectFromChain(chainCache, firstCluster, bytePos / myDrive->getSectorSize(), contiguousSectors); }
 private:
 	//DBP: Removed unused fields
 	//enum { NONE,READ,WRITE } last_action;
@@ -124,7 +127,7 @@ bool fatFile::Read(Bit8u * data, Bit16u *size) {
 	}
 
 	if (!loadedSector) {
-		currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+		currentSector = getSector(seekpos);
 		if(currentSector == 0) {
 			/* EOC reached before EOF */
 			*size = 0;
@@ -136,6 +139,7 @@ bool fatFile::Read(Bit8u * data, Bit16u *size) {
 		loadedSector = true;
 	}
 
+	const Bit32u sectSize = myDrive->getSectorSize();
 	sizedec = *size;
 	sizecount = 0;
 	while(sizedec != 0) {
@@ -143,10 +147,25 @@ bool fatFile::Read(Bit8u * data, Bit16u *size) {
 			*size = sizecount;
 			return true; 
 		}
-		data[sizecount++] = sectorBuffer[curSectOff++];
-		seekpos++;
-		if(curSectOff >= myDrive->getSectorSize()) {
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+		Bit32u len = sectSize - curSectOff, contiguous;
+		if (len > sizedec) len = sizedec;
+		if (len > filelength - seekpos) len = filelength - seekpos;
+		if (curSectOff == 0 && len == sectSize && getSector(seekpos, &contiguous) == currentSector) {
+			//DBP: Read as many whole sectors as possible directly into the destination
+			Bit32u count = (sizedec < filelength - seekpos ? sizedec : filelength - seekpos) / sectSize;
+			if (count > contiguous) count = contiguous;
+			len = count * sectSize;
+			myDrive->readSectors(currentSector, count, data + sizecount);
+			curSectOff = sectSize;
+		} else {
+			memcpy(data + sizecount, sectorBuffer + curSectOff, len);
+			curSectOff += len;
+		}
+		sizecount += (Bit16u)len;
+		seekpos += len;
+		sizedec -= (Bit16u)len;
+		if(curSectOff >= sectSize) {
+			currentSector = getSector(seekpos);
 			if(currentSector == 0) {
 				/* EOC reached before EOF */
 				//LOG_MSG("EOC reached before EOF, seekpos %d, filelen %d", seekpos, filelength);
@@ -159,7 +178,6 @@ bool fatFile::Read(Bit8u * data, Bit16u *size) {
 			loadedSector = true;
 			//LOG_MSG("Reading absolute sector at %d for seekpos %d", currentSector, seekpos);
 		}
-		--sizedec;
 	}
 	*size =sizecount;
 	return true;
@@ -209,17 +227,17 @@ bool fatFile::Write(Bit8u * data, Bit16u *size) {
 				firstCluster = myDrive->getFirstFreeClust();
 				if(firstCluster == 0) goto finalizeWrite; // out of space
 				myDrive->allocateCluster(firstCluster, 0);
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+				currentSector = getSector(seekpos);
 				myDrive->readSector(currentSector, sectorBuffer);
 				loadedSector = true;
 			}
 			if (!loadedSector) {
-				currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+				currentSector = getSector(seekpos);
 				if(currentSector == 0) {
 					/* EOC reached before EOF - try to increase file allocation */
 					myDrive->appendCluster(firstCluster);
 					/* Try getting sector again */
-					currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+					currentSector = getSector(seekpos);
 					if(currentSector == 0) {
 						/* No can do. lets give up and go home.  We must be out of room */
 						goto finalizeWrite;
@@ -236,7 +254,7 @@ bool fatFile::Write(Bit8u * data, Bit16u *size) {
 		if(curSectOff >= myDrive->getSectorSize()) {
 			if(loadedSector) myDrive->writeSector(currentSector, sectorBuffer);
 
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+			currentSector = getSector(seekpos);
 			if(currentSector == 0) loadedSector = false;
 			else {
 				curSectOff = 0;
@@ -279,7 +297,7 @@ bool fatFile::Seek(Bit32u *pos, Bit32u type) {
 
 	if(seekto<0) seekto = 0;
 	seekpos = (Bit32u)seekto;
-	currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+	currentSector = getSector(seekpos);
 	if (currentSector == 0) {
 		/* not within file size, thus no sector is available */
 		loadedSector = false;
@@ -427,6 +445,7 @@ void fatDrive::setClusterValue(Bit32u clustNum, Bit32u clustValue) {
 			var_write((Bit32u *)&fatSectBuffer[fatentoff], clustValue);
 			break;
 	}
+	fatGeneration++;
 	for(int fc=0;fc<bootbuffer.fatcopies;fc++) {
 		writeSector(fatsectnum + (fc * bootbuffer.sectorsperfat), &fatSectBuffer[0]);
 		if (fattype==FAT12) {
@@ -550,6 +569,12 @@ Bit8u fatDrive::readSector(Bit32u sectnum, void * data) {
 	return loadedDisk->Read_Sector(head, cylinder, sector, data);
 }	
 
+Bit8u fatDrive::readSectors(Bit32u sectnum, Bit32u count, void * data) {
+	if (absolute) return loadedDisk->Read_AbsoluteSectors(sectnum, count, data);
+	for (Bit8u* p = (Bit8u*)data; count--; p += bootbuffer.bytespersector) readSector(sectnum++, p);
+	return 0x00;
+}
+
 Bit8u fatDrive::writeSector(Bit32u sectnum, void * data) {
 	if (absolute) return loadedDisk->Write_AbsoluteSector(sectnum, data);
 	Bit32u cylindersize = bootbuffer.headcount * bootbuffer.sectorspertrack;
@@ -615,6 +640,48 @@ Bit32u fatDrive::getAbsoluteSectFromChain(Bit32u startClustNum, Bit32u logicalSe
 	return (getClustFirstSect(currentClust) + sectClust);
 }
 
+Bit32u fatDrive::getAbsoluteSectFromChain(fatChainCache& cache, Bit32u startClustNum, Bit32u logicalSector, Bit32u* contiguousSectors) {
+	//DBP: Same as above but remembers the part of the chain walked so far, optionally returns the number of sectors that follow in sequence
+	Bit32u skipClust = logicalSector / bootbuffer.sectorspercluster;
+	Bit32u sectClust = logicalSector % bootbuffer.sectorspercluster;
+
+	if (cache.generation != fatGeneration || cache.startCluster != startClustNum || cache.extents.empty()) {
+		cache.extents.clear();
+		fatChainCache::Extent first = { 0, startClustNum, 1 };
+		cache.extents.push_back(first);
+		cache.startCluster = startClustNum;
+		cache.generation = fatGeneration;
+		cache.complete = false;
+	}
+
+	std::vector<fatChainCache::Extent>& ext = cache.extents;
+	if (skipClust >= ext.back().index + ext.back().count) {
+		if (cache.complete) return 0;
+		Bit32u index = ext.back().index + ext.back().count - 1, currentClust = ext.back().cluster + ext.back().count - 1;
+		while (index != skipClust) {
+			Bit32u testvalue = getClusterValue(currentClust);
+			if ((fattype == FAT12 && testvalue >= 0xff8) || (fattype == FAT16 && testvalue >= 0xfff8) || (fattype == FAT32 && testvalue >= 0xfffffff8)) {
+				cache.complete = true;
+				return 0;
+			}
+			index++;
+			if (testvalue == currentClust + 1) ext.back().count++;
+			else { fatChainCache::Extent e = { index, testvalue, 1 }; ext.push_back(e); }
+			currentClust = testvalue;
+		}
+	}
+
+	// Binary search the last extent starting at or before the wanted cluster
+	size_t lo = 0, hi = ext.size() - 1;
+	while (lo < hi) {
+		size_t mid = (lo + hi + 1) / 2;
+		if (ext[mid].index <= skipClust) lo = mid; else hi = mid - 1;
+	}
+	const fatChainCache::Extent& e = ext[lo];
+	if (contiguousSectors) *contiguousSectors = (e.index + e.count - skipClust) * bootbuffer.sectorspercluster - sectClust;
+	return (getClustFirstSect(e.cluster + (skipClust - e.index)) + sectClust);
+}
+
 void fatDrive::deleteClustChain(Bit32u startCluster, Bit32u bytePos) {
 	Bit32u clustSize = getClusterSize();
 	Bit32u endClust = (bytePos + clustSize - 1) / clustSize;
@@ -936,6 +1003,7 @@ fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector,
 
 	memset(fatSectBuffer,0,1024);
 	curFatSect = 0xffffffff;
+	fatGeneration = 1;
 
 	#ifdef C_DBP_LIBRETRO // safety
 	snprintf(info, sizeof(info), "fatDrive %s", sysFilename);
@@ -30,6 +30,34 @@
 
 using namespace std;
 
+//DBP: Parsed directory records, entries of a directory are added on its first lookup and stay valid across media swaps
+struct isoDirIndexEntry {
+	Bit32u extent, size, parent, target; // target is the directory referenced by '.' and '..' entries, otherwise the entry itself
+	Bit32u first, count;                 // range of directory contents in entries, filled by ExpandDirIndex
+	Bit32u recSector;
+	Bit16u recPos, date, time;
+	Bit8u flags;
+	bool expanded;
+	char ident[14];
+};
+
+struct isoDirIndex {
+	std::vector<isoDirIndexEntry> entries;
+	ValueEqualHashMap<Bit32u> names; // by parent index and name
+
+	static Bit32u Hash(Bit32u parent, const char* name) {
+		Bit32u hash = (Bit32u)0x811c9dc5 ^ parent;
+		for (const char* e = name + ISO_MAX_FILENAME_LENGTH; *name && name != e; name++)
+			hash = ((hash * (Bit32u)0x01000193) ^ (Bit32u)toupper(*name));
+		return hash;
+	}
+
+	struct Key { Bit32u parent; const char* name; };
+	static bool Equal(const std::vector<isoDirIndexEntry>& entries, Bit32u idx, const Key& key) {
+		return (entries[idx].parent == key.parent && !strncasecmp(entries[idx].ident, key.name, sizeof(entries[idx].ident)));
+	}
+};
+
 class isoFile : public DOS_File {
 public:
 	isoFile(isoDrive *drive, const char *name, FileStat_Block *stat, Bit32u offset);
@@ -154,6 +182,7 @@ isoDrive::isoDrive(char driveLetter, const char *fileName, Bit8u mediaid, int &e
 	memset(dirIterators, 0, sizeof(dirIterators));
 	memset(sectorHashEntries, 0, sizeof(sectorHashEntries));
 	memset(&rootEntry, 0, sizeof(isoDirEntry));
+	dirIndex = new isoDirIndex;
 	
 	safe_strncpy(this->fileName, fileName, CROSS_LEN);
 	error = UpdateMscdex(driveLetter, fileName, subUnit);
@@ -188,7 +217,9 @@ isoDrive::isoDrive(char driveLetter, const char *fileName, Bit8u mediaid, int &e
 	}
 }
 
-isoDrive::~isoDrive() { }
+isoDrive::~isoDrive() {
+	delete dirIndex;
+}
 
 int isoDrive::UpdateMscdex(char driveLetter, const char* path, Bit8u& subUnit) {
 	if (MSCDEX_HasDrive(driveLetter)) {
@@ -210,6 +241,7 @@ int isoDrive::UpdateMscdex(char driveLetter, const char* path, Bit8u& subUnit) {
 }
 
 void isoDrive::Activate(void) {
+	//DBP: The image file is the same so the directory index is kept
 	UpdateMscdex(driveLetter, fileName, subUnit);
 }
 
@@ -219,16 +251,16 @@ bool isoDrive::FileOpen(DOS_File **file, char *name, Bit32u flags) {
 		return false;
 	}
 	
-	isoDirEntry de;
-	bool success = lookup(&de, name) && !IS_DIR(FLAGS1);
+	const isoDirIndexEntry* e = lookup(name);
+	bool success = e && !IS_DIR(e->flags);
 
 	if (success) {
 		FileStat_Block file_stat;
-		file_stat.size = DATA_LENGTH(de);
+		file_stat.size = e->size;
 		file_stat.attr = DOS_ATTR_ARCHIVE | DOS_ATTR_READ_ONLY;
-		file_stat.date = DOS_PackDate(1900 + de.dateYear, de.dateMonth, de.dateDay);
-		file_stat.time = DOS_PackTime(de.timeHour, de.timeMin, de.timeSec);
-		*file = new isoFile(this, name, &file_stat, EXTENT_LOCATION(de) * ISO_FRAMESIZE);
+		file_stat.date = e->date;
+		file_stat.time = e->time;
+		*file = new isoFile(this, name, &file_stat, e->extent * ISO_FRAMESIZE);
 		(*file)->flags = flags;
 	}
 	return success;
@@ -255,21 +287,23 @@ bool isoDrive::MakeDir(char* /*dir*/) {
 }
 
 bool isoDrive::TestDir(char *dir) {
-	isoDirEntry de;	
-	return (lookup(&de, dir) && IS_DIR(FLAGS1));
+	const isoDirIndexEntry* e = lookup(dir);
+	return (e && IS_DIR(e->flags));
 }
 
 bool isoDrive::FindFirst(char *dir, DOS_DTA &dta, bool fcb_findfirst) {
-	isoDirEntry de;
-	if (!lookup(&de, dir)) {
+	const isoDirIndexEntry* e = lookup(dir);
+	if (!e) {
 		DOS_SetError(DOSERR_PATH_NOT_FOUND);
 		return false;
 	}
 	
 	// get a directory iterator and save its id in the dta
-	int dirIterator = GetDirIterator(&de);
+	int dirIterator = GetDirIterator(e->extent, e->size);
 	bool isRoot = (*dir == 0);
 	dirIterators[dirIterator].root = isRoot;
+	dirIterators[dirIterator].dirIndex = (Bit32u)(e - &dirIndex->entries[0]);
+	if (IS_DIR(e->flags)) ExpandDirIndex(dirIterators[dirIterator].dirIndex);
 	dta.SetDirID((Bit16u)dirIterator);
 
 	Bit8u attr;
@@ -296,29 +330,29 @@ bool isoDrive::FindNext(DOS_DTA &dta) {
 	dta.GetSearchParams(attr, pattern);
 	
 	int dirIterator = dta.GetDirID();
-	bool isRoot = dirIterators[dirIterator].root;
+	DirIterator& it = dirIterators[dirIterator];
+	bool isRoot = it.root;
 	
-	isoDirEntry de;
-	while (GetNextDirEntry(dirIterator, &de)) {
+	//DBP: Iterate the directory index instead of reading the directory records
+	const isoDirIndexEntry& dir = dirIndex->entries[it.dirIndex];
+	while (it.valid && dir.expanded && it.pos < dir.count) {
+		const isoDirIndexEntry& de = dirIndex->entries[dir.first + it.pos++];
 		Bit8u findAttr = 0;
-		if (IS_DIR(FLAGS1)) findAttr |= DOS_ATTR_DIRECTORY;
+		if (IS_DIR(de.flags)) findAttr |= DOS_ATTR_DIRECTORY;
 		else findAttr |= DOS_ATTR_ARCHIVE;
-		if (IS_HIDDEN(FLAGS1)) findAttr |= DOS_ATTR_HIDDEN;
+		if (IS_HIDDEN(de.flags)) findAttr |= DOS_ATTR_HIDDEN;
 
-		if (!IS_ASSOC(FLAGS1) && !(isRoot && de.ident[0]=='.') && WildFileCmp((char*)de.ident, pattern)
+		if (!IS_ASSOC(de.flags) && !(isRoot && de.ident[0]=='.') && WildFileCmp(de.ident, pattern)
 			&& !(~attr & findAttr & (DOS_ATTR_DIRECTORY | DOS_ATTR_HIDDEN | DOS_ATTR_SYSTEM))) {
 			
 			/* file is okay, setup everything to be copied in DTA Block */
 			char findName[DOS_NAMELENGTH_ASCII];		
 			findName[0] = 0;
-			if(strlen((char*)de.ident) < DOS_NAMELENGTH_ASCII) {
-				strcpy(findName, (char*)de.ident);
+			if(strlen(de.ident) < DOS_NAMELENGTH_ASCII) {
+				strcpy(findName, de.ident);
 				upcase(findName);
 			}
-			Bit32u findSize = DATA_LENGTH(de);
-			Bit16u findDate = DOS_PackDate(1900 + de.dateYear, de.dateMonth, de.dateDay);
-			Bit16u findTime = DOS_PackTime(de.timeHour, de.timeMin, de.timeSec);
-			dta.SetResult(findName, findSize, findDate, findTime, findAttr);
+			dta.SetResult(findName, de.size, de.date, de.time, findAttr);
 			return true;
 		}
 	}
@@ -336,14 +370,13 @@ bool isoDrive::Rename(char* /*oldname*/, char* /*newname*/) {
 
 bool isoDrive::GetFileAttr(char *name, Bit16u *attr) {
 	*attr = 0;
-	isoDirEntry de;
-	bool success = lookup(&de, name);
-	if (success) {
+	const isoDirIndexEntry* e = lookup(name);
+	if (e) {
 		*attr = DOS_ATTR_ARCHIVE | DOS_ATTR_READ_ONLY;
-		if (IS_HIDDEN(FLAGS1)) *attr |= DOS_ATTR_HIDDEN;
-		if (IS_DIR(FLAGS1)) *attr |= DOS_ATTR_DIRECTORY;
+		if (IS_HIDDEN(e->flags)) *attr |= DOS_ATTR_HIDDEN;
+		if (IS_DIR(e->flags)) *attr |= DOS_ATTR_DIRECTORY;
 	}
-	return success;
+	return (e != NULL);
 }
 
 bool isoDrive::AllocationInfo(Bit16u *bytes_sector, Bit8u *sectors_cluster, Bit16u *total_clusters, Bit16u *free_clusters) {
@@ -355,38 +388,38 @@ bool isoDrive::AllocationInfo(Bit16u *bytes_sector, Bit8u *sectors_cluster, Bit1
 }
 
 bool isoDrive::FileExists(const char *name) {
-	isoDirEntry de;
-	return (lookup(&de, name) && !IS_DIR(FLAGS1));
+	const isoDirIndexEntry* e = lookup(name);
+	return (e && !IS_DIR(e->flags));
 }
 
 bool isoDrive::FileStat(const char *name, FileStat_Block *const stat_block) {
-	isoDirEntry de;
-	bool success = lookup(&de, name);
+	const isoDirIndexEntry* e = lookup(name);
 	
-	if (success) {
-		stat_block->date = DOS_PackDate(1900 + de.dateYear, de.dateMonth, de.dateDay);
-		stat_block->time = DOS_PackTime(de.timeHour, de.timeMin, de.timeSec);
-		stat_block->size = DATA_LENGTH(de);
+	if (e) {
+		stat_block->date = e->date;
+		stat_block->time = e->time;
+		stat_block->size = e->size;
 		stat_block->attr = DOS_ATTR_ARCHIVE | DOS_ATTR_READ_ONLY;
-		if (IS_DIR(FLAGS1)) stat_block->attr |= DOS_ATTR_DIRECTORY;
+		if (IS_DIR(e->flags)) stat_block->attr |= DOS_ATTR_DIRECTORY;
 	}
 	
-	return success;
+	return (e != NULL);
 }
 
 //DBP: Added GetLongFileName function
 bool isoDrive::GetLongFileName(const char* name, char longname[256])
 {
-	isoDirEntry de;
-	bool success = lookup(&de, name);
+	const isoDirIndexEntry* e = lookup(name);
+	Bit8u* buffer = NULL;
+	bool success = (e && e != &dirIndex->entries[0] && ReadCachedSector(&buffer, e->recSector));
 
 	if (success) {
-		Bit8u* buffer = NULL;
-		ReadCachedSector(&buffer, dirIterators[nextFreeDirIterator].currentSector);
-		char *short_ident = (char*)de.ident, *long_ident = (char*)&buffer[dirIterators[nextFreeDirIterator].pos - de.length + 33], *long_ver;
-		size_t short_len = strlen(short_ident), long_len = de.fileIdentLength;
-		de.ident[long_len] = '\0';
-		if (!IS_DIR(FLAGS1) && (long_ver = strchr(long_ident, ';')) != NULL)
+		char short_ident[sizeof(e->ident)], long_ident[256], *long_ver;
+		strcpy(short_ident, e->ident);
+		size_t short_len = strlen(short_ident), long_len = buffer[e->recPos + 32];
+		memcpy(long_ident, &buffer[e->recPos + 33], long_len);
+		long_ident[long_len] = '\0';
+		if (!IS_DIR(e->flags) && (long_ver = strchr(long_ident, ';')) != NULL)
 		{
 			*long_ver = '\0';
 			long_len = long_ver - long_ident;
@@ -420,15 +453,16 @@ Bits isoDrive::UnMount(void) {
 	return 2;
 }
 
-int isoDrive::GetDirIterator(const isoDirEntry* de) {
+int isoDrive::GetDirIterator(Bit32u extent, Bit32u length) {
 	int dirIterator = nextFreeDirIterator;
 	
 	// get start and end sector of the directory entry (pad end sector if necessary)
-	dirIterators[dirIterator].currentSector = EXTENT_LOCATION(*de);
+	dirIterators[dirIterator].currentSector = extent;
 	dirIterators[dirIterator].endSector =
-		EXTENT_LOCATION(*de) + DATA_LENGTH(*de) / ISO_FRAMESIZE - 1;
-	if (DATA_LENGTH(*de) % ISO_FRAMESIZE != 0)
+		extent + length / ISO_FRAMESIZE - 1;
+	if (length % ISO_FRAMESIZE != 0)
 		dirIterators[dirIterator].endSector++;
+	dirIterators[dirIterator].dirIndex = 0;
 	
 	// reset position and mark as valid
 	dirIterators[dirIterator].pos = 0;
@@ -556,45 +590,93 @@ bool isoDrive :: loadImage() {
 	Bit16u offset = iso ? 156 : 180;
 	if (readDirEntry(&this->rootEntry, &pvd[offset])>0) {
 		dataCD = true;
+		isoDirIndexEntry root;
+		memset(&root, 0, sizeof(root));
+		root.extent = EXTENT_LOCATION(rootEntry);
+		root.size = DATA_LENGTH(rootEntry);
+		root.recSector = ISO_FIRST_VD;
+		root.recPos = offset;
+		root.date = DOS_PackDate(1900 + rootEntry.dateYear, rootEntry.dateMonth, rootEntry.dateDay);
+		root.time = DOS_PackTime(rootEntry.timeHour, rootEntry.timeMin, rootEntry.timeSec);
+		root.flags = (iso ? rootEntry.fileFlags : rootEntry.timeZone);
+		dirIndex->entries.clear();
+		dirIndex->names.Clear();
+		dirIndex->entries.push_back(root);
+		ExpandDirIndex(0);
 		return true;
 	}
 	return false;
 }
 
-bool isoDrive :: lookup(isoDirEntry *de, const char *path) {
-	if (!dataCD) return false;
-	*de = this->rootEntry;
-	if (!strcmp(path, "")) return true;
+const isoDirIndexEntry* isoDrive :: ExpandDirIndex(Bit32u dirIdx) {
+	std::vector<isoDirIndexEntry>& entries = dirIndex->entries;
+	if (entries[dirIdx].expanded) return &entries[dirIdx];
+	entries[dirIdx].expanded = true;
+
+	// read all directory records once, later lookups and searches only use the index
+	const Bit32u first = (Bit32u)entries.size(), parent = entries[dirIdx].parent;
+	int dirIterator = GetDirIterator(entries[dirIdx].extent, entries[dirIdx].size);
+	isoDirEntry de;
+	while (GetNextDirEntry(dirIterator, &de)) {
+		isoDirIndexEntry e;
+		e.extent = EXTENT_LOCATION(de);
+		e.size = DATA_LENGTH(de);
+		e.parent = dirIdx;
+		e.first = e.count = 0;
+		e.recSector = dirIterators[dirIterator].currentSector;
+		e.recPos = (Bit16u)(dirIterators[dirIterator].pos - de.length);
+		e.date = DOS_PackDate(1900 + de.dateYear, de.dateMonth, de.dateDay);
+		e.time = DOS_PackTime(de.timeHour, de.timeMin, de.timeSec);
+		e.flags = FLAGS1;
+		e.expanded = false;
+		safe_strncpy(e.ident, (char*)de.ident, sizeof(e.ident));
+		const bool isDot = (e.ident[0] == '.' && !e.ident[1]), isDotDot = (e.ident[0] == '.' && e.ident[1] == '.' && !e.ident[2]);
+		e.target = (isDot ? dirIdx : (isDotDot ? parent : (Bit32u)entries.size()));
+		entries.push_back(e);
+
+		// the first entry of a name is found by lookups, same as when searching the directory records
+		if (IS_ASSOC(e.flags)) continue;
+		isoDirIndex::Key key = { dirIdx, e.ident };
+		Bit32u hash = isoDirIndex::Hash(dirIdx, e.ident);
+		if (!dirIndex->names.Get(hash, isoDirIndex::Equal, entries, key))
+			dirIndex->names.Put(hash, isoDirIndex::Equal, entries, key, (Bit32u)entries.size() - 1);
+	}
+	FreeDirIterator(dirIterator);
+	entries[dirIdx].first = first;
+	entries[dirIdx].count = (Bit32u)entries.size() - first;
+	return &entries[dirIdx];
+}
+
+const isoDirIndexEntry* isoDrive :: lookup(const char *path) {
+	if (!dataCD) return NULL;
+	if (!strcmp(path, "")) return &dirIndex->entries[0];
 	
 	char isoPath[ISO_MAXPATHNAME];
 	safe_strncpy(isoPath, path, ISO_MAXPATHNAME);
 	strreplace(isoPath, '\\', '/');
 	
-	// iterate over all path elements (name), and search each of them in the current de
+	// iterate over all path elements (name), and search each of them in the current directory
+	Bit32u cur = 0;
 	for(char* name = strtok(isoPath, "/"); NULL != name; name = strtok(NULL, "/")) {
 
-		bool found = false;	
 		// current entry must be a directory, abort otherwise
-		if (IS_DIR(FLAGS2)) {
-			
-			// remove the trailing dot if present
-			size_t nameLength = strlen(name);
-			if (nameLength > 0) {
-				if (name[nameLength - 1] == '.') name[nameLength - 1] = 0;
-			}
+		const isoDirIndexEntry* dir = &dirIndex->entries[cur];
+		if (!IS_DIR(dir->flags)) return NULL;
+		if (!dir->expanded) ExpandDirIndex(cur);
 			
-			// look for the current path element
-			int dirIterator = GetDirIterator(de);
-			while (!found && GetNextDirEntry(dirIterator, de)) {
-				if (!IS_ASSOC(FLAGS2) && (0 == strncasecmp((char*) de->ident, name, ISO_MAX_FILENAME_LENGTH))) {
-					found = true;
-				}
-			}
-			FreeDirIterator(dirIterator);
+		// remove the trailing dot if present
+		size_t nameLength = strlen(name);
+		if (nameLength > 0) {
+			if (name[nameLength - 1] == '.') name[nameLength - 1] = 0;
 		}
-		if (!found) return false;
+			
+		// look for the current path element
+		isoDirIndex::Key key = { cur, name };
+		Bit32u* found = dirIndex->names.Get(isoDirIndex::Hash(cur, name), isoDirIndex::Equal, dirIndex->entries, key);
+		if (!found) return NULL;
+		cur = dirIndex->entries[*found].target;
 	}
-	return true;
+	return &dirIndex->entries[cur];
 }
 
 bool isoDrive::CheckBootDiskImage(Bit8u** read_image, Bit32u* read_size)
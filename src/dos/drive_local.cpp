@@ -34,6 +34,12 @@
 #include "support.h"
 #include "cross.h"
 #include "inout.h"
+#include "dbp_threads.h"
+
+#include <vector>
+#include <algorithm>
+
+extern Bit64u DBP_GetTicksUs();
 
 
 bool localDrive::FileCreate(DOS_File * * file,char * name,Bit16u /*attributes*/) {
@@ -188,8 +194,8 @@ bool localDrive::FindFirst(char * _dir,DOS_DTA & dta,bool fcb_findfirst) {
 	strcat(tempDir,_dir);
 	CROSS_FILENAME(tempDir);
 
-	if (allocation.mediaid==0xF0 ) {
-		EmptyCache(); //rescan floppie-content on each findfirst
+	if (allocation.mediaid==0xF0 && !dirCache.IsWatchingChanges()) {
+		EmptyCache(); //rescan floppie-content on each findfirst (unless changes get noticed by the cache itself)
 	}
     
 	char end[2]={CROSS_FILESPLIT,0};
@@ -411,6 +417,8 @@ bool localDrive::FileStat(const char* name, FileStat_Block * const stat_block) {
 
 	}
 	stat_block->size=(Bit32u)temp_stat.st_size;
+	//DBP: Fill attributes like the other drive types
+	stat_block->attr=(Bit16u)((temp_stat.st_mode & S_IFDIR) ? DOS_ATTR_DIRECTORY : DOS_ATTR_ARCHIVE);
 	return true;
 }
 
@@ -471,15 +479,371 @@ localDrive::localDrive(const char * startdir,Bit16u _bytes_sector,Bit8u _sectors
 }
 
 
-//TODO Maybe use fflush, but that seemed to fuck up in visual c
+// Host file access of local files is moved off the emulation thread onto a shared I/O thread
+// Sequentially read files get read ahead in chunks, writes are collected and written out in the background
+// The emulation thread only touches the FILE handle while no job of the file is queued or running
+// Before a handle accesses the file, pending writes of other handles of the same file are written out and its own read-ahead is dropped
+// A write that fails in the background is reported by the next operation on the same handle: Write reports 0 bytes written
+// (like a full disk), Read, Seek and Flush fail with a write fault error and Close returns false
+struct localFileAsync
+{
+	enum lfaDefs : Bit32u
+	{
+		READAHEAD  = 64 * 1024,   // size of a read-ahead chunk, the next one is requested when half of the current one is used up
+		MAXPENDING = 1024 * 1024, // block until the I/O thread has caught up when this much written data is pending
+		HISTBUCKETS = 5,          // latency histogram buckets (< 1ms, < 4ms, < 16ms, < 64ms, slower)
+	};
+	enum ReadState : Bit8u { RA_NONE, RA_QUEUED, RA_DONE };
+	struct Run { Bit64u pos; Bit32u len; };
+	struct Stats { Bit32u hist[HISTBUCKETS], stall_us; };
+
+	// guarded by the I/O mutex
+	std::vector<Bit8u> wb, wbjob, rajob;
+	std::vector<Run> wbruns, wbjobruns;
+	Bit64u rajob_pos = 0;
+	Bit32u rajob_got = 0;
+	ReadState rastate = RA_NONE;
+	bool queued = false, busy = false, waiting = false, write_error = false; // write error stays set until reported to the DOS program
+	Semaphore done;
+
+	// owned by the emulation thread (position of the FILE handle also by the I/O thread while it runs a job)
+	std::vector<Bit8u> ra;
+	Bit64u ra_pos = 0, pos, fpos, seq_end = (Bit64u)-1;
+	Bit32u ra_len = 0, seen_write_seq;
+	bool ra_eof = false, writing = false, dirty = false, fpos_write = false;
+
+	static struct IO
+	{
+		Mutex mutex;
+		Semaphore wake, exited;
+		std::vector<localFile*> queue;
+		std::vector<localFile*> files; // files with attached state, only used by the emulation thread
+		Stats stats[DOS_DRIVES];
+		Bit32u users, write_seq; // write_seq counts writes to any file, only used by the emulation thread
+		Bit8u threaded; // 0 = not checked yet, 1 = single core (everything runs on the emulation thread), 2 = I/O thread available
+		bool idle, quit;
+	} io;
+
+	static localFileAsync& Attach(localFile& f)
+	{
+		if (f.async) return *f.async;
+		localFileAsync& a = *(f.async = new localFileAsync);
+		a.pos = a.fpos = (Bit64u)ftell_wrap(f.fhandle);
+		a.seen_write_seq = io.write_seq - 1; // check other handles of the same file on first access
+		io.files.push_back(&f);
+		if (!io.threaded)
+		{
+			extern unsigned dbp_cpu_features_get_core_amount(void);
+			io.threaded = (dbp_cpu_features_get_core_amount() <= 1 ? 1 : 2);
+		}
+		if (io.threaded == 2 && !io.users++)
+		{
+			io.idle = io.quit = false;
+			Thread::StartDetached(ThreadFunc, NULL);
+		}
+		return a;
+	}
+
+	static void Detach(localFile& f)
+	{
+		WaitIdle(f, true);
+		delete f.async;
+		f.async = NULL;
+		io.files.erase(std::find(io.files.begin(), io.files.end(), &f));
+		if (io.threaded != 2 || --io.users) return;
+		io.mutex.Lock();
+		io.quit = true;
+		if (io.idle) { io.idle = false; io.wake.Post(); }
+		io.mutex.Unlock();
+		io.exited.Wait();
+	}
+
+	// Wait until the file has no queued or running jobs, optionally dropping a read-ahead that is not needed anymore
+	static void WaitIdle(localFile& f, bool drop_readahead)
+	{
+		localFileAsync& a = *f.async;
+		io.mutex.Lock();
+		if (drop_readahead && a.rastate == RA_QUEUED && a.queued && !a.busy)
+		{
+			a.rastate = RA_NONE;
+			if (a.wb.empty()) { io.queue.erase(std::find(io.queue.begin(), io.queue.end(), &f)); a.queued = false; }
+		}
+		while (a.queued || a.busy) WaitLocked(f);
+		if (drop_readahead) a.rastate = RA_NONE;
+		io.mutex.Unlock();
+		a.writing = false;
+	}
+
+	// Take over a finished read-ahead chunk and return the state of the read-ahead
+	static ReadState PollReadAhead(localFile& f)
+	{
+		localFileAsync& a = *f.async;
+		if (a.rastate == RA_NONE) return RA_NONE; // only the emulation thread queues read-aheads
+		io.mutex.Lock();
+		if (a.rastate == RA_DONE)
+		{
+			a.ra.swap(a.rajob);
+			a.ra_pos = a.rajob_pos;
+			a.ra_len = a.rajob_got;
+			a.ra_eof = (a.rajob_got != READAHEAD);
+			a.rastate = RA_NONE;
+		}
+		ReadState res = a.rastate;
+		io.mutex.Unlock();
+		return res;
+	}
+
+	static void QueueReadAhead(localFile& f, Bit64u pos)
+	{
+		localFileAsync& a = *f.async;
+		io.mutex.Lock();
+		a.rajob_pos = pos;
+		a.rastate = RA_QUEUED;
+		Enqueue(f);
+		io.mutex.Unlock();
+	}
+
+	static void QueueWrite(localFile& f, const Bit8u* data, Bit32u len)
+	{
+		localFileAsync& a = *f.async;
+		io.mutex.Lock();
+		while (a.wb.size() + len > MAXPENDING) WaitLocked(f);
+		if (!a.wbruns.empty() && a.wbruns.back().pos + a.wbruns.back().len == a.pos) a.wbruns.back().len += len;
+		else { Run r = { a.pos, len }; a.wbruns.push_back(r); }
+		a.wb.insert(a.wb.end(), data, data + len);
+		Enqueue(f);
+		io.mutex.Unlock();
+		a.writing = a.dirty = true;
+		a.seen_write_seq = ++io.write_seq;
+	}
+
+	// Make writes of other handles of the same file visible to this handle, only needs to look when something was written since the last call
+	static void SyncOtherHandles(localFile& f)
+	{
+		localFileAsync& a = *f.async;
+		if (a.seen_write_seq == io.write_seq) return;
+		a.seen_write_seq = io.write_seq;
+		bool shared = false;
+		for (localFile* o : io.files)
+		{
+			if (o == &f || o->GetDrive() != f.GetDrive() || !o->IsName(f.name)) continue;
+			localFileAsync& oa = *o->async;
+			if (oa.writing || oa.fpos_write) WaitIdle(*o, false);
+			if (oa.fpos_write) fflush(o->fhandle); // move data out of the stdio buffer of the other handle
+			shared = true;
+		}
+		if (!shared) return;
+
+		// read-ahead data and the stdio buffer of this handle could be outdated (fseek can reuse buffered data, fflush drops it)
+		WaitIdle(f, true);
+		fflush(f.fhandle);
+		a.ra_len = 0;
+		a.fpos = (Bit64u)-1; // seek before the next host access
+	}
+
+	// Returns and resets a write error that happened in the background since the last call
+	static bool TakeWriteError(localFile& f)
+	{
+		localFileAsync& a = *f.async;
+		io.mutex.Lock();
+		const bool res = a.write_error;
+		a.write_error = false;
+		io.mutex.Unlock();
+		return res;
+	}
+
+	static Bit32u HostRead(localFile& f, Bit64u pos, void* data, Bit32u len)
+	{
+		localFileAsync& a = *f.async;
+		Bit64u t = DBP_GetTicksUs();
+		if (a.fpos != pos || a.fpos_write) fseek_wrap(f.fhandle, pos, SEEK_SET);
+		Bit32u got = (Bit32u)fread(data, 1, len, f.fhandle);
+		a.fpos = pos + got;
+		a.fpos_write = false;
+		Record(f, DBP_GetTicksUs() - t);
+		return got;
+	}
+
+	static Bit32u HostWrite(localFile& f, Bit64u pos, const void* data, Bit32u len)
+	{
+		localFileAsync& a = *f.async;
+		Bit64u t = DBP_GetTicksUs();
+		if (a.fpos != pos || !a.fpos_write) fseek_wrap(f.fhandle, pos, SEEK_SET);
+		Bit32u written = (Bit32u)fwrite(data, 1, len, f.fhandle);
+		a.fpos = pos + written;
+		a.fpos_write = true;
+		Record(f, DBP_GetTicksUs() - t);
+		return written;
+	}
+
+	static void GetPerfStats(char* buf, size_t bufsize)
+	{
+		// Lists the latency histogram and the time the emulation thread was stalled for each drive and resets the counters
+		char *p = buf, *pEnd = buf + bufsize;
+		*p = '\0';
+		io.mutex.Lock();
+		for (Bitu i = 0; i != DOS_DRIVES; i++)
+		{
+			Stats& s = io.stats[i];
+			if ((s.hist[0] | s.hist[1] | s.hist[2] | s.hist[3] | s.hist[4]) && p < pEnd)
+				p += snprintf(p, pEnd - p, "%s%c: %u|%u|%u|%u|%u stall %ums", (p == buf ? "" : ", "), (char)('A' + i), (unsigned)s.hist[0], (unsigned)s.hist[1], (unsigned)s.hist[2], (unsigned)s.hist[3], (unsigned)s.hist[4], (unsigned)(s.stall_us / 1000));
+			memset(&s, 0, sizeof(s));
+		}
+		io.mutex.Unlock();
+	}
+
+private:
+	static void Enqueue(localFile& f)
+	{
+		localFileAsync& a = *f.async;
+		if (io.threaded != 2)
+		{
+			// without an I/O thread run the job right away
+			DBP_ASSERT(!a.queued && !a.busy);
+			a.busy = true;
+			RunJob(f);
+			a.busy = false;
+			return;
+		}
+		if (a.queued || a.busy) return; // picked up again after the running job
+		a.queued = true;
+		io.queue.push_back(&f);
+		if (io.idle) { io.idle = false; io.wake.Post(); }
+	}
+
+	// Wait (with the mutex locked) for the I/O thread to make progress on the file
+	static void WaitLocked(localFile& f)
+	{
+		localFileAsync& a = *f.async;
+		Bit64u t = DBP_GetTicksUs();
+		a.waiting = true;
+		io.mutex.Unlock();
+		a.done.Wait();
+		io.mutex.Lock();
+		if (f.GetDrive() < DOS_DRIVES) io.stats[f.GetDrive()].stall_us += (Bit32u)(DBP_GetTicksUs() - t);
+	}
+
+	static void Record(localFile& f, Bit64u us)
+	{
+		if (f.GetDrive() >= DOS_DRIVES) return;
+		Bitu bucket = (us < 1000 ? 0 : us < 4000 ? 1 : us < 16000 ? 2 : us < 64000 ? 3 : 4);
+		if (io.threaded == 2) io.mutex.Lock();
+		io.stats[f.GetDrive()].hist[bucket]++;
+		if (io.threaded == 2) io.mutex.Unlock();
+	}
+
+	// Called with the mutex locked (or without an I/O thread), unlocks it during host file access
+	static void RunJob(localFile& f)
+	{
+		localFileAsync& a = *f.async;
+		const bool threaded = (io.threaded == 2);
+		if (a.rastate == RA_QUEUED)
+		{
+			if (a.rajob.size() != READAHEAD) a.rajob.resize(READAHEAD);
+			const Bit64u pos = a.rajob_pos;
+			if (threaded) io.mutex.Unlock();
+			Bit32u got = HostRead(f, pos, &a.rajob[0], READAHEAD);
+			if (threaded) io.mutex.Lock();
+			a.rajob_got = got;
+			a.rastate = RA_DONE;
+		}
+		if (!a.wb.empty())
+		{
+			a.wb.swap(a.wbjob);
+			a.wbruns.swap(a.wbjobruns);
+			if (threaded) io.mutex.Unlock();
+			const Bit8u* p = &a.wbjob[0];
+			bool failed = false;
+			for (const Run& r : a.wbjobruns) { if (HostWrite(f, r.pos, p, r.len) != r.len) failed = true; p += r.len; }
+			if (threaded) io.mutex.Lock();
+			if (failed) a.write_error = true;
+			a.wbjob.clear();
+			a.wbjobruns.clear();
+		}
+	}
+
+	static Thread::RET_t THREAD_CC ThreadFunc(void*)
+	{
+		io.mutex.Lock();
+		for (;;)
+		{
+			if (io.queue.empty())
+			{
+				if (io.quit) break;
+				io.idle = true;
+				io.mutex.Unlock();
+				io.wake.Wait();
+				io.mutex.Lock();
+				continue;
+			}
+			localFile& f = *io.queue.front();
+			io.queue.erase(io.queue.begin());
+			localFileAsync& a = *f.async;
+			a.queued = false;
+			a.busy = true;
+			RunJob(f);
+			a.busy = false;
+			if (!a.wb.empty() || a.rastate == RA_QUEUED) { a.queued = true; io.queue.push_back(&f); }
+			if (a.waiting) { a.waiting = false; a.done.Post(); }
+		}
+		io.mutex.Unlock();
+		io.exited.Post();
+		return 0;
+	}
+};
+localFileAsync::IO localFileAsync::io;
+
+void DBP_LocalFile_GetPerfStats(char* buf, size_t bufsize)
+{
+	localFileAsync::GetPerfStats(buf, bufsize);
+}
+
 bool localFile::Read(Bit8u * data,Bit16u * size) {
 	if (!OPEN_IS_READING(flags)) {	// check if file opened in write-only mode
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return false;
 	}
-	if (last_action==WRITE) fseek(fhandle,ftell(fhandle),SEEK_SET);
-	last_action=READ;
-	*size=(Bit16u)fread(data,1,*size,fhandle);
+	localFileAsync& a = localFileAsync::Attach(*this);
+	localFileAsync::SyncOtherHandles(*this);
+	if (localFileAsync::TakeWriteError(*this)) {
+		LOG_MSG("Warning: writing to file %s failed",name);
+		DOS_SetError(DOSERR_WRITE_FAULT);
+		return false;
+	}
+	if (a.writing) localFileAsync::WaitIdle(*this, false); // written data needs to reach the file first
+
+	const Bit64u start = a.pos;
+	Bit32u want = *size, got = 0;
+	while (got != want) {
+		localFileAsync::ReadState ras = localFileAsync::PollReadAhead(*this);
+		if (a.ra_len && a.pos >= a.ra_pos && a.pos < a.ra_pos + a.ra_len) {
+			Bit32u n = (Bit32u)(a.ra_pos + a.ra_len - a.pos);
+			if (n > want - got) n = want - got;
+			memcpy(data + got, &a.ra[(size_t)(a.pos - a.ra_pos)], n);
+			a.pos += n;
+			got += n;
+			continue;
+		}
+		if (ras == localFileAsync::RA_QUEUED && a.pos >= a.rajob_pos && a.pos < a.rajob_pos + localFileAsync::READAHEAD) {
+			// the data is already on its way, wait for it instead of reading it again
+			localFileAsync::WaitIdle(*this, false);
+			if (localFileAsync::PollReadAhead(*this) == localFileAsync::RA_NONE && a.ra_len && a.pos >= a.ra_pos && a.pos < a.ra_pos + a.ra_len) continue;
+		}
+		else if (ras != localFileAsync::RA_NONE) localFileAsync::WaitIdle(*this, true);
+		got += localFileAsync::HostRead(*this, a.pos, data + got, want - got);
+		a.pos = start + got;
+		break;
+	}
+	*size = (Bit16u)got;
+
+	// Request the next chunk in the background when the file is being read sequentially
+	if (start == a.seq_end && got == want && localFileAsync::io.threaded == 2 && localFileAsync::PollReadAhead(*this) == localFileAsync::RA_NONE) {
+		const bool in_ra = (a.ra_len && a.pos >= a.ra_pos && a.pos <= a.ra_pos + a.ra_len);
+		if (!in_ra || (!a.ra_eof && a.ra_pos + a.ra_len - a.pos < localFileAsync::READAHEAD / 2))
+			localFileAsync::QueueReadAhead(*this, (in_ra ? a.ra_pos + a.ra_len : a.pos));
+	}
+	a.seq_end = a.pos;
+
 	/* Fake harddrive motion. Inspector Gadget with soundblaster compatible */
 	/* Same for Igor */
 	/* hardrive motion => unmask irq 2. Only do it when it's masked as unmasking is realitively heavy to emulate */
@@ -493,53 +857,82 @@ bool localFile::Write(Bit8u * data,Bit16u * size) {
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return false;
 	}
-	if (last_action==READ) fseek(fhandle,ftell(fhandle),SEEK_SET);
-	last_action=WRITE;
+	localFileAsync& a = localFileAsync::Attach(*this);
+	localFileAsync::SyncOtherHandles(*this);
+	if (localFileAsync::TakeWriteError(*this)) {
+		// A previous write failed in the background (most likely the host disk is full), report it like a full disk
+		LOG_MSG("Warning: writing to file %s failed",name);
+		*size = 0;
+		return true;
+	}
+	if (a.rastate != localFileAsync::RA_NONE) localFileAsync::WaitIdle(*this, true);
+	a.ra_len = 0;
+	a.seq_end = (Bit64u)-1;
 	if(*size==0){  
-        return (!ftruncate(fileno(fhandle),ftell(fhandle)));
-    }
-    else 
-    {
-		*size=(Bit16u)fwrite(data,1,*size,fhandle);
+		localFileAsync::WaitIdle(*this, false);
+		fseek_wrap(fhandle,a.pos,SEEK_SET);
+		a.fpos = a.pos;
+		a.fpos_write = a.dirty = false;
+		a.seen_write_seq = ++localFileAsync::io.write_seq;
+		return (!ftruncate(fileno(fhandle),(off_t)a.pos));
+	}
+	else 
+	{
+		// Data is reported as written right away, the I/O thread writes it out in the background
+		localFileAsync::QueueWrite(*this, data, *size);
+		a.pos += *size;
 		return true;
-    }
+	}
 }
 
 bool localFile::Seek(Bit32u * pos,Bit32u type) {
-	int seektype;
+	localFileAsync& a = localFileAsync::Attach(*this);
+	localFileAsync::SyncOtherHandles(*this);
+	if (localFileAsync::TakeWriteError(*this)) {
+		LOG_MSG("Warning: writing to file %s failed",name);
+		DOS_SetError(DOSERR_WRITE_FAULT);
+		return false;
+	}
+	Bit64s newpos;
 	switch (type) {
-	case DOS_SEEK_SET:seektype=SEEK_SET;break;
-	case DOS_SEEK_CUR:seektype=SEEK_CUR;break;
-	case DOS_SEEK_END:seektype=SEEK_END;break;
+	case DOS_SEEK_SET:newpos=*reinterpret_cast<Bit32s*>(pos);break;
+	case DOS_SEEK_CUR:newpos=(Bit64s)a.pos+*reinterpret_cast<Bit32s*>(pos);break;
+	case DOS_SEEK_END:newpos=-1;break;
 	default:
 	//TODO Give some doserrorcode;
 		return false;//ERROR
 	}
-	int ret=fseek(fhandle,*reinterpret_cast<Bit32s*>(pos),seektype);
-	if (ret!=0) {
-		// Out of file range, pretend everythings ok 
-		// and move file pointer top end of file... ?! (Black Thorne)
-		fseek(fhandle,0,SEEK_END);
-	};
-#if 0
-	fpos_t temppos;
-	fgetpos(fhandle,&temppos);
-	Bit32u * fake_pos=(Bit32u*)&temppos;
-	*pos=*fake_pos;
-#endif
-	*pos=(Bit32u)ftell(fhandle);
-	last_action=NONE;
+	if (type==DOS_SEEK_END || newpos<0) {
+		// The end of the file is only known once all pending writes have reached it
+		localFileAsync::WaitIdle(*this, true);
+		if (type!=DOS_SEEK_END || fseek(fhandle,*reinterpret_cast<Bit32s*>(pos),SEEK_END)!=0) {
+			// Out of file range, pretend everythings ok 
+			// and move file pointer top end of file... ?! (Black Thorne)
+			fseek(fhandle,0,SEEK_END);
+		}
+		a.pos = a.fpos = (Bit64u)ftell_wrap(fhandle);
+		a.fpos_write = a.dirty = false;
+	}
+	else a.pos = (Bit64u)newpos;
+	*pos=(Bit32u)a.pos;
 	return true;
 }
 
 bool localFile::Close() {
 	// only close if one reference left
+	bool res = true;
 	if (refCtr==1) {
+		if(async) {
+			localFileAsync::SyncOtherHandles(*this);
+			localFileAsync::WaitIdle(*this, true);
+			if (localFileAsync::TakeWriteError(*this)) { LOG_MSG("Warning: writing to file %s failed",name); res = false; }
+			localFileAsync::Detach(*this);
+		}
 		if(fhandle) fclose(fhandle);
 		fhandle = 0;
 		open = false;
 	};
-	return true;
+	return res;
 }
 
 Bit16u localFile::GetInformation(void) {
@@ -553,13 +946,17 @@ localFile::localFile(const char* _name, FILE * handle) {
 	UpdateDateTimeFromHost();
 
 	attr=DOS_ATTR_ARCHIVE;
-	last_action=NONE;
+	async=NULL;
 	read_only_medium=false;
 
 	name=0;
 	SetName(_name);
 }
 
+localFile::~localFile() {
+	if (async) localFileAsync::Detach(*this);
+}
+
 void localFile::FlagReadOnlyMedium(void) {
 	read_only_medium = true;
 }
@@ -578,11 +975,21 @@ bool localFile::UpdateDateTimeFromHost(void) {
 	return true;
 }
 
-void localFile::Flush(void) {
-	if (last_action==WRITE) {
-		fseek(fhandle,ftell(fhandle),SEEK_SET);
-		last_action=NONE;
+bool localFile::Flush(void) {
+	// Wait for pending writes and move the FILE handle to the DOS file position which also flushes the stdio buffer
+	if (!async) return true;
+	localFileAsync::SyncOtherHandles(*this);
+	localFileAsync::WaitIdle(*this, true);
+	if (async->dirty || async->fpos != async->pos) {
+		fseek_wrap(fhandle,async->pos,SEEK_SET);
+		async->fpos = async->pos;
+		async->fpos_write = async->dirty = false;
+	}
+	if (localFileAsync::TakeWriteError(*this)) {
+		LOG_MSG("Warning: writing to file %s failed",name);
+		return false;
 	}
+	return true;
 }
 
 
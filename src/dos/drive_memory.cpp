@@ -23,6 +23,15 @@
 #include <time.h>
 #include <vector>
 
+#if defined(WIN32)
+#include <windows.h>
+#include <io.h>
+#define MEMORY_HAVE_MMAP
+#elif defined(C_HAVE_MPROTECT)
+#include <sys/mman.h>
+#define MEMORY_HAVE_MMAP
+#endif
+
 struct Memory_Entry
 {
 protected:
@@ -61,11 +70,20 @@ public:
 struct Memory_File : Memory_Entry
 {
 	std::vector<Bit8u> mem_data;
-	Bit32u refs;
+	const Bit8u* snap_data; // content inside a loaded snapshot, copied into mem_data on first modification
+	Bit32u snap_size, refs;
+
+	Memory_File(Bit16u _attr, const char* filename, Bit16u _date = 0, Bit16u _time = 0) : Memory_Entry(_attr, filename, _date, _time), snap_data(NULL), snap_size(0), refs(0) { DBP_ASSERT(IsFile()); }
 
-	Memory_File(Bit16u _attr, const char* filename, Bit16u _date = 0, Bit16u _time = 0) : Memory_Entry(_attr, filename, _date, _time), refs(0) { DBP_ASSERT(IsFile()); }
+	inline Bit32u Size() { return (snap_data ? snap_size : (Bit32u)mem_data.size()); }
+	inline const Bit8u* Data() { return (snap_data ? snap_data : (mem_data.empty() ? NULL : &mem_data[0])); }
 
-	inline Bit32u Size() { return (Bit32u)mem_data.size(); }
+	void MakeWritable()
+	{
+		if (!snap_data) return;
+		mem_data.assign(snap_data, snap_data + snap_size);
+		snap_data = NULL;
+	}
 };
 
 struct Memory_Handle : public DOS_File
@@ -90,14 +108,14 @@ struct Memory_Handle : public DOS_File
 	{
 		if (!OPEN_IS_READING(flags)) return FALSE_SET_DOSERR(ACCESS_DENIED);
 		if (!*size) return true;
-		if (mem_pos >= (Bit32u)src->mem_data.size())
+		if (mem_pos >= src->Size())
 		{
 			*size = 0;
 			return true;
 		}
-		Bit32u left = (Bit32u)src->mem_data.size() - mem_pos;
+		Bit32u left = src->Size() - mem_pos;
 		if (left < *size) *size = (Bit16u)left;
-		memcpy(data, &src->mem_data.operator[](mem_pos), *size);
+		memcpy(data, src->Data() + mem_pos, *size);
 		mem_pos += *size;
 		return true;
 	}
@@ -106,6 +124,7 @@ struct Memory_Handle : public DOS_File
 	{
 		if (!OPEN_IS_WRITING(flags)) return FALSE_SET_DOSERR(ACCESS_DENIED);
 		wasmodified = true;
+		src->MakeWritable();
 		if (!*size)
 		{
 			// file resizing/truncating
@@ -126,7 +145,7 @@ struct Memory_Handle : public DOS_File
 		{
 			case DOS_SEEK_SET: seekto = (Bit32s)*pos; break;
 			case DOS_SEEK_CUR: seekto = (Bit32s)*pos + (Bit32s)mem_pos; break;
-			case DOS_SEEK_END: seekto = (Bit32s)src->mem_data.size() + (Bit32s)*pos; break;
+			case DOS_SEEK_END: seekto = (Bit32s)src->Size() + (Bit32s)*pos; break;
 			default: return FALSE_SET_DOSERR(FUNCTION_NUMBER_INVALID);
 		}
 		if (seekto < 0) seekto = 0;
@@ -188,14 +207,40 @@ struct Memory_Search
 	Bit32u index;
 };
 
+// Snapshot file layout (little endian):
+//   Header: "DBPMEMS1", Bit32u entry count, Bit32u reserved, Bit64u file size, 8 reserved bytes
+//   Entries: Bit32u parent (1-based index of a directory entry, 0 for root), Bit32u size, Bit64u data offset, Bit16u date, time, attr, name, padding
+//   File data: each file starts at a page aligned offset so it can be used directly from a read-only mapping of the whole file
+struct Memory_Snapshot
+{
+	enum msDefs : Bit32u { HEADER_SIZE = 32, ENTRY_SIZE = 40, ALIGN = 4096 };
+	const Bit8u* map;
+	Bit64u size;
+	bool mapped;
+};
+
 struct memoryDriveImpl
 {
 	Memory_Directory root;
 	StringToPointerHashMap<Memory_Directory> directories;
 	std::vector<Memory_Search> searches;
 	std::vector<Bit16u> free_search_ids;
+	Memory_Snapshot snapshot;
+
+	memoryDriveImpl() : root(DOS_ATTR_VOLUME|DOS_ATTR_DIRECTORY, "") { snapshot.map = NULL; snapshot.size = 0; snapshot.mapped = false; }
 
-	memoryDriveImpl() : root(DOS_ATTR_VOLUME|DOS_ATTR_DIRECTORY, "") { }
+	~memoryDriveImpl()
+	{
+		if (!snapshot.map) return;
+		#ifdef MEMORY_HAVE_MMAP
+		#ifdef WIN32
+		if (snapshot.mapped) { UnmapViewOfFile((void*)snapshot.map); return; }
+		#else
+		if (snapshot.mapped) { munmap((void*)snapshot.map, (size_t)snapshot.size); return; }
+		#endif
+		#endif
+		free((void*)snapshot.map);
+	}
 
 	Memory_Directory* GetParentDir(const char* path, const char** out_name)
 	{
@@ -250,7 +295,7 @@ bool memoryDrive::FileCreate(DOS_File * * file, char * path, Bit16u attributes)
 	if (!dir) return FALSE_SET_DOSERR(PATH_NOT_FOUND);
 	if (e && e->IsDirectory()) return FALSE_SET_DOSERR(ACCESS_DENIED);
 	Memory_File* f;
-	if (e) { f = e->AsFile(); f->mem_data.clear(); f->SetTimeNow(); }
+	if (e) { f = e->AsFile(); f->snap_data = NULL; f->mem_data.clear(); f->SetTimeNow(); }
 	else { f = new Memory_File(attributes, filename); dir->entries.Put(filename, f); }
 	*file = new Memory_Handle(f, OPEN_READWRITE, path_org);
 	return true;
@@ -472,3 +517,153 @@ bool memoryDrive::CloneEntry(DOS_Drive* src_drv, const char* src_path)
 	dir->entries.Put(name, e);
 	return true;
 }
+
+bool memoryDrive::CloneDrive(DOS_Drive* src_drv)
+{
+	struct Local
+	{
+		memoryDrive* drv; DOS_Drive* src_drv; bool failed;
+		static void Clone(const char* path, bool is_dir, Bit32u size, Bit16u date, Bit16u time, Bit8u attr, Bitu data)
+		{
+			Local& l = *(Local*)data;
+			if (!l.drv->CloneEntry(l.src_drv, path)) l.failed = true;
+		}
+	};
+	DBP_ASSERT(!impl->root.entries.Len());
+	Local l = { this, src_drv, false };
+	DriveFileIterator(src_drv, Local::Clone, (Bitu)&l);
+	return !l.failed;
+}
+
+bool memoryDrive::WriteSnapshot(const char* path)
+{
+	// List entries breadth first so every directory is listed before its contents
+	struct Item { Memory_Entry* e; Bit32u parent; Bit64u ofs; };
+	std::vector<Item> items;
+	for (Memory_Entry* e : impl->root.entries) { Item it = { e, 0, 0 }; items.push_back(it); }
+	for (size_t i = 0; i != items.size(); i++)
+	{
+		if (!items[i].e->IsDirectory()) continue;
+		for (Memory_Entry* e : items[i].e->AsDirectory()->entries) { Item it = { e, (Bit32u)(i + 1), 0 }; items.push_back(it); }
+	}
+
+	std::vector<Bit8u> head(Memory_Snapshot::HEADER_SIZE + items.size() * Memory_Snapshot::ENTRY_SIZE);
+	Bit64u ofs = head.size();
+	for (Item& it : items)
+	{
+		if (!it.e->IsFile() || !it.e->AsFile()->Size()) continue;
+		it.ofs = ofs = (ofs + (Memory_Snapshot::ALIGN - 1)) & ~(Bit64u)(Memory_Snapshot::ALIGN - 1);
+		ofs += it.e->AsFile()->Size();
+	}
+
+	Bit8u* p = &head[0];
+	memcpy(p, "DBPMEMS1", 8);
+	host_writed(p + 8, (Bit32u)items.size());
+	host_writed(p + 16, (Bit32u)ofs);
+	host_writed(p + 20, (Bit32u)(ofs >> 32));
+	for (const Item& it : items)
+	{
+		p += (p == &head[0] ? Memory_Snapshot::HEADER_SIZE : Memory_Snapshot::ENTRY_SIZE);
+		host_writed(p +  0, it.parent);
+		host_writed(p +  4, (it.e->IsFile() ? it.e->AsFile()->Size() : 0));
+		host_writed(p +  8, (Bit32u)it.ofs);
+		host_writed(p + 12, (Bit32u)(it.ofs >> 32));
+		host_writew(p + 16, it.e->date);
+		host_writew(p + 18, it.e->time);
+		host_writew(p + 20, it.e->attr);
+		memcpy(p + 22, it.e->name, DOS_NAMELENGTH_ASCII);
+	}
+
+	FILE* f = fopen_wrap(path, "wb");
+	if (!f) return false;
+	bool failed = !fwrite(&head[0], head.size(), 1, f);
+	static const Bit8u zeros[Memory_Snapshot::ALIGN] = { 0 };
+	ofs = head.size();
+	for (const Item& it : items)
+	{
+		if (!it.ofs || failed) continue;
+		Memory_File* mf = it.e->AsFile();
+		failed |= ((it.ofs != ofs && !fwrite(zeros, (size_t)(it.ofs - ofs), 1, f)) || !fwrite(mf->Data(), mf->Size(), 1, f));
+		ofs = it.ofs + mf->Size();
+	}
+	failed |= !!fclose(f);
+	if (failed) remove(path);
+	return !failed;
+}
+
+bool memoryDrive::ReadSnapshot(const char* path)
+{
+	if (impl->root.entries.Len() || impl->snapshot.map) { DBP_ASSERT(false); return false; }
+	FILE* f = fopen_wrap(path, "rb");
+	if (!f) return false;
+	Bit8u hdr[Memory_Snapshot::HEADER_SIZE];
+	fseek_wrap(f, 0, SEEK_END);
+	const Bit64u filesize = (Bit64u)ftell_wrap(f);
+	fseek_wrap(f, 0, SEEK_SET);
+	const Bit32u count = (fread(hdr, sizeof(hdr), 1, f) && !memcmp(hdr, "DBPMEMS1", 8) ? host_readd(hdr + 8) : 0);
+	const Bit64u size = host_readd(hdr + 16) | ((Bit64u)host_readd(hdr + 20) << 32);
+	if (!count || size != filesize || size < Memory_Snapshot::HEADER_SIZE + (Bit64u)count * Memory_Snapshot::ENTRY_SIZE || (sizeof(void*) < 8 && size > 0x7FFFFFFF))
+	{
+		fclose(f);
+		return false;
+	}
+
+	// Map the whole file read-only, file contents are used directly until a file gets modified
+	Memory_Snapshot& snap = impl->snapshot;
+	snap.size = size;
+	#ifdef MEMORY_HAVE_MMAP
+	#ifdef WIN32
+	if (HANDLE hmap = CreateFileMappingA((HANDLE)_get_osfhandle(_fileno(f)), NULL, PAGE_READONLY, 0, 0, NULL))
+	{
+		snap.map = (const Bit8u*)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(hmap); // the view keeps the mapping alive
+	}
+	#else
+	void* m = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(f), 0);
+	snap.map = (m != MAP_FAILED ? (const Bit8u*)m : NULL);
+	#endif
+	snap.mapped = (snap.map != NULL);
+	#endif
+	if (!snap.map)
+	{
+		Bit8u* buf = (Bit8u*)malloc((size_t)size);
+		if (buf && (fseek_wrap(f, 0, SEEK_SET) || !fread(buf, (size_t)size, 1, f))) { free(buf); buf = NULL; }
+		snap.map = buf;
+	}
+	fclose(f);
+	if (!snap.map) return false;
+
+	std::vector<Memory_Directory*> dirs(count + 1, (Memory_Directory*)NULL);
+	std::vector<std::string> dir_paths(count + 1);
+	dirs[0] = &impl->root;
+	const Bit8u* p = snap.map + Memory_Snapshot::HEADER_SIZE;
+	for (Bit32u i = 1; i <= count; i++, p += Memory_Snapshot::ENTRY_SIZE)
+	{
+		const Bit32u parent = host_readd((HostPt)p), fsize = host_readd((HostPt)p + 4);
+		const Bit64u ofs = host_readd((HostPt)p + 8) | ((Bit64u)host_readd((HostPt)p + 12) << 32);
+		const Bit16u date = host_readw((HostPt)p + 16), time = host_readw((HostPt)p + 18), attr = host_readw((HostPt)p + 20);
+		char name[DOS_NAMELENGTH_ASCII];
+		memcpy(name, p + 22, DOS_NAMELENGTH_ASCII);
+		name[DOS_NAMELENGTH_ASCII - 1] = '\0';
+		Memory_Directory* dir = (parent < i ? dirs[parent] : NULL);
+		if (!dir || !name[0] || dir->entries.Get(name) || (fsize && (ofs > size || fsize > size - ofs))) { DBP_ASSERT(false); continue; } // skip invalid entries
+
+		Memory_Entry* e;
+		if (attr & DOS_ATTR_DIRECTORY)
+		{
+			e = dirs[i] = new Memory_Directory(attr, name, date, time);
+			std::string& dir_path = dir_paths[i];
+			if (parent) (dir_path = dir_paths[parent]) += '\\';
+			dir_path += name;
+			impl->directories.Put(dir_path.c_str(), dirs[i]);
+		}
+		else
+		{
+			e = new Memory_File(attr, name, date, time);
+			e->AsFile()->snap_data = (fsize ? snap.map + ofs : NULL);
+			e->AsFile()->snap_size = fsize;
+		}
+		dir->entries.Put(name, e);
+	}
+	return true;
+}
@@ -521,11 +521,28 @@ struct patchDriveImpl
 	std::vector<Patch_Search*> searches;
 	std::vector<Patch_Layer> layers;
 	Patch_Layer *layer_top, *layer_bottom;
+	DriveLayerIndex layer_index; // topmost layer holding a path that is not a patch entry
 	Bit8u IterateLayer;
 	bool IterateGetVariant, IterateHadVariant, IterateYMLOnly;
 
 	patchDriveImpl() : root(255, DOS_ATTR_VOLUME|DOS_ATTR_DIRECTORY, "", 0, 0), layer_top(NULL), layer_bottom(NULL) { }
 
+	// Returns the topmost layer that has the path or NULL if no layer has it
+	Patch_Layer* FindLayer(const char* path)
+	{
+		int idx = layer_index.Get(path);
+		if (idx < 0)
+		{
+			const Bit16u save_errorcode = dos.errorcode;
+			Bit16u attr; idx = DriveLayerIndex::LAYER_NONE;
+			for (Patch_Layer* l = layer_top; l >= layer_bottom; l--)
+				if (l->under.GetFileAttr((char*)path, &attr)) { idx = (int)(layer_top - l); break; }
+			dos.errorcode = save_errorcode;
+			layer_index.Set(path, (Bit8u)idx);
+		}
+		return (idx == DriveLayerIndex::LAYER_NONE ? NULL : layer_top - idx);
+	}
+
 	~patchDriveImpl()
 	{
 		for (Patch_Search* s : searches) delete s;
@@ -547,6 +564,7 @@ struct patchDriveImpl
 	void Reload(bool ymlOnly = false)
 	{
 		if (layers.empty()) { DBP_ASSERT(false); return; }
+		drive_content_generation++; // content seen by drives stacked on top of this changes
 		if (!ymlOnly)
 		{
 			for (Patch_Entry* e : root.entries) Patch_Directory::DeleteEntry(e);
@@ -706,6 +724,7 @@ void patchDrive::AddLayer(DOS_Drive& under, bool autodelete_under, DOS_File* pat
 	impl->layers.emplace_back(under, autodelete_under, (patchzip ? new zipDrive(patchzip, enable_crc_check) : NULL));
 	impl->layer_top = &impl->layers.back();
 	impl->layer_bottom = &impl->layers.front();
+	impl->layer_index.Clear();
 	if (impl->layers.size() == 1) label.SetLabel(under.GetLabel(), false, true);
 	if (final_layer_load_yml) { patchDrive::dos_yml.clear(); impl->Reload(); }
 }
@@ -732,8 +751,10 @@ bool patchDrive::FileOpen(DOS_File * * file, char * name, Bit32u flags)
 		return true;
 	}
 	const Bit16u save_errorcode = dos.errorcode;
-	for (Patch_Layer* l = impl->layer_top; l >= impl->layer_bottom; l--)
-		if (l->under.FileOpen(file, name, flags))
+	Patch_Layer* found = impl->FindLayer(name);
+	if (found && found->under.FileOpen(file, name, flags)) return (dos.errorcode = save_errorcode, true);
+	for (Patch_Layer* l = (found ? impl->layer_top : impl->layer_bottom); l >= impl->layer_bottom; l--) // only the bottom layer to set the error if not found
+		if (l != found && l->under.FileOpen(file, name, flags))
 			return (dos.errorcode = save_errorcode, true);
 	return false;
 }
@@ -757,7 +778,10 @@ bool patchDrive::FileExists(const char* name)
 {
 	DOSPATH_REMOVE_ENDINGDOTS(name);
 	if (Patch_Entry* p = impl->Get(name)) return p->IsFile();
-	for (Patch_Layer* l = impl->layer_bottom; l <= impl->layer_top; l++) if (l->under.FileExists(name)) return true;
+	Patch_Layer* found = impl->FindLayer(name);
+	if (!found) return false;
+	if (found->under.FileExists(name)) return true;
+	for (Patch_Layer* l = impl->layer_bottom; l <= impl->layer_top; l++) if (l != found && l->under.FileExists(name)) return true;
 	return false;
 }
 
@@ -776,7 +800,10 @@ bool patchDrive::TestDir(char* dir_path)
 	DOSPATH_REMOVE_ENDINGDOTS(dir_path);
 	if (!dir_path[0]) return true;
 	if (Patch_Entry* p = impl->Get(dir_path)) return p->IsDirectory();
-	for (Patch_Layer* l = impl->layer_bottom; l <= impl->layer_top; l++) if (l->under.TestDir(dir_path)) return true;
+	Patch_Layer* found = impl->FindLayer(dir_path);
+	if (!found) return false;
+	if (found->under.TestDir(dir_path)) return true;
+	for (Patch_Layer* l = impl->layer_bottom; l <= impl->layer_top; l++) if (l != found && l->under.TestDir(dir_path)) return true;
 	return false;
 }
 
@@ -872,8 +899,10 @@ bool patchDrive::FileStat(const char* name, FileStat_Block * const stat_block)
 		stat_block->time = p->time;
 		return true;
 	}
-	for (Patch_Layer* l = impl->layer_top; l >= impl->layer_bottom; l--)
-		if (l->under.FileStat(name, stat_block))
+	Patch_Layer* found = impl->FindLayer(name);
+	if (found && found->under.FileStat(name, stat_block)) return true;
+	for (Patch_Layer* l = (found ? impl->layer_top : impl->layer_bottom); l >= impl->layer_bottom; l--)
+		if (l != found && l->under.FileStat(name, stat_block))
 			return true;
 	return false;
 }
@@ -882,8 +911,10 @@ bool patchDrive::GetFileAttr(char * name, Bit16u * attr)
 {
 	DOSPATH_REMOVE_ENDINGDOTS(name);
 	if (Patch_Entry* p = impl->Get(name)) { *attr = p->attr; return true; }
-	for (Patch_Layer* l = impl->layer_top; l >= impl->layer_bottom; l--)
-		if (l->under.GetFileAttr(name, attr))
+	Patch_Layer* found = impl->FindLayer(name);
+	if (found && found->under.GetFileAttr(name, attr)) return true;
+	for (Patch_Layer* l = (found ? impl->layer_top : impl->layer_bottom); l >= impl->layer_bottom; l--)
+		if (l != found && l->under.GetFileAttr(name, attr))
 			return true;
 	return false;
 }
@@ -895,8 +926,10 @@ bool patchDrive::GetLongFileName(const char* path, char longname[256])
 	if (Patch_Entry* p = impl->Get(path))
 		if (p->IsDirectory() || p->AsFile()->type == Patch_File::TYPE_RAW)
 			return impl->layer_bottom[p->layer].patchzip->GetLongFileName(p->zippath, longname);
-	for (Patch_Layer* l = impl->layer_top; l >= impl->layer_bottom; l--)
-		if (l->under.GetLongFileName(path, longname))
+	Patch_Layer* found = impl->FindLayer(path);
+	if (found && found->under.GetLongFileName(path, longname)) return true;
+	for (Patch_Layer* l = (found ? impl->layer_top : impl->layer_bottom); l >= impl->layer_bottom; l--)
+		if (l != found && l->under.GetLongFileName(path, longname))
 			return true;
 	return false;
 }
@@ -52,6 +52,54 @@ struct Union_Search
 	Bit32u dir_hash;
 };
 
+// Large files in a save file are split into content defined chunks which are stored as separate ZIP entries in CHUNKS.DBP
+// A chunk is only written once, unchanged parts of a file are shared with previous saves
+// The save always holds all data of a file so it does not depend on the base content staying the same
+// Older cores don't know about this and would see the chunks as regular files, so it needs to be enabled explicitly
+struct Union_Chunk
+{
+	enum ucDefs : Bit32u
+	{
+		MIN_FILE_SIZE = 256 * 1024, // files smaller than this are stored as a whole
+		MIN_SIZE = 4 * 1024,        // chunk size limits, average size is around 20 KB
+		MAX_SIZE = 64 * 1024,
+		CUT_MASK = 0xFFFC0000,      // cut when the top 14 bits of the rolling hash are zero
+	};
+
+	Bit32u crc, fnv, size, datetime, src_ofs;
+	Bit32s src_file, next; // chunked file and offset the data can be read from, next chunk with the same CRC
+	bool has_fnv, referenced, keep;
+	char name[13];
+
+	// Length of the next chunk, the cut points only depend on the last 32 bytes so they resynchronize after an insertion or removal
+	static Bit32u Cut(const Bit8u* p, Bit32u len)
+	{
+		static Bit32u gear[256];
+		if (!gear[0]) for (Bit32u i = 0, x = 0x2545F491; i != 256; i++) { x ^= x << 13; x ^= x >> 17; x ^= x << 5; gear[i] = x; }
+		if (len <= MIN_SIZE) return len;
+		const Bit32u end = (len < MAX_SIZE ? len : MAX_SIZE);
+		for (Bit32u h = 0, i = MIN_SIZE - 32; i != end; i++)
+			if (!((h = (h << 1) + gear[p[i]]) & CUT_MASK) && i >= MIN_SIZE) return i + 1;
+		return end;
+	}
+
+	// Second hash next to the CRC to identify chunks with identical content
+	static Bit32u FNV(const Bit8u* p, Bit32u len)
+	{
+		Bit32u h = (Bit32u)0x811c9dc5;
+		for (const Bit8u* e = p + len; p != e; p++) h = ((h ^ *p) * (Bit32u)0x01000193);
+		return h;
+	}
+};
+
+struct Union_ChunkedFile
+{
+	struct Piece { Bit32u len; Bit32s chunk; };
+	std::string path;
+	Bit32u size, datetime;
+	std::vector<Piece> pieces;
+};
+
 struct Union_Modification
 {
 	enum Type { TDIR = 'D', TFILE = 'F', TDELETE = 'x', TNONE = 0 };
@@ -150,14 +198,18 @@ struct unionDriveImpl
 	std::vector<Union_Search> searches;
 	std::vector<Bit16u> free_search_ids;
 	std::vector<Bit32u> dirty_paths;
+	DriveLayerIndex layers; // paths known to be in over (0) or not (1), avoids probing over for every lookup of a file in under
 	std::string save_file;
+	std::vector<Union_Chunk> chunks;
+	ValueHashMap<Bit32s> chunk_crcs; // first chunk with a given CRC
+	std::vector<Union_ChunkedFile> chunked_files;
 	Bit32u save_size, free_bytes;
-	bool writable, autodelete_under, autodelete_over, dirty;
+	bool writable, autodelete_under, autodelete_over, dirty, chunked_save;
 	Bit16u modification_date, modification_time;
 
-	unionDriveImpl(DOS_Drive* _under, DOS_Drive* _over, const char* _save_file, bool _autodelete_under, bool _autodelete_over = false, bool strict_mode = false)
+	unionDriveImpl(DOS_Drive* _under, DOS_Drive* _over, const char* _save_file, bool _autodelete_under, bool _autodelete_over = false, bool strict_mode = false, bool _chunked_save = false)
 		: save_mem(_over ? NULL : new memoryDrive()), under(_under), over(_over ? _over : save_mem), save_size(0), free_bytes(0),
-		  autodelete_under(_autodelete_under), autodelete_over(_autodelete_over || save_mem), dirty(false)
+		  autodelete_under(_autodelete_under), autodelete_over(_autodelete_over || save_mem), dirty(false), chunked_save(_chunked_save)
 	{
 		Bit16u bytes_sector; Bit8u sectors_cluster; Bit16u total_clusters; Bit16u free_clusters;
 		over->AllocationInfo(&bytes_sector, &sectors_cluster, &total_clusters, &free_clusters);
@@ -193,6 +245,20 @@ struct unionDriveImpl
 			delete over;
 	}
 
+	bool InOver(const char* path)
+	{
+		if (!*path) return true;
+		int layer = layers.Get(path);
+		if (layer < 0)
+		{
+			const Bit16u save_errorcode = dos.errorcode;
+			Bit16u tmp; layer = (over->GetFileAttr((char*)path, &tmp) ? 0 : 1);
+			dos.errorcode = save_errorcode;
+			layers.Set(path, (Bit8u)layer);
+		}
+		return (layer == 0);
+	}
+
 	bool ExistInOverOrUnder(char* path, bool* out_is_file, bool* out_in_under)
 	{
 		bool file_in_under = under->FileExists(path), dir_in_under = under->TestDir(path), is_file = (over->FileExists(path) || file_in_under);
@@ -224,6 +290,7 @@ struct unionDriveImpl
 		}
 		if (type == Union_Modification::TFILE ? over->FileUnlink(path) : over->RemoveDir(path))
 		{
+			layers.Forget(path);
 			Bit16u tmp; bool in_under = under->GetFileAttr(path, &tmp);
 			if (in_under) { modifications.Put(path, new Union_Modification(path)); SetModificationTimestamp(); } //mark deletion
 			return TRUE_RESET_DOSERR;
@@ -245,7 +312,8 @@ struct unionDriveImpl
 		{
 			return (m->IsRedirect() && m->RedirectType() == type ? true : FALSE_SET_DOSERR(FILE_NOT_FOUND));
 		}
-		return (type == Union_Modification::TFILE ? (over->FileExists(path) || under->FileExists(path)) : (over->TestDir(path) || under->TestDir(path)));
+		if (type == Union_Modification::TFILE) return ((InOver(path) && over->FileExists(path)) || under->FileExists(path));
+		return ((InOver(path) && over->TestDir(path)) || under->TestDir(path));
 	}
 
 	bool UnionPrepareCreate(char* path, bool can_overwrite)
@@ -274,12 +342,25 @@ struct unionDriveImpl
 		{
 			zipDrive* zip;
 			unionDriveImpl* impl;
+			std::vector<Bit8u> chunk_manifest;
 			bool strict_mode;
 			Loader(zipDrive* _zip, unionDriveImpl* _impl, bool _strict_mode) : zip(_zip), impl(_impl), strict_mode(_strict_mode) {}
 			static void LoadFiles(const char* path, bool is_dir, Bit32u size, Bit16u date, Bit16u time, Bit8u attr, Bitu data)
 			{
 				Loader& l = *(Loader*)data;
 				DOS_File* df;
+				if (path[0] == 'C' && !strncmp(path, "CHUNKS.DBP", 10) && (!path[10] || path[10] == '\\'))
+				{
+					// Chunks get used by the files listed in FILECHNK.DBP
+					if (!is_dir && path[10] && strlen(path + 11) == 12 && l.impl->FindChunk(path + 11) < 0)
+						l.impl->AddChunk((Bit32u)strtoul(std::string(path + 11, 8).c_str(), NULL, 16), size, (((Bit32u)date) << 16) | time, path + 11);
+					return;
+				}
+				if (path[0] == 'F' && !strcmp(path, "FILECHNK.DBP"))
+				{
+					if (!DriveGetFileContent(l.zip, path, l.chunk_manifest)) { DBP_ASSERT(0); }
+					return;
+				}
 				if (path[0] == 'F' && size && !strcmp(path, "FILEMODS.DBP") && l.zip->FileOpen(&df, (char*)path, 0))
 				{
 					df->AddRef();
@@ -317,6 +398,7 @@ struct unionDriveImpl
 		Loader l(new zipDrive(new rawFile(zip_file_h, false)), this, strict_mode);
 		const Bit16u save_errorcode = dos.errorcode;
 		DriveFileIterator(l.zip, Loader::LoadFiles, (Bitu)&l);
+		if (l.chunk_manifest.size()) LoadChunkedFiles(l.zip, l.chunk_manifest, strict_mode);
 
 		// Forget delete modifications that have been re-added as files/directories to the save ZIP
 		for (Union_Modification* m : modifications)
@@ -331,20 +413,261 @@ struct unionDriveImpl
 		delete l.zip; // calls fclose
 	}
 
+	Bit32s FindChunk(Bit32u crc, Bit32u fnv, Bit32u size)
+	{
+		Bit32s* first = chunk_crcs.Get(crc);
+		for (Bit32s i = (first ? *first : -1); i != -1; i = chunks[i].next)
+			if (chunks[i].has_fnv && chunks[i].fnv == fnv && chunks[i].size == size) return i;
+		return -1;
+	}
+
+	Bit32s FindChunk(const char* name)
+	{
+		Bit32s* first = chunk_crcs.Get((Bit32u)strtoul(std::string(name, 8).c_str(), NULL, 16));
+		for (Bit32s i = (first ? *first : -1); i != -1; i = chunks[i].next)
+			if (!strcmp(chunks[i].name, name)) return i;
+		return -1;
+	}
+
+	Bit32s AddChunk(Bit32u crc, Bit32u size, Bit32u datetime, const char* name = NULL)
+	{
+		Union_Chunk c;
+		Bit32s* first = chunk_crcs.Get(crc);
+		c.crc = crc;
+		c.fnv = c.src_ofs = 0;
+		c.size = size;
+		c.datetime = datetime;
+		c.src_file = -1;
+		c.next = (first ? *first : -1);
+		c.has_fnv = c.referenced = false;
+		c.keep = true;
+		if (name) { strncpy(c.name, name, 12); c.name[12] = '\0'; }
+		else
+		{
+			// name is the CRC with a number to tell apart different chunks with the same CRC
+			Bit32u num = 0;
+			for (Bit32s i = c.next; i != -1; i = chunks[i].next)
+				{ Bit32u n = (Bit32u)strtoul(chunks[i].name + 9, NULL, 16); if (n >= num) num = n + 1; }
+			snprintf(c.name, sizeof(c.name), "%08X.%03X", crc, num & 0xFFF);
+		}
+		chunks.push_back(c);
+		chunk_crcs.Put(crc, (Bit32s)chunks.size() - 1);
+		return (Bit32s)chunks.size() - 1;
+	}
+
+	void ReferenceChunk(Bit32s idx, Bit32s file, Bit32u ofs)
+	{
+		Union_Chunk& c = chunks[idx];
+		c.referenced = true;
+		c.src_file = file;
+		c.src_ofs = ofs;
+	}
+
+	const Union_ChunkedFile* FindChunkedFile(const std::string& path)
+	{
+		for (const Union_ChunkedFile& f : chunked_files) if (f.path == path) return &f;
+		return NULL;
+	}
+
+	// Split the large files in over into chunks for the next save, reusing the split of files unchanged since the last save
+	// Returns true if unreferenced chunks should be removed from the save file now
+	bool UpdateChunkedFiles(std::vector<Union_ChunkedFile>& out)
+	{
+		for (Union_Chunk& c : chunks) { c.referenced = false; c.src_file = -1; c.keep = true; }
+		if (!chunked_save) return true; // store all files as a whole and drop chunks of a save loaded with chunked files
+
+		struct Local { static void Collect(const char* path, bool is_dir, Bit32u size, Bit16u date, Bit16u time, Bit8u attr, Bitu data)
+		{
+			size_t pathLen = strlen(path);
+			if (is_dir || size < Union_Chunk::MIN_FILE_SIZE || (pathLen > 4 && !memcmp(path + pathLen - 4, ".SWP", 4))) return;
+			std::vector<Union_ChunkedFile>& cfs = *(std::vector<Union_ChunkedFile>*)data;
+			cfs.emplace_back();
+			Union_ChunkedFile& f = cfs.back();
+			f.path = path;
+			f.size = size;
+			f.datetime = (((Bit32u)date) << 16) | time;
+		}};
+		DriveFileIterator(over, Local::Collect, (Bitu)&out);
+
+		std::vector<Bit8u> data, under_data;
+		for (size_t fi = 0; fi != out.size();)
+		{
+			Union_ChunkedFile& f = out[fi];
+			const Union_ChunkedFile* prev = FindChunkedFile(f.path);
+			const Bit32u namecrc = DriveCalculateCRC32((const Bit8u*)f.path.c_str(), f.path.length());
+			bool dirty = false;
+			for (Bit32u it : dirty_paths) { if (it == namecrc) { dirty = true; break; } }
+			if (prev && !dirty && prev->size == f.size && prev->datetime == f.datetime)
+			{
+				f.pieces = prev->pieces;
+				Bit32u ofs = 0;
+				for (const Union_ChunkedFile::Piece& pc : f.pieces) { ReferenceChunk(pc.chunk, (Bit32s)fi, ofs); ofs += pc.len; }
+				fi++;
+				continue;
+			}
+
+			data.clear();
+			under_data.clear();
+			FileStat_Block stat;
+			if (!DriveGetFileContent(over, f.path.c_str(), data) || data.size() != f.size) { DBP_ASSERT(0); out.erase(out.begin() + fi); continue; }
+
+			// If content matches, don't store in save file
+			if (under->FileStat(f.path.c_str(), &stat) && stat.size == f.size && !(stat.attr & DOS_ATTR_DIRECTORY) && DriveGetFileContent(under, f.path.c_str(), under_data)
+				&& under_data.size() == data.size() && !memcmp(&under_data[0], &data[0], data.size())) { out.erase(out.begin() + fi); continue; }
+
+			for (Bit32u ofs = 0, n; ofs != f.size; ofs += n)
+			{
+				const Bit8u* p = &data[ofs];
+				n = Union_Chunk::Cut(p, f.size - ofs);
+				const Bit32u crc = DriveCalculateCRC32(p, n);
+				const Bit32u fnv = Union_Chunk::FNV(p, n);
+				Bit32s idx = FindChunk(crc, fnv, n);
+				if (idx < 0) { idx = AddChunk(crc, n, f.datetime); chunks[idx].fnv = fnv; chunks[idx].has_fnv = true; }
+				ReferenceChunk(idx, (Bit32s)fi, ofs);
+				Union_ChunkedFile::Piece pc = { n, idx };
+				f.pieces.push_back(pc);
+			}
+			fi++;
+		}
+
+		// Chunks that are not used anymore stay in the save file until they make up a third of all chunk data
+		Bit64u used = 0, garbage = 0;
+		for (const Union_Chunk& c : chunks) (c.referenced ? used : garbage) += c.size;
+		return (garbage && garbage * 2 > used);
+	}
+
+	// Remove collected chunks and keep the split files for the next save
+	void FinishChunkedSave(std::vector<Union_ChunkedFile>& saved)
+	{
+		std::vector<Bit32s> remap(chunks.size(), -1);
+		size_t num = 0;
+		for (size_t i = 0; i != chunks.size(); i++)
+			if (chunks[i].keep) { remap[i] = (Bit32s)num; if (num != i) chunks[num] = chunks[i]; num++; }
+		chunks.resize(num);
+		chunk_crcs.Clear();
+		for (size_t i = 0; i != num; i++)
+		{
+			Bit32s* first = chunk_crcs.Get(chunks[i].crc);
+			chunks[i].next = (first ? *first : -1);
+			chunk_crcs.Put(chunks[i].crc, (Bit32s)i);
+		}
+		for (Union_ChunkedFile& f : saved)
+			for (Union_ChunkedFile::Piece& pc : f.pieces)
+				{ pc.chunk = remap[pc.chunk]; DBP_ASSERT(pc.chunk >= 0); }
+		chunked_files.swap(saved);
+	}
+
+	void SerializeChunkedFiles(const std::vector<Union_ChunkedFile>& cfs, std::string& out)
+	{
+		char buf[64];
+		for (const Union_ChunkedFile& f : cfs)
+		{
+			out += "FILE|";
+			out += f.path;
+			snprintf(buf, sizeof(buf), "|%X|%X\r\n", f.size, f.datetime);
+			out += buf;
+			for (const Union_ChunkedFile::Piece& pc : f.pieces)
+			{
+				snprintf(buf, sizeof(buf), "CHUNK|%s|%X|%08X\r\n", chunks[pc.chunk].name, pc.len, chunks[pc.chunk].fnv);
+				out += buf;
+			}
+		}
+	}
+
+	// Rebuild the chunked files listed in FILECHNK.DBP into the save memory drive
+	void LoadChunkedFiles(zipDrive* zip, const std::vector<Bit8u>& manifest, bool strict_mode)
+	{
+		std::vector<Union_ChunkedFile> cfs;
+		std::string line;
+		for (const Bit8u *p = (manifest.empty() ? NULL : &manifest[0]), *pEnd = p + manifest.size(), *nl; p && p < pEnd; p = nl + 1)
+		{
+			for (nl = p; nl != pEnd && *nl != '\n'; nl++) {}
+			line.assign((const char*)p, (const char*)nl);
+			while (line.length() && (Bit8u)line[line.length() - 1] <= ' ') line.erase(line.length() - 1);
+			char *a = &line[0], *b = strchr(a, '|'), *c = (b ? strchr(b + 1, '|') : NULL), *d = (c ? strchr(c + 1, '|') : NULL);
+			if (!b || !c) continue;
+			*b = *c = '\0';
+			if (!strcmp(a, "FILE") && d)
+			{
+				cfs.emplace_back();
+				Union_ChunkedFile& f = cfs.back();
+				f.path = b + 1;
+				f.size = (Bit32u)strtoul(c + 1, &d, 16);
+				f.datetime = (Bit32u)strtoul(d + 1, &d, 16);
+			}
+			else if (!strcmp(a, "CHUNK") && cfs.size() && d)
+			{
+				Bit32s idx = FindChunk(b + 1);
+				Union_ChunkedFile::Piece pc = { (Bit32u)strtoul(c + 1, NULL, 16), idx }; // idx is -1 if missing
+				if (idx >= 0) { chunks[idx].fnv = (Bit32u)strtoul(d + 1, NULL, 16); chunks[idx].has_fnv = true; }
+				cfs.back().pieces.push_back(pc);
+			}
+		}
+
+		std::vector<Bit8u> data, chunk_data;
+		char chunk_path[DOS_PATHLENGTH];
+		for (size_t fi = 0; fi != cfs.size();)
+		{
+			Union_ChunkedFile& f = cfs[fi];
+			const char* path = f.path.c_str();
+			size_t pathlen = f.path.length();
+			const char* ext = (pathlen > 4 ? path+pathlen-4 : NULL);
+			bool valid = !(strict_mode && ext && (!memcmp(ext, ".EXE", 4) || !memcmp(ext, ".COM", 4) || !memcmp(ext, ".BAT", 4) || !strcmp(path, "DOS.YML")));
+			data.clear();
+			for (const Union_ChunkedFile::Piece& pc : f.pieces)
+			{
+				if (!valid) break;
+				chunk_data.clear();
+				snprintf(chunk_path, sizeof(chunk_path), "CHUNKS.DBP\\%s", (pc.chunk >= 0 ? chunks[pc.chunk].name : "?"));
+				valid = (pc.chunk >= 0 && DriveGetFileContent(zip, chunk_path, chunk_data) && chunk_data.size() == pc.len && Union_Chunk::FNV(&chunk_data[0], pc.len) == chunks[pc.chunk].fnv);
+				if (valid) data.insert(data.end(), chunk_data.begin(), chunk_data.end());
+				else LOG_MSG("[DOSBOX] Chunk %s of saved file %s is missing or damaged, it cannot be restored", chunk_path, path);
+			}
+			if (!valid || data.size() != f.size) { cfs.erase(cfs.begin() + fi); continue; }
+
+			DOS_File* df;
+			CreateParentDirs(*save_mem, path);
+			if (!save_mem->FileCreate(&df, (char*)path, DOS_ATTR_ARCHIVE)) { DBP_ASSERT(0); cfs.erase(cfs.begin() + fi); continue; }
+			df->AddRef();
+			for (Bit32u ofs = 0; ofs != f.size;)
+			{
+				Bit16u n = (Bit16u)(f.size - ofs > 0x8000 ? 0x8000 : f.size - ofs);
+				if (!df->Write(&data[ofs], &n) || !n) { DBP_ASSERT(0); break; }
+				ofs += n;
+			}
+			df->date = (Bit16u)(f.datetime >> 16);
+			df->time = (Bit16u)f.datetime;
+			df->newtime = true;
+			df->Close();
+			delete df;
+			save_size += f.size;
+			Bit32u ofs = 0;
+			for (const Union_ChunkedFile::Piece& pc : f.pieces) { ReferenceChunk(pc.chunk, (Bit32s)fi, ofs); ofs += pc.len; }
+			fi++;
+		}
+		chunked_files.swap(cfs);
+	}
+
 	static void WriteSaveFile(Bitu implPtr)
 	{
 		#define ZIP_WRITE_LE16(b,v) { (b)[0] = (Bit8u)((Bit16u)(v) & 0xFF); (b)[1] = (Bit8u)((Bit16u)(v) >> 8); }
 		#define ZIP_WRITE_LE32(b,v) { (b)[0] = (Bit8u)((Bit32u)(v) & 0xFF); (b)[1] = (Bit8u)(((Bit32u)(v) >> 8) & 0xFF); (b)[2] = (Bit8u)(((Bit32u)(v) >> 16) & 0xFF); (b)[3] = (Bit8u)((Bit32u)(v) >> 24); }
 
-		struct SaveFile { Bit32u size, datetime; bool is_dir; char path[DOS_PATHLENGTH+3]; };
+		enum SaveFileKind : Bit8u { SF_FILE, SF_FILEMODS, SF_FILECHNK, SF_CHUNK };
+		struct SaveFile { Bit32u size, datetime; Bit32s chunk; bool is_dir; Bit8u kind; char path[DOS_PATHLENGTH+3]; };
 		struct Local { static void QueueFile(const char* path, bool is_dir, Bit32u size, Bit16u date, Bit16u time, Bit8u attr, Bitu data)
 		{
-			std::vector<SaveFile>& sfs = *(std::vector<SaveFile>*)data;
 			SaveFile sf;
 			sf.size = size;
 			sf.datetime = (((Bit32u)date) << 16) | time;
+			sf.chunk = -1;
 			sf.is_dir = is_dir;
+			sf.kind = SF_FILE;
 			strcpy(sf.path, path);
+			Insert(*(std::vector<SaveFile>*)data, sf);
+		}
+		static void Insert(std::vector<SaveFile>& sfs, const SaveFile& sf)
+		{
 			size_t pos = 0;
 			for (size_t num = sfs.size(); pos != num; pos++)
 			{
@@ -382,8 +705,66 @@ struct unionDriveImpl
 		DriveFileIterator(over, Local::QueueFile, (Bitu)&save_files);
 
 		// Also insert FILEMODS.DBP into list sorted by age
+		SaveFile sf;
+		sf.chunk = -1;
+		sf.is_dir = false;
 		if (impl->modifications.Len())
-			Local::QueueFile("FILEMODS.DBP", false, (Bit32u)-1, impl->modification_date, impl->modification_time, 0, (Bitu)&save_files);
+		{
+			sf.size = (Bit32u)-1;
+			sf.datetime = (((Bit32u)impl->modification_date) << 16) | impl->modification_time;
+			sf.kind = SF_FILEMODS;
+			strcpy(sf.path, "FILEMODS.DBP");
+			Local::Insert(save_files, sf);
+		}
+
+		// Large files are stored as chunks listed in FILECHNK.DBP instead of as a whole
+		std::vector<Union_ChunkedFile> chunked_files;
+		std::string chunk_manifest, prev_chunk_manifest;
+		const bool compact_chunks = impl->UpdateChunkedFiles(chunked_files);
+		if (chunked_files.size() || impl->chunks.size())
+		{
+			Bit32u first_chunk_datetime = 0xFFFFFFFF, manifest_datetime = 0;
+			for (Union_ChunkedFile& f : chunked_files)
+			{
+				for (size_t i = save_files.size(); i--;)
+					if (save_files[i].path == f.path) { save_files.erase(save_files.begin() + i); break; }
+				if (f.datetime > manifest_datetime) manifest_datetime = f.datetime;
+			}
+			for (Union_Chunk& c : impl->chunks)
+			{
+				if (!c.referenced && compact_chunks) { c.keep = false; continue; }
+				sf.size = c.size;
+				sf.datetime = c.datetime;
+				sf.chunk = (Bit32s)(&c - &impl->chunks[0]);
+				sf.is_dir = false;
+				sf.kind = SF_CHUNK;
+				snprintf(sf.path, sizeof(sf.path), "CHUNKS.DBP\\%s", c.name);
+				Local::Insert(save_files, sf);
+				if (c.datetime < first_chunk_datetime) first_chunk_datetime = c.datetime;
+			}
+			if (sf.chunk != -1)
+			{
+				sf.size = 0;
+				sf.datetime = first_chunk_datetime;
+				sf.chunk = -1;
+				sf.is_dir = true;
+				sf.kind = SF_FILE;
+				strcpy(sf.path, "CHUNKS.DBP");
+				Local::Insert(save_files, sf);
+			}
+			if (chunked_files.size())
+			{
+				impl->SerializeChunkedFiles(chunked_files, chunk_manifest);
+				impl->SerializeChunkedFiles(impl->chunked_files, prev_chunk_manifest);
+				sf.size = (Bit32u)chunk_manifest.size();
+				sf.datetime = manifest_datetime;
+				sf.chunk = -1;
+				sf.is_dir = false;
+				sf.kind = SF_FILECHNK;
+				strcpy(sf.path, "FILECHNK.DBP");
+				Local::Insert(save_files, sf);
+			}
+		}
 
 		std::string sbuf;
 		std::vector<Bit8u> central_dir;
@@ -399,12 +780,18 @@ struct unionDriveImpl
 			const Bit8u* filedata = NULL;
 			Bit16u pathLen = (Bit16u)(strlen(path) + (sf.is_dir ? 1 : 0));
 			bool under_match_size = false, is_swap = (pathLen > 4 && !memcmp(path + pathLen - 4, ".SWP", 4));
-			if (size == (Bit32u)-1) // generate file modifications meta file
+			if (sf.kind == SF_FILEMODS) // generate file modifications meta file
 			{
 				for (Union_Modification* m : impl->modifications) m->Serialize(sbuf);
 				size = (Bit32u)sbuf.size();
 				filedata = (Bit8u*)&sbuf[0];
 			}
+			else if (sf.kind == SF_FILECHNK)
+			{
+				filedata = (Bit8u*)&chunk_manifest[0];
+				if (chunk_manifest != prev_chunk_manifest && matches_existing) { fseek(fsave, 0, SEEK_CUR); matches_existing = false; }
+			}
+			else if (sf.kind == SF_CHUNK) {}
 			else if (!sf.is_dir && under->FileOpen(&df, path, 0))
 			{
 				// Read file data in both over and under drive to compare
@@ -488,6 +875,25 @@ struct unionDriveImpl
 				// but for now we keep things fast under the assumption that the save ZIP has not been tampered with
 			}
 
+			if (!matches_existing && sf.kind == SF_CHUNK)
+			{
+				// Read chunk data from the file that uses it, a chunk not used anymore is removed from the save file
+				Union_Chunk& c = impl->chunks[sf.chunk];
+				Bit32u ofs = c.src_ofs;
+				if (c.src_file < 0 || !over->FileOpen(&df, (char*)chunked_files[c.src_file].path.c_str(), 0)) { c.keep = false; continue; }
+				df->AddRef();
+				df->Seek(&ofs, DOS_SEEK_SET);
+				sbuf.resize(size);
+				for (Bit16u read; ofs != c.src_ofs + size; ofs += read)
+				{
+					read = (Bit16u)(c.src_ofs + size - ofs > 0x8000 ? 0x8000 : c.src_ofs + size - ofs);
+					if (!df->Read((Bit8u*)&sbuf[ofs - c.src_ofs], &read) || !read) { DBP_ASSERT(0); failed = true; break; }
+				}
+				df->Close();
+				delete df;
+				filedata = (Bit8u*)&sbuf[0];
+			}
+
 			if (!matches_existing)
 			{
 				if (!sf.is_dir && !filedata)
@@ -552,6 +958,7 @@ struct unionDriveImpl
 		fclose(fsave);
 
 		if (failed) { LOG_MSG("[DOSBOX] Error while writing file %s", impl->save_file.c_str()); goto reporterror; }
+		impl->FinishChunkedSave(chunked_files);
 		impl->save_size = save_size;
 		impl->dirty = false;
 		impl->dirty_paths.clear();
@@ -655,6 +1062,7 @@ struct Union_WriteHandle : public DOS_File
 			real_file->Seek(&start_pos, SEEK_SET);
 
 			const Bit16u save_errorcode = dos.errorcode;
+			impl->layers.Clear(); // file (and maybe parent directories) get added to over
 			DOS_File *clone_write;
 			if (!impl->over->FileCreate(&clone_write, name, DOS_ATTR_ARCHIVE))
 			{
@@ -714,7 +1122,7 @@ unionDrive::unionDrive(DOS_Drive& under, DOS_Drive& over, bool autodelete_under,
 	label.SetLabel(under.GetLabel(), false, true);
 }
 
-unionDrive::unionDrive(DOS_Drive& under, const char* save_file, bool autodelete_under, bool strict_mode) : impl(new unionDriveImpl(&under, NULL, save_file, autodelete_under, false, strict_mode))
+unionDrive::unionDrive(DOS_Drive& under, const char* save_file, bool autodelete_under, bool strict_mode, bool chunked_save) : impl(new unionDriveImpl(&under, NULL, save_file, autodelete_under, false, strict_mode, chunked_save))
 {
 	label.SetLabel(under.GetLabel(), false, true);
 }
@@ -723,6 +1131,7 @@ void unionDrive::AddUnder(DOS_Drive& add_under, bool autodelete_under)
 {
 	impl->under = new unionDrive(add_under, *impl->under, autodelete_under, impl->autodelete_under);
 	impl->autodelete_under = true;
+	impl->layers.Clear();
 }
 
 unionDrive::~unionDrive()
@@ -745,14 +1154,14 @@ bool unionDrive::FileOpen(DOS_File * * file, char * path, Bit32u flags)
 		if (!impl->writable) return FALSE_SET_DOSERR(ACCESS_DENIED);
 		DOS_File *real_file;
 		bool need_copy_on_write;
-		if (impl->over->FileOpen(&real_file, path, flags))
+		if (impl->InOver(path) && impl->over->FileOpen(&real_file, path, flags))
 		{
 			DBP_ASSERT(!m);
 			need_copy_on_write = false;
 		}
 		else
 		{
-			if (impl->over->TestDir(path)) { DBP_ASSERT(0); return FALSE_SET_DOSERR(FILE_NOT_FOUND); }
+			if (impl->InOver(path) && impl->over->TestDir(path)) { DBP_ASSERT(0); return FALSE_SET_DOSERR(FILE_NOT_FOUND); }
 			if (!impl->under->FileOpen(&real_file, (m ? m->RedirectSource() : path), OPEN_READ))
 			{
 				if (m)
@@ -803,7 +1212,7 @@ bool unionDrive::FileOpen(DOS_File * * file, char * path, Bit32u flags)
 	{
 		// No need to call AddRef on the opened file here, it will be done by our caller
 		if (m && m->IsRedirect()) return impl->under->FileOpen(file, m->RedirectSource(), flags);
-		if (!impl->over->FileOpen(file, path, flags) && !impl->under->FileOpen(file, path, flags)) return false;
+		if (!(impl->InOver(path) && impl->over->FileOpen(file, path, flags)) && !impl->under->FileOpen(file, path, flags)) return false;
 		return TRUE_RESET_DOSERR;
 	}
 }
@@ -815,8 +1224,10 @@ bool unionDrive::FileCreate(DOS_File** file, char * path, Bit16u attributes)
 	const Bit16u save_errorcode = dos.errorcode;
 	if (!impl->UnionPrepareCreate(path, true)) return false;
 	DOS_File *real_file;
+	impl->layers.Forget(path);
 	if (!impl->over->FileCreate(&real_file, path, attributes))
 	{
+		impl->layers.Clear(); // parent directories get added to over
 		CreateParentDirs(*impl->over, path, impl->under);
 		if (!impl->over->FileCreate(&real_file, path, attributes))
 		{
@@ -857,6 +1268,7 @@ bool unionDrive::Rename(char * oldpath, char * newpath)
 		if ((oldlastslash || newlastslash) && (oldlastslash - oldpath) != (newlastslash - newpath) && memcmp(oldpath, newpath, (newlastslash - newpath))) return FALSE_SET_DOSERR(ACCESS_DENIED);
 	}
 	impl->ForceCloseFileAndScheduleSave(this, oldpath, true);
+	impl->layers.Clear(); // a renamed directory moves all paths below it
 	if (new_m) //means (new_m->IsDelete())
 	{
 		delete new_m;
@@ -913,8 +1325,10 @@ bool unionDrive::MakeDir(char* dir_path)
 	DOSPATH_REMOVE_ENDINGDOTS(dir_path);
 	const Bit16u save_errorcode = dos.errorcode;
 	if (!impl->UnionPrepareCreate(dir_path, false)) return false;
+	impl->layers.Forget(dir_path);
 	if (!impl->over->MakeDir(dir_path))
 	{
+		impl->layers.Clear(); // parent directories get added to over
 		CreateParentDirs(*impl->over, dir_path, impl->under);
 		if (!impl->over->MakeDir(dir_path))
 		{
@@ -1029,7 +1443,7 @@ bool unionDrive::FindNext(DOS_DTA & dta)
 				dta.GetResult(dta_name, dta_size, dta_date, dta_time, dta_attr);
 				if (dta_attr & DOS_ATTR_VOLUME) continue;
 				if (dta_name[0] == '.' && dta_name[dta_name[1] == '.' ? 2 : 1] == '\0') continue;
-				Bit16u tmp; if (impl->over->GetFileAttr(dta_path, &tmp)) continue;
+				if (impl->InOver(dta_path)) continue;
 				if (impl->modifications.Get(dta_name, DOS_NAMELENGTH_ASCII, s.dir_hash)) continue;
 				dta.SetDirID(my_dir_id);
 				return TRUE_RESET_DOSERR;
@@ -1091,7 +1505,7 @@ bool unionDrive::FileStat(const char* path, FileStat_Block * const stat_block)
 	Union_Modification* m = impl->modifications.Get(path);
 	if (m && m->IsDelete())   return false;
 	if (m && m->IsRedirect()) return impl->under->FileStat(m->RedirectSource(), stat_block);
-	return (impl->over->FileStat(path, stat_block) || impl->under->FileStat(path, stat_block));
+	return ((impl->InOver(path) && impl->over->FileStat(path, stat_block)) || impl->under->FileStat(path, stat_block));
 }
 
 bool unionDrive::GetFileAttr(char * path, Bit16u * attr)
@@ -1100,7 +1514,7 @@ bool unionDrive::GetFileAttr(char * path, Bit16u * attr)
 	Union_Modification* m = impl->modifications.Get(path);
 	if (m && m->IsDelete())   return false;
 	if (m && m->IsRedirect()) return impl->under->GetFileAttr(m->RedirectSource(), attr);
-	return (impl->over->GetFileAttr(path, attr) || impl->under->GetFileAttr(path, attr));
+	return ((impl->InOver(path) && impl->over->GetFileAttr(path, attr)) || impl->under->GetFileAttr(path, attr));
 }
 
 bool unionDrive::GetLongFileName(const char* path, char longname[256])
@@ -1109,7 +1523,7 @@ bool unionDrive::GetLongFileName(const char* path, char longname[256])
 	Union_Modification* m = impl->modifications.Get(path);
 	if (m && m->IsDelete())   return false;
 	if (m && m->IsRedirect()) return impl->under->GetLongFileName(m->RedirectSource(), longname);
-	return (impl->over->GetLongFileName(path, longname) || impl->under->GetLongFileName(path, longname));
+	return ((impl->InOver(path) && impl->over->GetLongFileName(path, longname)) || impl->under->GetLongFileName(path, longname));
 }
 
 bool unionDrive::AllocationInfo(Bit16u * _bytes_sector, Bit8u * _sectors_cluster, Bit16u * _total_clusters, Bit16u * _free_clusters)
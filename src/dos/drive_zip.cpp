@@ -21,8 +21,21 @@
 #include "drives.h"
 #include "inout.h"
 #include "pic.h"
+#include "dbp_threads.h"
+#include "drive_zip_sdefl.h"
 
 #include <vector>
+#include <map>
+#include <algorithm>
+
+#if defined(WIN32)
+#include <windows.h>
+#include <io.h>
+#define ZIP_HAVE_MMAP
+#elif defined(C_HAVE_MPROTECT)
+#include <sys/mman.h>
+#define ZIP_HAVE_MMAP
+#endif
 
 struct miniz
 {
@@ -442,154 +455,6 @@ struct miniz
 	}
 };
 
-struct sdefl
-{
-	// BASED ON SMALL DEFLATE
-	// Small Deflate (public domain)
-	// By Micha Mettke - https://gist.github.com/vurtun/760a6a2a198b706a7b1a6197aa5ac747
-
-	enum { WIN_SIZ = (1 << 15), HASH_BITS = 19, HASH_SIZ = (1 << HASH_BITS) };
-	int bits, cnt, tbl[HASH_SIZ], prv[WIN_SIZ];
-
-	Bit32u Run(unsigned char *out, const unsigned char *in, int in_len, int lvl = 9)
-	{
-		enum { WIN_MSK = WIN_SIZ-1, MIN_MATCH = 4, MAX_MATCH = 258, HASH_MSK = HASH_SIZ-1, NIL = -1, LVL_MIN = 0, LVL_DEF = 5, LVL_MAX = 8 };
-		#define R2(n) n, n + 128, n + 64, n + 192
-		#define R4(n) R2(n), R2(n + 32), R2(n + 16), R2(n + 48)
-		#define R6(n) R4(n), R4(n +  8), R4(n +  4), R4(n + 12)
-		static const unsigned char sdefl_mirror[256] = { R6(0), R6(2), R6(1), R6(3) };
-		#undef R6
-		#undef R4
-		#undef R2
-
-		struct defl
-		{
-			static unsigned char* put(unsigned char *dst, struct sdefl *s, int code, int bitcnt)
-			{
-				s->bits |= (code << s->cnt);
-				s->cnt += bitcnt;
-				while (s->cnt >= 8) { *dst++ = (unsigned char)(s->bits & 0xFF); s->bits >>= 8; s->cnt -= 8; }
-				return dst;
-			}
-			static int ilog2(int n)
-			{
-				#define it(n) n,n,n,n, n,n,n,n, n,n,n,n ,n,n,n,n
-				static const signed char tbl[256] = {-1,0,1,1,2,2,2,2,3,3,3,3,3,3,3,3,it(4),it(5),it(5),it(6),it(6),it(6),it(6),it(7),it(7),it(7),it(7),it(7),it(7),it(7),it(7)};
-				int tt, t;
-				return (((tt = (n >> 16))) ? ((t = (tt >> 8)) ? 24+tbl[t]: 16+tbl[tt]) : ((t = (n >> 8)) ? 8+tbl[t]: tbl[n]));
-				#undef it
-			}
-			static int npow2(int n)
-			{
-				n--; n |= n >> 1; n |= n >> 2; n |= n >> 4; n |= n >> 8; n |= n >> 16; return (int)++n;
-			}
-			static unsigned uload32(const void *p)
-			{
-				unsigned int n = 0;
-				memcpy(&n, p, sizeof(n));
-				return n;
-			}
-			static unsigned hash32(const void *p)
-			{
-				unsigned n = uload32(p);
-				return (n*0x9E377989)>>(32-HASH_BITS);
-			}
-		};
-
-		int p = 0, max_chain = (lvl < 8) ? (1<<(lvl+1)): (1<<13);
-		unsigned char *q = out;
-
-		bits = cnt = 0;
-		for (p = 0; p < HASH_SIZ; ++p) tbl[p] = NIL;
-
-		p = 0;
-		q = defl::put(q, this, 0x01, 1); /* block */
-		q = defl::put(q, this, 0x01, 2); /* static huffman */
-		while (p < in_len){
-			int run, best_len = 0, dist = 0;
-			int max_match = ((in_len-p)>MAX_MATCH) ? MAX_MATCH:(in_len-p);
-			if (max_match > MIN_MATCH){
-				int limit = ((p-WIN_SIZ)<NIL)?NIL:(p-WIN_SIZ);
-				int chain_len = max_chain;
-				int i = tbl[defl::hash32(&in[p])];
-				while (i > limit) {
-					if (in[i+best_len] == in[p+best_len] && (defl::uload32(&in[i]) == defl::uload32(&in[p]))){
-						int n = MIN_MATCH;
-						while (n < max_match && in[i+n] == in[p+n]) n++;
-						if (n > best_len) {
-							best_len = n;
-							dist = p - i;
-							if (n == max_match) break;
-						}
-					}
-					if (!(--chain_len)) break;
-					i = prv[i&WIN_MSK];
-				}
-			}
-			if (lvl >= 5 && best_len >= MIN_MATCH && best_len < max_match){
-				const int x = p + 1;
-				int tar_len = best_len + 1;
-				int limit = ((x-WIN_SIZ)<NIL)?NIL:(x-WIN_SIZ);
-				int chain_len = max_chain;
-				int i = tbl[defl::hash32(&in[p])];
-				while (i > limit) {
-					if (in[i+best_len] == in[x+best_len] && (defl::uload32(&in[i]) == defl::uload32(&in[x]))){
-						int n = MIN_MATCH;
-						while (n < tar_len && in[i+n] == in[x+n]) n++;
-						if (n == tar_len) {
-							best_len = 0;
-							break;
-						}
-					}
-					if (!(--chain_len)) break;
-					i = prv[i&WIN_MSK];
-				}
-			}
-			if (best_len >= MIN_MATCH) {
-				static const short lxmin[] = {0,11,19,35,67,131};
-				static const short dxmax[] = {0,6,12,24,48,96,192,384,768,1536,3072,6144,12288,24576};
-				static const short lmin[] = {11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227};
-				static const short dmin[] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
-
-				/* length encoding */
-				int lc = best_len;
-				int lx = defl::ilog2(best_len - 3) - 2;
-				if (!(lx = (lx < 0) ? 0: lx)) lc += 254;
-				else if (best_len >= 258) lx = 0, lc = 285;
-				else lc = ((lx-1) << 2) + 265 + ((best_len - lxmin[lx]) >> lx);
-
-				if (lc <= 279) q = defl::put(q, this, sdefl_mirror[(lc - 256) << 1], 7);
-				else q = defl::put(q, this, sdefl_mirror[0xc0 - 280 + lc], 8);
-				if (lx) q = defl::put(q, this, best_len - lmin[lc - 265], lx);
-
-				/* distance encoding */
-				int dc = dist - 1;
-				int dx = defl::ilog2(defl::npow2(dist) >> 2);
-				if ((dx = (dx < 0) ? 0: dx))
-					dc = ((dx + 1) << 1) + (dist > dxmax[dx]);
-				q = defl::put(q, this, sdefl_mirror[dc << 3], 5);
-				if (dx) q = defl::put(q, this, dist - dmin[dc], dx);
-				run = best_len;
-			} else {
-				int c = in[p];
-				if (c <= 143) q = defl::put(q, this, sdefl_mirror[0x30+c], 8);
-				else q = defl::put(q, this, 1 + 2 * sdefl_mirror[0x90 - 144 + c], 9);
-				run = 1;
-			}
-			while (run-- != 0) {
-				unsigned h = defl::hash32(&in[p]);
-				prv[p&WIN_MSK] = tbl[h];
-				tbl[h] = p++;
-			}
-		}
-		/* zlib partial flush */
-		q = defl::put(q, this, 0, 7);
-		q = defl::put(q, this, 2, 10);
-		q = defl::put(q, this, 2, 3);
-		return (Bit32u)(q - out);
-	}
-};
-
 struct oz_unshrink
 {
 	// BASED ON OZUNSHRINK
@@ -1057,27 +922,90 @@ struct Zip_Archive
 	Bit64u ofs;
 	Bit64u size;
 	bool enable_crc_check;
+	const Bit8u* map; // whole archive mapped into memory when it is a host file, otherwise NULL
+	struct Zip_SeekIndex* seek_index; // persistent seek index of large files, only available for mapped archives
 
-	Zip_Archive(DOS_File* _zip, bool _enable_crc_check) : zip(_zip), enable_crc_check(_enable_crc_check)
+	Zip_Archive(DOS_File* _zip, bool _enable_crc_check) : zip(_zip), enable_crc_check(_enable_crc_check), map(NULL), seek_index(NULL)
 	{
 		zip->AddRef();
 		size = 0;
 		bool can_seek = zip->Seek64(&size, DOS_SEEK_END);
 		ofs = size;
 		DBP_ASSERT(can_seek);
+		MapHostFile();
 	}
 	
 	~Zip_Archive()
 	{
+		UnmapHostFile();
 		if (!zip) return;
 		if (zip->IsOpen()) zip->Close();
 		if (zip->RemoveRef() <= 0) delete zip;
 	}
 
+	void MapHostFile()
+	{
+		#ifdef ZIP_HAVE_MMAP
+		FILE* fh = NULL;
+		if (rawFile* rf = dynamic_cast<rawFile*>(zip)) fh = rf->f;
+		else if (localFile* lf = dynamic_cast<localFile*>(zip)) fh = lf->fhandle;
+		if (!fh || !size || OPEN_IS_WRITING(zip->flags)) return;
+		if (sizeof(void*) < 8 && size > (256*1024*1024)) return; // don't exhaust the address space of 32-bit hosts
+		map = MapFile(fh, size);
+		#endif
+	}
+
+	void UnmapHostFile()
+	{
+		if (map) UnmapFile(map, size);
+		map = NULL;
+	}
+
+	// Map a whole host file read-only into memory, returns NULL if not supported or failed
+	static const Bit8u* MapFile(FILE* fh, Bit64u size)
+	{
+		#ifdef ZIP_HAVE_MMAP
+		#ifdef WIN32
+		HANDLE hmap = CreateFileMappingA((HANDLE)_get_osfhandle(_fileno(fh)), NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!hmap) return NULL;
+		const Bit8u* res = (const Bit8u*)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(hmap); // the view keeps the mapping alive
+		return res;
+		#else
+		void* p = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(fh), 0);
+		return (p != MAP_FAILED ? (const Bit8u*)p : NULL);
+		#endif
+		#else
+		return NULL;
+		#endif
+	}
+
+	static void UnmapFile(const Bit8u* p, Bit64u size)
+	{
+		#ifdef ZIP_HAVE_MMAP
+		#ifdef WIN32
+		UnmapViewOfFile((void*)p);
+		#else
+		munmap((void*)p, (size_t)size);
+		#endif
+		#endif
+	}
+
+	// Returns a pointer into the mapped archive if available and the range is valid, otherwise NULL
+	inline const Bit8u* Map(Bit64u seek_ofs, Bit32u n)
+	{
+		return ((map && seek_ofs <= size && (Bit64u)n <= size - seek_ofs) ? map + seek_ofs : NULL);
+	}
+
 	Bit32u Read(Bit64u seek_ofs, void *pBuf, Bit32u n)
 	{
 		if (seek_ofs >= size) n = 0;
 		else if ((Bit64u)n > (size - seek_ofs)) n = (Bit32u)(size - seek_ofs);
+		if (map)
+		{
+			memcpy(pBuf, map + seek_ofs, n);
+			return n;
+		}
 		if (seek_ofs != ofs)
 		{
 			zip->Seek64(&seek_ofs, DOS_SEEK_SET);
@@ -1101,8 +1029,8 @@ struct ZIP_Unpacker
 	virtual ~ZIP_Unpacker() {}
 	virtual Bit32u Read(const struct Zip_File& f, Bit32u seek_ofs, void *res_buf, Bit32u res_n) = 0;
 	virtual bool CheckCRC(const Zip_File& f) = 0;
-	enum { METHOD_STORED = 0, METHOD_SHRUNK = 1, METHOD_IMPLODED = 6, METHOD_DEFLATED = 8 };
-	static bool MethodSupported(Bit32u method) { return (method == METHOD_DEFLATED || method == METHOD_STORED || method == METHOD_SHRUNK || method == METHOD_IMPLODED); }
+	enum { METHOD_STORED = 0, METHOD_SHRUNK = 1, METHOD_IMPLODED = 6, METHOD_DEFLATED = 8, METHOD_FRAMES = 0xDB }; // METHOD_FRAMES is a custom method for seekable block compression (must fit Zip_File::method)
+	static bool MethodSupported(Bit32u method) { return (method == METHOD_DEFLATED || method == METHOD_STORED || method == METHOD_SHRUNK || method == METHOD_IMPLODED || method == METHOD_FRAMES); }
 };
 
 struct Zip_Entry
@@ -1164,6 +1092,8 @@ struct Zip_StoredUnpacker : ZIP_Unpacker
 
 	bool CheckCRC(const Zip_File& f)
 	{
+		if (const Bit8u* p = archive.Map(f.data_ofs, f.decomp_size))
+			return (DriveCalculateCRC32(p, f.decomp_size) == f.crc);
 		Bit8u buf[1024]; Bit32u crc = 0; Bit64u pos = f.data_ofs;
 		for (Bit32u sz = f.decomp_size, step; sz; sz -= step, pos += step)
 		{
@@ -1197,9 +1127,10 @@ struct Zip_ShrinkUnpacker : Zip_MemoryUnpacker
 {
 	Zip_ShrinkUnpacker(Zip_Archive& archive, const Zip_File& f)
 	{
-		oz_unshrink *unshrink = (oz_unshrink*)malloc(sizeof(oz_unshrink) + f.comp_size);
-		Bit8u* in_buf = (Bit8u*)(unshrink + 1);
-		if (archive.Read(f.data_ofs, in_buf, f.comp_size) == f.comp_size)
+		const Bit8u* in_map = archive.Map(f.data_ofs, f.comp_size);
+		oz_unshrink *unshrink = (oz_unshrink*)malloc(sizeof(oz_unshrink) + (in_map ? 0 : f.comp_size));
+		Bit8u* in_buf = (in_map ? (Bit8u*)in_map : (Bit8u*)(unshrink + 1));
+		if (in_map || archive.Read(f.data_ofs, in_buf, f.comp_size) == f.comp_size)
 		{
 			mem_data.resize(f.decomp_size);
 			unshrink->in_start = unshrink->in_cur = in_buf;
@@ -1217,9 +1148,10 @@ struct Zip_ImplodeUnpacker : Zip_MemoryUnpacker
 {
 	Zip_ImplodeUnpacker(Zip_Archive& archive, const Zip_File& f)
 	{
-		unz_explode *explode = (unz_explode*)malloc(sizeof(unz_explode) + f.comp_size);
-		Bit8u* in_buf = (Bit8u*)(explode + 1);
-		if (archive.Read(f.data_ofs, in_buf, f.comp_size) == f.comp_size)
+		const Bit8u* in_map = archive.Map(f.data_ofs, f.comp_size);
+		unz_explode *explode = (unz_explode*)malloc(sizeof(unz_explode) + (in_map ? 0 : f.comp_size));
+		Bit8u* in_buf = (in_map ? (Bit8u*)in_map : (Bit8u*)(explode + 1));
+		if (in_map || archive.Read(f.data_ofs, in_buf, f.comp_size) == f.comp_size)
 		{
 			mem_data.resize(f.decomp_size);
 			explode->in_start = explode->in_cur = in_buf;
@@ -1244,15 +1176,26 @@ struct Zip_DeflateMemoryUnpacker : Zip_MemoryUnpacker
 		Bit64u ofs = f.data_ofs;
 		Bit32u out_buf_ofs = 0, read_buf_avail = 0, read_buf_ofs = 0, comp_remaining = f.comp_size;
 		Bit8u read_buf[miniz::MZ_ZIP_MAX_IO_BUF_SIZE], *out_data = &mem_data[0];
+		const Bit8u* read_ptr = read_buf;
 		miniz::tinfl_init(&inflator);
 
 		for (miniz::tinfl_status status = miniz::TINFL_STATUS_NEEDS_MORE_INPUT; status == miniz::TINFL_STATUS_NEEDS_MORE_INPUT || status == miniz::TINFL_STATUS_HAS_MORE_OUTPUT;)
 		{
 			if (!read_buf_avail)
 			{
-				read_buf_avail = (comp_remaining < miniz::MZ_ZIP_MAX_IO_BUF_SIZE ? comp_remaining : miniz::MZ_ZIP_MAX_IO_BUF_SIZE);
-				if (archive.Read(ofs, read_buf, read_buf_avail) != read_buf_avail)
-					break;
+				if (const Bit8u* in_map = archive.Map(ofs, comp_remaining))
+				{
+					// Inflate directly from the mapped archive
+					read_ptr = in_map;
+					read_buf_avail = comp_remaining;
+				}
+				else
+				{
+					read_ptr = read_buf;
+					read_buf_avail = (comp_remaining < miniz::MZ_ZIP_MAX_IO_BUF_SIZE ? comp_remaining : miniz::MZ_ZIP_MAX_IO_BUF_SIZE);
+					if (archive.Read(ofs, read_buf, read_buf_avail) != read_buf_avail)
+						break;
+				}
 				ofs += read_buf_avail;
 				comp_remaining -= read_buf_avail;
 				read_buf_ofs = 0;
@@ -1260,7 +1203,7 @@ struct Zip_DeflateMemoryUnpacker : Zip_MemoryUnpacker
 			Bit32u out_buf_size = f.decomp_size - out_buf_ofs;
 			Bit8u *pWrite_buf_cur = out_data + out_buf_ofs;
 			Bit32u in_buf_size = read_buf_avail;
-			status = miniz::tinfl_decompress(&inflator, read_buf + read_buf_ofs, &in_buf_size, out_data, pWrite_buf_cur, &out_buf_size, miniz::TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | (comp_remaining ? miniz::TINFL_FLAG_HAS_MORE_INPUT : 0));
+			status = miniz::tinfl_decompress(&inflator, read_ptr + read_buf_ofs, &in_buf_size, out_data, pWrite_buf_cur, &out_buf_size, miniz::TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | (comp_remaining ? miniz::TINFL_FLAG_HAS_MORE_INPUT : 0));
 			read_buf_avail -= in_buf_size;
 			read_buf_ofs += in_buf_size;
 			out_buf_ofs += out_buf_size;
@@ -1270,6 +1213,201 @@ struct Zip_DeflateMemoryUnpacker : Zip_MemoryUnpacker
 	}
 };
 
+// Worker threads which decompress ahead of the guest's read position in large deflated files of mapped archives
+// Decompressed blocks are kept in a bounded LRU cache shared by all files and seek cursors found on the way are shared with the file
+struct Zip_PrefetchPool
+{
+	enum { MAX_THREADS = 2, BLOCK_SIZE = miniz::TINFL_LZ_DICT_SIZE, CACHE_BLOCKS = (sizeof(void*) < 8 ? 512 : 2048), NONE = 0xFFFFFFFF };
+	struct Block { Bit64u key; Bit32u prev, next; Bit8u* data; };
+
+	Mutex mutex;
+	Semaphore wake[MAX_THREADS], exited[MAX_THREADS];
+	bool idle[MAX_THREADS], quit;
+	Bit32u threads, users, next_id, lru_head, lru_tail, free_head;
+	std::vector<struct Zip_DeflateUnpacker*> queue;
+	std::vector<Block> blocks;
+	std::map<Bit64u, Bit32u> lookup;
+
+	Zip_PrefetchPool() : threads(0), users(0), next_id(0), lru_head(NONE), lru_tail(NONE), free_head(NONE) { }
+
+	~Zip_PrefetchPool()
+	{
+		DBP_ASSERT(!users);
+		for (Block& b : blocks) free(b.data);
+	}
+
+	static Thread::RET_t THREAD_CC ThreadFunc(void* p);
+
+	bool AddUser()
+	{
+		if (users) { users++; return true; }
+		extern unsigned dbp_cpu_features_get_core_amount(void);
+		unsigned cores = dbp_cpu_features_get_core_amount();
+		if (cores <= 1) return false;
+		threads = (cores - 1 < MAX_THREADS ? cores - 1 : MAX_THREADS);
+		users = 1;
+		quit = false;
+		for (Bit32u i = 0; i != threads; i++) { idle[i] = false; Thread::StartDetached(ThreadFunc, (void*)(size_t)i); }
+		return true;
+	}
+
+	void RemoveUser()
+	{
+		DBP_ASSERT(users);
+		if (--users) return;
+		mutex.Lock();
+		DBP_ASSERT(queue.empty());
+		quit = true;
+		for (Bit32u i = 0; i != threads; i++) if (idle[i]) { idle[i] = false; wake[i].Post(); }
+		mutex.Unlock();
+		for (Bit32u i = 0; i != threads; i++) exited[i].Wait();
+		threads = 0;
+	}
+
+	// Functions below need to be called with the mutex locked
+	void Schedule(struct Zip_DeflateUnpacker* u)
+	{
+		queue.push_back(u);
+		for (Bit32u i = 0; i != threads; i++) if (idle[i]) { idle[i] = false; wake[i].Post(); break; }
+	}
+
+	void Unlink(Bit32u i)
+	{
+		Block& b = blocks[i];
+		if (b.prev != NONE) blocks[b.prev].next = b.next; else lru_head = b.next;
+		if (b.next != NONE) blocks[b.next].prev = b.prev; else lru_tail = b.prev;
+	}
+
+	void LinkFront(Bit32u i)
+	{
+		Block& b = blocks[i];
+		b.prev = NONE;
+		b.next = lru_head;
+		if (lru_head != NONE) blocks[lru_head].prev = i; else lru_tail = i;
+		lru_head = i;
+	}
+
+	const Bit8u* Get(Bit64u key, bool touch = true)
+	{
+		std::map<Bit64u, Bit32u>::iterator it = lookup.find(key);
+		if (it == lookup.end()) return NULL;
+		if (touch && lru_head != it->second) { Unlink(it->second); LinkFront(it->second); }
+		return blocks[it->second].data;
+	}
+
+	Bit8u* Insert(Bit64u key)
+	{
+		Bit32u i;
+		std::map<Bit64u, Bit32u>::iterator it = lookup.find(key);
+		if (it != lookup.end()) { i = it->second; Unlink(i); }
+		else
+		{
+			if (free_head != NONE) { i = free_head; free_head = blocks[i].next; }
+			else if (blocks.size() < CACHE_BLOCKS) { i = (Bit32u)blocks.size(); blocks.resize(i + 1); blocks[i].data = (Bit8u*)malloc(BLOCK_SIZE); }
+			else { i = lru_tail; Unlink(i); lookup.erase(blocks[i].key); } // evict least recently used
+			blocks[i].key = key;
+			lookup[key] = i;
+		}
+		LinkFront(i);
+		return blocks[i].data;
+	}
+
+	void Purge(Bit32u id)
+	{
+		std::map<Bit64u, Bit32u>::iterator it = lookup.lower_bound((Bit64u)id << 32);
+		while (it != lookup.end() && (Bit32u)(it->first >> 32) == id)
+		{
+			Unlink(it->second);
+			blocks[it->second].next = free_head;
+			free_head = it->second;
+			lookup.erase(it++);
+		}
+	}
+};
+
+static Zip_PrefetchPool zip_prefetch;
+
+std::string dbp_seekindex_dir; // host directory for persistent seek indexes without trailing separator, set by the frontend (disabled if empty)
+
+// Seek cursors of all large deflated files in a host archive stored in a host file that is shared by all instances.
+// The file name is made from the archive size and a hash of its central directory so the same content finds the same index.
+// It gets built once on a background thread after the first mount and is then mapped into memory and read on demand.
+struct Zip_SeekIndex
+{
+	enum { INDEX_VERSION = 1, MIN_FILE_SIZE = 4*1024*1024 };
+	struct Header { char magic[4]; Bit32u version, cursor_size, ptr_size, cdir_crc, entry_count; Bit64u archive_size; };
+	struct Entry { Bit64u data_ofs; Bit32u comp_size, decomp_size, cursor_block, cursor_count, table_ofs, reserved; }; // sorted by data_ofs
+	// At table_ofs there are cursor_count pairs of { Bit32u ofs, len } with len 0 for no cursor and len == cursor_size for an uncompressed cursor
+	struct Job { Bit64u local_header_ofs; Bit32u comp_size, decomp_size; };
+
+	Zip_Archive& archive;
+	std::string path;
+	Bit32u cdir_crc;
+	std::vector<Job> jobs;
+	const Bit8u* map;
+	Bit64u map_size;
+	bool tried_map, started;
+	volatile bool building, quit;
+	Semaphore built;
+
+	Zip_SeekIndex(Zip_Archive& _archive, Bit32u _cdir_crc, std::vector<Job>& _jobs) : archive(_archive), cdir_crc(_cdir_crc), map(NULL), map_size(0), tried_map(false), started(false), building(false), quit(false)
+	{
+		jobs.swap(_jobs);
+		char name[32];
+		sprintf(name, "%08X-%08X%08X.idx", cdir_crc, (Bit32u)(archive.size >> 32), (Bit32u)archive.size);
+		((path = dbp_seekindex_dir) += CROSS_FILESPLIT).append(name);
+	}
+
+	~Zip_SeekIndex()
+	{
+		if (started) { quit = true; built.Wait(); }
+		if (map) Zip_Archive::UnmapFile(map, map_size);
+	}
+
+	void Start()
+	{
+		if (TryMap()) return;
+		tried_map = false;
+		building = started = true;
+		Thread::StartDetached(BuildThread, this);
+	}
+
+	bool TryMap()
+	{
+		if (map) return true;
+		if (tried_map || building) return false;
+		tried_map = true;
+		FILE* fh = fopen_wrap(path.c_str(), "rb");
+		if (!fh) return false;
+		fseek_wrap(fh, 0, SEEK_END);
+		map_size = (Bit64u)ftell_wrap(fh);
+		if (map_size >= sizeof(Header) && (sizeof(void*) >= 8 || map_size < (64*1024*1024)))
+			map = Zip_Archive::MapFile(fh, map_size);
+		fclose(fh);
+		const Header* hdr = (const Header*)map;
+		if (map && (memcmp(hdr->magic, "DBSI", 4) || hdr->version != INDEX_VERSION || hdr->cursor_size != CursorSize() || hdr->ptr_size != sizeof(void*)
+			|| hdr->cdir_crc != cdir_crc || hdr->archive_size != archive.size || sizeof(Header) + (Bit64u)hdr->entry_count * sizeof(Entry) > map_size))
+		{
+			Zip_Archive::UnmapFile(map, map_size);
+			map = NULL;
+		}
+		return (map != NULL);
+	}
+
+	static Thread::RET_t THREAD_CC BuildThread(void* p)
+	{
+		Zip_SeekIndex& idx = *(Zip_SeekIndex*)p;
+		idx.Build();
+		idx.building = false;
+		idx.built.Post();
+		return 0;
+	}
+
+	static Bit32u CursorSize();
+	bool Load(const Zip_File& f, Bit32u cursor_block, Bit32u cursor_count, Bit8u* cursors);
+	void Build();
+};
+
 struct Zip_DeflateUnpacker : ZIP_Unpacker
 {
 	Zip_Archive& archive;
@@ -1281,6 +1419,7 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 	Bit32u read_buf_ofs;
 	Bit32u comp_remaining;
 	Bit32u crc_run, crc_ofs, crc_failed;
+	const Bit8u* read_ptr; // either read_buf or pointing into the mapped archive
 
 	enum { READ_BLOCK = miniz::MZ_ZIP_MAX_IO_BUF_SIZE, WRITE_BLOCK = miniz::TINFL_LZ_DICT_SIZE };
 	struct SeekCursor
@@ -1305,22 +1444,44 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 	enum { SEEK_CURSOR_MAX_DEFL = 128 + (sizeof(SeekCursor) + 9) / 10 * 11, SEEK_CACHE_CURSOR_NEED = 50, SEEK_CACHE_CURSOR_STEPS = 20 };
 	struct SeekCache { zipDrive* drv; std::string path; Bit32u count; } * seek_cache;
 
-	Zip_DeflateUnpacker(Zip_Archive& _archive, const Zip_File& f, zipDrive* drv, const char* path) : archive(_archive), crc_run(0), crc_ofs((Bit32u)-1), crc_failed(0), seek_cache(NULL)
+	enum { PREFETCH_MIN_SIZE = 8*1024*1024, PREFETCH_AHEAD = 2*1024*1024, PREFETCH_SKIP = 1024*1024 };
+	struct Prefetch
+	{
+		miniz::tinfl_decompressor inflator;
+		Bit64u ofs, data_ofs;
+		Bit32u out_ofs, comp_size, decomp_size, want_from, want_to, id;
+		bool queued, busy, waiting, failed;
+		Semaphore finished;
+		Bit8u write_buf[WRITE_BLOCK];
+	} *prefetch;
+
+	inline void LockCursors()   { if (prefetch) zip_prefetch.mutex.Lock();   }
+	inline void UnlockCursors() { if (prefetch) zip_prefetch.mutex.Unlock(); }
+	inline Bit64u BlockKey(Bit32u pos) { return ((Bit64u)prefetch->id << 32) | (pos / WRITE_BLOCK); }
+
+	static Bit32u CursorBlock(Bit32u decomp_size)
+	{
+		return decomp_size > (50*1024*1024) ? (1024*1024)  // 50~   MB, 50~   cursors
+			:  decomp_size > (30*1024*1024) ? ( 768*1024)  // 30~50 MB, 40~77 cursors
+			:  decomp_size > (12*1024*1024) ? ( 384*1024)  // 12~30 MB, 32~80 cursors
+			:                                 ( 256*1024); //  0~12 MB,  2~48 cursors
+	}
+
+	Zip_DeflateUnpacker(Zip_Archive& _archive, const Zip_File& f, zipDrive* drv, const char* path) : archive(_archive), crc_run(0), crc_ofs((Bit32u)-1), crc_failed(0), seek_cache(NULL), prefetch(NULL)
 	{
 		//printf("[%s] OPENED FILE!\n", f.name);
 		DBP_ASSERT(f.ofs_past_header);
-		cursor_block =
-			  f.decomp_size > (50*1024*1024) ? (1024*1024)  // 50~   MB, 50~   cursors
-			: f.decomp_size > (30*1024*1024) ? ( 768*1024)  // 30~50 MB, 40~77 cursors
-			: f.decomp_size > (12*1024*1024) ? ( 384*1024)  // 12~30 MB, 32~80 cursors
-			:                                  ( 256*1024); //  0~12 MB,  2~48 cursors
+		cursor_block = CursorBlock(f.decomp_size);
 		Bit32u cursor_count = (f.decomp_size + (cursor_block - 1)) / cursor_block;
 		cursors = (SeekCursor*)calloc(cursor_count, sizeof(SeekCursor));
 		Reset(f);
 
+		// Load cursors from the persistent seek index of the archive, archives with an index don't write seek cache files
+		if (archive.seek_index) archive.seek_index->Load(f, cursor_block, cursor_count, (Bit8u*)cursors);
+
 		// Read seek cache file for larger files
 		Bit8u drive_idx;
-		if (cursor_count > SEEK_CACHE_CURSOR_NEED && (drive_idx = DriveGetIndex(drv)) != DOS_DRIVES)
+		if (!archive.seek_index && cursor_count > SEEK_CACHE_CURSOR_NEED && (drive_idx = DriveGetIndex(drv)) != DOS_DRIVES)
 		{
 			seek_cache = new SeekCache;
 			seek_cache->drv = drv;
@@ -1359,14 +1520,152 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 				}
 			}
 		}
+
+		// Decompress large files ahead of time on worker threads, needs the archive to be mapped for thread safe access
+		if (archive.map && f.decomp_size >= PREFETCH_MIN_SIZE && zip_prefetch.AddUser())
+		{
+			prefetch = new Prefetch;
+			prefetch->data_ofs = f.data_ofs;
+			prefetch->comp_size = f.comp_size;
+			prefetch->decomp_size = f.decomp_size;
+			prefetch->want_from = prefetch->want_to = 0;
+			prefetch->queued = prefetch->busy = prefetch->waiting = prefetch->failed = false;
+			prefetch->id = ++zip_prefetch.next_id;
+			PrefetchReset();
+		}
 	}
 
 	~Zip_DeflateUnpacker()
 	{
+		if (prefetch)
+		{
+			zip_prefetch.mutex.Lock();
+			if (prefetch->queued) zip_prefetch.queue.erase(std::find(zip_prefetch.queue.begin(), zip_prefetch.queue.end(), this));
+			prefetch->want_to = 0; // stop a running job
+			if (prefetch->busy)
+			{
+				prefetch->waiting = true;
+				zip_prefetch.mutex.Unlock();
+				prefetch->finished.Wait();
+				zip_prefetch.mutex.Lock();
+			}
+			zip_prefetch.Purge(prefetch->id);
+			zip_prefetch.mutex.Unlock();
+			delete prefetch;
+			zip_prefetch.RemoveUser();
+		}
 		if (seek_cache) delete seek_cache;
 		free(cursors);
 	}
 
+	void PrefetchReset()
+	{
+		miniz::tinfl_init(&prefetch->inflator);
+		prefetch->ofs = prefetch->data_ofs;
+		prefetch->out_ofs = 0;
+	}
+
+	// Called on the emulation thread after the guest read data up to read_to
+	void PrefetchRequest(Bit32u read_to)
+	{
+		zip_prefetch.mutex.Lock();
+		Bit32u check = read_to + PREFETCH_AHEAD / 2;
+		if (!prefetch->failed && read_to < prefetch->decomp_size && (check >= prefetch->decomp_size || !zip_prefetch.Get(BlockKey(check), false)))
+		{
+			prefetch->want_from = read_to & ~(WRITE_BLOCK-1);
+			prefetch->want_to = (prefetch->decomp_size - read_to > PREFETCH_AHEAD ? read_to + PREFETCH_AHEAD : prefetch->decomp_size);
+			if (!prefetch->queued && !prefetch->busy) { prefetch->queued = true; zip_prefetch.Schedule(this); }
+		}
+		zip_prefetch.mutex.Unlock();
+	}
+
+	// Copies data available in the block cache, returns the number of bytes that could be served from it
+	Bit32u PrefetchReadCached(Bit32u seek_ofs, Bit8u* res_buf, Bit32u res_n)
+	{
+		Bit32u got = 0;
+		zip_prefetch.mutex.Lock();
+		while (got != res_n)
+		{
+			Bit32u pos = seek_ofs + got, in_block = (pos & (WRITE_BLOCK-1)), step = WRITE_BLOCK - in_block;
+			const Bit8u* block = zip_prefetch.Get(BlockKey(pos));
+			if (!block) break;
+			if (step > res_n - got) step = res_n - got;
+			memcpy(res_buf + got, block + in_block, step);
+			got += step;
+		}
+		zip_prefetch.mutex.Unlock();
+		return got;
+	}
+
+	// Called on a worker thread, decompresses blocks into the cache until the wanted range is covered
+	void PrefetchRun()
+	{
+		Prefetch& pf = *prefetch;
+		for (;;)
+		{
+			zip_prefetch.mutex.Lock();
+			Bit32u want_from = pf.want_from, want_to = pf.want_to;
+			bool behind = (pf.out_ofs >= want_from + WRITE_BLOCK && !zip_prefetch.Get(BlockKey(want_from), false));
+			if (behind || (pf.out_ofs < want_from && want_from - pf.out_ofs > PREFETCH_SKIP))
+			{
+				// Jump to the closest seek cursor before the wanted range (or restart from the beginning when it is behind us)
+				Bit32u idx = (want_from / cursor_block);
+				for (; idx != (Bit32u)-1; idx--)
+					if (cursors[idx].cursor_out && cursors[idx].cursor_out <= want_from && (behind || cursors[idx].cursor_out > pf.out_ofs))
+						break;
+				if (idx != (Bit32u)-1)
+				{
+					const SeekCursor& c = cursors[idx];
+					miniz::tinfl_init(&pf.inflator);
+					pf.ofs = c.cursor_in;
+					pf.out_ofs = c.cursor_out;
+					pf.inflator.m_num_bits                = c.m_num_bits;
+					pf.inflator.m_bit_buf                 = c.m_bit_buf;
+					pf.inflator.m_dist                    = c.m_dist;
+					pf.inflator.m_counter                 = c.m_counter;
+					pf.inflator.m_num_extra               = c.m_num_extra;
+					pf.inflator.m_dist_from_out_buf_start = c.m_dist_from_out_buf_start;
+					pf.inflator.m_state = miniz::TINFL_STATE_INDEX_BLOCK_BOUNDRY;
+					memcpy(pf.write_buf, c.write_buf, sizeof(pf.write_buf));
+				}
+				else if (behind) PrefetchReset();
+			}
+			zip_prefetch.mutex.Unlock();
+			if (pf.out_ofs >= want_to || pf.failed) return;
+
+			// Run the inflater until the end of the current block, all remaining input is available in the mapped archive
+			Bit32u block_ofs = (pf.out_ofs & (WRITE_BLOCK-1)), out_size = WRITE_BLOCK - block_ofs;
+			Bit32u in_size = pf.comp_size - (Bit32u)(pf.ofs - pf.data_ofs);
+			miniz::tinfl_status status = miniz::tinfl_decompress(&pf.inflator, archive.map + pf.ofs, &in_size, pf.write_buf, pf.write_buf + block_ofs, &out_size, 0);
+			pf.ofs += in_size;
+			pf.out_ofs += out_size;
+			if (status < miniz::TINFL_STATUS_DONE || pf.out_ofs > pf.decomp_size || (status == miniz::TINFL_STATUS_DONE && pf.out_ofs != pf.decomp_size) || (!in_size && !out_size))
+				{ DBP_ASSERT(false); pf.failed = true; return; }
+
+			bool block_done = (out_size && (!(pf.out_ofs & (WRITE_BLOCK-1)) || pf.out_ofs == pf.decomp_size));
+			bool at_boundary = (pf.inflator.m_state == miniz::TINFL_STATE_INDEX_BLOCK_BOUNDRY);
+			if (!block_done && !at_boundary) continue;
+
+			zip_prefetch.mutex.Lock();
+			if (block_done && pf.out_ofs - 1 >= pf.want_from)
+				memcpy(zip_prefetch.Insert(BlockKey(pf.out_ofs - 1)), pf.write_buf, WRITE_BLOCK);
+			SeekCursor* c = (at_boundary && pf.out_ofs != pf.decomp_size ? &cursors[pf.out_ofs / cursor_block] : NULL);
+			if (c && !c->cursor_out)
+			{
+				c->cursor_in                 = pf.ofs;
+				c->m_num_bits                = pf.inflator.m_num_bits;
+				c->m_bit_buf                 = pf.inflator.m_bit_buf;
+				c->m_dist                    = pf.inflator.m_dist;
+				c->m_counter                 = pf.inflator.m_counter;
+				c->m_num_extra               = pf.inflator.m_num_extra;
+				c->m_dist_from_out_buf_start = pf.inflator.m_dist_from_out_buf_start;
+				memcpy(c->write_buf, pf.write_buf, sizeof(c->write_buf));
+				c->cursor_out                = pf.out_ofs;
+			}
+			zip_prefetch.mutex.Unlock();
+		}
+	}
+
 	void Reset(const Zip_File& f)
 	{
 		miniz::tinfl_init(&inflator);
@@ -1381,9 +1680,19 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 		Bit32u want_from = seek_ofs, want_to = seek_ofs + res_n, last_idx = (Bit32u)-1, slowload_num, slowload_tick;
 		DBP_ASSERT(want_to <= f.decomp_size);
 
+		Bit8u* p_res = (Bit8u*)res_buf;
+		if (prefetch && crc_ofs == (Bit32u)-1) // not while verifying CRC which needs to decompress everything in order
+		{
+			Bit32u cached = PrefetchReadCached(want_from, p_res, res_n);
+			p_res += cached;
+			want_from += cached;
+			if (want_from == want_to) { PrefetchRequest(want_to); return res_n; }
+		}
+
 		Bit32u have_from = ((out_buf_ofs ? out_buf_ofs - 1 : 0) & ~(WRITE_BLOCK-1));
 		if (want_from < have_from || want_from > out_buf_ofs)
 		{
+			LockCursors();
 			for (Bit32u idx = (want_from / cursor_block);; idx--)
 			{
 				if (!idx && (!cursors[idx].cursor_out || cursors[idx].cursor_out > want_from)) break;
@@ -1404,6 +1713,7 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 				memcpy(write_buf, cursors[idx].write_buf, sizeof(write_buf));
 				break;
 			}
+			UnlockCursors();
 			if (want_from < have_from)
 			{
 				//printf("[%s] JUMP SEEKING FROM %u TO 0 (WANT DATA FROM %u)\n", f.name, out_buf_ofs, 0, want_from);
@@ -1411,7 +1721,6 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 			}
 		}
 
-		Bit8u* p_res = (Bit8u*)res_buf;
 		for (miniz::tinfl_status status = miniz::TINFL_STATUS_NEEDS_MORE_INPUT; status == miniz::TINFL_STATUS_NEEDS_MORE_INPUT || status == miniz::TINFL_STATUS_HAS_MORE_OUTPUT || status == miniz::TINFL_STATUS_DONE;)
 		{
 			if (out_buf_ofs > want_from)
@@ -1421,7 +1730,10 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 				Bit32u have_size = have_to - want_from;
 				memcpy(p_res, write_buf + (want_from & (WRITE_BLOCK-1)), have_size);
 				if (have_to == want_to)
+				{
+					if (prefetch) PrefetchRequest(want_to);
 					return res_n;
+				}
 				p_res += have_size;
 				want_from = have_to;
 			}
@@ -1429,9 +1741,19 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 
 			if (!read_buf_avail)
 			{
-				read_buf_avail = (comp_remaining < READ_BLOCK ? comp_remaining : READ_BLOCK);
-				if (archive.Read(ofs, read_buf, read_buf_avail) != read_buf_avail)
-					break;
+				if (const Bit8u* in_map = archive.Map(ofs, comp_remaining))
+				{
+					// Inflate directly from the mapped archive
+					read_ptr = in_map;
+					read_buf_avail = comp_remaining;
+				}
+				else
+				{
+					read_ptr = read_buf;
+					read_buf_avail = (comp_remaining < READ_BLOCK ? comp_remaining : READ_BLOCK);
+					if (archive.Read(ofs, read_buf, read_buf_avail) != read_buf_avail)
+						break;
+				}
 				ofs_last_read = ofs;
 				ofs += read_buf_avail;
 				comp_remaining -= read_buf_avail;
@@ -1442,7 +1764,7 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 			Bit8u *pWrite_buf_cur = write_buf + (out_buf_ofs & (WRITE_BLOCK-1));
 			Bit32u in_buf_size = read_buf_avail;
 
-			status = miniz::tinfl_decompress(&inflator, read_buf + read_buf_ofs, &in_buf_size, write_buf, pWrite_buf_cur, &out_buf_size, (comp_remaining ? miniz::TINFL_FLAG_HAS_MORE_INPUT : 0));
+			status = miniz::tinfl_decompress(&inflator, read_ptr + read_buf_ofs, &in_buf_size, write_buf, pWrite_buf_cur, &out_buf_size, (comp_remaining ? miniz::TINFL_FLAG_HAS_MORE_INPUT : 0));
 
 			if (crc_ofs == out_buf_ofs && out_buf_size)
 			{
@@ -1465,6 +1787,7 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 			{
 				// Gear cursors toward the middle of the block to accommodate forward and backward seeking as well as possible
 				Bit32u idx = (out_buf_ofs / cursor_block);
+				LockCursors();
 				if (!cursors[idx].cursor_out || (out_buf_ofs > cursors[idx].cursor_out + 120*1024 && out_buf_ofs < idx*cursor_block + cursor_block/2 + 70*1024))
 				{
 					//printf("[%s] STORE SEEK CURSOR #%u AT %u\n", f.name, idx, out_buf_ofs);
@@ -1477,17 +1800,20 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 					cursors[idx].m_num_extra               = inflator.m_num_extra;
 					cursors[idx].m_dist_from_out_buf_start = inflator.m_dist_from_out_buf_start;
 					memcpy(cursors[idx].write_buf, write_buf, sizeof(write_buf));
+					UnlockCursors();
 
 					// Write a seek cache next to the compressed file for larger files
 					if (seek_cache && idx > SEEK_CACHE_CURSOR_NEED)
 					{
 						Bit32u cursor_count = (Bit16u)((f.decomp_size + (cursor_block - 1)) / cursor_block), cursor_got = 0;
+						LockCursors();
 						for (Bit32u ii = (SEEK_CACHE_CURSOR_STEPS / 2); ii < cursor_count; ii++)
 						{
 							if (!cursors[ii].cursor_out) continue;
 							cursor_got++;
 							ii = (SEEK_CACHE_CURSOR_STEPS / 2 - 1) + ((ii + (SEEK_CACHE_CURSOR_STEPS-1)) / SEEK_CACHE_CURSOR_STEPS * SEEK_CACHE_CURSOR_STEPS);
 						}
+						UnlockCursors();
 						//printf("[%s] CURSORS FOR SEEK CACHE: %d / %d\n", f.name, cursor_got, (cursor_count+(SEEK_CACHE_CURSOR_STEPS-1))/SEEK_CACHE_CURSOR_STEPS);
 						if (cursor_got > cursor_count / (SEEK_CACHE_CURSOR_STEPS*2) && cursor_got > seek_cache->count && cursor_count <= 0xFFFF)
 						{
@@ -1515,6 +1841,7 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 						}
 					}
 				}
+				else UnlockCursors();
 			}
 		}
 		DBP_ASSERT(false);
@@ -1536,6 +1863,7 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 		Bit16u hdr[7] = { (Bit16u)0x5345, (Bit16u)sizeof(SeekCursor), (Bit16u)(f.comp_size>>16), (Bit16u)f.comp_size, (Bit16u)(f.data_ofs>>32), (Bit16u)(f.data_ofs>>16), (Bit16u)f.data_ofs }, idx_complen[2], sz;
 		df->Write((Bit8u*)hdr, &(sz = (Bit16u)sizeof(hdr)));
 		struct scomp { sdefl defl; Bit8u buf[SEEK_CURSOR_MAX_DEFL]; } *comp = new scomp;
+		LockCursors();
 		for (Bit32u ii = (SEEK_CACHE_CURSOR_STEPS / 2), cursor_count = (f.decomp_size + (cursor_block - 1)) / cursor_block; ii < cursor_count; ii++)
 		{
 			if (!cursors[ii].cursor_out) continue;
@@ -1548,12 +1876,160 @@ struct Zip_DeflateUnpacker : ZIP_Unpacker
 			if (idx_complen[1]) df->Write((Bit8u*)comp->buf, &idx_complen[1]);
 			else df->Write((Bit8u*)&cursors[idx_complen[0]], &(sz = (Bit16u)sizeof(SeekCursor)));
 		}
+		UnlockCursors();
 		df->Close();
 		delete df;
 		delete comp;
 	}
 };
 
+Bit32u Zip_SeekIndex::CursorSize()
+{
+	return (Bit32u)sizeof(Zip_DeflateUnpacker::SeekCursor);
+}
+
+bool Zip_SeekIndex::Load(const Zip_File& f, Bit32u cursor_block, Bit32u cursor_count, Bit8u* cursors)
+{
+	if (!TryMap()) return false;
+	const Header* hdr = (const Header*)map;
+	const Entry *e = (const Entry*)(hdr + 1), *e_end = e + hdr->entry_count;
+	for (Bit32u n = hdr->entry_count; n;) // binary search by data offset
+	{
+		Bit32u half = n / 2;
+		if (e[half].data_ofs < f.data_ofs) { e += half + 1; n -= half + 1; }
+		else n = half;
+	}
+	if (e == e_end || e->data_ofs != f.data_ofs || e->comp_size != f.comp_size || e->decomp_size != f.decomp_size
+		|| e->cursor_block != cursor_block || e->cursor_count != cursor_count || e->table_ofs + (Bit64u)cursor_count * 8 > map_size) return false;
+
+	const Bit32u cursor_size = CursorSize(), *table = (const Bit32u*)(map + e->table_ofs);
+	for (Bit32u i = 0; i != cursor_count; i++)
+	{
+		Bit32u ofs = table[i * 2], len = table[i * 2 + 1];
+		if (!len || len > cursor_size || ofs + (Bit64u)len > map_size) continue;
+		if (len == cursor_size) memcpy(cursors + i * cursor_size, map + ofs, cursor_size);
+		else zipDrive::Uncompress(map + ofs, len, cursors + i * cursor_size, cursor_size);
+	}
+	return true;
+}
+
+// Called on a background thread, inflates all listed files from the mapped archive and writes a new index file
+void Zip_SeekIndex::Build()
+{
+	typedef Zip_DeflateUnpacker::SeekCursor SeekCursor;
+	std::string tmp_path = path;
+	char tmp_ext[16];
+	sprintf(tmp_ext, ".%08X", (Bit32u)((size_t)this ^ (size_t)time(NULL)));
+	tmp_path.append(tmp_ext); // unique per instance to allow building the same index in parallel
+	#ifdef WIN32
+	mkdir(dbp_seekindex_dir.c_str());
+	#else
+	mkdir(dbp_seekindex_dir.c_str(), 0700);
+	#endif
+	FILE* fh = fopen_wrap(tmp_path.c_str(), "wb");
+	if (!fh) return;
+
+	std::vector<Entry> entries;
+	std::vector<Bit32u> table;
+	struct Work { miniz::tinfl_decompressor inflator; SeekCursor cursor; sdefl defl; Bit8u comp[Zip_DeflateUnpacker::SEEK_CURSOR_MAX_DEFL]; Bit8u write_buf[Zip_DeflateUnpacker::WRITE_BLOCK]; } *w = new Work;
+	Bit64u file_ofs = sizeof(Header) + jobs.size() * sizeof(Entry);
+	bool ok = true;
+	for (size_t j = 0; j != jobs.size() && ok && !quit; j++)
+	{
+		const Job& job = jobs[j];
+		const Bit8u *lh = archive.Map(job.local_header_ofs, 30), *in;
+		if (!lh || MZ_READ_LE32(lh) != 0x04034b50) continue;
+		Entry e = { job.local_header_ofs + 30 + MZ_READ_LE16(lh + 26) + MZ_READ_LE16(lh + 28), job.comp_size, job.decomp_size, Zip_DeflateUnpacker::CursorBlock(job.decomp_size), 0, 0, 0 };
+		if ((in = archive.Map(e.data_ofs, e.comp_size)) == NULL) continue;
+		e.cursor_count = (e.decomp_size + (e.cursor_block - 1)) / e.cursor_block;
+		e.table_ofs = (Bit32u)file_ofs;
+		table.assign(e.cursor_count * 2, 0);
+		file_ofs += table.size() * sizeof(Bit32u);
+		fseek_wrap(fh, file_ofs, SEEK_SET);
+
+		miniz::tinfl_init(&w->inflator);
+		for (Bit32u in_ofs = 0, out_ofs = 0; !quit;)
+		{
+			Bit32u block_ofs = (out_ofs & (Zip_DeflateUnpacker::WRITE_BLOCK-1)), out_size = Zip_DeflateUnpacker::WRITE_BLOCK - block_ofs, in_size = e.comp_size - in_ofs;
+			miniz::tinfl_status status = miniz::tinfl_decompress(&w->inflator, in + in_ofs, &in_size, w->write_buf, w->write_buf + block_ofs, &out_size, 0);
+			in_ofs += in_size;
+			out_ofs += out_size;
+			if (status == miniz::TINFL_STATUS_DONE && out_ofs == e.decomp_size) { entries.push_back(e); break; }
+			if (status < miniz::TINFL_STATUS_DONE || status == miniz::TINFL_STATUS_DONE || out_ofs > e.decomp_size || (!in_size && !out_size)) break; // corrupt, leave it out of the index
+			if (w->inflator.m_state != miniz::TINFL_STATE_INDEX_BLOCK_BOUNDRY || out_ofs == e.decomp_size) continue;
+
+			// Store the first block boundary after the start of each cursor block like the prefetcher does
+			Bit32u idx = out_ofs / e.cursor_block;
+			if (table[idx * 2 + 1]) continue;
+			memset(&w->cursor, 0, sizeof(w->cursor));
+			w->cursor.cursor_in                 = e.data_ofs + in_ofs;
+			w->cursor.cursor_out                = out_ofs;
+			w->cursor.m_num_bits                = w->inflator.m_num_bits;
+			w->cursor.m_bit_buf                 = w->inflator.m_bit_buf;
+			w->cursor.m_dist                    = w->inflator.m_dist;
+			w->cursor.m_counter                 = w->inflator.m_counter;
+			w->cursor.m_num_extra               = w->inflator.m_num_extra;
+			w->cursor.m_dist_from_out_buf_start = w->inflator.m_dist_from_out_buf_start;
+			memcpy(w->cursor.write_buf, w->write_buf, sizeof(w->cursor.write_buf));
+			Bit32u len = w->defl.Run(w->comp, (const unsigned char*)&w->cursor, sizeof(SeekCursor));
+			const void* data = (len < sizeof(SeekCursor) ? (const void*)w->comp : (const void*)&w->cursor);
+			if (len >= sizeof(SeekCursor)) len = sizeof(SeekCursor); // store uncompressed when not beneficial
+			if (fwrite(data, 1, len, fh) != len || file_ofs + len > 0xFFFFFFFF) { ok = false; break; }
+			table[idx * 2] = (Bit32u)file_ofs;
+			table[idx * 2 + 1] = len;
+			file_ofs += len;
+		}
+		if (entries.empty() || entries.back().data_ofs != e.data_ofs) continue;
+		fseek_wrap(fh, e.table_ofs, SEEK_SET);
+		if (fwrite(&table[0], sizeof(Bit32u), table.size(), fh) != table.size()) ok = false;
+		fseek_wrap(fh, file_ofs, SEEK_SET);
+	}
+	delete w;
+
+	struct Local { static bool SortByOfs(const Entry& a, const Entry& b) { return a.data_ofs < b.data_ofs; } };
+	std::sort(entries.begin(), entries.end(), Local::SortByOfs);
+	Header hdr = { { 'D', 'B', 'S', 'I' }, INDEX_VERSION, CursorSize(), (Bit32u)sizeof(void*), cdir_crc, (Bit32u)entries.size(), archive.size };
+	fseek_wrap(fh, 0, SEEK_SET);
+	if (ok && !quit && fwrite(&hdr, sizeof(hdr), 1, fh) == 1 && (entries.empty() || fwrite(&entries[0], sizeof(Entry), entries.size(), fh) == entries.size()) && !fclose(fh))
+	{
+		#ifdef WIN32
+		remove(path.c_str()); // rename doesn't replace on Windows, another instance might have just built the same index
+		#endif
+		if (!rename(tmp_path.c_str(), path.c_str())) return;
+	}
+	else fclose(fh);
+	remove(tmp_path.c_str());
+}
+
+Thread::RET_t THREAD_CC Zip_PrefetchPool::ThreadFunc(void* p)
+{
+	Bit32u tnum = (Bit32u)(size_t)p;
+	zip_prefetch.mutex.Lock();
+	while (!zip_prefetch.quit)
+	{
+		if (zip_prefetch.queue.empty())
+		{
+			zip_prefetch.idle[tnum] = true;
+			zip_prefetch.mutex.Unlock();
+			zip_prefetch.wake[tnum].Wait();
+			zip_prefetch.mutex.Lock();
+			continue;
+		}
+		Zip_DeflateUnpacker* u = zip_prefetch.queue.front();
+		zip_prefetch.queue.erase(zip_prefetch.queue.begin());
+		u->prefetch->queued = false;
+		u->prefetch->busy = true;
+		zip_prefetch.mutex.Unlock();
+		u->PrefetchRun();
+		zip_prefetch.mutex.Lock();
+		u->prefetch->busy = false;
+		if (u->prefetch->waiting) { u->prefetch->waiting = false; u->prefetch->finished.Post(); }
+	}
+	zip_prefetch.mutex.Unlock();
+	zip_prefetch.exited[tnum].Post();
+	return 0;
+}
+
 void Zip_File::PICHandler(Bitu implPtr)
 {
 	Zip_File& f = *(Zip_File*)implPtr;
@@ -1561,6 +2037,97 @@ void Zip_File::PICHandler(Bitu implPtr)
 	f.have_pic = 0;
 }
 
+// Seekable block compressed file data (written by tools/dosbox_pure_pack.cpp)
+// Layout: [u8 frame method] [u8 log2 frame size] [u16 reserved] [u32 frame count] [u32 frame offsets * (frame count + 1)] [frames]
+// Each frame holds frame size bytes (except the last) compressed independently, a frame with a compressed size equal to its size is stored
+struct Zip_FramedUnpacker : ZIP_Unpacker
+{
+	Zip_Archive& archive;
+	miniz::tinfl_decompressor inflator;
+	std::vector<Bit32u> frame_ofs;
+	std::vector<Bit8u> frame_buf, comp_buf;
+	Bit32u frame_shift, frame_idx;
+
+	enum { HEADER_SIZE = 8, FRAME_METHOD_DEFLATE = 8, MIN_FRAME_SHIFT = 12, MAX_FRAME_SHIFT = 24 };
+
+	Zip_FramedUnpacker(Zip_Archive& _archive, const Zip_File& f) : archive(_archive), frame_shift(0), frame_idx((Bit32u)-1)
+	{
+		DBP_ASSERT(f.ofs_past_header);
+		Bit8u hdr[HEADER_SIZE];
+		if (f.comp_size < HEADER_SIZE || archive.Read(f.data_ofs, hdr, HEADER_SIZE) != HEADER_SIZE) return;
+		Bit32u shift = hdr[1], count = MZ_READ_LE32(hdr + 4), table_size = (count + 1) * 4;
+		if (hdr[0] != FRAME_METHOD_DEFLATE || shift < MIN_FRAME_SHIFT || shift > MAX_FRAME_SHIFT || count != (Bit32u)(((Bit64u)f.decomp_size + (1 << shift) - 1) >> shift)
+			|| (Bit64u)HEADER_SIZE + table_size > f.comp_size) return;
+
+		std::vector<Bit8u> table(table_size);
+		if (archive.Read(f.data_ofs + HEADER_SIZE, &table[0], table_size) != table_size) return;
+		frame_ofs.resize(count + 1);
+		Bit32u max_comp = 0;
+		for (Bit32u i = 0; i <= count; i++)
+		{
+			frame_ofs[i] = MZ_READ_LE32(&table[i * 4]);
+			if (i && (frame_ofs[i] < frame_ofs[i - 1] || frame_ofs[i] > f.comp_size)) { frame_ofs.clear(); return; }
+			if (i && frame_ofs[i] - frame_ofs[i - 1] > max_comp) max_comp = frame_ofs[i] - frame_ofs[i - 1];
+		}
+		frame_shift = shift;
+		frame_buf.resize((size_t)1 << shift);
+		if (!archive.map) comp_buf.resize(max_comp);
+	}
+
+	bool DecodeFrame(const Zip_File& f, Bit32u idx)
+	{
+		frame_idx = (Bit32u)-1;
+		Bit32u comp_len = frame_ofs[idx + 1] - frame_ofs[idx], out_len = f.decomp_size - (idx << frame_shift);
+		if (out_len > frame_buf.size()) out_len = (Bit32u)frame_buf.size();
+		const Bit8u* src = archive.Map(f.data_ofs + frame_ofs[idx], comp_len);
+		if (!src)
+		{
+			if (archive.Read(f.data_ofs + frame_ofs[idx], &comp_buf[0], comp_len) != comp_len) return false;
+			src = &comp_buf[0];
+		}
+		if (comp_len == out_len)
+			memcpy(&frame_buf[0], src, out_len);
+		else
+		{
+			miniz::tinfl_init(&inflator);
+			Bit32u in_size = comp_len, out_size = out_len;
+			miniz::tinfl_status status = miniz::tinfl_decompress(&inflator, src, &in_size, &frame_buf[0], &frame_buf[0], &out_size, miniz::TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+			if (status != miniz::TINFL_STATUS_DONE || out_size != out_len) { DBP_ASSERT(false); return false; }
+		}
+		frame_idx = idx;
+		return true;
+	}
+
+	Bit32u Read(const Zip_File& f, Bit32u seek_ofs, void *res_buf, Bit32u res_n)
+	{
+		if (frame_ofs.empty()) return 0;
+		Bit8u* p_res = (Bit8u*)res_buf;
+		for (Bit32u pos = seek_ofs, pos_end = seek_ofs + res_n; pos != pos_end;)
+		{
+			Bit32u idx = (pos >> frame_shift), in_frame = pos - (idx << frame_shift), step = (Bit32u)frame_buf.size() - in_frame;
+			if (idx != frame_idx && !DecodeFrame(f, idx)) return (Bit32u)(p_res - (Bit8u*)res_buf);
+			if (step > pos_end - pos) step = pos_end - pos;
+			memcpy(p_res, &frame_buf[in_frame], step);
+			p_res += step;
+			pos += step;
+		}
+		return res_n;
+	}
+
+	bool CheckCRC(const Zip_File& f)
+	{
+		if (frame_ofs.empty()) return false;
+		Bit32u crc = 0;
+		for (Bit32u idx = 0, count = (Bit32u)frame_ofs.size() - 1; idx != count; idx++)
+		{
+			if (!DecodeFrame(f, idx)) return false;
+			Bit32u len = f.decomp_size - (idx << frame_shift);
+			crc = DriveCalculateCRC32(&frame_buf[0], (len > frame_buf.size() ? (Bit32u)frame_buf.size() : len), crc);
+		}
+		return (crc == f.crc);
+	}
+};
+
 struct Zip_Handle : public DOS_File
 {
 	Bit32u ofs;
@@ -1585,6 +2152,7 @@ struct Zip_Handle : public DOS_File
 			else if (_src->method == ZIP_Unpacker::METHOD_STORED)   _src->unpacker = new Zip_StoredUnpacker(archive);
 			else if (_src->method == ZIP_Unpacker::METHOD_SHRUNK)   _src->unpacker = new Zip_ShrinkUnpacker(archive, *_src);
 			else if (_src->method == ZIP_Unpacker::METHOD_IMPLODED) _src->unpacker = new Zip_ImplodeUnpacker(archive, *_src);
+			else if (_src->method == ZIP_Unpacker::METHOD_FRAMES)   _src->unpacker = new Zip_FramedUnpacker(archive, *_src);
 			else { DBP_ASSERT(0); _src->unpacker = nullptr; }
 			if (_src->unpacker && archive.enable_crc_check && !_src->unpacker->CheckCRC(*_src))
 				{ DBP_ASSERT(0); delete _src->unpacker; _src->unpacker = nullptr; }
@@ -1806,6 +2374,7 @@ struct zipDriveImpl
 		// Now create an index into the central directory file records, do some basic sanity checking on each record, and check for zip64 entries (which are not yet supported).
 		p = cdir_start;
 		ValueHashMap<void*> lfnDirs;
+		std::vector<Zip_SeekIndex::Job> seek_jobs;
 		for (Bit32u i = 0, total_header_size; i < total_files && p >= cdir_start && p < cdir_end && MZ_READ_LE32(p) == MZ_ZIP_CENTRAL_DIR_HEADER_SIG; i++, p += total_header_size)
 		{
 			Bit32u bit_flag         = MZ_READ_LE16(p + MZ_ZIP_CDH_BIT_FLAG_OFS);
@@ -1899,6 +2468,8 @@ struct zipDriveImpl
 				{
 					while (parent->entries.Get(p_dos)) { if (!parent->IncrementName(p_dos)) goto skip_zip_entry; }
 					parent->entries.Put(p_dos, new Zip_File(DOS_ATTR_ARCHIVE, p_dos, file_date, file_time, diff8dot3, local_header_ofs, (Bit32u)decomp_size, (Bit32u)comp_size, crc, (Bit8u)bit_flag, (Bit8u)method));
+					if (method == ZIP_Unpacker::METHOD_DEFLATED && decomp_size >= Zip_SeekIndex::MIN_FILE_SIZE)
+						seek_jobs.push_back({ local_header_ofs, (Bit32u)comp_size, (Bit32u)decomp_size });
 					break;
 				}
 
@@ -1923,10 +2494,20 @@ struct zipDriveImpl
 			}
 			skip_zip_entry:;
 		}
+		if (!seek_jobs.empty() && archive.map && !dbp_seekindex_dir.empty())
+		{
+			archive.seek_index = new Zip_SeekIndex(archive, DriveCalculateCRC32(cdir_start, (size_t)cdir_size), seek_jobs);
+			archive.seek_index->Start();
+		}
 		free(m_central_dir);
 		if (root.time == 0xFFFF) root.time = root.date = 0;
 	}
 
+	~zipDriveImpl()
+	{
+		delete archive.seek_index; // stops a running index build before the archive gets unmapped
+	}
+
 	bool SetOfsPastHeader(Zip_File& f)
 	{
 		char local_header[MZ_ZIP_LOCAL_DIR_HEADER_SIZE];
@@ -1951,12 +2532,12 @@ struct zipDriveImpl
 	}
 };
 
-DOS_Drive* zipDrive::MountWithDependencies(const char* path, std::string*& error_msg, bool enable_crc_check, bool enter_solo_root_dir, const char* dosc_path)
+DOS_Drive* zipDrive::MountWithDependencies(const char* path, std::string*& error_msg, bool enable_crc_check, bool enter_solo_root_dir, const char* dosc_path, std::vector<std::string>* out_dependencies)
 {
 	struct Local
 	{
 		struct ZFILE { const char* path; const ZFILE* child; zipDriveImpl* child_impl; };
-		static DOS_Drive* Open(const ZFILE& z, std::string*& error_msg, bool enable_crc_check, bool enter_solo_root_dir, const char* dosc_path = NULL)
+		static DOS_Drive* Open(const ZFILE& z, std::string*& error_msg, bool enable_crc_check, bool enter_solo_root_dir, std::vector<std::string>* deps, const char* dosc_path = NULL)
 		{
 			const char* path = z.path;
 
@@ -1967,6 +2548,7 @@ DOS_Drive* zipDrive::MountWithDependencies(const char* path, std::string*& error
 				df = new rawFile(zip_file_h, false); // kept unreferenced until zipDriveImpl constructor will reference it
 
 			if (!df) return NULL;
+			if (deps) deps->push_back(path);
 			bool multi_parent = false;
 			std::string* parent = NULL;
 			DOS_Drive* parent_drive = NULL;
@@ -1982,7 +2564,7 @@ DOS_Drive* zipDrive::MountWithDependencies(const char* path, std::string*& error
 					const ZFILE* recurse = z.child;
 					while (recurse && strcmp(recurse->path, parentpath.c_str())) recurse = recurse->child;
 					if (recurse) (error_msg = new std::string("DOSZ file has recursive parents: "))->append(lastslash ? (lastslash + 1) : path);
-					else parent_drive = Open({parentpath.c_str(), &z, impl}, error_msg, enable_crc_check, enter_solo_root_dir);
+					else parent_drive = Open({parentpath.c_str(), &z, impl}, error_msg, enable_crc_check, enter_solo_root_dir, deps);
 					if (!parent_drive && !error_msg) (error_msg = new std::string("DOSZ parent does not exist: "))->append(*parent);
 				}
 				else (error_msg = new std::string("DOSZ file has multiple parents: "))->append(lastslash ? (lastslash + 1) : path);
@@ -2003,14 +2585,10 @@ DOS_Drive* zipDrive::MountWithDependencies(const char* path, std::string*& error
 			if (len > 5 && (path[len - 1] == 'Z' || path[len - 1] == 'z'))
 			{
 				// Load .DOSC patch file overlay for .DOSZ
-				if (dosc_path)
-					c_file_h = fopen_wrap(dosc_path, "rb");
-				else
-				{
-					std::string doscpath(path);
-					doscpath.back() = (path[len - 1] == 'Z' ? 'C' : 'c');
-					c_file_h = fopen_wrap(doscpath.c_str(), "rb");
-				}
+				std::string doscpath(dosc_path ? dosc_path : path);
+				if (!dosc_path) doscpath.back() = (path[len - 1] == 'Z' ? 'C' : 'c');
+				c_file_h = fopen_wrap(doscpath.c_str(), "rb");
+				if (c_file_h && deps) deps->push_back(doscpath);
 			}
 			if (!parent_drive && !c_file_h && !z.child) return zip_drive;
 
@@ -2021,7 +2599,8 @@ DOS_Drive* zipDrive::MountWithDependencies(const char* path, std::string*& error
 			return patch_drive;
 		}
 	};
-	return Local::Open({path, NULL, NULL}, error_msg, enable_crc_check, enter_solo_root_dir, dosc_path);
+	if (out_dependencies) out_dependencies->clear();
+	return Local::Open({path, NULL, NULL}, error_msg, enable_crc_check, enter_solo_root_dir, out_dependencies, dosc_path);
 }
 
 zipDrive::zipDrive(DOS_File* zip, bool enable_crc_check) : impl(new zipDriveImpl(zip, enable_crc_check, false))
@@ -2223,5 +2802,14 @@ void zipDrive::Uncompress(const Bit8u* src, Bit32u src_len, Bit8u* trg, Bit32u t
 	}
 }
 
+bool DriveInflate(const Bit8u* src, Bit32u src_len, Bit8u* trg, Bit32u trg_len)
+{
+	miniz::tinfl_decompressor inflator;
+	miniz::tinfl_init(&inflator);
+	Bit32u in_size = src_len, out_size = trg_len;
+	miniz::tinfl_status status = miniz::tinfl_decompress(&inflator, src, &in_size, trg, trg, &out_size, miniz::TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+	return ((status == miniz::TINFL_STATUS_DONE || status == miniz::TINFL_STATUS_HAS_MORE_OUTPUT) && out_size == trg_len);
+}
+
 #include <dbp_serialize.h>
 DBP_SERIALIZE_SET_POINTER_LIST(PIC_EventHandler, zipDrive, Zip_File::PICHandler);
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (C) 2020-2024 Bernhard Schelling
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _DRIVE_ZIP_SDEFL_H__
+#define _DRIVE_ZIP_SDEFL_H__
+
+// Raw deflate compressor with a single static huffman block
+// Has no dependencies so it can also be used by the offline pack tool (tools/dosbox_pure_pack.cpp)
+
+#include <string.h>
+
+struct sdefl
+{
+	// BASED ON SMALL DEFLATE
+	// Small Deflate (public domain)
+	// By Micha Mettke - https://gist.github.com/vurtun/760a6a2a198b706a7b1a6197aa5ac747
+
+	enum { WIN_SIZ = (1 << 15), HASH_BITS = 19, HASH_SIZ = (1 << HASH_BITS) };
+	int bits, cnt, tbl[HASH_SIZ], prv[WIN_SIZ];
+
+	unsigned Run(unsigned char *out, const unsigned char *in, int in_len, int lvl = 9)
+	{
+		enum { WIN_MSK = WIN_SIZ-1, MIN_MATCH = 4, MAX_MATCH = 258, HASH_MSK = HASH_SIZ-1, NIL = -1, LVL_MIN = 0, LVL_DEF = 5, LVL_MAX = 8 };
+		#define R2(n) n, n + 128, n + 64, n + 192
+		#define R4(n) R2(n), R2(n + 32), R2(n + 16), R2(n + 48)
+		#define R6(n) R4(n), R4(n +  8), R4(n +  4), R4(n + 12)
+		static const unsigned char sdefl_mirror[256] = { R6(0), R6(2), R6(1), R6(3) };
+		#undef R6
+		#undef R4
+		#undef R2
+
+		struct defl
+		{
+			static unsigned char* put(unsigned char *dst, struct sdefl *s, int code, int bitcnt)
+			{
+				s->bits |= (code << s->cnt);
+				s->cnt += bitcnt;
+				while (s->cnt >= 8) { *dst++ = (unsigned char)(s->bits & 0xFF); s->bits >>= 8; s->cnt -= 8; }
+				return dst;
+			}
+			static int ilog2(int n)
+			{
+				#define it(n) n,n,n,n, n,n,n,n, n,n,n,n ,n,n,n,n
+				static const signed char tbl[256] = {-1,0,1,1,2,2,2,2,3,3,3,3,3,3,3,3,it(4),it(5),it(5),it(6),it(6),it(6),it(6),it(7),it(7),it(7),it(7),it(7),it(7),it(7),it(7)};
+				int tt, t;
+				return (((tt = (n >> 16))) ? ((t = (tt >> 8)) ? 24+tbl[t]: 16+tbl[tt]) : ((t = (n >> 8)) ? 8+tbl[t]: tbl[n]));
+				#undef it
+			}
+			static int npow2(int n)
+			{
+				n--; n |= n >> 1; n |= n >> 2; n |= n >> 4; n |= n >> 8; n |= n >> 16; return (int)++n;
+			}
+			static unsigned uload32(const void *p)
+			{
+				unsigned int n = 0;
+				memcpy(&n, p, sizeof(n));
+				return n;
+			}
+			static unsigned hash32(const void *p)
+			{
+				unsigned n = uload32(p);
+				return (n*0x9E377989)>>(32-HASH_BITS);
+			}
+		};
+
+		int p = 0, max_chain = (lvl < 8) ? (1<<(lvl+1)): (1<<13);
+		unsigned char *q = out;
+
+		bits = cnt = 0;
+		for (p = 0; p < HASH_SIZ; ++p) tbl[p] = NIL;
+
+		p = 0;
+		q = defl::put(q, this, 0x01, 1); /* block */
+		q = defl::put(q, this, 0x01, 2); /* static huffman */
+		while (p < in_len){
+			int run, best_len = 0, dist = 0;
+			int max_match = ((in_len-p)>MAX_MATCH) ? MAX_MATCH:(in_len-p);
+			if (max_match > MIN_MATCH){
+				int limit = ((p-WIN_SIZ)<NIL)?NIL:(p-WIN_SIZ);
+				int chain_len = max_chain;
+				int i = tbl[defl::hash32(&in[p])];
+				while (i > limit) {
+					if (in[i+best_len] == in[p+best_len] && (defl::uload32(&in[i]) == defl::uload32(&in[p]))){
+						int n = MIN_MATCH;
+						while (n < max_match && in[i+n] == in[p+n]) n++;
+						if (n > best_len) {
+							best_len = n;
+							dist = p - i;
+							if (n == max_match) break;
+						}
+					}
+					if (!(--chain_len)) break;
+					i = prv[i&WIN_MSK];
+				}
+			}
+			if (lvl >= 5 && best_len >= MIN_MATCH && best_len < max_match){
+				const int x = p + 1;
+				int tar_len = best_len + 1;
+				int limit = ((x-WIN_SIZ)<NIL)?NIL:(x-WIN_SIZ);
+				int chain_len = max_chain;
+				int i = tbl[defl::hash32(&in[p])];
+				while (i > limit) {
+					if (in[i+best_len] == in[x+best_len] && (defl::uload32(&in[i]) == defl::uload32(&in[x]))){
+						int n = MIN_MATCH;
+						while (n < tar_len && in[i+n] == in[x+n]) n++;
+						if (n == tar_len) {
+							best_len = 0;
+							break;
+						}
+					}
+					if (!(--chain_len)) break;
+					i = prv[i&WIN_MSK];
+				}
+			}
+			if (best_len >= MIN_MATCH) {
+				static const short lxmin[] = {0,11,19,35,67,131};
+				static const short dxmax[] = {0,6,12,24,48,96,192,384,768,1536,3072,6144,12288,24576};
+				static const short lmin[] = {11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227};
+				static const short dmin[] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+
+				/* length encoding */
+				int lc = best_len;
+				int lx = defl::ilog2(best_len - 3) - 2;
+				if (!(lx = (lx < 0) ? 0: lx)) lc += 254;
+				else if (best_len >= 258) lx = 0, lc = 285;
+				else lc = ((lx-1) << 2) + 265 + ((best_len - lxmin[lx]) >> lx);
+
+				if (lc <= 279) q = defl::put(q, this, sdefl_mirror[(lc - 256) << 1], 7);
+				else q = defl::put(q, this, sdefl_mirror[0xc0 - 280 + lc], 8);
+				if (lx) q = defl::put(q, this, best_len - lmin[lc - 265], lx);
+
+				/* distance encoding */
+				int dc = dist - 1;
+				int dx = defl::ilog2(defl::npow2(dist) >> 2);
+				if ((dx = (dx < 0) ? 0: dx))
+					dc = ((dx + 1) << 1) + (dist > dxmax[dx]);
+				q = defl::put(q, this, sdefl_mirror[dc << 3], 5);
+				if (dx) q = defl::put(q, this, dist - dmin[dc], dx);
+				run = best_len;
+			} else {
+				int c = in[p];
+				if (c <= 143) q = defl::put(q, this, sdefl_mirror[0x30+c], 8);
+				else q = defl::put(q, this, 1 + 2 * sdefl_mirror[0x90 - 144 + c], 9);
+				run = 1;
+			}
+			while (run-- != 0) {
+				unsigned h = defl::hash32(&in[p]);
+				prv[p&WIN_MSK] = tbl[h];
+				tbl[h] = p++;
+			}
+		}
+		/* zlib partial flush */
+		q = defl::put(q, this, 0, 7);
+		q = defl::put(q, this, 2, 10);
+		q = defl::put(q, this, 2, 3);
+		return (unsigned)(q - out);
+	}
+};
+
+#endif
@@ -378,6 +378,8 @@ void DrivePathRemoveEndingDots(const char** path, char path_buf[DOS_PATHLENGTH])
 	}
 }
 
+Bit32u drive_content_generation;
+
 Bit8u DriveGetIndex(DOS_Drive* drv)
 {
 	struct Local { static bool Compare(DOS_Drive *outer, DOS_Drive *drv)
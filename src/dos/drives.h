@@ -159,6 +159,15 @@ struct partTable {
 #endif
 //Forward
 class imageDisk;
+//DBP: Added cache of the cluster chain of an open file as runs of consecutive clusters
+struct fatChainCache {
+	struct Extent { Bit32u index, cluster, count; };
+	std::vector<Extent> extents;
+	Bit32u startCluster, generation;
+	bool complete;
+	fatChainCache() : startCluster(0), generation(0), complete(false) {}
+};
+
 class fatDrive : public DOS_Drive {
 public:
 	fatDrive(const char * sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector);
@@ -183,8 +192,10 @@ public:
 	virtual void EmptyCache(void){}
 public:
 	Bit8u readSector(Bit32u sectnum, void * data);
+	Bit8u readSectors(Bit32u sectnum, Bit32u count, void * data);
 	Bit8u writeSector(Bit32u sectnum, void * data);
 	Bit32u getAbsoluteSectFromBytePos(Bit32u startClustNum, Bit32u bytePos);
+	Bit32u getAbsoluteSectFromChain(fatChainCache& cache, Bit32u startClustNum, Bit32u logicalSector, Bit32u* contiguousSectors = NULL);
 	Bit32u getSectorCount(void);
 	Bit32u getSectorSize(void);
 	Bit32u getClusterSize(void);
@@ -233,6 +244,7 @@ private:
 
 	Bit8u fatSectBuffer[1024];
 	Bit32u curFatSect;
+	Bit32u fatGeneration; // increased on every change to the FAT to invalidate chain caches
 };
 
 
@@ -367,10 +379,10 @@ public:
 private:
 	int  readDirEntry(isoDirEntry *de, Bit8u *data);
 	bool loadImage();
-	bool lookupSingle(isoDirEntry *de, const char *name, Bit32u sectorStart, Bit32u length);
-	bool lookup(isoDirEntry *de, const char *path);
+	const struct isoDirIndexEntry* lookup(const char *path);
+	const struct isoDirIndexEntry* ExpandDirIndex(Bit32u dirIndex);
 	int  UpdateMscdex(char driveLetter, const char* physicalPath, Bit8u& subUnit);
-	int  GetDirIterator(const isoDirEntry* de);
+	int  GetDirIterator(Bit32u extent, Bit32u length);
 	bool GetNextDirEntry(const int dirIterator, isoDirEntry* de);
 	void FreeDirIterator(const int dirIterator);
 	bool ReadCachedSector(Bit8u** buffer, const Bit32u sector);
@@ -381,6 +393,7 @@ private:
 		Bit32u currentSector;
 		Bit32u endSector;
 		Bit32u pos;
+		Bit32u dirIndex;
 	} dirIterators[MAX_OPENDIRS];
 	
 	int nextFreeDirIterator;
@@ -391,6 +404,9 @@ private:
 		Bit8u data[ISO_FRAMESIZE];
 	} sectorHashEntries[ISO_MAX_HASH_TABLE_SIZE];
 
+	//DBP: Directory records are parsed once per directory into an index with hashed name lookups
+	struct isoDirIndex* dirIndex;
+
 	bool iso;
 	bool dataCD;
 	isoDirEntry rootEntry;
@@ -503,6 +519,7 @@ bool ReadAndClose(DOS_File *df, std::string& out, Bit32u maxsize = 1024*1024);
 Bit16u DriveReadFileBytes(DOS_Drive* drv, const char* path, Bit8u* outbuf, Bit16u numbytes);
 bool DriveCreateFile(DOS_Drive* drv, const char* path, const Bit8u* buf, Bit32u numbytes);
 Bit32u DriveCalculateCRC32(const Bit8u *ptr, size_t len, Bit32u crc = 0);
+bool DriveInflate(const Bit8u* src, Bit32u src_len, Bit8u* trg, Bit32u trg_len); // raw deflate stream which must fill trg completely
 void DriveFileIterator(DOS_Drive* drv, void(*func)(const char* path, bool is_dir, Bit32u size, Bit16u date, Bit16u time, Bit8u attr, Bitu data), Bitu data = 0, Bit32u limitDirVisits = (Bit32u)-1, const char* root = nullptr);
 
 template <typename TVal> struct BaseHashMap
@@ -710,6 +727,24 @@ template <typename TVal> struct ValueEqualHashMap : public BaseHashMap<TVal>
 	private: typedef BaseHashMap<TVal> BHM;
 };
 
+extern Bit32u drive_content_generation; // increased when a drive changes its content other than through its DOS_Drive functions
+
+// Remembers which layer of a stacked drive (0 being the top) holds a path so lookups don't need to probe all layers in order
+// Stacked drives need to call Forget or Clear when they modify paths, other changes are caught by drive_content_generation
+struct DriveLayerIndex
+{
+	enum { LAYER_NONE = 0xFF };
+	INLINE DriveLayerIndex() : generation(drive_content_generation) { }
+	INLINE int Get(const char* path) { Validate(); Bit8u* l = map.Get(BaseStringToPointerHashMap::Hash(path)); return (l ? *l : -1); }
+	INLINE void Set(const char* path, Bit8u layer) { Validate(); map.Put(BaseStringToPointerHashMap::Hash(path), layer); }
+	INLINE void Forget(const char* path) { map.Remove(BaseStringToPointerHashMap::Hash(path)); }
+	INLINE void Clear() { map.Clear(); }
+private:
+	INLINE void Validate() { if (generation != drive_content_generation) { map.Clear(); generation = drive_content_generation; } }
+	ValueHashMap<Bit8u> map;
+	Bit32u generation;
+};
+
 //Used to load drive images and archives from the native filesystem not a DOS_Drive
 struct rawFile : public DOS_File
 {
@@ -718,11 +753,12 @@ struct rawFile : public DOS_File
 	~rawFile() { if (f) fclose(f); }
 	virtual bool Close() { if (refCtr == 1) open = false; return true; }
 	virtual bool Read(Bit8u* data, Bit16u* size) { *size = (Bit16u)fread(data, 1, *size, f); return open; }
-	virtual bool Write(Bit8u* data, Bit16u* size) { if (!OPEN_IS_WRITING(flags)) return false; *size = (Bit16u)fwrite(data, 1, *size, f); return (*size && open); }
+	virtual bool Write(Bit8u* data, Bit16u* size) { if (!OPEN_IS_WRITING(flags)) return false; if (!*size) return Truncate(); *size = (Bit16u)fwrite(data, 1, *size, f); return (*size && open); }
 	virtual bool Seek(Bit32u* pos, Bit32u type) { fseek(f, (long)*pos, type); *pos = (Bit32u)ftell_wrap(f); return open; }
 	virtual bool Seek64(Bit64u* pos, Bit32u type) { if (fseek_wrap(f, *pos, type) || type != DOS_SEEK_SET) { *pos = (Bit64u)ftell_wrap(f); } return open; }
 	virtual Bit16u GetInformation(void) { return (OPEN_IS_WRITING(flags) ? 0x40 : 0); }
 	static rawFile* TryOpen(const char* path) { FILE* f = fopen_wrap(path, "rb"); return (f ? new rawFile(f, false) : NULL); }
+	bool Truncate() { Bit64s pos = (Bit64s)ftell_wrap(f); return (open && pos == (long)pos && !fflush(f) && !ftruncate(fileno(f), (long)pos)); } // writing 0 bytes truncates like in DOS
 };
 
 struct invalidFileHandle : public DOS_File
@@ -759,13 +795,16 @@ public:
 	virtual Bits UnMount(void);
 
 	bool CloneEntry(DOS_Drive* src_drv, const char* src_path);
+	bool CloneDrive(DOS_Drive* src_drv);
+	bool WriteSnapshot(const char* path);
+	bool ReadSnapshot(const char* path);
 private:
 	struct memoryDriveImpl* impl;
 };
 
 class zipDrive : public DOS_Drive {
 public:
-	static DOS_Drive* MountWithDependencies(const char* path, std::string*& error_msg, bool enable_crc_check = false, bool enter_solo_root_dir = false, const char* dosc_path = NULL);
+	static DOS_Drive* MountWithDependencies(const char* path, std::string*& error_msg, bool enable_crc_check = false, bool enter_solo_root_dir = false, const char* dosc_path = NULL, std::vector<std::string>* out_dependencies = NULL);
 	zipDrive(DOS_File* zip, bool enable_crc_check = false);
 	virtual ~zipDrive();
 	virtual bool FileOpen(DOS_File * * file, char * name,Bit32u flags);
@@ -795,7 +834,7 @@ private:
 class unionDrive : public DOS_Drive {
 public:
 	unionDrive(DOS_Drive& under, DOS_Drive& over, bool autodelete_under = false, bool autodelete_over = false);
-	unionDrive(DOS_Drive& under, const char* save_file = NULL, bool autodelete_under = false, bool strict_mode = false);
+	unionDrive(DOS_Drive& under, const char* save_file = NULL, bool autodelete_under = false, bool strict_mode = false, bool chunked_save = false);
 	void AddUnder(DOS_Drive& add_under, bool autodelete_under = false);
 	virtual ~unionDrive();
 	virtual bool FileOpen(DOS_File * * file, char * name,Bit32u flags);
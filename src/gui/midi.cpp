@@ -328,6 +328,9 @@ void MIDI_Init(Section * sec) {
 void DBP_MIDI_ReplayCache()
 {
 	if (!midi.handler) return;
+	#ifdef C_DBP_SUPPORT_MIDI_MT32
+	if (midi.handler == &Midi_mt32) Midi_mt32.DiscardRendered();
+	#endif
 	struct Local
 	{
 		static void PlayControl(Bit8u ch, Bit8u ctrl, Bit8u cache_val)
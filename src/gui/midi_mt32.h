@@ -19,6 +19,8 @@
 #include "mixer.h"
 #include "support.h"
 #include "cross.h"
+#include "pic.h"
+#include "dbp_threads.h"
 #include "../dos/drives.h"
 #ifdef _MSC_VER
 #pragma warning ( disable : 4244 ) // conversion from 'double' to 'float', possible loss of data
@@ -27,9 +29,12 @@
 
 static void MIDI_MT32_CallBack(Bitu len);
 
+// Milliseconds the background thread renders ahead of the mixer (0 renders synchronously in the mixer callback)
+Bit32u dbp_mt32_renderahead = 0;
+
 struct MidiHandler_mt32 : public MidiHandler
 {
-	MidiHandler_mt32() : MidiHandler(), chan(NULL), mo(NULL), f_control(NULL), f_pcm(NULL), d_zip(NULL), syn(NULL) {}
+	MidiHandler_mt32() : MidiHandler(), chan(NULL), mo(NULL), f_control(NULL), f_pcm(NULL), d_zip(NULL), syn(NULL), ring(NULL) {}
 	MixerChannel*   chan;
 	MixerObject*    mo;
 	DOS_File*       f_control;
@@ -37,6 +42,15 @@ struct MidiHandler_mt32 : public MidiHandler
 	DOS_Drive*      d_zip;
 	MT32Emu::Synth* syn;
 
+	// Background rendering state, the ring positions count stereo output frames since the synth was opened
+	enum { RING_FRAMES = 16384, RING_MASK = RING_FRAMES - 1, RENDER_CHUNK = 256, MAX_AHEAD_MS = 100 };
+	Bit16s*   ring;
+	Bit64u    ring_read, ring_write;
+	Bit32u    out_rate, ahead_frames, need_frames, render_time;
+	bool      render_idle, render_waiting, render_hold, render_quit;
+	Mutex     render_mutex;
+	Semaphore render_wake, render_done;
+
 	const char * GetName(void) { return "mt32"; };
 
 	struct RomFile : public MT32Emu::File
@@ -208,6 +222,7 @@ struct MidiHandler_mt32 : public MidiHandler
 
 	void Close(void)
 	{
+		StopRenderThread();
 		if (f_control) { f_control->Close(); delete f_control; f_control = NULL; }
 		if (f_pcm)     { f_pcm->Close(); delete f_pcm;         f_pcm     = NULL; }
 		if (d_zip)     { delete d_zip;                         d_zip     = NULL; }
@@ -237,22 +252,141 @@ struct MidiHandler_mt32 : public MidiHandler
 			syn = NULL;
 			return false;
 		}
-		chan->SetFreq(syn->getStereoOutputSampleRate());
+		out_rate = syn->getStereoOutputSampleRate();
+		chan->SetFreq(out_rate);
 		chan->Enable(true);
+		StartRenderThread();
 		return true;
 	}
 
+	void StartRenderThread()
+	{
+		DBP_ASSERT(!ring);
+		Bit32u ms = (dbp_mt32_renderahead > MAX_AHEAD_MS ? MAX_AHEAD_MS : dbp_mt32_renderahead);
+		if (!ms) return;
+
+		// Events get queued with timestamps while the thread renders, keep SysEx data in a preallocated buffer and allow a larger backlog
+		syn->setMIDIEventQueueSize(MT32Emu::DEFAULT_MIDI_EVENT_QUEUE_SIZE * 4);
+		syn->configureMIDIEventQueueSysexStorage(SYSEX_SIZE * 4);
+
+		ring = new Bit16s[RING_FRAMES * 2];
+		ring_read = ring_write = 0;
+		ahead_frames = out_rate * ms / 1000;
+		need_frames = render_time = 0;
+		render_idle = render_waiting = render_hold = render_quit = false;
+		chan->perf_external = true; // only count rendering time, not the time Mix waits for the render thread
+		Thread::StartDetached(RenderThread, this);
+	}
+
+	void StopRenderThread()
+	{
+		if (!ring) return;
+		render_mutex.Lock();
+		render_quit = true;
+		if (render_idle) { render_idle = false; render_wake.Post(); }
+		render_mutex.Unlock();
+		render_done.Wait();
+		delete[] ring;
+		ring = NULL;
+		if (chan) chan->perf_external = false;
+	}
+
+	// Called with render_mutex locked, returns with it locked after the render thread has rendered enough or is idle when on hold
+	void WaitRenderThread()
+	{
+		render_waiting = true;
+		if (render_idle) { render_idle = false; render_wake.Post(); }
+		render_mutex.Unlock();
+		render_done.Wait();
+		render_mutex.Lock();
+	}
+
+	static Thread::RET_t THREAD_CC RenderThread(void* p)
+	{
+		MidiHandler_mt32& self = *(MidiHandler_mt32*)p;
+		extern bool dbp_mixer_perf;
+		extern Bit64u DBP_GetTicksUs();
+		self.render_mutex.Lock();
+		while (!self.render_quit)
+		{
+			Bit32u fill = (Bit32u)(self.ring_write - self.ring_read), target = (self.render_hold ? 0 : self.ahead_frames);
+			if (self.render_waiting && !self.render_hold && self.need_frames > target) target = self.need_frames;
+			if (fill >= target)
+			{
+				if (self.render_waiting) { self.render_waiting = false; self.render_done.Post(); }
+				self.render_idle = true;
+				self.render_mutex.Unlock();
+				self.render_wake.Wait();
+				self.render_mutex.Lock();
+				continue;
+			}
+			Bit32u pos = (Bit32u)self.ring_write & RING_MASK, n = target - fill;
+			if (n > RENDER_CHUNK) n = RENDER_CHUNK;
+			if (n > RING_FRAMES - pos) n = RING_FRAMES - pos;
+			self.render_mutex.Unlock();
+			Bit64u perf_start = (dbp_mixer_perf ? DBP_GetTicksUs() : 0);
+			self.syn->render(self.ring + pos * 2, n);
+			Bit32u perf_time = (perf_start ? (Bit32u)(DBP_GetTicksUs() - perf_start) : 0);
+			self.render_mutex.Lock();
+			self.ring_write += n;
+			self.render_time += perf_time;
+			if (self.render_waiting && !self.render_hold && (Bit32u)(self.ring_write - self.ring_read) >= self.need_frames) { self.render_waiting = false; self.render_done.Post(); }
+		}
+		self.render_mutex.Unlock();
+		self.render_done.Post();
+		return 0;
+	}
+
+	void Render(Bit16s* out, Bit32u len)
+	{
+		if (!ring) { syn->render(out, len); return; }
+		render_mutex.Lock();
+		if ((Bit32u)(ring_write - ring_read) < len) { need_frames = len; WaitRenderThread(); }
+		Bit32u pos = (Bit32u)ring_read & RING_MASK, first = (len > RING_FRAMES - pos ? RING_FRAMES - pos : len);
+		memcpy(out, ring + pos * 2, first * 4);
+		if (first != len) memcpy(out + first * 2, ring, (len - first) * 4);
+		ring_read += len;
+		chan->perf_time += render_time; // account time spent on the render thread to the channel for performance statistics
+		render_time = 0;
+		if (render_idle) { render_idle = false; render_wake.Post(); } // top up the render ahead window
+		render_mutex.Unlock();
+	}
+
+	// Throw away audio rendered ahead of time and apply all queued events immediately (used when the MIDI state gets restored)
+	void DiscardRendered()
+	{
+		if (!ring) return;
+		render_mutex.Lock();
+		render_hold = true;
+		if (!render_idle) WaitRenderThread();
+		syn->flushMIDIQueue();
+		ring_read = ring_write;
+		render_hold = false;
+		render_idle = false;
+		render_wake.Post();
+		render_mutex.Unlock();
+	}
+
+	Bit32u EventTimestamp()
+	{
+		// Place the event at the current emulated time inside the mixer tick plus the render ahead window so output stays sample accurate
+		Bit64u out_pos = ring_read + (Bit32u)(PIC_TickIndex() * out_rate / 1000) + ahead_frames;
+		return (Bit32u)(out_pos * MT32Emu::SAMPLE_RATE / out_rate);
+	}
+
 	void PlayMsg(Bit8u * msg)
 	{
 		if (!syn && (!f_control || !LoadSynth())) return;
 		Bit32u msg32 = ((Bit32u)(msg[0]) | ((Bit32u)(msg[1]) << 8U) | ((Bit32u)(msg[2]) << 16U) | ((Bit32u)(msg[3]) << 24U));
-		syn->playMsg(msg32);
+		if (ring) syn->playMsg(msg32, EventTimestamp());
+		else syn->playMsg(msg32);
 	};
 
 	void PlaySysex(Bit8u * sysex,Bitu len)
 	{
 		if (!syn && (!f_control || !LoadSynth())) return;
-		syn->playSysex(sysex, (Bit32u)len);
+		if (ring) syn->playSysex(sysex, (Bit32u)len, EventTimestamp());
+		else syn->playSysex(sysex, (Bit32u)len);
 	}
 };
 
@@ -262,6 +396,6 @@ static void MIDI_MT32_CallBack(Bitu len)
 {
 	DBP_ASSERT(len <= (MIXER_BUFSIZE/4));
 	if (len > (MIXER_BUFSIZE/4)) len = (MIXER_BUFSIZE/4);
-	Midi_mt32.syn->render((Bit16s*)MixTemp, (Bit32u)len);
+	Midi_mt32.Render((Bit16s*)MixTemp, (Bit32u)len);
 	Midi_mt32.chan->AddSamples_s16(len, (Bit16s*)MixTemp);
 }
@@ -25,6 +25,7 @@
 #define TSF_IMPLEMENTATION
 #define TSF_STATIC
 #define TSF_NO_STDIO
+#define TSF_SHORT_SAMPLES
 #include "tsf.h"
 
 static void MIDI_TSF_CallBack(Bitu len);
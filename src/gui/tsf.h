@@ -10,6 +10,7 @@
    #include "tsf.h"
 
    [OPTIONAL] #define TSF_NO_STDIO to remove stdio dependency
+   [OPTIONAL] #define TSF_SHORT_SAMPLES to keep sample data as 16-bit instead of float (halves memory use)
    [OPTIONAL] #define TSF_MALLOC, TSF_REALLOC, and TSF_FREE to avoid stdlib.h
    [OPTIONAL] #define TSF_MEMCPY, TSF_MEMSET to avoid string.h
    [OPTIONAL] #define TSF_POW, TSF_POWF, TSF_EXPF, TSF_LOG, TSF_TAN, TSF_LOG10, TSF_SQRT to avoid math.h
@@ -325,12 +326,20 @@ typedef signed short tsf_s16;
 typedef unsigned int tsf_u32;
 typedef char tsf_char20[20];
 
+#ifdef TSF_SHORT_SAMPLES
+typedef short tsf_sample;
+#define TSF_SAMPLE_FLOAT(s) ((s) * (1.0f / 32767.0f))
+#else
+typedef float tsf_sample;
+#define TSF_SAMPLE_FLOAT(s) (s)
+#endif
+
 #define TSF_FourCCEquals(value1, value2) (value1[0] == value2[0] && value1[1] == value2[1] && value1[2] == value2[2] && value1[3] == value2[3])
 
 struct tsf
 {
 	struct tsf_preset* presets;
-	float* fontSamples;
+	tsf_sample* fontSamples;
 	struct tsf_voice* voices;
 	struct tsf_channels* channels;
 
@@ -989,6 +998,12 @@ static int tsf_load_samples(void** pRawBuffer, float** pFloatBuffer, unsigned in
 	if (!(*pFloatBuffer = (float*)TSF_REALLOC(*pFloatBuffer, resNum * sizeof(float)))) *pFloatBuffer = oldres;
 	*pSmplCount = resNum;
 	return (*pFloatBuffer ? 1 : 0);
+	#elif defined(TSF_SHORT_SAMPLES)
+	// Keep the 16-bit samples as they are stored in the file
+	(void)pFloatBuffer;
+	*pSmplCount = chunkSmpl->size / (unsigned int)sizeof(short);
+	*pRawBuffer = (void*)TSF_MALLOC(chunkSmpl->size);
+	return (*pRawBuffer && stream->read(stream->data, *pRawBuffer, chunkSmpl->size));
 	#else
 	// Inline convert the samples from short to float
 	float *res, *out; const short *in;
@@ -1002,6 +1017,31 @@ static int tsf_load_samples(void** pRawBuffer, float** pFloatBuffer, unsigned in
 	#endif
 }
 
+#ifdef TSF_SHORT_SAMPLES
+static tsf_sample* tsf_float_to_short_samples(float* buffer, unsigned int count)
+{
+	// Convert in place (each short is written at or before the float it was read from) then shrink the buffer
+	tsf_sample *out = (tsf_sample*)buffer, *res; unsigned int i;
+	for (i = 0; i != count; i++)
+	{
+		float s = buffer[i] * 32767.0f;
+		out[i] = (tsf_sample)(s >= 32767.0f ? 32767 : (s <= -32768.0f ? -32768 : (s < 0 ? s - 0.5f : s + 0.5f)));
+	}
+	res = (tsf_sample*)TSF_REALLOC(buffer, (count ? count : 1) * sizeof(tsf_sample));
+	return (res ? res : out);
+}
+
+#ifdef STB_VORBIS_INCLUDE_STB_VORBIS_H
+static int tsf_has_compressed_samples(const struct tsf_hydra *hydra)
+{
+	int i;
+	for (i = 0; i != hydra->shdrNum; i++)
+		if (hydra->shdrs[i].sampleType & 0x30) return 1;
+	return 0;
+}
+#endif
+#endif
+
 static int tsf_voice_envelope_release_samples(struct tsf_voice_envelope* e, float outSampleRate)
 {
 	return (int)((e->parameters.release <= 0 ? TSF_FASTRELEASETIME : e->parameters.release) * outSampleRate);
@@ -1220,7 +1260,7 @@ static void tsf_voice_calcpitchratio(struct tsf_voice* v, float pitchShift, floa
 static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, int numSamples)
 {
 	struct tsf_region* region = v->region;
-	float* input = f->fontSamples;
+	tsf_sample* input = f->fontSamples;
 	float* outL = outputBuffer;
 	float* outR = (f->outputmode == TSF_STEREO_UNWEAVED ? outL + numSamples : TSF_NULL);
 
@@ -1292,7 +1332,7 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
 					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+					float alpha = (float)(tmpSourceSamplePosition - pos), val = (TSF_SAMPLE_FLOAT(input[pos]) * (1.0f - alpha) + TSF_SAMPLE_FLOAT(input[nextPos]) * alpha);
 
 					// Low-pass filter.
 					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
@@ -1313,7 +1353,7 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
 					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+					float alpha = (float)(tmpSourceSamplePosition - pos), val = (TSF_SAMPLE_FLOAT(input[pos]) * (1.0f - alpha) + TSF_SAMPLE_FLOAT(input[nextPos]) * alpha);
 
 					// Low-pass filter.
 					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
@@ -1333,7 +1373,7 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
 					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+					float alpha = (float)(tmpSourceSamplePosition - pos), val = (TSF_SAMPLE_FLOAT(input[pos]) * (1.0f - alpha) + TSF_SAMPLE_FLOAT(input[nextPos]) * alpha);
 
 					// Low-pass filter.
 					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
@@ -1432,14 +1472,31 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 	else
 	{
 		#ifdef STB_VORBIS_INCLUDE_STB_VORBIS_H
+		#ifdef TSF_SHORT_SAMPLES
+		if (!floatBuffer && !tsf_has_compressed_samples(&hydra)) smplCount /= (tsf_u32)sizeof(short); // use uncompressed data as is
+		else
+		#endif
 		if (!floatBuffer && !tsf_decode_sf3_samples(rawBuffer, &floatBuffer, &smplCount, &hydra)) goto out_of_memory;
 		#endif
+		#ifdef TSF_SHORT_SAMPLES
+		if (floatBuffer)
+		{
+			TSF_FREE(rawBuffer);
+			rawBuffer = tsf_float_to_short_samples(floatBuffer, smplCount);
+			floatBuffer = TSF_NULL;
+		}
+		#endif
 		res = (tsf*)TSF_MALLOC(sizeof(tsf));
 		if (res) TSF_MEMSET(res, 0, sizeof(tsf));
 		if (!res || !tsf_load_presets(res, &hydra, smplCount)) goto out_of_memory;
 		res->outSampleRate = 44100.0f;
+		#ifdef TSF_SHORT_SAMPLES
+		res->fontSamples = (tsf_sample*)rawBuffer;
+		rawBuffer = TSF_NULL; // don't free below
+		#else
 		res->fontSamples = floatBuffer;
 		floatBuffer = TSF_NULL; // don't free below
+		#endif
 	}
 	if (0)
 	{
@@ -55,6 +55,13 @@ using namespace std;
 #define WCTRL_DECREASING		0x40
 #define WCTRL_IRQPENDING		0x80
 
+#if !defined(__SSE2__) && (_M_IX86_FP == 2 || (defined(_M_AMD64) || defined(_M_X64)))
+#define __SSE2__ 1
+#endif
+#if defined(__SSE2__) && __SSE2__
+#include <emmintrin.h>
+#endif
+
 Bit8u adlib_commandreg;
 static MixerChannel * gus_chan;
 static Bit8u irqtable[8] = { 0, 2, 5, 3, 7, 11, 12, 15 };
@@ -64,6 +71,8 @@ static Bit8u dmatable[8] = { 0, 1, 3, 5, 6, 7, 0, 0 };
 static Bit8u* GUSRam;
 static Bit16u vol16bit[4096];
 static Bit32u pantable[16];
+//DBP: Bit mask of voices which are not disabled, only these are visited in the mixer callback
+static Bit32u gus_activevoices;
 
 class GUSChannels;
 static void CheckVoiceIrq(void);
@@ -200,9 +209,14 @@ public:
 	void WriteWaveFreq(Bit16u val) {
 		WaveAdd = ((Bit32u)val << (WAVE_FRACT-1)) / 512;        //Samples / original gus frame
 	}
+	INLINE void UpdateActive(void) {
+		if (RampCtrl & WaveCtrl & 3) gus_activevoices &= ~irqmask;
+		else gus_activevoices |= irqmask;
+	}
 	void WriteWaveCtrl(Bit8u val) {
 		Bit32u oldirq=myGUS.WaveIRQ;
 		WaveCtrl = val & 0x7f;
+		UpdateActive();
 		if ((val & 0xa0)==0xa0) myGUS.WaveIRQ|=irqmask;
 		else myGUS.WaveIRQ&=~irqmask;
 		if (oldirq != myGUS.WaveIRQ) 
@@ -225,6 +239,7 @@ public:
 	void WriteRampCtrl(Bit8u val) {
 		Bit32u old=myGUS.RampIRQ;
 		RampCtrl = val & 0x7f;
+		UpdateActive();
 		//Manually set the irq
 		if ((val & 0xa0)==0xa0) 
 			myGUS.RampIRQ|=irqmask;
@@ -310,12 +325,96 @@ public:
 		UpdateVolumes();
 	}
 
+	// Number of samples that can be generated before the wave position reaches a boundary (only valid while not ramping)
+	INLINE Bitu GetStaticSpan(Bitu len) const {
+		if (WaveCtrl & (WCTRL_STOP | WCTRL_STOPPED)) return len;
+		Bit32u steps;
+		if (WaveCtrl & WCTRL_DECREASING) {
+			if (WaveAddr <= WaveStart) return 0;
+			steps = (WaveAdd ? (WaveAddr - WaveStart - 1) / WaveAdd : (Bit32u)len);
+		} else {
+			if (WaveAddr >= WaveEnd) return 0;
+			steps = (WaveAdd ? (WaveEnd - WaveAddr - 1) / WaveAdd : (Bit32u)len);
+		}
+		return (steps < len ? steps : len);
+	}
+
+	// Mix a span of samples with constant volume during which no wave boundary will be reached
+	void GenerateStaticSpan(Bit32s * stream,Bitu len,bool is16) {
+		const Bit32u step = ((WaveCtrl & (WCTRL_STOP | WCTRL_STOPPED)) ? 0 : WaveAdd);
+		const bool decreasing = ((WaveCtrl & WCTRL_DECREASING) != 0);
+		if (!myGUS.dacenabled || !(VolLeft | VolRight)) {
+			// Silent voice, just advance the position
+			if (decreasing) WaveAddr -= step * (Bit32u)len;
+			else WaveAddr += step * (Bit32u)len;
+			return;
+		}
+		const bool interpolate = (WaveAdd < (1 << WAVE_FRACT));
+		Bit16s samps[64];
+		for (Bitu done = 0; done != len;) {
+			Bitu n = len - done;
+			if (n > 64) n = 64;
+			for (Bitu i = 0; i != n; i++) {
+				Bit32u useAddr = WaveAddr >> WAVE_FRACT, nextAddr;
+				Bit32s w1, w2;
+				if (is16) {
+					useAddr = (useAddr & 0xc0000L) | ((useAddr & 0x1ffffL) << 1);
+					w1 = (GUSRam[useAddr + 0] | (((Bit8s)GUSRam[useAddr + 1]) << 8));
+					if (interpolate) {
+						nextAddr = (useAddr + 2) & (GUSRAM_SIZE - 1);
+						w2 = (GUSRam[nextAddr + 0] | (((Bit8s)GUSRam[nextAddr + 1]) << 8));
+						w1 += (((w2 - w1)*(Bit32s)(WaveAddr&WAVE_FRACT_MASK)) >> WAVE_FRACT);
+					}
+				} else {
+					w1 = ((Bit8s)GUSRam[useAddr]) << 8;
+					if (interpolate) {
+						nextAddr = (useAddr + 1) & (GUSRAM_SIZE - 1);
+						w2 = ((Bit8s)GUSRam[nextAddr]) << 8;
+						w1 += (((w2 - w1)*(Bit32s)(WaveAddr&WAVE_FRACT_MASK)) >> WAVE_FRACT);
+					}
+				}
+				samps[i] = (Bit16s)w1;
+				if (decreasing) WaveAddr -= step;
+				else WaveAddr += step;
+			}
+			MixStaticSpan(stream + done * 2, samps, n);
+			done += n;
+		}
+	}
+
+	INLINE void MixStaticSpan(Bit32s * stream,const Bit16s* samps,Bitu n) const {
+		Bitu i = 0;
+		#if defined(__SSE2__) && __SSE2__
+		// Volumes are at most 1 << 13 so the 16x16 bit products can be combined from the low and high halves
+		const __m128i vol = _mm_set_epi16((short)VolRight, (short)VolLeft, (short)VolRight, (short)VolLeft, (short)VolRight, (short)VolLeft, (short)VolRight, (short)VolLeft);
+		for (; i + 4 <= n; i += 4) {
+			__m128i s = _mm_loadl_epi64((const __m128i*)(samps + i));
+			s = _mm_unpacklo_epi16(s, s);
+			__m128i lo = _mm_mullo_epi16(s, vol), hi = _mm_mulhi_epi16(s, vol);
+			__m128i* out = (__m128i*)(stream + i * 2);
+			_mm_storeu_si128(out + 0, _mm_add_epi32(_mm_loadu_si128(out + 0), _mm_unpacklo_epi16(lo, hi)));
+			_mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_unpackhi_epi16(lo, hi)));
+		}
+		#endif
+		for (; i != n; i++) {
+			stream[i << 1] += samps[i] * VolLeft;
+			stream[(i << 1) + 1] += samps[i] * VolRight;
+		}
+	}
+
 	void generateSamples(Bit32s * stream,Bitu len) {
 		//Disabled channel
 		if (RampCtrl & WaveCtrl & 3) return;
 		bool is16 = (WaveCtrl & WCTRL_16BIT)!=0;
 
-		for (Bitu i=0; i < len; i++) {
+		for (Bitu i=0; i < len;) {
+			// While the volume is not ramping, mix everything up to the next wave boundary in one go
+			Bitu span = ((RampCtrl & 3) ? GetStaticSpan(len - i) : 0);
+			if (span) {
+				GenerateStaticSpan(stream + (i << 1), span, is16);
+				i += span;
+				continue;
+			}
 			if (myGUS.dacenabled && (VolLeft | VolRight)) {
 				// Get sample
 				Bit32s tmpsamp = is16 ? GetSample16():GetSample8();
@@ -325,7 +424,10 @@ public:
 			}
 			WaveUpdate();
 			RampUpdate();
+			i++;
 		}
+		// Voice might have stopped itself
+		UpdateActive();
 	}
 };
 
@@ -774,8 +876,8 @@ static void GUS_CallBack(Bitu len) {
 	Bit32s buffer[MIXER_BUFSIZE][2];
 	memset(buffer, 0, len * sizeof(buffer[0]));
 
-	for (Bitu i = 0; i < myGUS.ActiveChannels; i++) {
-		guschan[i]->generateSamples(buffer[0], len);
+	for (Bit32u i = 0, voices = (gus_activevoices & myGUS.ActiveMask); voices; i++, voices >>= 1) {
+		if (voices & 1) guschan[i]->generateSamples(buffer[0], len);
 	}
 	if (myGUS.dacenabled) {
 		for (Bitu i = 0; i < len; i++) {
@@ -816,6 +918,7 @@ public:
 		if(!section->Get_bool("gus")) return;
 	
 		memset(&myGUS,0,sizeof(myGUS));
+		gus_activevoices = 0;
 		GUSRam = new Bit8u[GUSRAM_SIZE];
 		memset(GUSRam,0,GUSRAM_SIZE);
 	
@@ -942,5 +1045,9 @@ void DBPSerialize_GUS(DBPArchive& ar_outer)
 		ar.Serialize(*guschan[i]);
 
 	if (ar.mode == DBPArchive::MODE_LOAD)
+	{
 		curchan = (chan_idx < 32 ? guschan[chan_idx] : NULL);
+		for (Bit8u i = 0; i != 32; i++)
+			guschan[i]->UpdateActive();
+	}
 }
@@ -29,6 +29,9 @@
 #include "bios_disk.h"
 #include "../dos/drives.h"
 #include "../dos/cdrom.h"
+#include "pci_bus.h"
+#include "mem.h"
+#include "paging.h"
 
 static const unsigned char IDE_default_IRQs[4] = {
 	14, /* primary */
@@ -90,8 +93,27 @@ enum { MAX_IDE_CONTROLLERS = 2 };
 
 static struct IDEController* idecontroller[MAX_IDE_CONTROLLERS];
 
+bool dbp_ide_busmaster; // add the PCI bus master IDE function, set by the frontend
+static bool ide_busmaster_active; // bus master function was added, DMA is advertised and accepted
+
 #define IDEMIN(a,b) ((a) < (b) ? (a) : (b))
 
+/* bus master transfers address physical memory directly, like the DMA controller they don't go through the CPU paging */
+static void IDE_PhysBlockCopy(PhysPt addr,uint8_t* data,uint32_t len,bool to_mem) {
+	const Bitu total_pages = MEM_TotalPages();
+	while (len) {
+		Bitu page = addr >> 12;
+		const uint32_t ofs = addr & 4095, n = IDEMIN(len,4096 - ofs);
+		if (page < LINK_START) page = paging.firstmb[page];
+		if (page >= total_pages) { if (!to_mem) memset(data,0xFF,n); } /* no memory at this address */
+		else if (to_mem) memcpy(MemBase + page*4096 + ofs,data,n);
+		else memcpy(data,MemBase + page*4096 + ofs,n);
+		addr += n;
+		data += n;
+		len -= n;
+	}
+}
+
 static void ide_altio_w(Bitu port, Bitu val, Bitu iolen);
 static Bitu ide_altio_r(Bitu port, Bitu iolen);
 static void ide_baseio_w(Bitu port, Bitu val, Bitu iolen);
@@ -111,7 +133,18 @@ struct IDEController {
 	unsigned short base_io;
 	int IRQ;
 
+	/* PCI bus master IDE (PIIX-style) registers of this channel */
+	uint8_t bm_command;           /* bit 0 = start, bit 3 = transfer to memory */
+	uint8_t bm_status;            /* bit 0 = active, bit 1 = error, bit 2 = interrupt, bit 5/6 = drive DMA capable */
+	bool bm_eot;                  /* current PRD entry is the last one */
+	uint32_t bm_prd;              /* physical address of the PRD table */
+	uint32_t bm_prd_next;         /* physical address of the next PRD entry */
+	uint32_t bm_addr, bm_left;    /* memory region of the current PRD entry that is still to be transferred */
+
 	IDEController(unsigned char index) {
+		bm_command = bm_status = 0;
+		bm_eot = false;
+		bm_prd = bm_prd_next = bm_addr = bm_left = 0;
 		host_reset = false;
 		irq_pending = false;
 		interrupt_enable = true;
@@ -127,6 +160,7 @@ struct IDEController {
 	}
 
 	void check_device_irq();
+	void bm_run();
 	~IDEController();
 
 	void install_io_port() {
@@ -156,6 +190,7 @@ struct IDEDevice {
 	bool allow_writing;
 	bool irq_signal;
 	bool asleep;
+	bool dma; /* the current command transfers its data with the bus master */
 	IDEDeviceState state;
 
 	/* feature: 0x1F1 (Word 00h in ATA specs)
@@ -186,6 +221,7 @@ struct IDEDevice {
 		asleep = false;
 		irq_signal = false;
 		allow_writing = true;
+		dma = false;
 		state = IDE_DEV_READY;
 		feature = count = lba[0] = lba[1] = lba[2] = command = drivehead = 0;
 		status = IDE_STATUS_DRIVE_READY | IDE_STATUS_DRIVE_SEEK_COMPLETE;
@@ -196,6 +232,11 @@ struct IDEDevice {
 	virtual void writecommand(uint8_t cmd) = 0;
 	virtual Bitu data_read(Bitu iolen) = 0;
 	virtual void data_write(Bitu v,Bitu iolen) = 0;
+	virtual uint32_t dma_block(PhysPt addr,uint32_t len) = 0; /* bus master copy of the current data block, returns bytes moved */
+
+	inline bool dma_pending() {
+		return dma && (status & IDE_STATUS_DRQ) && (state == IDE_DEV_DATA_READ || state == IDE_DEV_DATA_WRITE);
+	}
 
 	static inline IDEDevice* GetByIndex(Bitu dev_idx/*which IDE device*/) {
 		return (dev_idx < MAX_IDE_CONTROLLERS*2 ? idecontroller[dev_idx>>1]->device[dev_idx&1] : NULL);
@@ -203,6 +244,7 @@ struct IDEDevice {
 
 	void host_reset_begin() {    /* IDE controller -> upon setting bit 2 of alt (0x3F6) */
 		status = 0xFF;
+		dma = false;
 		asleep = false;
 		allow_writing = true;
 		state = IDE_DEV_BUSY;
@@ -237,12 +279,23 @@ struct IDEDevice {
 	}
 
 	void raise_irq() {
+		if (dma) {
+			/* the command is done, the bus master stops being active */
+			dma = false;
+			controller->bm_status &= ~1;
+		}
 		if (!irq_signal) {
 			irq_signal = true;
 			controller->check_device_irq();
 		}
 	}
 
+	void data_ready() {
+		/* data is ready for the host, DMA commands move it with the bus master instead of signaling PIO */
+		if (dma_pending()) controller->bm_run();
+		else raise_irq();
+	}
+
 	void lower_irq() {
 		if (irq_signal) {
 			irq_signal = false;
@@ -309,6 +362,7 @@ void IDEController::check_device_irq() {
 	if (irq_pending != sig) {
 		if (sig) {
 			irq_pending = true;
+			bm_status |= 4;
 			if (IRQ >= 0) PIC_ActivateIRQ((unsigned int)IRQ);
 		}
 		else {
@@ -318,6 +372,31 @@ void IDEController::check_device_irq() {
 	}
 }
 
+void IDEController::bm_run() {
+	/* move data between the selected device and the memory regions of the PRD table */
+	IDEDevice* dev = device[select];
+	if (!(bm_status & 1) || !dev) return;
+	while (dev->dma_pending()) {
+		if (!bm_left) {
+			if (bm_eot) {
+				/* PRD table exhausted before the device finished, stop and let the driver time out */
+				bm_status &= ~1;
+				return;
+			}
+			uint8_t prd[8];
+			IDE_PhysBlockCopy(bm_prd_next,prd,8,false);
+			uint32_t flags = host_readd(prd + 4);
+			bm_addr = host_readd(prd) & ~1u;
+			bm_left = ((flags & 0xFFFE) ? (flags & 0xFFFE) : 0x10000);
+			bm_eot = !!(flags & 0x80000000);
+			bm_prd_next += 8;
+		}
+		uint32_t n = dev->dma_block(bm_addr, bm_left);
+		bm_addr += n;
+		bm_left -= n;
+	}
+}
+
 IDEController::~IDEController()
 {
 	if (device[0]) delete device[0];
@@ -378,6 +457,12 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 		return my_cdrom;
 	}
 
+	float read_delay() {
+		//DBP: Count the read set up in LBA/TransferLength and return the busy time for the selected disk timing mode
+		double ms = DBP_IOTiming_Access(DBP_IOSTATS_DOS + DOSDriveIndex, DBP_IODEV_CDROM, (Bit64u)LBA * 2048, TransferLength * (atapi_cmd[0] == 0xBE ? TransferSectorSize : 2048), false);
+		return (dbp_iotiming == DBP_IOTIMING_TURBO ? 0.00001f : dbp_iotiming == DBP_IOTIMING_ACCURATE ? (float)ms + 0.00001f : 3.f);
+	}
+
 	#if 0
 	static const char* getIDECommandName(uint8_t cmd)
 	{
@@ -496,23 +581,27 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 				allow_writing = true;
 				break;
 			case 0xA0: /* ATAPI PACKET */
-				if (feature & 1) {
-					/* this code does not support DMA packet commands */
+				if ((feature & 1) && !ide_busmaster_active) {
+					/* DMA packet commands need the bus master function */
 					LOG_MSG("Attempted DMA transfer");
 					abort_error();
 					count = 0x03; /* no more data (command/data=1, input/output=1) */
 					feature = 0xF4;
 					raise_irq();
+					break;
 				}
-				else {
-					state = IDE_DEV_BUSY;
-					status = IDE_STATUS_BUSY;
-					atapi_to_host = (feature >> 2) & 1; /* 0=to device 1=to host */
-					host_maximum_byte_count = ((unsigned int)lba[2] << 8) + (unsigned int)lba[1]; /* LBA field bits 23:8 are byte count */
-					if (host_maximum_byte_count == 0) host_maximum_byte_count = 0x10000UL;
-					PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-					PIC_AddEvent(IDE_DelayedCommand,(0.25)/*ms*/,device_index);
+				state = IDE_DEV_BUSY;
+				status = IDE_STATUS_BUSY;
+				atapi_to_host = (feature >> 2) & 1; /* 0=to device 1=to host */
+				if (feature & 1) {
+					/* DMA packet command, the byte count limit only applies to PIO so let the data blocks be as large as the buffer allows */
+					dma = true;
+					lba[1] = lba[2] = 0xFF;
 				}
+				host_maximum_byte_count = ((unsigned int)lba[2] << 8) + (unsigned int)lba[1]; /* LBA field bits 23:8 are byte count */
+				if (host_maximum_byte_count == 0) host_maximum_byte_count = 0x10000UL;
+				PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
+				PIC_AddEvent(IDE_DelayedCommand,(0.25)/*ms*/,device_index);
 				break;
 			case 0xA1: /* IDENTIFY PACKET DEVICE */
 				state = IDE_DEV_BUSY;
@@ -538,7 +627,8 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 				break;
 			case 0xEF: /* SET FEATURES */
 				if (feature == 0x66/*Disable reverting to power on defaults*/ ||
-					feature == 0xCC/*Enable reverting to power on defaults*/) {
+					feature == 0xCC/*Enable reverting to power on defaults*/ ||
+					(feature == 0x03 && ide_busmaster_active)/*Set transfer mode, PIO and multiword DMA are both always available*/) {
 					/* ignore */
 					status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRIVE_SEEK_COMPLETE;
 					state = IDE_DEV_READY;
@@ -639,6 +729,15 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 		}
 	}
 
+	virtual uint32_t dma_block(PhysPt addr,uint32_t len) {
+		uint32_t n = IDEMIN(len,sector_total - sector_i);
+		IDE_PhysBlockCopy(addr,sector+sector_i,n,state == IDE_DEV_DATA_READ);
+		sector_i += n;
+		if (sector_i >= sector_total)
+			io_completion();
+		return n;
+	}
+
 	void update_from_cdrom() {
 		CDROM_Interface *cdrom = getMSCDEXDrive();
 		if (cdrom == NULL) {
@@ -665,6 +764,7 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 		host_writew(sector+(49*2),
 			0x0800UL|/*IORDY supported*/
 			0x0200UL|/*must be one*/
+			(ide_busmaster_active ? 0x0100UL : 0)|/*DMA supported*/
 			0);
 		host_writew(sector+(50*2),
 			0x4000UL);
@@ -674,6 +774,14 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 			0x00F0UL);
 		host_writew(sector+(53*2),
 			0x0006UL);
+		if (ide_busmaster_active) {
+			host_writew(sector+(63*2),  /* multiword DMA modes 0-2 supported, mode 2 selected */
+				0x0407UL);
+			host_writew(sector+(65*2),  /* multiword DMA cycle time */
+				0x0078UL);
+			host_writew(sector+(66*2),  /* multiword DMA cycle time */
+				0x0078UL);
+		}
 		host_writew(sector+(64*2),      /* PIO modes supported */
 			0x0003UL);
 		host_writew(sector+(67*2),      /* PIO cycle time */
@@ -941,9 +1049,8 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 						count = 0x02;
 						state = IDE_DEV_ATAPI_BUSY;
 						status = IDE_STATUS_BUSY;
-						/* TODO: Emulate CD-ROM spin-up delay, and seek delay */
 						PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-						PIC_AddEvent(IDE_DelayedCommand,(3)/*ms*/,device_index);
+						PIC_AddEvent(IDE_DelayedCommand,read_delay(),device_index);
 						return;
 					}
 					else {
@@ -979,9 +1086,8 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 						count = 0x02;
 						state = IDE_DEV_ATAPI_BUSY;
 						status = IDE_STATUS_BUSY;
-						/* TODO: Emulate CD-ROM spin-up delay, and seek delay */
 						PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-						PIC_AddEvent(IDE_DelayedCommand,(3)/*ms*/,device_index);
+						PIC_AddEvent(IDE_DelayedCommand,read_delay(),device_index);
 						return;
 					}
 					else {
@@ -1215,9 +1321,8 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 					LBAnext = LBA;
 					state = IDE_DEV_ATAPI_BUSY;
 					status = IDE_STATUS_BUSY;
-					/* TODO: Emulate CD-ROM spin-up delay, and seek delay */
 					PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-					PIC_AddEvent(IDE_DelayedCommand,(3)/*ms*/,device_index);
+					PIC_AddEvent(IDE_DelayedCommand,read_delay(),device_index);
 				}
 				else {
 					count = 0x03;
@@ -1275,9 +1380,8 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 					count = 0x02;
 					state = IDE_DEV_ATAPI_BUSY;
 					status = IDE_STATUS_BUSY;
-					/* TODO: Emulate CD-ROM spin-up delay, and seek delay */
 					PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-					PIC_AddEvent(IDE_DelayedCommand,(3)/*ms*/,device_index);
+					PIC_AddEvent(IDE_DelayedCommand,read_delay(),device_index);
 				}
 				else {
 					count = 0x03;
@@ -1333,9 +1437,8 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 					count = 0x02;
 					state = IDE_DEV_ATAPI_BUSY;
 					status = IDE_STATUS_BUSY;
-					/* TODO: Emulate CD-ROM spin-up delay, and seek delay */
 					PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-					PIC_AddEvent(IDE_DelayedCommand,(3)/*ms*/,device_index);
+					PIC_AddEvent(IDE_DelayedCommand,read_delay(),device_index);
 				}
 				else {
 					count = 0x03;
@@ -1692,8 +1795,8 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 				feature = 0x00;
 				state = IDE_DEV_DATA_WRITE;
 				status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRQ|IDE_STATUS_DRIVE_SEEK_COMPLETE;
-				raise_irq();
 				allow_writing = true;
+				data_ready();
 				break;
 			case 0x5A: /* MODE SENSE(10) */
 				mode_sense();
@@ -1727,8 +1830,8 @@ struct IDEATAPICDROMDevice : public IDEDevice {
 					feature, count, lba[0], lba[1], lba[2], drivehead);
 				#endif
 
-				raise_irq();
 				allow_writing = true;
+				data_ready();
 				break;
 		}
 	}
@@ -2923,6 +3026,110 @@ static void ide_baseio_w(Bitu port,Bitu val,Bitu iolen) {
 	}
 }
 
+#ifdef PCI_FUNCTIONALITY_ENABLED
+static Bitu ide_busmaster_r(Bitu port,Bitu iolen);
+static void ide_busmaster_w(Bitu port,Bitu val,Bitu iolen);
+
+static struct PCI_IDEDevice : public PCI_Device {
+	enum { vendor = 0x8086, device = 0x7010 }; // Intel 82371SB PIIX3 IDE
+	enum { default_bm_base = 0xFFA0 };
+	IO_ReadHandleObject ReadHandler;
+	IO_WriteHandleObject WriteHandler;
+	Bit16u bm_base;
+
+	PCI_IDEDevice() : PCI_Device(vendor,device), bm_base(0) { }
+
+	Bits ParseReadRegister(Bit8u regnum) { return regnum; }
+
+	bool OverrideReadRegister(Bit8u regnum, Bit8u* rval, Bit8u* rval_mask) { return false; }
+
+	Bits ParseWriteRegister(Bit8u regnum,Bit8u value) {
+		if ((regnum>=0x10) && (regnum<0x20)) return -1;	// channels are in compatibility mode, base addresses 0-3 are unused
+		if ((regnum>=0x24) && (regnum<0x28)) return -1;
+		switch (regnum) {
+			case 0x20: // bus master base address, 16 bytes of I/O space
+				MapBusMaster((Bit16u)((bm_base & 0xFF00) | (value & 0xF0)));
+				return (value & 0xF0) | 0x01;
+			case 0x21:
+				MapBusMaster((Bit16u)((value << 8) | (bm_base & 0xF0)));
+				return value;
+			case 0x22: case 0x23:
+				return 0x00;
+		}
+		return value;
+	}
+
+	bool InitializeRegisters(Bit8u registers[256]) {
+		registers[0x08] = 0x00;	// revision ID
+		registers[0x09] = 0x80;	// interface (bus master capable, both channels in compatibility mode)
+		registers[0x0a] = 0x01;	// subclass type (IDE controller)
+		registers[0x0b] = 0x01;	// class type (mass storage controller)
+		registers[0x0e] = 0x00;	// header type (other)
+
+		registers[0x04] = 0x05;	// command register (I/O space enabled, bus master enabled)
+		registers[0x06] = 0x80;	// status register (fast back-to-back, medium timing)
+		registers[0x07] = 0x02;
+
+		registers[0x20] = (Bit8u)(default_bm_base & 0xF0) | 0x01; // base address 4 (bus master registers in I/O space)
+		registers[0x21] = (Bit8u)(default_bm_base >> 8);
+		registers[0x41] = 0x80;	// IDE timing, primary channel decode enabled
+		registers[0x43] = 0x80;	// IDE timing, secondary channel decode enabled
+
+		MapBusMaster(default_bm_base);
+		return true;
+	}
+
+	void MapBusMaster(Bit16u base) {
+		ReadHandler.Uninstall();
+		WriteHandler.Uninstall();
+		bm_base = base;
+		if (!base) return;
+		ReadHandler.Install(base,ide_busmaster_r,IO_MB,16);
+		WriteHandler.Install(base,ide_busmaster_w,IO_MB,16);
+	}
+} ide_pci_device;
+
+static Bitu ide_busmaster_r(Bitu port,Bitu iolen) {
+	IDEController *ide = idecontroller[((port - ide_pci_device.bm_base) >> 3) & 1];
+	if (ide == NULL) return 0xFF;
+	switch (port & 7) {
+		case 0: return ide->bm_command;
+		case 2: return ide->bm_status;
+		case 4: case 5: case 6: case 7: return (ide->bm_prd >> ((port & 3) * 8)) & 0xFF;
+	}
+	return 0xFF;
+}
+
+static void ide_busmaster_w(Bitu port,Bitu val,Bitu iolen) {
+	IDEController *ide = idecontroller[((port - ide_pci_device.bm_base) >> 3) & 1];
+	if (ide == NULL) return;
+	switch (port & 7) {
+		case 0: /* command */
+			if ((val & 1) && !(ide->bm_command & 1)) {
+				/* start from the beginning of the PRD table */
+				ide->bm_status |= 1;
+				ide->bm_prd_next = ide->bm_prd;
+				ide->bm_left = 0;
+				ide->bm_eot = false;
+				ide->bm_command = (uint8_t)(val & 0x09);
+				ide->bm_run();
+			}
+			else {
+				if (!(val & 1)) ide->bm_status &= ~1; /* stopping aborts a transfer that is still going */
+				ide->bm_command = (uint8_t)(val & 0x09);
+			}
+			break;
+		case 2: /* status, error and interrupt bits are cleared by writing 1 */
+			ide->bm_status = (uint8_t)((ide->bm_status & 0x01) | (ide->bm_status & ~val & 0x06) | (val & 0x60));
+			break;
+		case 4: case 5: case 6: case 7: {
+			const unsigned shift = (unsigned)(port & 3) * 8;
+			ide->bm_prd = ((ide->bm_prd & ~(0xFFu << shift)) | ((Bit32u)(val & 0xFF) << shift)) & ~3u;
+			break; }
+	}
+}
+#endif
+
 void IDE_RefreshCDROMs()
 {
 	if (!idecontroller[0]) return; // IDE_SetupControllers not yet called
@@ -2981,6 +3188,17 @@ void IDE_SetupControllers(bool alwaysHaveCDROM)
 	for (Bit8u i = 0; i != MAX_IDE_CONTROLLERS; i++)
 		idecontroller[i] = new IDEController(i);
 
+	ide_busmaster_active = false;
+	#ifdef PCI_FUNCTIONALITY_ENABLED
+	// When enabled, machines with a PCI bus get the bus master function so drivers can use DMA instead of PIO
+	if (dbp_ide_busmaster && PCI_IsPresent())
+	{
+		void PCI_AddDevice(PCI_Device* dev);
+		PCI_AddDevice(&ide_pci_device);
+		ide_busmaster_active = true;
+	}
+	#endif
+
 	DBP_STATIC_ASSERT(MAX_HDD_IMAGES == MAX_IDE_CONTROLLERS*2);
 	for (Bit8u i = 0; i != MAX_IDE_CONTROLLERS*2; i++)
 	{
@@ -2991,6 +3209,7 @@ void IDE_SetupControllers(bool alwaysHaveCDROM)
 		#endif
 		if (!imageDiskList[i+2] && numCDROMDevices && numCDROMDevices--)
 			c->device[i&1] = new IDEATAPICDROMDevice(c, i);
+		if (c->device[i&1] && ide_busmaster_active) c->bm_status |= ((i&1) ? 0x40 : 0x20); /* drive DMA capable, like the BIOS would set up */
 	}
 
 	IDE_RefreshCDROMs();
@@ -2998,6 +3217,9 @@ void IDE_SetupControllers(bool alwaysHaveCDROM)
 
 void IDE_ShutdownControllers(void)
 {
+	#ifdef PCI_FUNCTIONALITY_ENABLED
+	ide_pci_device.MapBusMaster(0);
+	#endif
 	for (IDEController*& c : idecontroller)
 		if (c) { delete c; c = NULL; }
 }
@@ -3023,6 +3245,8 @@ void DBPSerialize_IDE(DBPArchive& ar_outer)
 			<< (uint8_t&)d->loading_mode << d->TransferSectorType << d->TransferReadCD9 << d->atapi_to_host << d->has_changed;
 		ar.SerializeArray(d->sense).SerializeArray(d->atapi_cmd) << d->atapi_cmd_i << d->atapi_cmd_total;
 		ar.SerializeSparse(d->sector, sizeof(d->sector));
+		if (ar.version >= 9)
+			ar << d->dma << c->bm_command << c->bm_status << c->bm_eot << c->bm_prd << c->bm_prd_next << c->bm_addr << c->bm_left;
 	}
 }
 
@@ -3064,6 +3288,19 @@ struct IDEATADevice : public IDEDevice {
 		return imageDiskList[bios_disk_index];
 	}
 
+	float io_delay(float default_ms, bool write) {
+		//DBP: Count the transfer at the current address and return the busy time for the selected disk timing mode
+		uint32_t sectorn, n = ((count & 0xFF) ? (count & 0xFF) : 256);
+		if (command == 0xC4 || command == 0xC5) { if (n > multiple_sector_count) n = (uint32_t)multiple_sector_count; }
+		else n = 1;
+		if (drivehead_is_lba(drivehead))
+			sectorn = (((drivehead & 0xFu) << 24u) | lba[0] | ((unsigned int)lba[1] << 8u) | ((unsigned int)lba[2] << 16u));
+		else
+			sectorn = (uint32_t)(((drivehead & 0xFu) * sects) + ((lba[1] | ((unsigned int)lba[2] << 8u)) * sects * heads) + (lba[0] - 1u));
+		double ms = DBP_IOTiming_Access(DBP_IOSTATS_BIOS + bios_disk_index, DBP_IODEV_HARDDISK, (Bit64u)sectorn * 512, n * 512, write);
+		return (dbp_iotiming == DBP_IOTIMING_TURBO ? 0.00001f : dbp_iotiming == DBP_IOTIMING_ACCURATE ? (float)ms + 0.00001f : default_ms);
+	}
+
 	virtual void writecommand(uint8_t cmd) {
 		if (!command_interruption_ok(cmd))
 			return;
@@ -3111,7 +3348,7 @@ struct IDEATADevice : public IDEDevice {
 				state = IDE_DEV_BUSY;
 				status = IDE_STATUS_BUSY;
 				PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-				PIC_AddEvent(IDE_DelayedCommand,(0.1f)/*ms*/,device_index);
+				PIC_AddEvent(IDE_DelayedCommand,io_delay(0.1f, false),device_index);
 				break;
 			case 0x30: /* WRITE SECTOR */
 				/* the drive does NOT signal an interrupt. it sets DRQ and waits for a sector
@@ -3166,7 +3403,7 @@ struct IDEATADevice : public IDEDevice {
 				state = IDE_DEV_BUSY;
 				status = IDE_STATUS_BUSY;
 				PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-				PIC_AddEvent(IDE_DelayedCommand,(0.1f)/*ms*/,device_index);
+				PIC_AddEvent(IDE_DelayedCommand,io_delay(0.1f, false),device_index);
 				break;
 			case 0xC5: /* WRITE MULTIPLE */
 				/* the drive does NOT signal an interrupt. it sets DRQ and waits for a sector
@@ -3315,6 +3552,16 @@ struct IDEATADevice : public IDEDevice {
 			io_completion();
 	}
 
+	virtual uint32_t dma_block(PhysPt addr,uint32_t len) {
+		/* the ATA commands here are all PIO (dma never gets set), this only completes the device interface */
+		uint32_t n = (uint32_t)IDEMIN((Bitu)len,sector_total - sector_i);
+		IDE_PhysBlockCopy(addr,sector+sector_i,n,state == IDE_DEV_DATA_READ);
+		sector_i += n;
+		if (sector_i >= sector_total)
+			io_completion();
+		return n;
+	}
+
 	void update_from_biosdisk() {
 		imageDisk *dsk = getBIOSdisk();
 		if (dsk == NULL) {
@@ -3512,14 +3759,14 @@ struct IDEATADevice : public IDEDevice {
 				state = IDE_DEV_BUSY;
 				status = IDE_STATUS_BUSY;
 				PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-				PIC_AddEvent(IDE_DelayedCommand,0.00001f/*ms*/,device_index);
+				PIC_AddEvent(IDE_DelayedCommand,io_delay(0.00001f, false),device_index);
 				break;
 			case 0x30:/* WRITE SECTOR */
 				/* this is where the drive has accepted the sector, lowers DRQ, and begins executing the command */
 				state = IDE_DEV_BUSY;
 				status = IDE_STATUS_BUSY;
 				PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-				PIC_AddEvent(IDE_DelayedCommand,((progress_count == 0) ? 0.1f : 0.00001f)/*ms*/,device_index);
+				PIC_AddEvent(IDE_DelayedCommand,io_delay((progress_count == 0) ? 0.1f : 0.00001f, true),device_index);
 				break;
 			case 0xC4:/* READ MULTIPLE */
 				/* OK, decrement count, increment address */
@@ -3548,14 +3795,14 @@ struct IDEATADevice : public IDEDevice {
 				state = IDE_DEV_BUSY;
 				status = IDE_STATUS_BUSY;
 				PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-				PIC_AddEvent(IDE_DelayedCommand,0.00001f/*ms*/,device_index);
+				PIC_AddEvent(IDE_DelayedCommand,io_delay(0.00001f, false),device_index);
 				break;
 			case 0xC5:/* WRITE MULTIPLE */
 				/* this is where the drive has accepted the sector, lowers DRQ, and begins executing the command */
 				state = IDE_DEV_BUSY;
 				status = IDE_STATUS_BUSY;
 				PIC_RemoveSpecificEvents(IDE_DelayedCommand,device_index);
-				PIC_AddEvent(IDE_DelayedCommand,((progress_count == 0) ? 0.1f : 0.00001f)/*ms*/,device_index);
+				PIC_AddEvent(IDE_DelayedCommand,io_delay((progress_count == 0) ? 0.1f : 0.00001f, true),device_index);
 				break;
 			default: /* most commands: signal drive ready, return to ready state */
 				/* NTS: Some MS-DOS CD-ROM drivers will loop endlessly if we never set "drive seek complete"
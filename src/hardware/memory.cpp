@@ -237,6 +237,17 @@ void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size) {
 }
 #endif
 
+//DBP: Return a host pointer if all pages of the range are mapped directly to contiguous RAM (not the case for device memory, write protected or
+//     code pages and pages not yet present in the TLB) so callers can skip the intermediate copy that MEM_BlockRead/MEM_BlockWrite need
+HostPt MEM_GetBlockHostPt(PhysPt pt,Bitu size,bool write) {
+	const PhysPt end = pt + (PhysPt)(size - 1);
+	HostPt tlb_addr = (write ? get_tlb_write(pt) : get_tlb_read(pt));
+	if (!size || end < pt || !tlb_addr) return NULL;
+	for (PhysPt page = (pt & ~0xfff) + 0x1000; page && page <= end; page += 0x1000)
+		if ((write ? get_tlb_write(page) : get_tlb_read(page)) != tlb_addr) return NULL;
+	return tlb_addr + pt;
+}
+
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size) {
 	mem_memcpy(dest,src,size);
 }
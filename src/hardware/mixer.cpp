@@ -88,7 +88,8 @@ static Mutex DBP_AudioMutex;
 #endif
 
 #ifdef C_DBP_LIBRETRO
-bool dbp_swapstereo;
+bool dbp_swapstereo, dbp_mixer_perf;
+extern Bit64u DBP_GetTicksUs();
 float dbp_volume_sb = 1, dbp_volume_midi = 1, dbp_volume_adlib = 1, dbp_volume_speaker = 1, dbp_volume_cdrom = 1, dbp_volume_other = 1;
 #endif
 
@@ -114,6 +115,12 @@ static struct {
 	bool nosound;
 	Bit32u freq;
 	Bit32u blocksize;
+	//DBP: Added buffer statistics and config values for adaptive buffering
+	Bit32u underruns, overruns;
+	Bitu cfg_min_needed;
+	Bit32u cfg_blocksize;
+	//DBP: Added number of samples mixed since the last performance statistics report
+	Bit32u perf_frames;
 } mixer;
 
 Bit8u MixTemp[MIXER_BUFSIZE];
@@ -127,6 +134,8 @@ MixerChannel * MIXER_AddChannel(MIXER_Handler handler,Bitu freq,const char * nam
 	chan->SetVolume(1,1);
 	chan->enabled=false;
 	chan->ever_enabled=false; //DBP: added for serialization
+	chan->perf_time=0; //DBP: added for performance statistics
+	chan->perf_external=false;
 	chan->interpolate = false;
 	chan->SetFreq(freq); //Sets interpolate as well.
 	chan->last_samples_were_silence = true;
@@ -222,6 +231,9 @@ void MixerChannel::SetFreq(Bitu freq) {
 
 void MixerChannel::Mix(Bitu _needed) {
 	needed=_needed;
+	#ifdef C_DBP_LIBRETRO
+	Bit64u perf_start = ((dbp_mixer_perf && !perf_external && enabled && needed>done) ? DBP_GetTicksUs() : 0);
+	#endif
 	while (enabled && needed>done) {
 		Bitu left = (needed - done);
 		left *= freq_add;
@@ -230,6 +242,9 @@ void MixerChannel::Mix(Bitu _needed) {
 		if (left > (MIXER_BUFSIZE/4)) left = (MIXER_BUFSIZE/4);
 		handler(left);
 	}
+	#ifdef C_DBP_LIBRETRO
+	if (perf_start) perf_time += (Bit32u)(DBP_GetTicksUs() - perf_start);
+	#endif
 }
 
 void MixerChannel::AddSilence(void) {
@@ -537,6 +552,9 @@ static Bit32u calc_tickadd(Bit32u freq) {
 
 /* Mix a certain amount of new samples */
 static void MIXER_MixData(Bitu needed) {
+	#ifdef C_DBP_LIBRETRO
+	if (needed > mixer.done) mixer.perf_frames += (Bit32u)(needed - mixer.done);
+	#endif
 	MixerChannel * chan=mixer.channels;
 	while (chan) {
 		chan->Mix(needed);
@@ -616,6 +634,7 @@ MIXER_CallBack(void * /*userdata*/, uint8_t *stream, int len) {
 	Callback_LockAudio();
 	if (mixer.done < need) {
 //		LOG_MSG("Full underrun need %d, have %d, min %d", need, mixer.done, mixer.min_needed);
+		mixer.underruns++;
 		if((need - mixer.done) > (need >>7) ) //Max 1 percent stretch.
 			{ Callback_UnlockAudio(); return; }
 		reduce = mixer.done;
@@ -659,6 +678,7 @@ MIXER_CallBack(void * /*userdata*/, uint8_t *stream, int len) {
 	} else {
 		/* There is way too much data in the buffer */
 //		LOG_MSG("overflow run need %d, have %d, min %d", need, mixer.done, mixer.min_needed);
+		mixer.overruns++;
 		if (mixer.done > MIXER_BUFSIZE)
 			index_add = MIXER_BUFSIZE - 2*mixer.min_needed;
 		else
@@ -870,6 +890,9 @@ void MIXER_Init(Section* sec) {
 	mixer.min_needed = (mixer.freq*mixer.min_needed)/1000;
 	mixer.max_needed = mixer.blocksize * 2 + 2*mixer.min_needed;
 	mixer.needed = mixer.min_needed+1;
+	mixer.cfg_min_needed = mixer.min_needed;
+	mixer.cfg_blocksize = mixer.blocksize;
+	mixer.underruns = mixer.overruns = 0;
 	PROGRAMS_MakeFile("MIXER.COM",MIXER_ProgramStart);
 }
 
@@ -891,6 +914,40 @@ void DBP_MIXER_ScrapAudio()
 		MIXER_CallBack(0, dummy, (mixer.done > 164 ? 64 : mixer.done - 100) * MIXER_SSIZE);
 }
 
+void DBP_MIXER_SetBuffering(Bit32u prebuffer_samples, Bit32u blocksize)
+{
+	// Passing 0 for blocksize restores the values from the configuration
+	Callback_LockAudio();
+	mixer.min_needed = (blocksize ? prebuffer_samples : mixer.cfg_min_needed);
+	mixer.blocksize = (blocksize ? blocksize : mixer.cfg_blocksize);
+	mixer.max_needed = mixer.blocksize * 2 + 2*mixer.min_needed;
+	Callback_UnlockAudio();
+}
+
+void DBP_MIXER_GetBufferStats(Bit32u& underruns, Bit32u& overruns, bool reset)
+{
+	Callback_LockAudio();
+	underruns = mixer.underruns;
+	overruns = mixer.overruns;
+	if (reset) mixer.underruns = mixer.overruns = 0;
+	Callback_UnlockAudio();
+}
+
+void DBP_MIXER_GetPerfStats(char* buf, size_t bufsize)
+{
+	// Lists the microseconds each channel spent per second of generated audio and resets the counters
+	char *p = buf, *pEnd = buf + bufsize;
+	*p = '\0';
+	float secs = (float)mixer.perf_frames / (mixer.freq ? mixer.freq : 1);
+	for (MixerChannel* chan = mixer.channels; chan; chan = chan->next)
+	{
+		if (chan->perf_time && secs > 0 && p < pEnd)
+			p += snprintf(p, pEnd - p, "%s%s: %uus", (p == buf ? "" : ", "), chan->name, (unsigned)(chan->perf_time / secs));
+		chan->perf_time = 0;
+	}
+	mixer.perf_frames = 0;
+}
+
 void DBP_MIXER_ApplyVolumes()
 {
 	for (MixerChannel* chan = mixer.channels; chan; chan = chan->next) chan->UpdateVolume();
@@ -446,6 +446,11 @@ bool PCI_IsInitialized() {
 	return false;
 }
 
+//DBP: Devices that are only added when the machine has a PCI bus check this instead of being queued for later
+bool PCI_IsPresent() {
+	return (pci_interface != NULL);
+}
+
 
 void PCI_ShutDown(Section* sec){
 	delete pci_interface;
@@ -649,6 +649,7 @@ void DBPSerialize_PIC(DBPArchive& ar)
 	DBP_SERIALIZE_EXTERN_POINTER_LIST(PIC_EventHandler, Voodoo);
 	DBP_SERIALIZE_EXTERN_POINTER_LIST(PIC_EventHandler, zipDrive); // not stored
 	DBP_SERIALIZE_EXTERN_POINTER_LIST(PIC_EventHandler, network); // not stored (for now)
+	DBP_SERIALIZE_EXTERN_POINTER_LIST(PIC_EventHandler, diskWriteBack); // not stored
 
 	float pic_indices[PIC_QUEUESIZE];
 	Bitu pic_values[PIC_QUEUESIZE];
@@ -662,9 +663,10 @@ void DBPSerialize_PIC(DBPArchive& ar)
 	{
 		for (PICEntry* it = pic_queue.next_entry; it; it = it->next)
 		{
-			// skip storing state irrelevant union and zip drive events which keep a pointer in the value
+			// skip storing state irrelevant union, zip and disk write-back events which keep a pointer in the value
 			if (it->pic_event == DBPSerializePIC_EventHandlerunionDrivePtrs[0]) continue;
 			if (it->pic_event == DBPSerializePIC_EventHandlerzipDrivePtrs[0]) continue;
+			if (it->pic_event == DBPSerializePIC_EventHandlerdiskWriteBackPtrs[0]) continue;
 			// skip storing network events because network hardware state is not serialized
 			if (it->pic_event == DBPSerializePIC_EventHandlernetworkPtrs[0]) continue;
 			if (it->pic_event == DBPSerializePIC_EventHandlernetworkPtrs[1]) continue;
@@ -716,6 +718,9 @@ void DBPSerialize_PIC(DBPArchive& ar)
 		pic_queue.free_entry = (pic_count != PIC_QUEUESIZE ? &pic_queue.entries[pic_count] : NULL);
 		pic_queue.next_entry = (pic_count ? &pic_queue.entries[0] : NULL);
 		if (pic_count) pic_queue.entries[pic_count-1].next = NULL;
+
+		// disk write-back events are not stored, add them again for pending writes
+		void DBPSerialize_PIC_RearmDiskWriteBack(); DBPSerialize_PIC_RearmDiskWriteBack();
 	}
 }
 
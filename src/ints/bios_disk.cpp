@@ -27,6 +27,7 @@
 #include "dos_inc.h" /* for Drives[] */
 #include "../dos/drives.h"
 #include "mapper.h"
+#include "pic.h"
 
 //DBP: for mem_readb_inline and mem_writeb_inline
 #include "paging.h"
@@ -34,6 +35,8 @@
 #ifdef C_DBP_SUPPORT_DISK_MOUNT_DOSFILE
 #include <time.h>
 #include <stdlib.h>
+#include <algorithm>
+#include "dbp_threads.h"
 
 struct discardDisk
 {
@@ -65,6 +68,262 @@ struct discardDisk
 	}
 };
 
+// Collects writes to an image or save file in memory and writes them out later
+// Host files are written from a background thread, DOS files only on the emulation thread (from the timer event or when too many pages are pending)
+// Modified pages are kept in a journal and written in the order the guest wrote them, consecutive writes to the same page
+// are merged into one entry and journal entries that continue each other in the file are merged into large sequential writes
+struct diskWriteBack;
+static std::vector<diskWriteBack*> diskWriteBacks; // all existing objects to add the timer events again after loading a save state
+
+struct diskWriteBack
+{
+	enum wbDefs : Bit32u
+	{
+		PAGESIZE    = 512,
+		SUBMITPAGES = 2048,        // hand pending pages to the writer thread when this many have been modified (1 MB)
+		MAXPAGES    = 32768,       // block until the writer thread is done when this many are pending (16 MB)
+		MAXRUN      = 1024 * 1024, // largest single write
+	};
+
+	struct Page { Bit32u pagenum, prev; Bit64u mask[PAGESIZE / 64]; Bit8u data[PAGESIZE]; }; // prev is index + 1 of an earlier entry of the same page
+	struct Journal { std::vector<Page> pages; ValueHashMap<Bit32u> map; }; // pages in order of modification, map from pagenum + 1 to index of the latest entry
+
+	FILE* file;
+	DOS_File* dos_file;
+	Journal journals[2], *pending = &journals[0], *inflight = &journals[1];
+	std::vector<Bit8u> runbuf;
+	Bit64u runofs = 0;
+	Mutex mutex;
+	Semaphore wake, done, exited;
+	bool threaded = false, busy = false, idle = false, waiting = false, quit = false, have_pic = false;
+
+	diskWriteBack(FILE* f, DOS_File* df) : file(f), dos_file(df) { diskWriteBacks.push_back(this); }
+
+	~diskWriteBack()
+	{
+		diskWriteBacks.erase(std::find(diskWriteBacks.begin(), diskWriteBacks.end(), this));
+		if (have_pic) PIC_RemoveSpecificEvents(PICHandler, (Bitu)this);
+		if (!threaded) { WriteJournal(*pending); return; }
+		Submit(true);
+		mutex.Lock();
+		while (busy) { waiting = true; mutex.Unlock(); done.Wait(); mutex.Lock(); }
+		quit = true;
+		if (idle) { idle = false; wake.Post(); }
+		mutex.Unlock();
+		exited.Wait();
+	}
+
+	void Write(Bit64u ofs, const void* data, Bit32u len)
+	{
+		const bool was_empty = pending->pages.empty();
+		for (const Bit8u* p = (const Bit8u*)data; len;)
+		{
+			const Bit32u pageofs = (Bit32u)(ofs % PAGESIZE), n = (len < PAGESIZE - pageofs ? len : PAGESIZE - pageofs);
+			DBP_ASSERT(ofs / PAGESIZE < 0xFFFFFFFF);
+			Page& pg = GetPage(*pending, (Bit32u)(ofs / PAGESIZE));
+			memcpy(pg.data + pageofs, p, n);
+			for (Bit32u i = pageofs, iEnd = pageofs + n, cnt; i != iEnd; i += cnt)
+			{
+				cnt = (iEnd - i < 64 - (i % 64) ? iEnd - i : 64 - (i % 64));
+				pg.mask[i / 64] |= (cnt == 64 ? ~(Bit64u)0 : (((Bit64u)1 << cnt) - 1) << (i % 64));
+			}
+			p += n; ofs += n; len -= n;
+		}
+		if (pending->pages.size() >= SUBMITPAGES)
+			Submit(pending->pages.size() >= MAXPAGES);
+		if (!pending->pages.empty() && (!have_pic || was_empty))
+		{
+			// make sure modifications reach the file shortly after writing stops
+			if (have_pic) PIC_RemoveSpecificEvents(PICHandler, (Bitu)this);
+			have_pic = true;
+			PIC_AddEvent(PICHandler, 100.0f, (Bitu)this);
+		}
+	}
+
+	void Read(Bit64u ofs, void* data, Bit32u len)
+	{
+		mutex.Lock();
+		Bit32u got = 0;
+		if (file)
+		{
+			fseek_wrap(file, ofs, SEEK_SET);
+			got = (Bit32u)fread(data, 1, len, file);
+		}
+		else
+		{
+			dos_file->Seek64(&ofs, DOS_SEEK_SET);
+			for (Bit16u n; got != len; got += n)
+				if (!dos_file->Read((Bit8u*)data + got, &(n = (Bit16u)(len - got > 0xFFFF ? 0xFFFF : len - got))) || !n) break;
+		}
+		if (got != len) memset((Bit8u*)data + got, 0, len - got); // can be past the end of the file while pages are pending
+		if (busy) Overlay(*inflight, ofs, (Bit8u*)data, len);
+		mutex.Unlock();
+		Overlay(*pending, ofs, (Bit8u*)data, len);
+	}
+
+	// Hand the pending pages over to the writer thread, optionally waiting for a previous batch to finish first
+	void Submit(bool wait)
+	{
+		if (pending->pages.empty()) return;
+		if (!threaded)
+		{
+			// DOS files (i.e. on a union drive) can't be accessed from another thread
+			extern unsigned dbp_cpu_features_get_core_amount(void);
+			if (!file || dbp_cpu_features_get_core_amount() <= 1) { WriteJournal(*pending); ClearJournal(*pending); if (have_pic) { PIC_RemoveSpecificEvents(PICHandler, (Bitu)this); have_pic = false; } return; }
+			threaded = true;
+			Thread::StartDetached(ThreadFunc, this);
+		}
+		mutex.Lock();
+		if (busy && !wait) { mutex.Unlock(); return; } // try again on the next write or timer event
+		while (busy) { waiting = true; mutex.Unlock(); done.Wait(); mutex.Lock(); }
+		std::swap(pending, inflight);
+		busy = true;
+		if (idle) { idle = false; wake.Post(); }
+		mutex.Unlock();
+		if (have_pic) { PIC_RemoveSpecificEvents(PICHandler, (Bitu)this); have_pic = false; }
+	}
+
+	static void PICHandler(Bitu p)
+	{
+		diskWriteBack& wb = *(diskWriteBack*)p;
+		wb.have_pic = false;
+		wb.Submit(false);
+		if (!wb.pending->pages.empty()) { wb.have_pic = true; PIC_AddEvent(PICHandler, 100.0f, p); }
+	}
+
+	// The timer event is not stored in save states so it needs to be added again after loading
+	static void RearmAll()
+	{
+		for (diskWriteBack* wb : diskWriteBacks)
+		{
+			wb->have_pic = !wb->pending->pages.empty();
+			if (wb->have_pic) PIC_AddEvent(PICHandler, 100.0f, (Bitu)wb);
+		}
+	}
+
+	static Thread::RET_t THREAD_CC ThreadFunc(void* p)
+	{
+		diskWriteBack& wb = *(diskWriteBack*)p;
+		wb.mutex.Lock();
+		for (;;)
+		{
+			if (!wb.busy)
+			{
+				if (wb.quit) break;
+				wb.idle = true;
+				wb.mutex.Unlock();
+				wb.wake.Wait();
+				wb.mutex.Lock();
+				continue;
+			}
+			Journal& j = *wb.inflight;
+			wb.mutex.Unlock();
+			wb.WriteJournal(j);
+			wb.mutex.Lock();
+			ClearJournal(j);
+			wb.busy = false;
+			if (wb.waiting) { wb.waiting = false; wb.done.Post(); }
+		}
+		wb.mutex.Unlock();
+		wb.exited.Post();
+		return 0;
+	}
+
+private:
+	static Page& GetPage(Journal& j, Bit32u pagenum)
+	{
+		// Only a rewrite of the most recently modified page can be merged without changing the order of writes
+		Bit32u* idx = j.map.Get(pagenum + 1);
+		if (idx && *idx == j.pages.size() - 1) return j.pages[*idx];
+		const Bit32u prev = (idx ? *idx + 1 : 0);
+		j.map.Put(pagenum + 1, (Bit32u)j.pages.size());
+		j.pages.emplace_back();
+		Page& pg = j.pages.back();
+		pg.pagenum = pagenum;
+		pg.prev = prev;
+		memset(pg.mask, 0, sizeof(pg.mask));
+		return pg;
+	}
+
+	static void ClearJournal(Journal& j)
+	{
+		j.pages.clear();
+		j.map.Clear();
+	}
+
+	static void Overlay(const Journal& j, Bit64u ofs, Bit8u* data, Bit32u len)
+	{
+		if (j.pages.empty()) return;
+		for (Bit64u pagenum = ofs / PAGESIZE, pageEnd = (ofs + len + PAGESIZE - 1) / PAGESIZE; pagenum != pageEnd; pagenum++)
+		{
+			const Bit32u* idx = j.map.Get((Bit32u)pagenum + 1);
+			if (!idx) continue;
+			const Bit64u pageStart = pagenum * PAGESIZE;
+			const Bit32u iStart = (ofs > pageStart ? (Bit32u)(ofs - pageStart) : 0), iEnd = (ofs + len < pageStart + PAGESIZE ? (Bit32u)(ofs + len - pageStart) : PAGESIZE);
+			const Page* pg = &j.pages[*idx];
+			if (!iStart && iEnd == PAGESIZE && (pg->mask[0] & pg->mask[1] & pg->mask[2] & pg->mask[3] & pg->mask[4] & pg->mask[5] & pg->mask[6] & pg->mask[7]) == ~(Bit64u)0)
+				{ memcpy(data + (pageStart - ofs), pg->data, PAGESIZE); continue; }
+
+			// Go from the latest to the earliest entry of the page, bytes already taken from a later entry are skipped
+			Bit64u taken[PAGESIZE / 64] = { 0 };
+			for (;; pg = &j.pages[pg->prev - 1])
+			{
+				for (Bit32u i = iStart; i != iEnd; i++)
+					if ((pg->mask[i / 64] & ~taken[i / 64]) & ((Bit64u)1 << (i % 64)))
+						data[pageStart + i - ofs] = pg->data[i];
+				if (!pg->prev) break;
+				for (Bit32u m = 0; m != PAGESIZE / 64; m++) taken[m] |= pg->mask[m];
+			}
+		}
+	}
+
+	// Called either on the writer thread or, if there is none, directly on the emulation thread
+	void WriteJournal(const Journal& j)
+	{
+		for (const Page& pg : j.pages)
+		{
+			for (Bit32u i = 0, iEnd; i != PAGESIZE; i = iEnd)
+			{
+				// find the next span of modified bytes in the page
+				while (i != PAGESIZE && !(pg.mask[i / 64] & ((Bit64u)1 << (i % 64)))) i += ((i % 64) || pg.mask[i / 64] ? 1 : 64);
+				if (i == PAGESIZE) break;
+				for (iEnd = i + 1; iEnd != PAGESIZE && (pg.mask[iEnd / 64] & ((Bit64u)1 << (iEnd % 64))); iEnd++) {}
+
+				const Bit64u ofs = (Bit64u)pg.pagenum * PAGESIZE + i;
+				if (runbuf.size() && (ofs != runofs + runbuf.size() || runbuf.size() + (iEnd - i) > MAXRUN)) FlushRun();
+				if (runbuf.empty()) runofs = ofs;
+				runbuf.insert(runbuf.end(), pg.data + i, pg.data + iEnd);
+			}
+		}
+		FlushRun();
+		if (file) { mutex.Lock(); fflush(file); mutex.Unlock(); }
+	}
+
+	void FlushRun()
+	{
+		if (runbuf.empty()) return;
+		mutex.Lock();
+		if (file)
+		{
+			fseek_wrap(file, runofs, SEEK_SET);
+			fwrite(&runbuf[0], runbuf.size(), 1, file);
+		}
+		else
+		{
+			Bit64u ofs = runofs;
+			dos_file->Seek64(&ofs, DOS_SEEK_SET);
+			for (Bit32u written = 0, total = (Bit32u)runbuf.size(); written != total;)
+			{
+				Bit16u n = (Bit16u)(total - written > 0xFFFF ? 0xFFFF : total - written);
+				if (!dos_file->Write(&runbuf[written], &n) || !n) { DBP_ASSERT(false); break; }
+				written += n;
+			}
+		}
+		mutex.Unlock();
+		runbuf.clear();
+	}
+};
+
 struct differencingDisk
 {
 	enum ddDefs : Bit32u
@@ -80,10 +339,13 @@ struct differencingDisk
 	std::vector<Bit32u>   diffFreeCursors;
 	std::string           savePath;
 	FILE*                 saveFile = NULL;
+	diskWriteBack*        saveWriteBack = NULL;
 	Bit32u                saveEndCursor = 0;
 
 	~differencingDisk()
 	{
+		if (saveWriteBack)
+			delete saveWriteBack;
 		if (saveFile)
 			fclose(saveFile);
 	}
@@ -110,6 +372,7 @@ struct differencingDisk
 				else diffFreeCursors.push_back(cursor);
 			}
 			saveEndCursor = cursor;
+			saveWriteBack = new diskWriteBack(saveFile, NULL);
 		}
 		else if (0)
 		{
@@ -143,7 +406,7 @@ struct differencingDisk
 			if (!saveFile && !savePath.empty())
 			{
 				saveFile = fopen(savePath.c_str(), "wb+");
-				if (saveFile) { fwrite("FFDD\x1", 5, 1, saveFile); saveEndCursor = 5; };
+				if (saveFile) { fwrite("FFDD\x1", 5, 1, saveFile); saveEndCursor = 5; saveWriteBack = new diskWriteBack(saveFile, NULL); };
 				savePath.clear();
 			}
 			const bool reuseFree = (cursor_val == NULL_CURSOR && diffFreeCursors.size());
@@ -161,14 +424,11 @@ struct differencingDisk
 					writeSectNum:
 					Bit32u sectnumval;
 					var_write(&sectnumval, sectnum);
-					fseek_wrap(saveFile, cursor_val, SEEK_SET);
-					fwrite(&sectnumval, sizeof(sectnumval), 1, saveFile);
+					saveWriteBack->Write(cursor_val, &sectnumval, sizeof(sectnumval));
 				}
 				else if (reuseFree)
 					goto writeSectNum;
-				else
-					fseek_wrap(saveFile, cursor_val + sizeof(sectnum), SEEK_SET);
-				fwrite(data, BYTESPERSECTOR, 1, saveFile);
+				saveWriteBack->Write(cursor_val + sizeof(sectnum), data, BYTESPERSECTOR);
 			}
 			else
 			{
@@ -187,8 +447,7 @@ struct differencingDisk
 			{
 				// mark sector in diff file as free
 				Bit32u sectnumval = 0xFFFFFFFF;
-				fseek_wrap(saveFile, cursor_val, SEEK_SET);
-				fwrite(&sectnumval, sizeof(sectnumval), 1, saveFile);
+				saveWriteBack->Write(cursor_val, &sectnumval, sizeof(sectnumval));
 			}
 			diffFreeCursors.push_back(cursor_val);
 			*cursor_ptr = NULL_CURSOR;
@@ -203,14 +462,111 @@ struct differencingDisk
 		if (cursor == NULL_CURSOR) return false;
 		if (saveFile)
 		{
-			fseek_wrap(saveFile, cursor + sizeof(sectnum), SEEK_SET);
-			return !!fread(data, BYTESPERSECTOR, 1, saveFile);
+			saveWriteBack->Read(cursor + sizeof(sectnum), data, BYTESPERSECTOR);
+			return true;
 		}
 		memcpy(data, diffSectorBufs[cursor].data, BYTESPERSECTOR);
 		return true;
 	}
 };
 
+Bit32u dbp_diskcache_mb = 16; // size of the block cache of each mounted disk image, set by the frontend (0 to disable)
+
+struct diskBlockCache
+{
+	enum dbcDefs : Bit32u
+	{
+		BLOCKSECTORS = 32, // sectors per block
+		MAXREADAHEAD = 8,  // blocks
+		NULL_INDEX   = (Bit32u)-1,
+	};
+
+	struct Block { Bit32u blocknum, prev, next; Bit8u* data; };
+	std::vector<Block>  blocks;
+	ValueHashMap<Bit32u> map; // blocknum + 1 to index in blocks (hash map keys 0 and 1 are the same)
+	Bit32u blocksize, maxblocks, head = NULL_INDEX, tail = NULL_INDEX, seqnext = NULL_INDEX, readahead = 1;
+
+	diskBlockCache(Bit32u sector_size, Bit32u maxmb) : blocksize(BLOCKSECTORS * sector_size)
+	{
+		maxblocks = (Bit32u)(((Bit64u)maxmb * 1024 * 1024) / blocksize);
+		if (maxblocks < MAXREADAHEAD) maxblocks = MAXREADAHEAD;
+	}
+
+	~diskBlockCache()
+	{
+		for (Block& b : blocks) free(b.data);
+	}
+
+	void Unlink(Bit32u idx)
+	{
+		Block& b = blocks[idx];
+		if (b.prev != NULL_INDEX) blocks[b.prev].next = b.next; else head = b.next;
+		if (b.next != NULL_INDEX) blocks[b.next].prev = b.prev; else tail = b.prev;
+	}
+
+	void LinkFront(Bit32u idx)
+	{
+		Block& b = blocks[idx];
+		b.prev = NULL_INDEX;
+		b.next = head;
+		if (head != NULL_INDEX) blocks[head].prev = idx; else tail = idx;
+		head = idx;
+	}
+
+	const Bit8u* Get(Bit32u sectnum, Bit32u sector_size)
+	{
+		Bit32u* pidx = map.Get(sectnum / BLOCKSECTORS + 1);
+		if (!pidx) return NULL;
+		if (*pidx != head) { Unlink(*pidx); LinkFront(*pidx); }
+		return blocks[*pidx].data + (sectnum % BLOCKSECTORS) * sector_size;
+	}
+
+	// Returns the buffer to fill for a block, reusing the least recently used one when full
+	Bit8u* Insert(Bit32u blocknum)
+	{
+		Bit32u idx;
+		if (blocks.size() < maxblocks)
+		{
+			idx = (Bit32u)blocks.size();
+			blocks.emplace_back();
+			blocks[idx].data = (Bit8u*)malloc(blocksize);
+		}
+		else
+		{
+			idx = tail;
+			Unlink(idx);
+			map.Remove(blocks[idx].blocknum + 1);
+		}
+		blocks[idx].blocknum = blocknum;
+		map.Put(blocknum + 1, idx);
+		LinkFront(idx);
+		return blocks[idx].data;
+	}
+
+	// Number of blocks to read on a miss, grows while blocks get missed in sequential order
+	Bit32u ReadAhead(Bit32u blocknum)
+	{
+		readahead = (blocknum == seqnext ? (readahead < MAXREADAHEAD ? readahead * 2 : MAXREADAHEAD) : 1);
+		seqnext = blocknum + readahead;
+		return readahead;
+	}
+
+	void Update(Bit32u sectnum, const void* data, Bit32u sector_size)
+	{
+		Bit32u* pidx = map.Get(sectnum / BLOCKSECTORS + 1);
+		if (pidx) memcpy(blocks[*pidx].data + (sectnum % BLOCKSECTORS) * sector_size, data, sector_size);
+	}
+
+	void Clear()
+	{
+		for (Block& b : blocks) free(b.data);
+		blocks.clear();
+		map.Clear();
+		head = tail = seqnext = NULL_INDEX;
+		readahead = 1;
+	}
+};
+
 #ifdef _MSC_VER
 #pragma pack (1)
 #endif
@@ -247,9 +603,10 @@ struct fatFromDOSDrive
 		SECTORSPERTRACK   = 63,
 		SECT_MBR          = 0,
 		SECT_BOOT         = 32,
-		CACHECOUNT        = 256,
-		KEEPOPENCOUNT     = 4,
+		MINCACHECOUNT     = 256,
+		KEEPOPENCOUNT     = 16,
 		FAT32_ROOTCLUSTER = 2,
+		NO_INDEX          = (Bit32u)-1,
 	};
 
 	partTable  mbr;
@@ -258,19 +615,22 @@ struct fatFromDOSDrive
 	Bit32u     sectorsPerCluster;
 	Bit8u      fatSz, readOnly;
 
-	struct ffddFile { char path[DOS_PATHLENGTH+1]; Bit32u firstSect; };
-	std::vector<direntry> root, dirs;
-	std::vector<ffddFile> files;
-	std::vector<Bit32u>   fileAtSector;
-	std::vector<Bit8u>    fat;
-	Bit32u sect_disk_end, sect_files_end, sect_files_start, sect_dirs_start, sect_root_start, sect_fat2_start, sect_fat1_start;
-
-	Bit8u                 cacheSectorData[CACHECOUNT][BYTESPERSECTOR];
-	Bit32u                cacheSectorNumber[CACHECOUNT];
+	// The drive gets scanned once into these compact lists, the directory entries of a directory are generated when it is first accessed
+	struct ffddEntry { Bit32u nameOfs, lfnOfs, size, cluster, dir; Bit16u date, time; Bit8u attr; };
+	struct ffddDir { Bit32u pathOfs, parent, firstEntry, numEntries, numDirEntries, firstCluster, numClusters; std::vector<direntry> generated; };
+	struct ffddFile { Bit32u firstSect, dir, entry; };
+	std::vector<ffddEntry> entries;
+	std::vector<ffddDir>   dirs;  // in order of cluster allocation, starting with the root directory
+	std::vector<ffddFile>  files; // files with data sorted by firstSect
+	std::vector<char>      names;
+	std::vector<Bit8u>     fat;
+	Bit32u sect_disk_end, sect_files_end, sect_files_start, sect_dirs_start, sect_root_start, sect_fat2_start, sect_fat1_start, rootDirEntries = 0;
+
+	std::vector<Bit8u>    cacheSectorData;
+	std::vector<Bit32u>   cacheSectorNumber;
 	differencingDisk      difference;
-	DOS_File*             openFiles[KEEPOPENCOUNT];
+	DOS_File*             openFiles[KEEPOPENCOUNT]; // most recently used first
 	Bit32u                openIndex[KEEPOPENCOUNT];
-	Bit32u                openCursor = 0;
 
 	~fatFromDOSDrive()
 	{
@@ -280,8 +640,10 @@ struct fatFromDOSDrive
 
 	fatFromDOSDrive(DOS_Drive* drv, Bit32u freeSpaceMB = 0, const char* inSavePath = NULL, Bit32u serial = 0, const StringToPointerHashMap<void>* fileFilter = NULL) : drive(drv)
 	{
+		const Bit32u cacheCount = (dbp_diskcache_mb * (1024 * 1024 / BYTESPERSECTOR) > MINCACHECOUNT ? dbp_diskcache_mb * (1024 * 1024 / BYTESPERSECTOR) : MINCACHECOUNT);
+		cacheSectorData.resize(cacheCount * BYTESPERSECTOR);
+		cacheSectorNumber.resize(cacheCount, 0);
 		cacheSectorNumber[0] = 1; // must not state that sector 0 is already cached
-		memset(&cacheSectorNumber[1], 0, sizeof(cacheSectorNumber) - sizeof(cacheSectorNumber[0]));
 		memset(openFiles, 0, sizeof(openFiles));
 
 		struct Iter
@@ -305,40 +667,24 @@ struct fatFromDOSDrive
 					var_write((Bit16u*)&ffdd.fat[idx + idx / 2], (Bit16u)((var_read((Bit16u *)&ffdd.fat[idx + idx / 2]) & 0xF000) | (val & 0xFFF)));
 			}
 
-			static direntry* AddDirEntry(fatFromDOSDrive& ffdd, bool useFAT16Root, size_t& diridx)
+			static Bit32u AddName(fatFromDOSDrive& ffdd, const char* str)
 			{
-				const Bit32u entriesPerCluster = ffdd.sectorsPerCluster * BYTESPERSECTOR / sizeof(direntry);
-				if (!useFAT16Root && (diridx % entriesPerCluster) == 0)
-				{
-					// link fat (was set to 0xFFFF before but now we knew the chain continues)
-					if (diridx) SetFAT(ffdd, 2 + (diridx - 1) / entriesPerCluster, (Bit32u)(2 + ffdd.dirs.size() / entriesPerCluster));
-					diridx = ffdd.dirs.size();
-					ffdd.dirs.resize(diridx + entriesPerCluster);
-					memset(&ffdd.dirs[diridx], 0, sizeof(direntry) * entriesPerCluster);
-					SetFAT(ffdd, 2 + diridx / entriesPerCluster, (Bit32u)0x0FFFFFFF); // set as last cluster in chain for now
-				}
-				else if (useFAT16Root && diridx && (diridx % 512) == 0)
-				{
-					// this actually should never be larger than 512 for some FAT16 drivers
-					ffdd.root.resize(diridx + 512);
-					memset(&ffdd.root[diridx], 0, sizeof(direntry) * 512);
-				}
-				return &(!useFAT16Root ? ffdd.dirs : ffdd.root)[diridx++];
+				const Bit32u ofs = (Bit32u)ffdd.names.size();
+				ffdd.names.insert(ffdd.names.end(), str, str + strlen(str) + 1);
+				return ofs;
 			}
 
-			static void ParseDir(fatFromDOSDrive& ffdd, char* dir, const StringToPointerHashMap<void>* filter, int dirlen = 0, Bit16u parentFirstCluster = 0)
+			// Entries inside filtered directories are not added but like with DriveFileIterator they still count towards the used size
+			static void ParseDir(fatFromDOSDrive& ffdd, char* dir, int dirlen, Bit32u dirIdx, bool sum, Bit64u& usedBytes, const StringToPointerHashMap<void>* filter)
 			{
-				const bool useFAT16Root = (!dirlen && ffdd.fatSz != 32), readOnly = ffdd.readOnly;
-				const size_t firstidx = (!useFAT16Root ? ffdd.dirs.size() : 0);
-				const Bit32u sectorsPerCluster = ffdd.sectorsPerCluster, bytesPerCluster = sectorsPerCluster * BYTESPERSECTOR, entriesPerCluster = bytesPerCluster / sizeof(direntry);
-				const Bit16u myFirstCluster = (dirlen ? (Bit16u)(2 + firstidx / entriesPerCluster) : (Bit16u)0) ;
-
-				char finddir[DOS_PATHLENGTH+4];
+				char finddir[DOS_PATHLENGTH*4];
 				memcpy(finddir, dir, dirlen); // because FindFirst can modify this...
 				finddir[dirlen] = '\0';
 				if (dirlen) dir[dirlen++] = '\\';
 
-				size_t diridx = 0;
+				const Bit32u firstEntry = (Bit32u)ffdd.entries.size();
+				Bit32u numDirEntries = 0;
+				std::vector<std::string> sumOnlyDirs;
 				RealPt save_dta = dos.dta();
 				dos.dta(dos.tables.tempdta);
 				DOS_DTA dta(dos.dta());
@@ -347,167 +693,82 @@ struct fatFromDOSDrive
 				{
 					char dta_name[DOS_NAMELENGTH_ASCII]; Bit32u dta_size; Bit16u dta_date, dta_time; Bit8u dta_attr;
 					dta.GetResult(dta_name, dta_size, dta_date, dta_time, dta_attr);
-					const char *fend = dta_name + strlen(dta_name);
 					const bool dot = (dta_name[0] == '.' && dta_name[1] == '\0'), dotdot = (dta_name[0] == '.' && dta_name[1] == '.' && dta_name[2] == '\0');
 					if (!dirlen && (dot || dotdot)) continue; // root shouldn't have dot entries (yet unpatched localDrive can)
 
-					ffddFile f;
-					memcpy(f.path, dir, dirlen);
-					memcpy(f.path + dirlen, dta_name, fend - dta_name + 1);
-					if (filter && filter->Get(f.path)) continue;
-
-					char longname[256];
-					const bool isLongFileName = (!dot && !dotdot && !(dta_attr & DOS_ATTR_VOLUME) && ffdd.drive->GetLongFileName(f.path, longname));
-					if (isLongFileName)
+					strcpy(dir + dirlen, dta_name);
+					const bool filtered = (filter && filter->Get(dir));
+					if (sum && !dot && !dotdot && !(dta_attr & DOS_ATTR_VOLUME) && !filtered)
+						usedBytes += (dta_size + (32*1024-1)) / (32*1024) * (32*1024); // count as 32 kb clusters
+					if (filtered || dirIdx == NO_INDEX)
 					{
-						size_t lfnlen = strlen(longname);
-						const char *lfn_end = longname + lfnlen;
-						for (size_t i = 0, lfnblocks = (lfnlen + 12) / 13; i != lfnblocks; i++)
-						{
-							lfndirentry* le = (lfndirentry*)AddDirEntry(ffdd, useFAT16Root, diridx);
-							le->ord = (Bit8u)((lfnblocks - i)|(i == 0 ? 0x40 : 0x0));
-							le->attrib = DOS_ATTR_LONG_NAME;
-							le->type = 0;
-							le->loFirstClust = 0;
-							const char* plfn = longname + (lfnblocks - i - 1) * 13;
-							for (int j = 0; j != 13; j++, plfn++)
-							{
-								char* p = le->Name(j);
-								if (plfn > lfn_end) { p[0] = p[1] = (char)0xFF; }
-								else if (plfn == lfn_end) { p[0] = p[1] = 0; }
-								else { p[0] = *plfn; p[1] = 0; }
-							}
-						}
-					}
-
-					const char *fext = (dot || dotdot ? NULL : strrchr(dta_name, '.'));
-					direntry* e = AddDirEntry(ffdd, useFAT16Root, diridx);
-					memset(e->entryname, ' ', sizeof(e->entryname));
-					memcpy(e->entryname, dta_name, (fext ? fext : fend) - dta_name);
-					if (fext++) memcpy(e->entryname + 8, fext, fend - fext);
-
-					e->attrib = dta_attr | (readOnly ? DOS_ATTR_READ_ONLY : 0) | (isLongFileName ? DOS_ATTR_PENDING_SHORT_NAME : 0);
-					//var_write(&e->crtTime,    dta_time); // create date/time is DOS 7.0 and up only
-					//var_write(&e->crtDate,    dta_date); // create date/time is DOS 7.0 and up only
-					var_write(&e->accessDate, dta_date);
-					var_write(&e->modTime,    dta_time);
-					var_write(&e->modDate,    dta_date);
-
-					if (dot)
-					{
-						e->attrib |= DOS_ATTR_DIRECTORY; // make sure
-						var_write(&e->loFirstClust, myFirstCluster);
-					}
-					else if (dotdot)
-					{
-						e->attrib |= DOS_ATTR_DIRECTORY; // make sure
-						var_write(&e->loFirstClust, parentFirstCluster);
-					}
-					else if (dta_attr & DOS_ATTR_VOLUME)
-					{
-						DBP_ASSERT(!dirlen && !(e->attrib & DOS_ATTR_DIRECTORY) && !dta_size); // only root can have a volume entry
+						if (sum && !dot && !dotdot && (dta_attr & DOS_ATTR_DIRECTORY)) sumOnlyDirs.emplace_back(dta_name);
+						continue;
 					}
-					else if (!(dta_attr & DOS_ATTR_DIRECTORY))
-					{
-						var_write(&e->entrysize, dta_size);
 
-						Bit32u fileIdx = (Bit32u)ffdd.files.size();
-						ffdd.files.push_back(f);
-
-						Bit32u numSects = (dta_size + bytesPerCluster - 1) / bytesPerCluster * sectorsPerCluster;
-						for (Bit32u i = 0; i != numSects; i++) ffdd.fileAtSector.push_back(fileIdx);
-					}
+					char longname[256];
+					const bool isLongFileName = (!dot && !dotdot && !(dta_attr & DOS_ATTR_VOLUME) && ffdd.drive->GetLongFileName(dir, longname));
+					ffddEntry e;
+					e.nameOfs = AddName(ffdd, dta_name);
+					e.lfnOfs  = (isLongFileName ? AddName(ffdd, longname) : NO_INDEX);
+					e.size    = dta_size;
+					e.cluster = 0;
+					e.dir     = NO_INDEX;
+					e.date    = dta_date;
+					e.time    = dta_time;
+					e.attr    = dta_attr;
+					ffdd.entries.push_back(e);
+					numDirEntries += 1 + (isLongFileName ? (Bit32u)(strlen(longname) + 12) / 13 : 0);
 				}
 				dos.dta(save_dta);
-				DBP_ASSERT(!dirlen || diridx >= firstidx + 2); // directories need at least dot and dotdot entries
 
-				// Now fill out the subdirectories (can't be done above because only one dos.dta can run simultaneously 
-				std::vector<direntry>& entries = (!useFAT16Root ? ffdd.dirs : ffdd.root);
-				for (size_t ei = firstidx; ei != diridx; ei++)
+				// Now parse the subdirectories (can't be done above because only one dos.dta can run simultaneously)
+				const Bit32u numEntries = (Bit32u)ffdd.entries.size() - firstEntry;
+				if (dirIdx != NO_INDEX)
 				{
-					direntry& e = entries[ei];
-					Bit8u* entryname = e.entryname;
-					int totlen = dirlen;
-					if (e.attrib & DOS_ATTR_DIRECTORY) // copy name before modifying SFN
-					{
-						if (entryname[0] == '.' && entryname[entryname[1] == '.' ? 2 : 1] == ' ') continue;
-						for (int i = 0; i != 8 && entryname[i] != ' '; i++) dir[totlen++] = entryname[i];
-						if (entryname[8] != ' ') dir[totlen++] = '.';
-						for (int i = 8; i != 11 && entryname[i] != ' '; i++) dir[totlen++] = entryname[i];
-					}
-					if (e.attrib & DOS_ATTR_PENDING_SHORT_NAME) // convert LFN to SFN
-					{
-						memset(entryname, ' ', sizeof(e.entryname));
-						int ni = 0, niext = 0, lossy = 0;
-						for (lfndirentry* le = (lfndirentry*)&e; le-- == (lfndirentry*)&e || !(le[1].ord & 0x40);)
-						{
-							for (int j = 0; j != 13; j++)
-							{
-								char c = *le->Name(j);
-								if (c == '\0') { lossy |= (niext && ni - niext > 3); break; }
-								if (c == '.') { if (ni > 8) { memset(entryname+8, ' ', 3); ni = 8; } if (!ni || niext) { lossy = 1; } niext = ni; continue; }
-								if (c == ' ' || ni == 11 || (ni == 8 && !niext)) { lossy = 1; continue; }
-								if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) { }
-								else if (c >= 'a' && c <= 'z') { c ^= 0x20; }
-								else if (strchr("$%'-_@~`!(){}^#&", c)) { }
-								else { lossy = 1; c = '_'; }
-								entryname[ni++] = (Bit8u)c;
-							}
-						}
-
-						if (niext && niext != 8)
-							for (int i = 2; i >= 0; i--)
-								entryname[8+i] = entryname[niext+i], entryname[niext+i] = ' ';
-						if (niext && niext <= 4 && ni - niext > 3)
-							for (int i = niext + 3; i != 8; i++)
-								entryname[i] = ' ';
-
-						if (lossy)
-						{
-							if (!niext) niext = ni;
-							for (int i = 1; i <= 999999; i++)
-							{
-								int taillen = (i<=9?2:i<=99?3:i<=999?4:i<=9999?5:i<=99999?6:7);
-								char* ptr = (char*)&entryname[niext + taillen > 8 ? 8 : niext + taillen];
-								for (int j = i; j; j /= 10) *--ptr = '0'+(j%10);
-								*--ptr = '~';
-
-								bool conflict = false;
-								for (size_t e2 = firstidx; e2 != diridx; e2++)
-									if (!(entries[e2].attrib & (DOS_ATTR_VOLUME|DOS_ATTR_PENDING_SHORT_NAME)) && !memcmp(entryname, entries[e2].entryname, sizeof(e.entryname)))
-										{ conflict = true; break; }
-								if (!conflict) break;
-							}
-						}
-
-						Bit8u chksum = 0;
-						for (int i = 0; i != 11;) chksum = (chksum >> 1) + (chksum << 7) + entryname[i++];
-						for (lfndirentry* le = (lfndirentry*)&e; le-- == (lfndirentry*)&e || !(le[1].ord & 0x40);) le->chksum = chksum;
-						e.attrib &= ~DOS_ATTR_PENDING_SHORT_NAME;
-					}
-					if (e.attrib & DOS_ATTR_DIRECTORY) // this reallocates ffdd.dirs so do this last
-					{
-						var_write(&e.loFirstClust, (Bit16u)(2 + ffdd.dirs.size() / entriesPerCluster));
-						ParseDir(ffdd, dir, filter, totlen, myFirstCluster);
-					}
+					ffddDir& d = ffdd.dirs[dirIdx];
+					d.firstEntry = firstEntry;
+					d.numEntries = numEntries;
+					d.numDirEntries = numDirEntries;
+				}
+				for (Bit32u i = firstEntry; i != firstEntry + numEntries; i++)
+				{
+					if (!(ffdd.entries[i].attr & DOS_ATTR_DIRECTORY)) continue;
+					const char* name = &ffdd.names[ffdd.entries[i].nameOfs];
+					if (name[0] == '.' && name[name[1] == '.' ? 2 : 1] == '\0') continue;
+					const int namelen = (int)strlen(name), totlen = dirlen + namelen;
+					memcpy(dir + dirlen, name, namelen + 1);
+					Bit32u subIdx = ffdd.entries[i].dir = (Bit32u)ffdd.dirs.size();
+					ffdd.dirs.emplace_back();
+					ffdd.dirs[subIdx].pathOfs = AddName(ffdd, dir);
+					ffdd.dirs[subIdx].parent = dirIdx;
+					ffdd.dirs[subIdx].firstEntry = ffdd.dirs[subIdx].numEntries = ffdd.dirs[subIdx].numDirEntries = 0;
+					if (totlen + 1 + DOS_NAMELENGTH_ASCII < (int)sizeof(finddir))
+						ParseDir(ffdd, dir, totlen, subIdx, (sum && totlen + DOS_NAMELENGTH < DOS_PATHLENGTH), usedBytes, filter);
+				}
+				for (const std::string& name : sumOnlyDirs)
+				{
+					const int totlen = dirlen + (int)name.length();
+					memcpy(dir + dirlen, name.c_str(), name.length() + 1);
+					if (totlen + DOS_NAMELENGTH < DOS_PATHLENGTH)
+						ParseDir(ffdd, dir, totlen, NO_INDEX, true, usedBytes, filter);
 				}
-			}
-
-			struct SumInfo { Bit64u used_bytes; const StringToPointerHashMap<void>* filter; };
-			static void SumFileSize(const char* path, bool is_dir, Bit32u size, Bit16u, Bit16u, Bit8u, Bitu data)
-			{
-				if (!((SumInfo*)data)->filter || !((SumInfo*)data)->filter->Get(path))
-					((SumInfo*)data)->used_bytes += (size + (32*1024-1)) / (32*1024) * (32*1024); // count as 32 kb clusters
 			}
 		};
 
-		Iter::SumInfo sum = { 0, fileFilter }; Bit16u drv_bytes_sector; Bit8u drv_sectors_cluster;  Bit16u drv_total_clusters, drv_free_clusters;
+		char dirbuf[DOS_PATHLENGTH*4];
+		Bit64u usedBytes = 0;
+		dirs.emplace_back();
+		dirs[0].pathOfs = Iter::AddName(*this, "");
+		dirs[0].parent = NO_INDEX;
+		Iter::ParseDir(*this, dirbuf, 0, 0, true, usedBytes, fileFilter);
+
+		Bit16u drv_bytes_sector; Bit8u drv_sectors_cluster;  Bit16u drv_total_clusters, drv_free_clusters;
 		drv->AllocationInfo(&drv_bytes_sector, &drv_sectors_cluster, &drv_total_clusters, &drv_free_clusters);
-		DriveFileIterator(drv, Iter::SumFileSize, (Bitu)&sum);
 
 		readOnly = (drv_free_clusters == 0 || freeSpaceMB == 0);
 
-		const Bit32u addFreeMB = (readOnly ? 0 : freeSpaceMB), totalMB = (Bit32u)(sum.used_bytes / (1024*1024)) + (addFreeMB ? (1 + addFreeMB) : 0);
+		const Bit32u addFreeMB = (readOnly ? 0 : freeSpaceMB), totalMB = (Bit32u)(usedBytes / (1024*1024)) + (addFreeMB ? (1 + addFreeMB) : 0);
 		if      (totalMB >= 3072) { fatSz = 32; sectorsPerCluster = 64; } // 32 kb clusters ( 98304 ~        FAT entries)
 		else if (totalMB >= 2048) { fatSz = 32; sectorsPerCluster = 32; } // 16 kb clusters (131072 ~ 196608 FAT entries)
 		else if (totalMB >=  384) { fatSz = 16; sectorsPerCluster = 64; } // 32 kb clusters ( 12288 ~  65504 FAT entries)
@@ -524,33 +785,44 @@ struct fatFromDOSDrive
 		Iter::SetFAT(*this, 0, (Bit32u)0xFFFFFF8);
 		Iter::SetFAT(*this, 1, (Bit32u)0xFFFFFFF);
 
-		if (fatSz != 32)
+		// Directories get their clusters in the order they were found, on FAT12/FAT16 the root directory has a fixed area outside of the clusters
+		const Bit32u bytesPerCluster = sectorsPerCluster * BYTESPERSECTOR;
+		const Bit32u entriesPerCluster = bytesPerCluster / sizeof(direntry);
+		Bit32u fileCluster = 2;
+		for (ffddDir& d : dirs)
 		{
-			// this actually should never be anything but 512 for some FAT16 drivers
-			root.resize(512);
-			memset(&root[0], 0, sizeof(direntry) * 512);
+			if (&d == &dirs[0] && fatSz != 32)
+			{
+				// this actually should never be anything but 512 for some FAT16 drivers
+				rootDirEntries = (d.numDirEntries + 511) / 512 * 512;
+				if (!rootDirEntries) rootDirEntries = 512;
+				d.firstCluster = d.numClusters = 0;
+				continue;
+			}
+			d.firstCluster = fileCluster;
+			d.numClusters = (d.numDirEntries + entriesPerCluster - 1) / entriesPerCluster;
+			if (!d.numClusters) d.numClusters = 1; // directories that weren't parsed (path too long) still need their own cluster
+			for (Bit32u i = fileCluster, iEnd = i + d.numClusters; i != iEnd; i++) Iter::SetFAT(*this, i, (i + 1 == iEnd ? (Bit32u)0x0FFFFFFF : i + 1));
+			fileCluster += d.numClusters;
 		}
+		const Bit32u dirClusters = fileCluster - 2;
 
-		char dirbuf[DOS_PATHLENGTH+4];
-		Iter::ParseDir(*this, dirbuf, fileFilter);
-
-		const Bit32u bytesPerCluster = sectorsPerCluster * BYTESPERSECTOR;
-		const Bit32u entriesPerCluster = bytesPerCluster / sizeof(direntry);
-		Bit32u fileCluster = (Bit32u)(2 + dirs.size() / entriesPerCluster);
-		for (Bit32u fileSect = 0, rootOrDir = 0; rootOrDir != 2; rootOrDir++)
+		Bit32u fileSect = 0;
+		for (Bit32u dirIdx = 0; dirIdx != (Bit32u)dirs.size(); dirIdx++)
 		{
-			for (direntry& e : (rootOrDir ? dirs : root))
+			for (Bit32u i = dirs[dirIdx].firstEntry, iEnd = i + dirs[dirIdx].numEntries; i != iEnd; i++)
 			{
-				if (!e.entrysize || (e.attrib & DOS_ATTR_LONG_NAME_MASK) == DOS_ATTR_LONG_NAME) continue;
-				var_write(&e.hiFirstClust, (Bit16u)(fileCluster >> 16));
-				var_write(&e.loFirstClust, (Bit16u)(fileCluster));
+				ffddEntry& e = entries[i];
+				if (!e.size || (e.attr & (DOS_ATTR_DIRECTORY|DOS_ATTR_VOLUME)) || IsDotName(&names[e.nameOfs])) continue;
+				e.cluster = fileCluster;
 
 				// Write FAT link chain
-				Bit32u numClusters = (var_read(&e.entrysize) + bytesPerCluster - 1) / bytesPerCluster;
+				Bit32u numClusters = (e.size + bytesPerCluster - 1) / bytesPerCluster;
 				for (Bit32u i = fileCluster, iEnd = i + numClusters - 1; i != iEnd; i++) Iter::SetFAT(*this, i, i + 1);
 				Iter::SetFAT(*this, fileCluster + numClusters - 1, (Bit32u)0xFFFFFFF);
 
-				files[fileAtSector[fileSect]].firstSect = fileSect;
+				ffddFile f = { fileSect, dirIdx, i };
+				files.push_back(f);
 
 				fileCluster += numClusters;
 				fileSect += numClusters * sectorsPerCluster;
@@ -575,9 +847,9 @@ struct fatFromDOSDrive
 		sect_fat1_start = SECT_BOOT + reservedSectors;
 		sect_fat2_start = sect_fat1_start + sectorsPerFat;
 		sect_root_start = sect_fat2_start + sectorsPerFat;
-		sect_dirs_start = sect_root_start + ((root.size() * sizeof(direntry) + BYTESPERSECTOR - 1) / BYTESPERSECTOR);
-		sect_files_start = sect_dirs_start + ((dirs.size() * sizeof(direntry) + BYTESPERSECTOR - 1) / BYTESPERSECTOR);
-		sect_files_end = sect_files_start + fileAtSector.size();
+		sect_dirs_start = sect_root_start + ((rootDirEntries * sizeof(direntry) + BYTESPERSECTOR - 1) / BYTESPERSECTOR);
+		sect_files_start = sect_dirs_start + dirClusters * sectorsPerCluster;
+		sect_files_end = sect_files_start + fileSect;
 		sect_disk_end = SECT_BOOT + partSize;
 		DBP_ASSERT(sect_disk_end >= sect_files_end);
 
@@ -586,9 +858,14 @@ struct fatFromDOSDrive
 
 		if (!serial)
 		{
+			// Same serial as when all directory entries were generated up front (the FAT, then the FAT12/FAT16 root, then all directory clusters in order)
 			serial = DriveCalculateCRC32(&fat[0], fat.size());
-			if (root.size()) serial = DriveCalculateCRC32((Bit8u*)&root[0], root.size() * sizeof(direntry), serial);
-			if (dirs.size()) serial = DriveCalculateCRC32((Bit8u*)&dirs[0], dirs.size() * sizeof(direntry), serial);
+			for (Bit32u dirIdx = 0; dirIdx != (Bit32u)dirs.size(); dirIdx++)
+			{
+				std::vector<direntry>& dir = GetDir(dirIdx);
+				if (dir.size()) serial = DriveCalculateCRC32((Bit8u*)&dir[0], dir.size() * sizeof(direntry), serial);
+				std::vector<direntry>().swap(dir); // generated again on access
+			}
 		}
 
 		memset(&mbr, 0, sizeof(mbr));
@@ -625,7 +902,7 @@ struct fatFromDOSDrive
 		if (fatSz != 32) // FAT12/FAT16
 		{
 			var_write(&mbr.pentry[0].parttype, (fatSz == 12 ? 0x01 : (sect_disk_end < 65536 ? 0x04 : 0x06))); // FAT12/16
-			var_write(&bootsec.rootdirentries, (Bit16u)root.size());
+			var_write(&bootsec.rootdirentries, (Bit16u)rootDirEntries);
 			var_write(&bootsec.sectorsperfat, (Bit16u)sectorsPerFat);
 			bootsec.bootcode[0] = 0x80; //Physical drive (harddisk) flag
 			bootsec.bootcode[2] = 0x29; //Extended boot signature
@@ -671,6 +948,182 @@ struct fatFromDOSDrive
 		chs[2] = (Bit8u)(cylinder & 0xFF);
 	}
 
+
+	static bool IsDotName(const char* name)
+	{
+		return (name[0] == '.' && name[name[1] == '.' ? 2 : 1] == '\0');
+	}
+
+	std::vector<direntry>& GetDir(Bit32u dirIdx)
+	{
+		ffddDir& d = dirs[dirIdx];
+		std::vector<direntry>& res = d.generated;
+		const bool useFAT16Root = (!dirIdx && fatSz != 32);
+		const Bit32u entriesPerCluster = sectorsPerCluster * BYTESPERSECTOR / sizeof(direntry);
+		const size_t totalEntries = (useFAT16Root ? rootDirEntries : d.numClusters * entriesPerCluster);
+		if (res.size() == totalEntries) return res;
+		res.resize(totalEntries);
+		memset(&res[0], 0, sizeof(direntry) * totalEntries);
+
+		const Bit16u myFirstCluster = (dirIdx ? (Bit16u)d.firstCluster : (Bit16u)0);
+		const Bit16u parentFirstCluster = (dirIdx && d.parent ? (Bit16u)dirs[d.parent].firstCluster : (Bit16u)0);
+		size_t diridx = 0;
+		for (Bit32u fi = d.firstEntry, fiEnd = fi + d.numEntries; fi != fiEnd; fi++)
+		{
+			const ffddEntry& fe = entries[fi];
+			const char *dta_name = &names[fe.nameOfs], *fend = dta_name + strlen(dta_name);
+			const bool dot = (dta_name[0] == '.' && dta_name[1] == '\0'), dotdot = (dta_name[0] == '.' && dta_name[1] == '.' && dta_name[2] == '\0');
+
+			const bool isLongFileName = (fe.lfnOfs != NO_INDEX);
+			if (isLongFileName)
+			{
+				const char *longname = &names[fe.lfnOfs];
+				size_t lfnlen = strlen(longname);
+				const char *lfn_end = longname + lfnlen;
+				for (size_t i = 0, lfnblocks = (lfnlen + 12) / 13; i != lfnblocks; i++)
+				{
+					lfndirentry* le = (lfndirentry*)&res[diridx++];
+					le->ord = (Bit8u)((lfnblocks - i)|(i == 0 ? 0x40 : 0x0));
+					le->attrib = DOS_ATTR_LONG_NAME;
+					le->type = 0;
+					le->loFirstClust = 0;
+					const char* plfn = longname + (lfnblocks - i - 1) * 13;
+					for (int j = 0; j != 13; j++, plfn++)
+					{
+						char* p = le->Name(j);
+						if (plfn > lfn_end) { p[0] = p[1] = (char)0xFF; }
+						else if (plfn == lfn_end) { p[0] = p[1] = 0; }
+						else { p[0] = *plfn; p[1] = 0; }
+					}
+				}
+			}
+
+			const char *fext = (dot || dotdot ? NULL : strrchr(dta_name, '.'));
+			direntry* e = &res[diridx++];
+			memset(e->entryname, ' ', sizeof(e->entryname));
+			memcpy(e->entryname, dta_name, (fext ? fext : fend) - dta_name);
+			if (fext++) memcpy(e->entryname + 8, fext, fend - fext);
+
+			e->attrib = fe.attr | (readOnly ? DOS_ATTR_READ_ONLY : 0) | (isLongFileName ? DOS_ATTR_PENDING_SHORT_NAME : 0);
+			//var_write(&e->crtTime,    fe.time); // create date/time is DOS 7.0 and up only
+			//var_write(&e->crtDate,    fe.date); // create date/time is DOS 7.0 and up only
+			var_write(&e->accessDate, fe.date);
+			var_write(&e->modTime,    fe.time);
+			var_write(&e->modDate,    fe.date);
+
+			if (dot)
+			{
+				e->attrib |= DOS_ATTR_DIRECTORY; // make sure
+				var_write(&e->loFirstClust, myFirstCluster);
+			}
+			else if (dotdot)
+			{
+				e->attrib |= DOS_ATTR_DIRECTORY; // make sure
+				var_write(&e->loFirstClust, parentFirstCluster);
+			}
+			else if (fe.attr & DOS_ATTR_VOLUME)
+			{
+				DBP_ASSERT(!dirIdx && !(e->attrib & DOS_ATTR_DIRECTORY) && !fe.size); // only root can have a volume entry
+			}
+			else if (!(fe.attr & DOS_ATTR_DIRECTORY))
+			{
+				var_write(&e->entrysize, fe.size);
+				var_write(&e->hiFirstClust, (Bit16u)(fe.cluster >> 16));
+				var_write(&e->loFirstClust, (Bit16u)(fe.cluster));
+			}
+			else
+			{
+				var_write(&e->loFirstClust, (Bit16u)dirs[fe.dir].firstCluster);
+			}
+		}
+		DBP_ASSERT(!dirIdx || diridx >= 2); // directories need at least dot and dotdot entries
+
+		// Now convert long file names to short file names (needs all entries of the directory to check for conflicts)
+		for (size_t ei = 0; ei != diridx; ei++)
+		{
+			direntry& e = res[ei];
+			Bit8u* entryname = e.entryname;
+			if (e.attrib & DOS_ATTR_PENDING_SHORT_NAME) // convert LFN to SFN
+			{
+				memset(entryname, ' ', sizeof(e.entryname));
+				int ni = 0, niext = 0, lossy = 0;
+				for (lfndirentry* le = (lfndirentry*)&e; le-- == (lfndirentry*)&e || !(le[1].ord & 0x40);)
+				{
+					for (int j = 0; j != 13; j++)
+					{
+						char c = *le->Name(j);
+						if (c == '\0') { lossy |= (niext && ni - niext > 3); break; }
+						if (c == '.') { if (ni > 8) { memset(entryname+8, ' ', 3); ni = 8; } if (!ni || niext) { lossy = 1; } niext = ni; continue; }
+						if (c == ' ' || ni == 11 || (ni == 8 && !niext)) { lossy = 1; continue; }
+						if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) { }
+						else if (c >= 'a' && c <= 'z') { c ^= 0x20; }
+						else if (strchr("$%'-_@~`!(){}^#&", c)) { }
+						else { lossy = 1; c = '_'; }
+						entryname[ni++] = (Bit8u)c;
+					}
+				}
+
+				if (niext && niext != 8)
+					for (int i = 2; i >= 0; i--)
+						entryname[8+i] = entryname[niext+i], entryname[niext+i] = ' ';
+				if (niext && niext <= 4 && ni - niext > 3)
+					for (int i = niext + 3; i != 8; i++)
+						entryname[i] = ' ';
+
+				if (lossy)
+				{
+					if (!niext) niext = ni;
+					for (int i = 1; i <= 999999; i++)
+					{
+						int taillen = (i<=9?2:i<=99?3:i<=999?4:i<=9999?5:i<=99999?6:7);
+						char* ptr = (char*)&entryname[niext + taillen > 8 ? 8 : niext + taillen];
+						for (int j = i; j; j /= 10) *--ptr = '0'+(j%10);
+						*--ptr = '~';
+
+						bool conflict = false;
+						for (size_t e2 = 0; e2 != diridx; e2++)
+							if (!(res[e2].attrib & (DOS_ATTR_VOLUME|DOS_ATTR_PENDING_SHORT_NAME)) && !memcmp(entryname, res[e2].entryname, sizeof(e.entryname)))
+								{ conflict = true; break; }
+						if (!conflict) break;
+					}
+				}
+
+				Bit8u chksum = 0;
+				for (int i = 0; i != 11;) chksum = (chksum >> 1) + (chksum << 7) + entryname[i++];
+				for (lfndirentry* le = (lfndirentry*)&e; le-- == (lfndirentry*)&e || !(le[1].ord & 0x40);) le->chksum = chksum;
+				e.attrib &= ~DOS_ATTR_PENDING_SHORT_NAME;
+			}
+		}
+		return res;
+	}
+
+	DOS_File* OpenFile(Bit32u idx)
+	{
+		Bit32u i = 0;
+		while (i != KEEPOPENCOUNT && !(openFiles[i] && openIndex[i] == idx)) i++;
+		DOS_File* df;
+		if (i != KEEPOPENCOUNT) df = openFiles[i];
+		else
+		{
+			// Close the least recently used file to make room
+			i = KEEPOPENCOUNT - 1;
+			if (openFiles[i]) { openFiles[i]->Close(); delete openFiles[i]; openFiles[i] = NULL; }
+
+			const ffddFile& f = files[idx];
+			const char *dirpath = &names[dirs[f.dir].pathOfs], *name = &names[entries[f.entry].nameOfs];
+			std::string path(dirpath);
+			if (*dirpath) path += '\\';
+			path += name;
+			if (!drive->FileOpen(&df, (char*)path.c_str(), OPEN_READ)) return NULL;
+			df->AddRef();
+		}
+		memmove(&openFiles[1], &openFiles[0], i * sizeof(openFiles[0]));
+		memmove(&openIndex[1], &openIndex[0], i * sizeof(openIndex[0]));
+		openFiles[0] = df;
+		openIndex[0] = idx;
+		return df;
+	}
+
 	Bit8u WriteSector(Bit32u sectnum, const void* data)
 	{
 		if (sectnum >= sect_disk_end) return 1;
@@ -687,7 +1140,7 @@ struct fatFromDOSDrive
 		void* unmodified = GetUnmodifiedSector(sectnum, filebuf);
 
 		if (difference.WriteDiff(sectnum, data, unmodified))
-			cacheSectorNumber[sectnum % CACHECOUNT] = (Bit32u)-1; // invalidate cache
+			cacheSectorNumber[sectnum % cacheSectorNumber.size()] = (Bit32u)-1; // invalidate cache
 
 		return 0;
 	}
@@ -697,43 +1150,30 @@ struct fatFromDOSDrive
 		if (sectnum >= sect_files_end) {}
 		else if (sectnum >= sect_files_start)
 		{
-			Bit32u idx = fileAtSector[sectnum - sect_files_start];
-			ffddFile& f = files[idx];
-			DOS_File* df = NULL;
-			for (Bit32u i = 0; i != KEEPOPENCOUNT; i++)
-				if (openIndex[i] == idx && openFiles[i])
-					{ df = openFiles[i]; break; }
-			if (!df)
-			{
-				openCursor = (openCursor + 1) % KEEPOPENCOUNT;
-				DOS_File*& cachedf = openFiles[openCursor];
-				if (cachedf)
-				{
-					cachedf->Close();
-					delete cachedf;
-					cachedf = NULL;
-				}
-				if (drive->FileOpen(&df, f.path, OPEN_READ))
-				{
-					df->AddRef();
-					cachedf = df;
-					openIndex[openCursor] = idx;
-				}
-				else return NULL;
-			}
-			if (df)
-			{
-				Bit32u pos = (sectnum - f.firstSect) * BYTESPERSECTOR;
-				Bit16u read = (Bit16u)BYTESPERSECTOR;
-				df->Seek(&pos, DOS_SEEK_SET);
-				if (!df->Read((Bit8u*)filebuf, &read)) { read = 0; DBP_ASSERT(0); }
-				if (read != BYTESPERSECTOR)
-					memset((Bit8u*)filebuf + read, 0, BYTESPERSECTOR - read);
-				return filebuf;
-			}
+			// Find the file containing the sector (last file starting at or before it)
+			size_t lo = 0, hi = files.size();
+			while (hi - lo > 1) { size_t mid = (lo + hi) / 2; if (files[mid].firstSect <= sectnum) lo = mid; else hi = mid; }
+			DOS_File* df = OpenFile((Bit32u)lo);
+			if (!df) return NULL;
+			Bit32u pos = (sectnum - files[lo].firstSect) * BYTESPERSECTOR;
+			Bit16u read = (Bit16u)BYTESPERSECTOR;
+			df->Seek(&pos, DOS_SEEK_SET);
+			if (!df->Read((Bit8u*)filebuf, &read)) { read = 0; DBP_ASSERT(0); }
+			if (read != BYTESPERSECTOR)
+				memset((Bit8u*)filebuf + read, 0, BYTESPERSECTOR - read);
+			return filebuf;
+		}
+		else if (sectnum >= sect_dirs_start)
+		{
+			// Find the directory containing the sector (last directory starting at or before its cluster)
+			const Bit32u cluster = 2 + (sectnum - sect_dirs_start) / sectorsPerCluster;
+			size_t lo = 0, hi = dirs.size();
+			while (hi - lo > 1) { size_t mid = (lo + hi) / 2; if (dirs[mid].firstCluster <= cluster) lo = mid; else hi = mid; }
+			std::vector<direntry>& dir = GetDir((Bit32u)lo);
+			const size_t idx = (sectnum - sect_dirs_start - (dirs[lo].firstCluster - 2) * sectorsPerCluster) * (BYTESPERSECTOR / sizeof(direntry));
+			return (idx < dir.size() ? &dir[idx] : NULL);
 		}
-		else if (sectnum >= sect_dirs_start) return &dirs[(sectnum - sect_dirs_start) * (BYTESPERSECTOR / sizeof(direntry))];
-		else if (sectnum >= sect_root_start) return &root[(sectnum - sect_root_start) * (BYTESPERSECTOR / sizeof(direntry))];
+		else if (sectnum >= sect_root_start) return &GetDir(0)[(sectnum - sect_root_start) * (BYTESPERSECTOR / sizeof(direntry))];
 		else if (sectnum >= sect_fat2_start) return &fat[(sectnum - sect_fat2_start) * BYTESPERSECTOR];
 		else if (sectnum >= sect_fat1_start) return &fat[(sectnum - sect_fat1_start) * BYTESPERSECTOR];
 		else if (sectnum == SECT_BOOT) return &bootsec; // boot sector 1
@@ -748,8 +1188,8 @@ struct fatFromDOSDrive
 
 	Bit8u ReadSector(Bit32u sectnum, void* data)
 	{
-		Bit32u sectorHash = sectnum % CACHECOUNT;
-		void *cachedata = cacheSectorData[sectorHash];
+		Bit32u sectorHash = (Bit32u)(sectnum % cacheSectorNumber.size());
+		void *cachedata = &cacheSectorData[sectorHash * BYTESPERSECTOR];
 		if (cacheSectorNumber[sectorHash] == sectnum)
 		{
 			memcpy(data, cachedata, BYTESPERSECTOR);
@@ -791,10 +1231,11 @@ struct sparseVhd
 
 	enum vhdDefs : Bit32u { BYTESPERSECTOR = 512, CACHECOUNT = 256 };
 	enum EAction { NONE,READ,WRITE } last_action = NONE;
-	Bit32u  footer_sector, bat_sector, total_sectors, sectors_per_block, bitmap_sectors, cache_blocknum = 0;
+	Bit32u  footer_sector, bat_sector, bat_length, total_sectors, sectors_per_block, bitmap_sectors, cache_blocknum = 0;
 	Bit32u* bat = NULL;
-	Bit8u   *seen_blocks;
+	Bit8u   *seen_blocks, *zeroed_blocks; // zeroed_blocks marks allocated blocks that had zeros written to them since the last call to Compact
 	Bit64u  current_fpos = 0;
+	diskWriteBack* writeback = NULL; // all writes go through this, created on the first one
 	Bit8u   cacheSectorData[CACHECOUNT][BYTESPERSECTOR];
 	Bit32u  cacheSectorNumber[CACHECOUNT];
 
@@ -836,9 +1277,12 @@ struct sparseVhd
 		vhd->total_sectors = (max_sectors < calc_sectors ? max_sectors : calc_sectors);
 		vhd->sectors_per_block = sectors_per_block;
 		vhd->bitmap_sectors = ((((sectors_per_block + 7) / 8) + (BYTESPERSECTOR-1)) / BYTESPERSECTOR);
-		vhd->bat = new Bit32u[bat_length + (((bat_length+7)/8) + (sizeof(Bit32u)-1)) / sizeof(Bit32u)];
+		vhd->bat_length = bat_length;
+		const Bit32u bitmap_words = (((bat_length+7)/8) + (sizeof(Bit32u)-1)) / sizeof(Bit32u);
+		vhd->bat = new Bit32u[bat_length + bitmap_words * 2];
 		vhd->seen_blocks = (Bit8u*)(vhd->bat + bat_length);
-		memset(vhd->seen_blocks, 0, ((bat_length+7)/8)); // seen no blocks
+		vhd->zeroed_blocks = (Bit8u*)(vhd->bat + bat_length + bitmap_words);
+		memset(vhd->seen_blocks, 0, bitmap_words * 2 * sizeof(Bit32u)); // seen no blocks, no zeroed blocks
 		vhd->cacheSectorNumber[0] = 1; // must not state that sector 0 is already cached
 		memset(&vhd->cacheSectorNumber[1], 0, sizeof(vhd->cacheSectorNumber) - sizeof(vhd->cacheSectorNumber[0]));
 
@@ -946,6 +1390,7 @@ struct sparseVhd
 
 	~sparseVhd()
 	{
+		if (writeback) delete writeback;
 		delete [] bat;
 	}
 
@@ -958,19 +1403,33 @@ struct sparseVhd
 		last_action = action;
 	}
 
+	bool FileRead(DOS_File* dos_file, Bit32u sectnum, void* data, Bit32u len = BYTESPERSECTOR)
+	{
+		if (writeback) { writeback->Read((Bit64u)sectnum * BYTESPERSECTOR, data, len); return true; }
+		SeekTo(dos_file, sectnum, READ);
+		Bit16u read_size = (Bit16u)len;
+		if (!dos_file->Read((Bit8u*)data, &read_size)) read_size = 0;
+		current_fpos += read_size;
+		return (read_size == len);
+	}
+
+	void FileWrite(DOS_File* dos_file, Bit64u ofs, const void* data, Bit32u len)
+	{
+		if (!writeback) writeback = new diskWriteBack(NULL, dos_file);
+		writeback->Write(ofs, data, len);
+	}
+
 	bool SeeBlock(DOS_File* dos_file, const Bit32u blocknum, Bit32u readsectnum = 0)
 	{
 		// Similar to QEMU's implementation, we enforce a bitmap with all sectors marked as used. To make sure, existing blocks not allocated by us are confirmed in this function.
 		// For writable VHDs we convert all sectors to be used. A theoretical read-only VHD with unused sectors and non-zero bytes in the actual data ends up with bad performance.
 		seen_blocks[blocknum/8] |= (1<<(blocknum%8));
-		Bit16u sector_size = (Bit16u)BYTESPERSECTOR;
 		Bit8u bitmap[BYTESPERSECTOR], test[BYTESPERSECTOR], zeros[BYTESPERSECTOR] = {0};
 		const bool read_only = !OPEN_IS_WRITING(dos_file->flags);
 		if (read_only) readsectnum = bat[blocknum] + bitmap_sectors + (readsectnum - (blocknum * sectors_per_block));
 		for (Bit32u bitmap_sector = bat[blocknum], i = 0, bits_per_sector = (BYTESPERSECTOR * 8); i < sectors_per_block; i += bits_per_sector, bitmap_sector++)
 		{
-			SeekTo(dos_file, bitmap_sector, READ);
-			if (!dos_file->Read(bitmap, &sector_size) || sector_size != BYTESPERSECTOR) { DBP_ASSERT(false); return false; } else { current_fpos += sector_size; }
+			if (!FileRead(dos_file, bitmap_sector, bitmap)) { DBP_ASSERT(false); return false; }
 			bool modified = false;
 			for (Bit8u* pBitmap = bitmap; pBitmap != &bitmap[BYTESPERSECTOR]; pBitmap++)
 			{
@@ -979,8 +1438,7 @@ struct sparseVhd
 				for (Bit8u bitmapval = *pBitmap, mask = 0x80; mask; mask >>= 1, psector++)
 				{
 					if ((bitmapval & mask) || psector >= maxsector) continue;
-					SeekTo(dos_file, psector, READ);
-					if (!dos_file->Read((Bit8u*)test, &sector_size) || sector_size != BYTESPERSECTOR) { DBP_ASSERT(false); return false; } else { current_fpos += sector_size; }
+					if (!FileRead(dos_file, psector, test)) { DBP_ASSERT(false); return false; }
 					bool has_garbage = false;
 					for (Bit64u* pTest = (Bit64u*)test, *pTestEnd = pTest + (BYTESPERSECTOR / sizeof(Bit64u)); pTest != pTestEnd; pTest++) { if (*pTest) { has_garbage = true; break; } }
 					if (read_only)
@@ -992,14 +1450,11 @@ struct sparseVhd
 					*pBitmap |= mask;
 					modified = true;
 					if (!has_garbage) continue; // already filled with zeros
-					SeekTo(dos_file, psector, WRITE);
-					if (!dos_file->Write((Bit8u*)zeros, &sector_size) || sector_size != BYTESPERSECTOR) { DBP_ASSERT(false); return false; } else { current_fpos += sector_size; }
+					FileWrite(dos_file, (Bit64u)psector * BYTESPERSECTOR, zeros, BYTESPERSECTOR);
 				}
 			}
 			if (!modified) continue;
-			SeekTo(dos_file, bitmap_sector, WRITE);
-			if (!dos_file->Write(bitmap, &sector_size) || sector_size != BYTESPERSECTOR) { DBP_ASSERT(false); return false; }
-			current_fpos += sector_size;
+			FileWrite(dos_file, (Bit64u)bitmap_sector * BYTESPERSECTOR, bitmap, BYTESPERSECTOR);
 		}
 		return true;
 	}
@@ -1018,9 +1473,7 @@ struct sparseVhd
 			}
 			else
 			{
-				SeekTo(dos_file, bat[blocknum] + bitmap_sectors + blocksec, READ);
-				Bit16u read_size = (Bit16u)BYTESPERSECTOR;
-				current_fpos += (dos_file->Read(cachedata, &read_size) ? read_size : 0);
+				FileRead(dos_file, bat[blocknum] + bitmap_sectors + blocksec, cachedata);
 			}
 		}
 		memcpy(data, cachedata, BYTESPERSECTOR);
@@ -1031,52 +1484,120 @@ struct sparseVhd
 	{
 		if (sectnum >= total_sectors) return 0x05;
 		const Bit32u blocknum = (sectnum / sectors_per_block), blocksec = (sectnum % sectors_per_block);
+		bool is_zero = true;
+		for (Bit64u* p = (Bit64u*)data, *pEnd = p + (BYTESPERSECTOR / sizeof(Bit64u)); p != pEnd; p++) { if (*p) { is_zero = false; break; } }
 		if (bat[blocknum] == (Bit32u)-1)
 		{
-			bool is_zero = true;
-			for (Bit64u* p = (Bit64u*)data, *pEnd = p + (BYTESPERSECTOR / sizeof(Bit64u)); p != pEnd; p++) { if (*p) { is_zero = false; break; } }
-			if (is_zero) return 0x00;
+			if (is_zero) return 0x00; // unallocated blocks read as zeros already
 			AllocNewBlock(dos_file, blocknum);
 		}
-		else if (!(seen_blocks[blocknum/8] & (1<<(blocknum%8)))) SeeBlock(dos_file, blocknum);
+		else
+		{
+			if (!(seen_blocks[blocknum/8] & (1<<(blocknum%8)))) SeeBlock(dos_file, blocknum);
+			if (is_zero) zeroed_blocks[blocknum/8] |= (1<<(blocknum%8)); // block might be all zeros now, checked by Compact
+		}
 
 		const Bit32u sectorHash = (sectnum % CACHECOUNT);
 		cacheSectorNumber[sectorHash] = sectnum;
 		memcpy(cacheSectorData[sectorHash], data, BYTESPERSECTOR);
 
-		SeekTo(dos_file, bat[blocknum] + bitmap_sectors + blocksec, WRITE);
-		Bit16u write_size = (Bit16u)BYTESPERSECTOR;
-		size_t ret = (dos_file->Write((Bit8u*)data, &write_size) ? write_size : 0);
-		current_fpos += ret;
-		return (ret ? 0x00 : 0x05);
+		FileWrite(dos_file, (Bit64u)(bat[blocknum] + bitmap_sectors + blocksec) * BYTESPERSECTOR, data, BYTESPERSECTOR);
+		return 0x00;
 	}
 
 	void AllocNewBlock(DOS_File* dos_file, const Bit32u blocknum)
 	{
 		VHDFooter vhd_footer;
-		SeekTo(dos_file, footer_sector, READ);
-		Bit16u footer_len = (Bit16u)sizeof(vhd_footer);
-		dos_file->Read((Bit8u*)&vhd_footer, &footer_len);
+		FileRead(dos_file, footer_sector, &vhd_footer, sizeof(vhd_footer));
 		DBP_ASSERT(!memcmp(vhd_footer.cookie, "conectix", 8) && VHD_READ_BE32(vhd_footer.disk_type) == 3 /* sparse */);
 
 		bat[blocknum] = footer_sector;
-		Bit64u batofs = ((Bit64u)bat_sector * BYTESPERSECTOR) + ((Bit64u)blocknum * sizeof(Bit32u));
-		Bit32u bat_be = VHD_READ_BE32((Bit8u*)&bat[blocknum]);
-		Bit16u bat_num_len = (Bit16u)sizeof(Bit32u);
-		dos_file->Seek64(&batofs, DOS_SEEK_SET); // forced seek
-		dos_file->Write((Bit8u*)&bat_be, &bat_num_len);
+		WriteBATEntry(dos_file, blocknum);
 
-		SeekTo(dos_file, footer_sector, WRITE); // last SeekTo was READ so seek is forced and ignores currently invalid current_fpos
+		// Write the new block (bitmap marked as fully used followed by zeroed data) and the moved footer in one go
 		seen_blocks[blocknum/8] |= (1<<(blocknum%8));
-		Bit16u sector_size = (Bit16u)BYTESPERSECTOR;
-		Bit8u zeros[BYTESPERSECTOR] = {0}, ones[BYTESPERSECTOR];
-		memset(ones, 0xFF, sizeof(ones)); // mark as fully used
-		for (Bit32u i = 0; i != (bitmap_sectors + sectors_per_block); i++)
-			if (!dos_file->Write((i < bitmap_sectors ? ones : zeros), &sector_size) || sector_size != BYTESPERSECTOR) { DBP_ASSERT(false); break; }
-
-		dos_file->Write((Bit8u*)&vhd_footer, &footer_len);
+		std::vector<Bit8u> block((bitmap_sectors + sectors_per_block) * BYTESPERSECTOR + sizeof(vhd_footer), 0);
+		memset(&block[0], 0xFF, bitmap_sectors * BYTESPERSECTOR);
+		memcpy(&block[block.size() - sizeof(vhd_footer)], &vhd_footer, sizeof(vhd_footer));
+		FileWrite(dos_file, (Bit64u)footer_sector * BYTESPERSECTOR, &block[0], (Bit32u)block.size());
 		footer_sector += bitmap_sectors + sectors_per_block;
-		last_action = NONE; // force next seek
+	}
+
+	void WriteBATEntry(DOS_File* dos_file, const Bit32u blocknum)
+	{
+		Bit32u bat_be = VHD_READ_BE32((Bit8u*)&bat[blocknum]);
+		FileWrite(dos_file, ((Bit64u)bat_sector * BYTESPERSECTOR) + ((Bit64u)blocknum * sizeof(Bit32u)), &bat_be, sizeof(bat_be));
+	}
+
+	Bit64u Compact(DOS_File* dos_file, bool all_blocks)
+	{
+		// Drop blocks that contain only zeros, checking either all blocks or only the ones that had zeros written to them
+		enum { CHUNK_SECTORS = 64 };
+		const Bit32u block_sectors = bitmap_sectors + sectors_per_block;
+		Bit8u chunk[CHUNK_SECTORS * BYTESPERSECTOR];
+		std::vector<Bit32u> holes;
+		for (Bit32u blocknum = 0; blocknum != bat_length; blocknum++)
+		{
+			if (bat[blocknum] == (Bit32u)-1 || (!all_blocks && !(zeroed_blocks[blocknum/8] & (1<<(blocknum%8))))) continue;
+			zeroed_blocks[blocknum/8] &= ~(1<<(blocknum%8));
+			if (!(seen_blocks[blocknum/8] & (1<<(blocknum%8))) && !SeeBlock(dos_file, blocknum)) continue;
+			bool is_zero = true;
+			for (Bit32u i = 0; i < sectors_per_block && is_zero; i += CHUNK_SECTORS)
+			{
+				const Bit32u n = (sectors_per_block - i < CHUNK_SECTORS ? sectors_per_block - i : CHUNK_SECTORS);
+				if (!FileRead(dos_file, bat[blocknum] + bitmap_sectors + i, chunk, n * BYTESPERSECTOR)) { is_zero = false; break; }
+				for (Bit64u* p = (Bit64u*)chunk, *pEnd = p + (n * BYTESPERSECTOR / sizeof(Bit64u)); p != pEnd; p++) { if (*p) { is_zero = false; break; } }
+			}
+			if (!is_zero) continue;
+			holes.push_back(bat[blocknum]);
+			bat[blocknum] = (Bit32u)-1;
+			WriteBATEntry(dos_file, blocknum);
+		}
+		if (holes.empty()) return 0;
+
+		// Fill the holes by moving the blocks from the end of the file into them, then move the footer and truncate the file
+		VHDFooter vhd_footer;
+		FileRead(dos_file, footer_sector, &vhd_footer, sizeof(vhd_footer));
+		DBP_ASSERT(!memcmp(vhd_footer.cookie, "conectix", 8) && VHD_READ_BE32(vhd_footer.disk_type) == 3 /* sparse */);
+		std::sort(holes.begin(), holes.end());
+		const Bit32u old_footer_sector = footer_sector;
+		while (!holes.empty())
+		{
+			const Bit32u last_start = footer_sector - block_sectors;
+			if (holes.back() == last_start) { holes.pop_back(); footer_sector = last_start; continue; }
+
+			Bit32u last_block = 0;
+			while (last_block != bat_length && bat[last_block] != last_start) last_block++;
+			if (last_block == bat_length) break; // file doesn't end with a block, leave the remaining holes unused
+
+			const Bit32u hole = holes.front();
+			holes.erase(holes.begin());
+			for (Bit32u i = 0; i < block_sectors; i += CHUNK_SECTORS)
+			{
+				const Bit32u n = (block_sectors - i < CHUNK_SECTORS ? block_sectors - i : CHUNK_SECTORS);
+				FileRead(dos_file, last_start + i, chunk, n * BYTESPERSECTOR);
+				FileWrite(dos_file, (Bit64u)(hole + i) * BYTESPERSECTOR, chunk, n * BYTESPERSECTOR);
+			}
+			bat[last_block] = hole;
+			WriteBATEntry(dos_file, last_block);
+			footer_sector = last_start;
+		}
+		if (footer_sector == old_footer_sector) return 0;
+
+		FileWrite(dos_file, (Bit64u)footer_sector * BYTESPERSECTOR, &vhd_footer, sizeof(vhd_footer));
+		delete writeback; // flush all writes before truncating the file
+		writeback = NULL;
+		Bit64u file_end = (Bit64u)(footer_sector + 1) * BYTESPERSECTOR;
+		Bit16u truncate_size = 0;
+		dos_file->Seek64(&file_end, DOS_SEEK_SET);
+		last_action = NONE;
+		if (!dos_file->Write(NULL, &truncate_size))
+		{
+			// The old footer remains valid at the end of the file, the moved blocks at the end are just unused now
+			footer_sector = old_footer_sector;
+			return 0;
+		}
+		return (Bit64u)(old_footer_sector - footer_sector) * BYTESPERSECTOR;
 	}
 };
 #endif // C_DBP_SUPPORT_DISK_FAT_EMULATOR
@@ -1224,20 +1745,24 @@ Bit8u imageDisk::Read_AbsoluteSector(Bit32u sectnum, void * data) {
 	if (ffdd) return ffdd->ReadSector(sectnum, data);
 	#endif
 
-	if (discard && discard->Read_AbsoluteSector(sectnum, data, sector_size))
-		return 0x00;
-
-	if (differencing && differencing->GetDiff(sectnum, data))
+	if (cache)
+	{
+		const Bit8u* cached = cache->Get(sectnum, sector_size);
+		if (!cached)
+		{
+			// Read the missing block and when reading sequentially also the ones following it
+			const Bit32u blocknum = sectnum / diskBlockCache::BLOCKSECTORS;
+			for (Bit32u b = blocknum, bEnd = b + cache->ReadAhead(blocknum); b != bEnd; b++)
+			{
+				if (b != blocknum && cache->Get(b * diskBlockCache::BLOCKSECTORS, sector_size)) break;
+				Read_Uncached(b * diskBlockCache::BLOCKSECTORS, diskBlockCache::BLOCKSECTORS, cache->Insert(b));
+			}
+			cached = cache->Get(sectnum, sector_size);
+		}
+		memcpy(data, cached, sector_size);
 		return 0x00;
-
-	if (vhd)
-		return vhd->ReadSector(dos_file, sectnum, data);
-
-	Bit64u bytenum = (Bit64u)sectnum * sector_size;
-	if (last_action==WRITE || bytenum!=current_fpos) dos_file->Seek64(&bytenum, DOS_SEEK_SET);
-	DBP_ASSERT(sector_size <= 0xFFFF);
-	Bit16u read_size = (Bit16u)sector_size;
-	size_t ret=dos_file->Read((Bit8u*)data, &read_size)?read_size:0;
+	}
+	return Read_Uncached(sectnum, 1, data);
 	#else
 	Bit32u bytenum;
 
@@ -1245,12 +1770,60 @@ Bit8u imageDisk::Read_AbsoluteSector(Bit32u sectnum, void * data) {
 
 	if (last_action==WRITE || bytenum!=current_fpos) fseek_wrap(diskimg,bytenum,SEEK_SET);
 	size_t ret=fread(data, 1, sector_size, diskimg);
-	#endif
 	current_fpos=bytenum+ret;
 	last_action=READ;
 
 	return 0x00;
+	#endif
+}
+
+#ifdef C_DBP_SUPPORT_DISK_MOUNT_DOSFILE
+Bit8u imageDisk::Read_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data) {
+	#ifdef C_DBP_SUPPORT_DISK_FAT_EMULATOR
+	if (ffdd) { for (Bit8u* p = (Bit8u*)data; count--; p += sector_size) ffdd->ReadSector(sectnum++, p); return 0x00; }
+	#endif
+	if (!cache) return Read_Uncached(sectnum, count, data);
+	for (Bit8u* p = (Bit8u*)data; count--; p += sector_size) Read_AbsoluteSector(sectnum++, p);
+	return 0x00;
+}
+
+Bit8u imageDisk::Read_Uncached(Bit32u sectnum, Bit32u count, void * data) {
+	if (vhd)
+	{
+		Bit32u vhdsect = sectnum;
+		for (Bit8u* p = (Bit8u*)data, *pEnd = p + count * sector_size; p != pEnd; p += sector_size)
+			vhd->ReadSector(dos_file, vhdsect++, p);
+	}
+	else
+	{
+		// Read the whole range from the image file in one go, then apply the sectors that are modified in memory
+		Bit64u bytenum = (Bit64u)sectnum * sector_size;
+		if (last_action==WRITE || bytenum!=current_fpos) dos_file->Seek64(&bytenum, DOS_SEEK_SET);
+		DBP_ASSERT(sector_size <= 0xFFFF);
+		size_t ret = 0;
+		for (Bit32u remain = count * sector_size; remain;)
+		{
+			Bit16u read_size = (Bit16u)(remain > 0xFFFF - 0xFFFF % sector_size ? 0xFFFF - 0xFFFF % sector_size : remain);
+			if (!dos_file->Read((Bit8u*)data + ret, &read_size) || !read_size) break;
+			ret += read_size;
+			remain -= read_size;
+		}
+		if (ret != count * sector_size) memset((Bit8u*)data + ret, 0, count * sector_size - ret);
+		current_fpos=bytenum+ret;
+		last_action=READ;
+	}
+
+	if (discard || differencing)
+	{
+		for (Bit8u* p = (Bit8u*)data, *pEnd = p + count * sector_size; p != pEnd; p += sector_size, sectnum++)
+		{
+			if (discard && discard->Read_AbsoluteSector(sectnum, p, sector_size)) continue;
+			if (differencing) differencing->GetDiff(sectnum, p);
+		}
+	}
+	return 0x00;
 }
+#endif
 
 Bit8u imageDisk::Write_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data) {
 	Bit32u sectnum;
@@ -1266,6 +1839,9 @@ Bit8u imageDisk::Write_AbsoluteSector(Bit32u sectnum, void *data) {
 	#endif
 
 	#ifdef C_DBP_SUPPORT_DISK_MOUNT_DOSFILE
+	if (cache)
+		cache->Update(sectnum, data, sector_size);
+
 	if (discard)
 	{
 		discard->Write_AbsoluteSector(sectnum, data, sector_size);
@@ -1335,6 +1911,15 @@ void imageDisk::SetDifferencingDisk(const char* savePath)
 	if (differencing) delete differencing;
 	differencing = new differencingDisk();
 	differencing->SetupSave(savePath, heads*cylinders*sectors);
+	if (cache) cache->Clear(); // might have been filled from unmodified image
+}
+
+bool imageDisk::CompactVHD(Bit64u* freed_bytes)
+{
+	if (!vhd || !dos_file || !OPEN_IS_WRITING(dos_file->flags) || differencing || discard) return false;
+	Bit64u freed = vhd->Compact(dos_file, true);
+	if (freed_bytes) *freed_bytes = freed;
+	return true;
 }
 
 bool imageDisk::ExportToFile(const char* path, bool vhd_format)
@@ -1366,6 +1951,8 @@ imageDisk::~imageDisk()
 		if (!fat_drive || fat_drive->loadedDisk != this) continue;
 		fat_drive->loadedDisk = NULL;
 	}
+	if (vhd && dos_file && OPEN_IS_WRITING(dos_file->flags)) vhd->Compact(dos_file, false); // drop blocks that were zeroed in this session
+	if (vhd) { delete vhd; vhd = NULL; } // flushes pending writes to dos_file
 	if (dos_file)
 	{
 		if (dos_file->IsOpen()) dos_file->Close();
@@ -1382,6 +1969,7 @@ imageDisk::~imageDisk()
 	if (discard) delete discard;
 	if (differencing) delete differencing;
 	if (vhd) delete vhd;
+	if (cache) delete cache;
 #ifdef C_DBP_SUPPORT_DISK_FAT_EMULATOR
 	if (ffdd) delete ffdd;
 #endif
@@ -1406,6 +1994,8 @@ imageDisk::imageDisk(FILE *imgFile, const char *imgName, Bit32u imgSizeK, bool i
 	if (vhd) isHardDisk = true;
 	if (!OPEN_IS_WRITING(dos_file->flags))
 		discard = new discardDisk();
+	if (dbp_diskcache_mb)
+		cache = new diskBlockCache(sector_size, dbp_diskcache_mb);
 	#else
 	diskimg = imgFile;
 	fseek(diskimg,0,SEEK_SET);
@@ -1505,6 +2095,9 @@ void imageDisk::Set_Geometry(Bit32u setHeads, Bit32u setCyl, Bit32u setSect, Bit
 	heads = setHeads;
 	cylinders = setCyl;
 	sectors = setSect;
+	#ifdef C_DBP_SUPPORT_DISK_MOUNT_DOSFILE
+	if (cache && sector_size != setSectSize) { delete cache; cache = new diskBlockCache(setSectSize, dbp_diskcache_mb); }
+	#endif
 	sector_size = setSectSize;
 	active = true;
 }
@@ -1545,6 +2138,55 @@ static Bit8u GetDosDriveNumber(Bit8u biosNum) {
 	}
 }
 
+Bit8u dbp_iotiming = DBP_IOTIMING_DEFAULT; // disk timing mode, set by the frontend
+DBP_IOStats dbp_iostats[DBP_IOSTATS_COUNT];
+
+double DBP_IOTiming_Access(Bitu slot, DBP_IODevice device, Bit64u pos, Bitu bytes, bool write)
+{
+	// Counts a transfer and returns how long it would take on a period typical drive in milliseconds
+	// An access that doesn't continue where the previous one on the same drive ended pays the average seek and rotational latency
+	static const struct { double access_ms, bytes_per_ms; } devs[] =
+	{
+		{ 100.0,   46.08 }, // floppy disk drive: 45 KB/s
+		{  16.0, 3145.73 }, // IDE hard disk: 3 MB/s
+		{ 150.0,  307.20 }, // 2x CD-ROM drive: 300 KB/s
+	};
+	DBP_ASSERT(slot < DBP_IOSTATS_COUNT && device <= DBP_IODEV_CDROM);
+	DBP_IOStats& s = dbp_iostats[slot];
+	if (write) { s.write_ops++; s.write_bytes += bytes; } else { s.read_ops++; s.read_bytes += bytes; }
+	double ms = (pos != s.next_pos ? devs[device].access_ms : 0.0) + bytes / devs[device].bytes_per_ms;
+	s.next_pos = pos + bytes;
+	return ms;
+}
+
+void DBP_IOTiming_Wait(double ms)
+{
+	// Lets the guest run interrupts until the modelled transfer time has passed, like the BIOS wait functions do
+	extern bool DBP_IsShuttingDown();
+	for (double end = PIC_FullIndex() + ms; PIC_FullIndex() < end && !DBP_IsShuttingDown();) CALLBACK_Idle();
+}
+
+void DBP_IOTiming_GetPerfStats(char* buf, size_t bufsize)
+{
+	// Lists the read/write operations and bytes of each drive that has been accessed
+	char *p = buf, *pEnd = buf + bufsize;
+	*p = '\0';
+	for (Bitu i = 0; i != DBP_IOSTATS_COUNT && p < pEnd; i++)
+	{
+		const DBP_IOStats& s = dbp_iostats[i];
+		if (!s.read_ops && !s.write_ops) continue;
+		char name[4] = { (char)('A' + i), ':', '\0' };
+		if (i >= DBP_IOSTATS_BIOS) { Bitu n = i - DBP_IOSTATS_BIOS; name[0] = (n < 2 ? 'F' : 'H'); name[1] = 'D'; name[2] = (char)('0' + (n < 2 ? n : n - 2)); }
+		p += snprintf(p, pEnd - p, "%s%s R%u/%uKB W%u/%uKB", (p == buf ? "" : ", "), name, (unsigned)s.read_ops, (unsigned)(s.read_bytes >> 10), (unsigned)s.write_ops, (unsigned)(s.write_bytes >> 10));
+	}
+}
+
+static void INT13_IOTiming(Bit8u drivenum, Bit32u sectnum, Bitu count, bool write) {
+	imageDisk* disk = imageDiskList[drivenum];
+	double ms = DBP_IOTiming_Access(DBP_IOSTATS_BIOS + drivenum, (disk->hardDrive ? DBP_IODEV_HARDDISK : DBP_IODEV_FLOPPY), (Bit64u)sectnum * 512, count * 512, write);
+	if (dbp_iotiming == DBP_IOTIMING_ACCURATE) DBP_IOTiming_Wait(ms);
+}
+
 static bool driveInactive(Bit8u driveNum) {
 	if(driveNum>=MAX_DISK_IMAGES) {
 		LOG(LOG_BIOS,LOG_ERROR)("Disk %d non-existant", driveNum);
@@ -1697,6 +2339,7 @@ static Bitu INT13_DiskHandler(void) {
 				bufptr++;
 			}
 		}
+		INT13_IOTiming(drivenum, ((Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2)) * imageDiskList[drivenum]->heads + reg_dh) * imageDiskList[drivenum]->sectors + (reg_cl & 63) - 1, reg_al, false);
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
 		break;
@@ -1728,6 +2371,7 @@ static Bitu INT13_DiskHandler(void) {
 				return CBRET_NONE;
 			}
         }
+		INT13_IOTiming(drivenum, ((Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2)) * imageDiskList[drivenum]->heads + reg_dh) * imageDiskList[drivenum]->sectors + (reg_cl & 63) - 1, reg_al, true);
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
         break;
@@ -1918,6 +2562,7 @@ static Bitu INT13_DiskHandler(void) {
 				bufptr++;
 			}
 		}
+		INT13_IOTiming(drivenum, dap.sector, dap.num, false);
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
 		break;
@@ -1949,6 +2594,7 @@ static Bitu INT13_DiskHandler(void) {
 				return CBRET_NONE;
 			}
 		}
+		INT13_IOTiming(drivenum, dap.sector, dap.num, true);
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
 		break;
@@ -2069,3 +2715,9 @@ void DBP_SetMountSwappingRequested()
 {
 	swapping_requested = true;
 }
+
+#ifdef C_DBP_SUPPORT_DISK_MOUNT_DOSFILE
+#include <dbp_serialize.h>
+DBP_SERIALIZE_SET_POINTER_LIST(PIC_EventHandler, diskWriteBack, diskWriteBack::PICHandler);
+void DBPSerialize_PIC_RearmDiskWriteBack() { diskWriteBack::RearmAll(); }
+#endif
@@ -0,0 +1,235 @@
+/*
+ *  Copyright (C) 2020-2024 Bernhard Schelling
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+// Offline packer for DOSZ content packs with seekable block compressed files
+// Small files are stored as regular deflate ZIP entries, large files are split into
+// independently compressed frames with a frame offset table (see Zip_FramedUnpacker in drive_zip.cpp)
+// Build with 'make pack', usage: dosbox_pure_pack <input directory> <output.dosz> [log2 frame size]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../src/dos/drive_zip_sdefl.h"
+
+enum { METHOD_STORED = 0, METHOD_DEFLATED = 8, METHOD_FRAMES = 0xDB, FRAME_METHOD_DEFLATE = 8 };
+enum { DEFAULT_FRAME_SHIFT = 16, MIN_FRAME_SHIFT = 12, MAX_FRAME_SHIFT = 24, FRAMED_MIN_SIZE = 1024 * 1024 };
+
+struct Entry { std::string name; unsigned method, crc, comp_size, decomp_size, ofs, dostime; bool dir; };
+
+static void Put16(std::vector<unsigned char>& v, unsigned n) { v.push_back((unsigned char)n); v.push_back((unsigned char)(n >> 8)); }
+static void Put32(std::vector<unsigned char>& v, unsigned n) { Put16(v, n & 0xFFFF); Put16(v, n >> 16); }
+static void Set32(unsigned char* p, unsigned n) { p[0] = (unsigned char)n; p[1] = (unsigned char)(n >> 8); p[2] = (unsigned char)(n >> 16); p[3] = (unsigned char)(n >> 24); }
+
+static bool Fail(const char* msg, const char* arg) { fprintf(stderr, "Error: %s%s%s\n", msg, (arg ? " " : ""), (arg ? arg : "")); return false; }
+
+static unsigned DosTime(time_t t)
+{
+	struct tm* tm = localtime(&t);
+	if (!tm || tm->tm_year < 80) return (1 << 21) | (1 << 16); // 1980-01-01
+	return ((unsigned)(tm->tm_year - 80) << 25) | ((unsigned)(tm->tm_mon + 1) << 21) | ((unsigned)tm->tm_mday << 16) | ((unsigned)tm->tm_hour << 11) | ((unsigned)tm->tm_min << 5) | ((unsigned)tm->tm_sec >> 1);
+}
+
+static unsigned CRC32(const unsigned char* p, size_t len)
+{
+	static unsigned table[256];
+	if (!table[1]) for (unsigned i = 0; i != 256; i++) { unsigned c = i; for (int k = 0; k != 8; k++) c = (c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1); table[i] = c; }
+	unsigned crc = 0xFFFFFFFF;
+	for (const unsigned char* e = p + len; p != e; p++) crc = table[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+// Raw deflate with the same compressor the core uses, returns false if the result is not smaller than the input
+static bool Deflate(const unsigned char* in, size_t in_len, std::vector<unsigned char>& out)
+{
+	static sdefl defl;
+	static std::vector<unsigned char> padded;
+	if (!in_len || in_len > 0x7FFFFFF) return false;
+	padded.assign(in, in + in_len); // the compressor hashes 4 bytes at every position and can read past the end
+	padded.resize(in_len + 4, 0);
+	out.resize(in_len + in_len / 8 + 16); // static huffman codes are at most 9 bits per byte
+	out.resize(defl.Run(&out[0], &padded[0], (int)in_len));
+	return (out.size() < in_len);
+}
+
+static void Pack(const std::vector<unsigned char>& data, unsigned frame_shift, Entry& e, std::vector<unsigned char>& out)
+{
+	e.decomp_size = (unsigned)data.size();
+	e.crc = (data.empty() ? 0 : CRC32(&data[0], data.size()));
+	out.clear();
+	if (data.size() >= FRAMED_MIN_SIZE)
+	{
+		size_t frame_size = ((size_t)1 << frame_shift), count = (data.size() + frame_size - 1) / frame_size;
+		out.push_back(FRAME_METHOD_DEFLATE);
+		out.push_back((unsigned char)frame_shift);
+		Put16(out, 0);
+		Put32(out, (unsigned)count);
+		out.resize(out.size() + (count + 1) * 4);
+		std::vector<unsigned char> comp;
+		for (size_t i = 0; i != count; i++)
+		{
+			Set32(&out[8 + i * 4], (unsigned)out.size());
+			const unsigned char* frame = &data[i * frame_size];
+			size_t len = std::min(frame_size, data.size() - i * frame_size);
+			if (Deflate(frame, len, comp)) out.insert(out.end(), comp.begin(), comp.end());
+			else out.insert(out.end(), frame, frame + len); // incompressible frame is stored as is
+		}
+		Set32(&out[8 + count * 4], (unsigned)out.size());
+		e.method = METHOD_FRAMES;
+	}
+	else if (!data.empty() && Deflate(&data[0], data.size(), out))
+		e.method = METHOD_DEFLATED;
+	else
+	{
+		out = data;
+		e.method = METHOD_STORED;
+	}
+	e.comp_size = (unsigned)out.size();
+}
+
+static bool ReadFile(const std::string& path, std::vector<unsigned char>& data)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f) return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data.resize(size < 0 ? 0 : (size_t)size);
+	bool ok = (size >= 0 && (data.empty() || fread(&data[0], 1, data.size(), f) == data.size()));
+	fclose(f);
+	return ok;
+}
+
+static bool Collect(const std::string& base, const std::string& sub, std::vector<Entry>& entries)
+{
+	DIR* d = opendir((base + sub).c_str());
+	if (!d) return Fail("Unable to open directory", (base + sub).c_str());
+	std::vector<std::string> names;
+	for (struct dirent* de; (de = readdir(d)) != NULL;)
+		if (strcmp(de->d_name, ".") && strcmp(de->d_name, "..")) names.push_back(de->d_name);
+	closedir(d);
+	std::sort(names.begin(), names.end());
+	for (size_t i = 0; i != names.size(); i++)
+	{
+		std::string name = sub + names[i];
+		struct stat st;
+		if (stat((base + name).c_str(), &st)) return Fail("Unable to stat", (base + name).c_str());
+		Entry e = { name, METHOD_STORED, 0, 0, 0, 0, DosTime(st.st_mtime), S_ISDIR(st.st_mode) };
+		if (e.dir) e.name += '/';
+		else if ((unsigned long long)st.st_size > 0xFFFFFFFFull) return Fail("File too large", (base + name).c_str());
+		entries.push_back(e);
+		if (e.dir && !Collect(base, e.name, entries)) return false;
+	}
+	return true;
+}
+
+static bool Run(const char* in_dir, const char* out_path, unsigned frame_shift)
+{
+	std::string base = in_dir;
+	if (!base.empty() && base[base.size() - 1] != '/') base += '/';
+	std::vector<Entry> entries;
+	if (!Collect(base, std::string(), entries)) return false;
+	if (entries.size() > 0xFFFF) return Fail("Too many files", NULL);
+
+	FILE* f = fopen(out_path, "wb");
+	if (!f) return Fail("Unable to create", out_path);
+	unsigned long long ofs = 0, framed = 0;
+	std::vector<unsigned char> data, comp, hdr;
+	for (size_t i = 0; i != entries.size(); i++)
+	{
+		Entry& e = entries[i];
+		if (e.dir) { data.clear(); comp.clear(); e.method = METHOD_STORED; }
+		else if (!ReadFile(base + e.name, data)) { fclose(f); return Fail("Unable to read", (base + e.name).c_str()); }
+		else Pack(data, frame_shift, e, comp);
+		if (e.method == METHOD_FRAMES) framed++;
+
+		hdr.clear();
+		Put32(hdr, 0x04034b50);
+		Put16(hdr, 20); // version needed
+		Put16(hdr, 0); // flags
+		Put16(hdr, e.method);
+		Put32(hdr, e.dostime);
+		Put32(hdr, e.crc);
+		Put32(hdr, e.comp_size);
+		Put32(hdr, e.decomp_size);
+		Put16(hdr, (unsigned)e.name.size());
+		Put16(hdr, 0); // extra length
+		hdr.insert(hdr.end(), e.name.begin(), e.name.end());
+		e.ofs = (unsigned)ofs;
+		if ((ofs += hdr.size() + comp.size()) > 0xFFFFFFFFull) { fclose(f); return Fail("Output exceeds 4GB", NULL); }
+		fwrite(&hdr[0], 1, hdr.size(), f);
+		if (!comp.empty()) fwrite(&comp[0], 1, comp.size(), f);
+		if (!e.dir) printf("%s %s (%u -> %u)\n", (e.method == METHOD_FRAMES ? "framed " : e.method == METHOD_DEFLATED ? "deflate" : "stored "), e.name.c_str(), e.decomp_size, e.comp_size);
+	}
+
+	unsigned long long cd_ofs = ofs;
+	hdr.clear();
+	for (size_t i = 0; i != entries.size(); i++)
+	{
+		const Entry& e = entries[i];
+		Put32(hdr, 0x02014b50);
+		Put16(hdr, 20); // version made by
+		Put16(hdr, 20); // version needed
+		Put16(hdr, 0); // flags
+		Put16(hdr, e.method);
+		Put32(hdr, e.dostime);
+		Put32(hdr, e.crc);
+		Put32(hdr, e.comp_size);
+		Put32(hdr, e.decomp_size);
+		Put16(hdr, (unsigned)e.name.size());
+		Put16(hdr, 0); // extra length
+		Put16(hdr, 0); // comment length
+		Put16(hdr, 0); // disk number
+		Put16(hdr, 0); // internal attributes
+		Put32(hdr, (e.dir ? 0x10 : 0)); // external attributes
+		Put32(hdr, e.ofs);
+		hdr.insert(hdr.end(), e.name.begin(), e.name.end());
+	}
+	if (cd_ofs + hdr.size() > 0xFFFFFFFFull) { fclose(f); return Fail("Output exceeds 4GB", NULL); }
+	unsigned cd_size = (unsigned)hdr.size();
+	Put32(hdr, 0x06054b50);
+	Put16(hdr, 0); // disk number
+	Put16(hdr, 0); // disk with central directory
+	Put16(hdr, (unsigned)entries.size());
+	Put16(hdr, (unsigned)entries.size());
+	Put32(hdr, cd_size);
+	Put32(hdr, (unsigned)cd_ofs);
+	Put16(hdr, 0); // comment length
+	bool ok = (fwrite(&hdr[0], 1, hdr.size(), f) == hdr.size());
+	ok = (fclose(f) == 0 && ok);
+	if (!ok) return Fail("Unable to write", out_path);
+	printf("Wrote %s with %u entries (%u framed)\n", out_path, (unsigned)entries.size(), (unsigned)framed);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3 || argc > 4)
+	{
+		fprintf(stderr, "Usage: %s <input directory> <output.dosz> [log2 frame size (%d to %d, default %d)]\n", argv[0], MIN_FRAME_SHIFT, MAX_FRAME_SHIFT, DEFAULT_FRAME_SHIFT);
+		return 1;
+	}
+	unsigned frame_shift = (argc > 3 ? (unsigned)atoi(argv[3]) : (unsigned)DEFAULT_FRAME_SHIFT);
+	if (frame_shift < MIN_FRAME_SHIFT || frame_shift > MAX_FRAME_SHIFT) { Fail("Invalid frame size", argv[3]); return 1; }
+	return (Run(argv[1], argv[2], frame_shift) ? 0 : 1);
+}